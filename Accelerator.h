@@ -0,0 +1,62 @@
+// Common interface of the acceleration structures over one mesh's triangles
+// Each structure works in model space over three vertices per triangle, so a RaytraceTexturedObject can switch
+// between them at runtime and the same scene can be benchmarked with each
+#pragma once
+
+// Standard libraries
+#include <vector>
+
+// RT Specific
+#include "Geometry.h"
+#include "RayPacket.h"
+
+// Constants
+// Structures a mesh can be traced with
+const unsigned int ACCELERATOR_BVH = 0;
+const unsigned int ACCELERATOR_UNIFORM_GRID = 1;
+const unsigned int ACCELERATOR_TWO_LEVEL_GRID = 2;
+
+class Accelerator
+{
+public:
+	virtual ~Accelerator() {};
+
+	// Build over three vertices per triangle, replacing any earlier build
+	virtual void build(const std::vector<Cartesian3>& triangleVertices) = 0;
+	virtual bool isEmpty() const = 0;
+	// Free the built structure, keeping its settings
+	virtual void clear() = 0;
+
+	// Nearest triangle hit with tMin < t < tMax, writing t, the barycentrics and the triangle's index
+	virtual bool intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const = 0;
+	// Whether any triangle is hit with tMin < t < tMax, stopping at the first found
+	virtual bool intersectAny(const Ray& ray, float tMin, float tMax) const = 0;
+	// Nearest hits for the active rays of a prepared packet, shortening their tMax and writing their hits.
+	// Structures without a packet traversal trace the rays one at a time
+	virtual void intersectPacket(RayPacket& packet) const
+	{
+		for (unsigned int lane = 0; lane < packet.size; lane++)
+		{
+			RayHit hit;
+			if (packet.isActive(lane) && intersect(packet.getRay(lane), packet.tMin, packet.tMax[lane], hit))
+			{
+				packet.tMax[lane] = hit.t;
+				packet.hits[lane] = hit;
+			}
+		}
+	};
+
+	// Triangle behind each entry the structure's leaves or cells reference, in storage order. Triangles may repeat
+	virtual const std::vector<unsigned int>& getTriangleReferences() const = 0;
+	// Renumber the triangles after their owner reorders them, newIndices holds the new index of each old one
+	virtual void remapTriangles(const std::vector<unsigned int>& newIndices) = 0;
+
+	// Bounds of all triangles
+	virtual AABB getBounds() const = 0;
+	// For reports
+	virtual const char* getName() const = 0;
+
+	// Copy of the built structure, allocated and filled by the calling thread, so on a NUMA machine its pages are on
+	// that thread's node. The caller owns it
+	virtual Accelerator* clone() const = 0;
+};
@@ -0,0 +1,374 @@
+// Bounding volume hierarchy
+#include "BVH.h"
+
+// Standard libraries
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+// RT Specific
+#include "TreeLayout.h"
+
+// Plain float box used while binning, so the inner loops never construct a Cartesian3
+struct BinBounds
+{
+	float minBounds[3];
+	float maxBounds[3];
+
+	BinBounds()
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minBounds[axis] = std::numeric_limits<float>::infinity();
+			maxBounds[axis] = -std::numeric_limits<float>::infinity();
+		}
+	}
+	void grow(const float* otherMin, const float* otherMax)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minBounds[axis] = std::min(minBounds[axis], otherMin[axis]);
+			maxBounds[axis] = std::max(maxBounds[axis], otherMax[axis]);
+		}
+	}
+	void grow(const BinBounds& other) { grow(other.minBounds, other.maxBounds); }
+	float surfaceArea() const
+	{
+		float dx = maxBounds[0] - minBounds[0], dy = maxBounds[1] - minBounds[1], dz = maxBounds[2] - minBounds[2];
+		if (dx < 0.0f) return 0.0f;
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	}
+};
+
+// stream output for build statistics
+std::ostream& operator << (std::ostream& outStream, const BVHBuildStats& value)
+{
+	const char* builderName = "BVH";
+	if (value.builder == BVH_BUILDER_LBVH)
+	{
+		builderName = value.treeletsOptimised ? "LBVH with treelets" : "LBVH";
+	}
+	else if (value.builder == BVH_BUILDER_SBVH)
+	{
+		builderName = "SBVH";
+	}
+	outStream << builderName << " built in " << value.buildTimeMs << "ms: " << value.nodeCount << " nodes, " << value.leafCount << " leaves, " << value.referenceCount << " references, max depth " << value.maxDepth << ", SAH cost " << value.sahCost;
+	return outStream;
+}
+
+BVH::BVH(unsigned int newMaxLeafSize) : maxLeafSize(newMaxLeafSize), builder(BVH_BUILDER_SAH), optimiseTreelets(false), buildThreads(0), spatialSplitBudget(BVH_DEFAULT_SPLIT_BUDGET), layout(BVH_LAYOUT_VAN_EMDE_BOAS), stats()
+{
+}
+
+void BVH::build(const std::vector<AABB>& bounds, const std::vector<Cartesian3>* triangleVertices)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	// Scratch copies of bounds and centroids, indexed by primitive
+	primitiveBounds.resize(6 * bounds.size());
+	primitiveCentroids.resize(3 * bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			primitiveBounds[6 * i + axis] = bounds[i].minBounds[axis];
+			primitiveBounds[6 * i + 3 + axis] = bounds[i].maxBounds[axis];
+			primitiveCentroids[3 * i + axis] = 0.5f * (bounds[i].minBounds[axis] + bounds[i].maxBounds[axis]);
+		}
+	}
+	primitiveIndices.resize(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		primitiveIndices[i] = (unsigned int)i;
+	}
+
+	nodes.clear();
+	stats = BVHBuildStats();
+	stats.builder = builder;
+	if (!bounds.empty())
+	{
+		if (builder == BVH_BUILDER_LBVH)
+		{
+			buildLinear();
+			stats.treeletsOptimised = optimiseTreelets;
+		}
+		else if (builder == BVH_BUILDER_SBVH && triangleVertices != nullptr && triangleVertices->size() == 3 * bounds.size())
+		{
+			buildSpatial(*triangleVertices);
+		}
+		else
+		{
+			// Also used when the SBVH wasn't given triangles
+			stats.builder = BVH_BUILDER_SAH;
+			buildSAH();
+		}
+		applyLayout();
+	}
+
+	// Release scratch memory
+	std::vector<float>().swap(primitiveBounds);
+	std::vector<float>().swap(primitiveCentroids);
+
+	stats.nodeCount = (unsigned int)nodes.size();
+	stats.referenceCount = primitiveIndices.size();
+	stats.sahCost = computeSAHCost();
+	stats.buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Top down binned SAH build
+void BVH::buildSAH()
+{
+	// A binary tree with n leaves never has more than 2n - 1 nodes
+	nodes.reserve(2 * primitiveIndices.size() - 1);
+
+	// Root holds everything
+	BVHNode root;
+	root.leftFirst = 0;
+	root.primitiveCount = (unsigned int)primitiveIndices.size();
+	nodes.push_back(root);
+	updateNodeBounds(0);
+
+	// Split iteratively, badly behaved meshes can produce very deep trees
+	std::vector<std::pair<unsigned int, unsigned int>> stack;
+	stack.push_back(std::make_pair(0u, 0u));
+	while (!stack.empty())
+	{
+		unsigned int nodeIndex = stack.back().first;
+		unsigned int depth = stack.back().second;
+		stack.pop_back();
+
+		if (subdivide(nodeIndex, depth))
+		{
+			unsigned int leftChild = nodes[nodeIndex].leftFirst;
+			stack.push_back(std::make_pair(leftChild, depth + 1));
+			stack.push_back(std::make_pair(leftChild + 1, depth + 1));
+		}
+		else
+		{
+			stats.leafCount++;
+			stats.maxDepth = std::max(stats.maxDepth, depth);
+		}
+	}
+}
+
+// Reorder nodes into van Emde Boas order, keeping siblings together, and lay the leaves' references out in the new node order
+void BVH::applyLayout()
+{
+	if (layout != BVH_LAYOUT_VAN_EMDE_BOAS || nodes.size() <= 1)
+	{
+		return;
+	}
+
+	// Units are the root on its own and each pair of siblings, named by their first node
+	std::vector<unsigned int> order = computeVanEmdeBoasOrder(0, [&](unsigned int unit, unsigned int* childrenOut)
+	{
+		unsigned int childCount = 0;
+		unsigned int unitSize = unit == 0 ? 1 : 2;
+		for (unsigned int i = 0; i < unitSize; i++)
+		{
+			if (!nodes[unit + i].isLeaf())
+			{
+				childrenOut[childCount++] = nodes[unit + i].leftFirst;
+			}
+		}
+		return childCount;
+	});
+
+	// New position of each unit's first node
+	std::vector<unsigned int> newIndices(nodes.size());
+	unsigned int nodeCount = 0;
+	for (auto unit : order)
+	{
+		newIndices[unit] = nodeCount;
+		nodeCount += unit == 0 ? 1 : 2;
+	}
+
+	std::vector<BVHNode> newNodes(nodeCount);
+	std::vector<unsigned int> newPrimitiveIndices;
+	newPrimitiveIndices.reserve(primitiveIndices.size());
+	for (auto unit : order)
+	{
+		unsigned int unitSize = unit == 0 ? 1 : 2;
+		for (unsigned int i = 0; i < unitSize; i++)
+		{
+			BVHNode node = nodes[unit + i];
+			if (node.isLeaf())
+			{
+				unsigned int first = (unsigned int)newPrimitiveIndices.size();
+				newPrimitiveIndices.insert(newPrimitiveIndices.end(), primitiveIndices.begin() + node.leftFirst, primitiveIndices.begin() + node.leftFirst + node.primitiveCount);
+				node.leftFirst = first;
+			}
+			else
+			{
+				node.leftFirst = newIndices[node.leftFirst];
+			}
+			newNodes[newIndices[unit] + i] = node;
+		}
+	}
+	nodes.swap(newNodes);
+	primitiveIndices.swap(newPrimitiveIndices);
+}
+
+// Fit a node's box to the primitives it references
+void BVH::updateNodeBounds(unsigned int nodeIndex)
+{
+	BVHNode& node = nodes[nodeIndex];
+	BinBounds box;
+	for (unsigned int i = 0; i < node.primitiveCount; i++)
+	{
+		const float* bounds = &primitiveBounds[6 * primitiveIndices[node.leftFirst + i]];
+		box.grow(bounds, bounds + 3);
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		node.minBounds[axis] = box.minBounds[axis];
+		node.maxBounds[axis] = box.maxBounds[axis];
+	}
+}
+
+bool BVH::subdivide(unsigned int nodeIndex, unsigned int depth)
+{
+	unsigned int first = nodes[nodeIndex].leftFirst;
+	unsigned int count = nodes[nodeIndex].primitiveCount;
+	if (count <= 1 || depth >= BVH_MAX_DEPTH - 1)
+	{
+		return false;
+	}
+
+	// Bin over centroid bounds rather than node bounds, so bins are never empty at the edges
+	BinBounds centroidBounds;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		const float* centroid = &primitiveCentroids[3 * primitiveIndices[first + i]];
+		centroidBounds.grow(centroid, centroid);
+	}
+	const float* centroidMin = centroidBounds.minBounds;
+	const float* centroidMax = centroidBounds.maxBounds;
+	BinBounds nodeBounds;
+	nodeBounds.grow(nodes[nodeIndex].minBounds, nodes[nodeIndex].maxBounds);
+
+	// Costs are left unnormalised by the node's area, which cancels out in the comparison
+	float leafCost = BVH_INTERSECTION_COST * count * nodeBounds.surfaceArea();
+	float bestCost = std::numeric_limits<float>::infinity();
+	int bestAxis = -1;
+	unsigned int bestBin = 0;
+
+	// Small nodes don't need as many candidate planes as they have few primitives to separate
+	unsigned int binCount = std::min(BVH_SAH_BINS, std::max(4u, count));
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float axisMin = centroidMin[axis];
+		float axisExtent = centroidMax[axis] - axisMin;
+		if (axisExtent <= 0.0f) continue;
+		float binScale = binCount / axisExtent;
+
+		// Fill bins
+		BinBounds binBounds[BVH_SAH_BINS];
+		unsigned int binCounts[BVH_SAH_BINS] = {};
+		for (unsigned int i = 0; i < count; i++)
+		{
+			unsigned int primitive = primitiveIndices[first + i];
+			unsigned int bin = std::min(binCount - 1, (unsigned int)((primitiveCentroids[3 * primitive + axis] - axisMin) * binScale));
+			binCounts[bin]++;
+			binBounds[bin].grow(&primitiveBounds[6 * primitive], &primitiveBounds[6 * primitive + 3]);
+		}
+
+		// Sweep from both sides to get the area and count left and right of each plane
+		float leftArea[BVH_SAH_BINS - 1], rightArea[BVH_SAH_BINS - 1];
+		unsigned int leftCount[BVH_SAH_BINS - 1], rightCount[BVH_SAH_BINS - 1];
+		BinBounds leftBox, rightBox;
+		unsigned int leftSum = 0, rightSum = 0;
+		for (unsigned int plane = 0; plane < binCount - 1; plane++)
+		{
+			leftSum += binCounts[plane];
+			leftBox.grow(binBounds[plane]);
+			leftCount[plane] = leftSum;
+			leftArea[plane] = leftBox.surfaceArea();
+
+			rightSum += binCounts[binCount - 1 - plane];
+			rightBox.grow(binBounds[binCount - 1 - plane]);
+			rightCount[binCount - 2 - plane] = rightSum;
+			rightArea[binCount - 2 - plane] = rightBox.surfaceArea();
+		}
+
+		// Evaluate each plane
+		for (unsigned int plane = 0; plane < binCount - 1; plane++)
+		{
+			if (leftCount[plane] == 0 || rightCount[plane] == 0) continue;
+			float cost = BVH_TRAVERSAL_COST * nodeBounds.surfaceArea() + BVH_INTERSECTION_COST * (leftCount[plane] * leftArea[plane] + rightCount[plane] * rightArea[plane]);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = plane;
+			}
+		}
+	}
+
+	// Splitting doesn't pay off, keep as a leaf if it is small enough
+	if (bestCost >= leafCost && count <= maxLeafSize)
+	{
+		return false;
+	}
+
+	unsigned int leftCount = 0;
+	if (bestAxis >= 0)
+	{
+		// Partition references about the chosen plane
+		float axisMin = centroidMin[bestAxis];
+		float binScale = binCount / (centroidMax[bestAxis] - axisMin);
+		unsigned int* begin = &primitiveIndices[first];
+		unsigned int* middle = std::partition(begin, begin + count, [&](unsigned int primitive)
+		{
+			unsigned int bin = std::min(binCount - 1, (unsigned int)((primitiveCentroids[3 * primitive + bestAxis] - axisMin) * binScale));
+			return bin <= bestBin;
+		});
+		leftCount = (unsigned int)(middle - begin);
+	}
+	if (leftCount == 0 || leftCount == count)
+	{
+		// All centroids coincide but there are too many for one leaf, so split the range in half
+		leftCount = count / 2;
+	}
+
+	// Create children next to each other
+	unsigned int leftChild = (unsigned int)nodes.size();
+	BVHNode child;
+	child.leftFirst = first;
+	child.primitiveCount = leftCount;
+	nodes.push_back(child);
+	child.leftFirst = first + leftCount;
+	child.primitiveCount = count - leftCount;
+	nodes.push_back(child);
+	updateNodeBounds(leftChild);
+	updateNodeBounds(leftChild + 1);
+
+	// and make this an interior node
+	nodes[nodeIndex].leftFirst = leftChild;
+	nodes[nodeIndex].primitiveCount = 0;
+	return true;
+}
+
+float BVH::computeSAHCost() const
+{
+	if (nodes.empty()) return 0.0f;
+
+	float cost = 0.0f;
+	for (auto& node : nodes)
+	{
+		BinBounds box;
+		box.grow(node.minBounds, node.maxBounds);
+		if (node.isLeaf())
+		{
+			cost += BVH_INTERSECTION_COST * node.primitiveCount * box.surfaceArea();
+		}
+		else
+		{
+			cost += BVH_TRAVERSAL_COST * box.surfaceArea();
+		}
+	}
+	BinBounds rootBox;
+	rootBox.grow(nodes[0].minBounds, nodes[0].maxBounds);
+	float rootArea = rootBox.surfaceArea();
+	return rootArea > 0.0f ? cost / rootArea : cost;
+}
@@ -0,0 +1,405 @@
+// Bounding volume hierarchy
+// Built with binned surface area heuristic splits over a set of primitive bounds,
+// the owner is responsible for intersecting the primitives referenced by each leaf
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <utility>
+
+// RT Specific
+#include "Geometry.h"
+#include "RayStats.h"
+#include "RayPacket.h"
+
+// Constants
+// Number of candidate split planes per axis
+const unsigned int BVH_SAH_BINS = 16;
+// Default upper limit on primitives in a leaf, SAH may create smaller leaves
+const unsigned int BVH_DEFAULT_MAX_LEAF_SIZE = 4;
+// Nodes at this depth are always leaves, so traversal can use a fixed size stack
+const unsigned int BVH_MAX_DEPTH = 64;
+// Relative costs used by the SAH
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_INTERSECTION_COST = 1.0f;
+// Builders
+// Binned SAH, slower to build but gives the best trees
+const unsigned int BVH_BUILDER_SAH = 0;
+// Linear BVH from Morton ordered centroids, built in parallel for very large meshes
+const unsigned int BVH_BUILDER_LBVH = 1;
+// Binned SAH that may also split triangles at planes, duplicating their references, for meshes with long thin triangles
+const unsigned int BVH_BUILDER_SBVH = 2;
+// Leaves per treelet restructured by the optional LBVH optimisation pass
+const unsigned int BVH_TREELET_SIZE = 7;
+// The LBVH switches from 30 to 63 bit Morton codes above this many primitives, as the coarser grid gives too many duplicates
+const size_t BVH_WIDE_MORTON_THRESHOLD = 1 << 20;
+// Candidate planes per axis for SBVH spatial splits
+const unsigned int BVH_SPATIAL_BINS = 32;
+// Spatial splits are only tried when the object split's children overlap by more than this fraction of the root area
+const float BVH_SPATIAL_OVERLAP = 1e-5f;
+// Default extra references the SBVH may create, as a fraction of the primitive count
+const float BVH_DEFAULT_SPLIT_BUDGET = 0.3f;
+// Node layouts
+// Order the builder created them in, roughly depth first
+const unsigned int BVH_LAYOUT_DEPTH_FIRST = 0;
+// Van Emde Boas order of sibling pairs after the build, with leaf references following the new node order
+const unsigned int BVH_LAYOUT_VAN_EMDE_BOAS = 1;
+
+// Flattened node, 32 bytes. Siblings are stored next to each other,
+// so interior nodes only need the index of the left child
+struct BVHNode
+{
+	float minBounds[3];
+	// Left child for interior nodes, first entry of primitiveIndices for leaves
+	unsigned int leftFirst;
+	float maxBounds[3];
+	// Zero for interior nodes
+	unsigned int primitiveCount;
+
+	bool isLeaf() const { return primitiveCount > 0; };
+};
+
+// Statistics recorded by the last build, for tuning
+struct BVHBuildStats
+{
+	double buildTimeMs;
+	unsigned int nodeCount;
+	unsigned int leafCount;
+	unsigned int maxDepth;
+	float sahCost;
+	unsigned int builder;
+	bool treeletsOptimised;
+	// Entries in primitiveIndices, more than the primitives when the SBVH duplicates references
+	size_t referenceCount;
+};
+
+// stream output for build statistics
+std::ostream& operator << (std::ostream& outStream, const BVHBuildStats& value);
+
+class BVH
+{
+private:
+	// Scratch data used during build, as flat float arrays read per axis while binning
+	// Six floats (min then max) per primitive for bounds, three for centroids
+	std::vector<float> primitiveBounds;
+	std::vector<float> primitiveCentroids;
+
+	// Binned SAH split of a node, returns false if it was made a leaf
+	bool subdivide(unsigned int nodeIndex, unsigned int depth);
+	void updateNodeBounds(unsigned int nodeIndex);
+
+	// Builders, run on the scratch data above
+	void buildSAH();
+	// Implemented in BVHLinear.cpp
+	void buildLinear();
+	// Implemented in BVHSpatial.cpp, needs the triangle behind each primitive
+	void buildSpatial(const std::vector<Cartesian3>& triangleVertices);
+
+	// Reorder the finished tree's nodes and references for the chosen layout
+	void applyLayout();
+public:
+	// Nodes, root is at index 0
+	std::vector<BVHNode> nodes;
+	// Leaves reference ranges of this array, which holds indices of the input primitives
+	std::vector<unsigned int> primitiveIndices;
+
+	// Build settings and results
+	unsigned int maxLeafSize;
+	unsigned int builder;
+	// Restructure small treelets of the LBVH to recover SAH quality
+	bool optimiseTreelets;
+	// Worker threads for the LBVH, 0 uses one per hardware thread
+	unsigned int buildThreads;
+	// Extra references the SBVH may create, as a fraction of the primitive count
+	float spatialSplitBudget;
+	// One of the BVH_LAYOUT constants
+	unsigned int layout;
+	BVHBuildStats stats;
+
+	// Constructor
+	BVH(unsigned int newMaxLeafSize = BVH_DEFAULT_MAX_LEAF_SIZE);
+
+	// Build over the bounds of each primitive. The SBVH also needs the three vertices of each primitive's triangle,
+	// and falls back to binned SAH without them
+	void build(const std::vector<AABB>& bounds, const std::vector<Cartesian3>* triangleVertices = nullptr);
+
+	// Expected cost of a random ray relative to the root, using the SAH costs above
+	float computeSAHCost() const;
+
+	bool isEmpty() const { return nodes.empty(); };
+
+	// Nearest hit traversal, visiting the nearer child first and skipping nodes beyond the closest hit so far.
+	// intersectLeaf(first, count, tMax) tests the primitives at primitiveIndices[first] onwards, and on a closer hit shrinks
+	// tMax and returns true. Passing references rather than primitives lets callers keep per primitive data in leaf order,
+	// and whole leaves let them test several primitives at once
+	template <typename LeafIntersector>
+	bool intersectNearest(const Ray& ray, float tMin, float tMax, LeafIntersector intersectLeaf) const;
+
+	// Occlusion traversal, stopping at the first hit between tMin and tMax rather than the nearest.
+	// The interval never shrinks, so deferred nodes are never culled and the stack holds no distances.
+	// occludesLeaf(first, count) returns true when any primitive of the leaf is hit within the interval
+	template <typename LeafOccluder>
+	bool intersectAny(const Ray& ray, float tMin, float tMax, LeafOccluder occludesLeaf) const;
+
+	// Nearest hit traversal of a prepared, coherent packet. Each node is tested against the first ray still
+	// active in it, then if that misses against the packet's bounds, and only then ray by ray, so a coherent
+	// packet mostly pays for one box test per node. Rays before the first to hit a node are dropped for its subtree.
+	// Children are visited in the order of the first active ray. Node visits count once per packet.
+	// intersectLeaf(first, count, mask) intersects the rays in mask, shortening their tMax and writing their hits
+	template <typename PacketLeafIntersector>
+	void intersectPacket(RayPacket& packet, PacketLeafIntersector intersectLeaf) const;
+};
+
+// Slab test of a ray against a node's box. Returns the entry distance, or infinity on a miss
+inline float intersectNodeBounds(const BVHNode& node, const Cartesian3& origin, const Cartesian3& inverseDirection, float tMin, float tMax)
+{
+	float tx1 = (node.minBounds[0] - origin.x) * inverseDirection.x;
+	float tx2 = (node.maxBounds[0] - origin.x) * inverseDirection.x;
+	// A NaN from 0 * infinity (origin on a slab plane) only makes the test conservative
+	float tNear = std::min(tx1, tx2);
+	float tFar = std::max(tx1, tx2);
+	float ty1 = (node.minBounds[1] - origin.y) * inverseDirection.y;
+	float ty2 = (node.maxBounds[1] - origin.y) * inverseDirection.y;
+	tNear = std::max(tNear, std::min(ty1, ty2));
+	tFar = std::min(tFar, std::max(ty1, ty2));
+	float tz1 = (node.minBounds[2] - origin.z) * inverseDirection.z;
+	float tz2 = (node.maxBounds[2] - origin.z) * inverseDirection.z;
+	tNear = std::max(tNear, std::min(tz1, tz2));
+	tFar = std::min(tFar, std::max(tz1, tz2));
+	tNear = std::max(tNear, tMin);
+	tFar = std::min(tFar, tMax);
+	if (tNear > tFar) return std::numeric_limits<float>::infinity();
+	return tNear;
+}
+
+template <typename LeafIntersector>
+bool BVH::intersectNearest(const Ray& ray, float tMin, float tMax, LeafIntersector intersectLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	Cartesian3 origin = ray.getOrigin();
+	Cartesian3 direction = ray.getDirection();
+	Cartesian3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	if (intersectNodeBounds(nodes[0], origin, inverseDirection, tMin, tMax) == std::numeric_limits<float>::infinity())
+	{
+		return false;
+	}
+
+	// Stack of nodes still to visit, with their entry distances
+	unsigned int stackNodes[BVH_MAX_DEPTH];
+	float stackDistances[BVH_MAX_DEPTH];
+	int stackSize = 0;
+
+	RayStats& threadStats = rayStats;
+	bool intersection = false;
+	unsigned int nodeIndex = 0;
+	while (true)
+	{
+		const BVHNode& node = nodes[nodeIndex];
+		threadStats.nodeVisits++;
+		if (node.isLeaf())
+		{
+			threadStats.primitiveTests += node.primitiveCount;
+			if (intersectLeaf(node.leftFirst, node.primitiveCount, tMax))
+			{
+				intersection = true;
+			}
+		}
+		else
+		{
+			// Visit the nearer child next and defer the other
+			unsigned int nearChild = node.leftFirst;
+			unsigned int farChild = node.leftFirst + 1;
+			float nearDistance = intersectNodeBounds(nodes[nearChild], origin, inverseDirection, tMin, tMax);
+			float farDistance = intersectNodeBounds(nodes[farChild], origin, inverseDirection, tMin, tMax);
+			if (farDistance < nearDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+			if (nearDistance != std::numeric_limits<float>::infinity())
+			{
+				if (farDistance != std::numeric_limits<float>::infinity())
+				{
+					stackNodes[stackSize] = farChild;
+					stackDistances[stackSize] = farDistance;
+					stackSize++;
+				}
+				nodeIndex = nearChild;
+				continue;
+			}
+		}
+
+		// Pop the next node that could still hold a closer hit
+		do
+		{
+			if (stackSize == 0)
+			{
+				return intersection;
+			}
+			stackSize--;
+		} while (stackDistances[stackSize] >= tMax);
+		nodeIndex = stackNodes[stackSize];
+	}
+}
+
+template <typename LeafOccluder>
+bool BVH::intersectAny(const Ray& ray, float tMin, float tMax, LeafOccluder occludesLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+
+	Cartesian3 origin = ray.getOrigin();
+	Cartesian3 direction = ray.getDirection();
+	Cartesian3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	if (intersectNodeBounds(nodes[0], origin, inverseDirection, tMin, tMax) == std::numeric_limits<float>::infinity())
+	{
+		return false;
+	}
+
+	// Nodes still to visit
+	unsigned int stackNodes[BVH_MAX_DEPTH];
+	int stackSize = 0;
+
+	RayStats& threadStats = rayStats;
+	unsigned int nodeIndex = 0;
+	while (true)
+	{
+		const BVHNode& node = nodes[nodeIndex];
+		threadStats.nodeVisits++;
+		if (node.isLeaf())
+		{
+			threadStats.primitiveTests += node.primitiveCount;
+			if (occludesLeaf(node.leftFirst, node.primitiveCount))
+			{
+				return true;
+			}
+		}
+		else
+		{
+			unsigned int firstChild = node.leftFirst;
+			unsigned int secondChild = node.leftFirst + 1;
+			float firstDistance = intersectNodeBounds(nodes[firstChild], origin, inverseDirection, tMin, tMax);
+			float secondDistance = intersectNodeBounds(nodes[secondChild], origin, inverseDirection, tMin, tMax);
+			bool firstHit = firstDistance != std::numeric_limits<float>::infinity();
+			bool secondHit = secondDistance != std::numeric_limits<float>::infinity();
+			if (firstHit && secondHit)
+			{
+				// Nearer first still finds an occluder sooner on average, and the distances come for free
+				if (secondDistance < firstDistance)
+				{
+					std::swap(firstChild, secondChild);
+				}
+				stackNodes[stackSize++] = secondChild;
+				nodeIndex = firstChild;
+				continue;
+			}
+			if (firstHit || secondHit)
+			{
+				nodeIndex = firstHit ? firstChild : secondChild;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			return false;
+		}
+		nodeIndex = stackNodes[--stackSize];
+	}
+}
+
+template <typename PacketLeafIntersector>
+void BVH::intersectPacket(RayPacket& packet, PacketLeafIntersector intersectLeaf) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+	PacketBoxKernel boxKernel = getPacketBoxKernel();
+	unsigned int groupCount = (packet.size + RAY_PACKET_LANES - 1) / RAY_PACKET_LANES;
+	const unsigned int allLanes = (1u << RAY_PACKET_LANES) - 1;
+
+	// Nodes still to visit, with the first ray that was active when they were deferred
+	unsigned int stackNodes[BVH_MAX_DEPTH];
+	unsigned int stackFirstRays[BVH_MAX_DEPTH];
+	int stackSize = 0;
+
+	RayStats& threadStats = rayStats;
+	unsigned int nodeIndex = 0;
+	unsigned int firstRay = 0;
+	while (true)
+	{
+		const BVHNode& node = nodes[nodeIndex];
+		threadStats.nodeVisits++;
+
+		// Find the first ray from firstRay on that hits the node. Its group is tested first, as it usually hits
+		unsigned int group = firstRay / RAY_PACKET_LANES;
+		unsigned int groupMask = boxKernel(node.minBounds, node.maxBounds, packet, group * RAY_PACKET_LANES) & (allLanes << (firstRay % RAY_PACKET_LANES));
+		if (groupMask == 0 && !packetMissesBox(node.minBounds, node.maxBounds, packet))
+		{
+			while (groupMask == 0 && ++group < groupCount)
+			{
+				groupMask = boxKernel(node.minBounds, node.maxBounds, packet, group * RAY_PACKET_LANES);
+			}
+		}
+
+		if (groupMask != 0)
+		{
+			unsigned int lane = 0;
+			while (!(groupMask & (1u << lane)))
+			{
+				lane++;
+			}
+			firstRay = group * RAY_PACKET_LANES + lane;
+
+			if (node.isLeaf())
+			{
+				// Every later ray that hits the leaf's box
+				RayPacketMask mask = (RayPacketMask)groupMask << (group * RAY_PACKET_LANES);
+				for (unsigned int laterGroup = group + 1; laterGroup < groupCount; laterGroup++)
+				{
+					mask |= (RayPacketMask)boxKernel(node.minBounds, node.maxBounds, packet, laterGroup * RAY_PACKET_LANES) << (laterGroup * RAY_PACKET_LANES);
+				}
+				threadStats.primitiveTests += node.primitiveCount * countPacketRays(mask);
+				intersectLeaf(node.leftFirst, node.primitiveCount, mask);
+			}
+			else
+			{
+				// Nearer child for the first active ray next, the packet shares its direction signs
+				Cartesian3 origin(packet.origin[0][firstRay], packet.origin[1][firstRay], packet.origin[2][firstRay]);
+				Cartesian3 inverseDirection(packet.inverseDirection[0][firstRay], packet.inverseDirection[1][firstRay], packet.inverseDirection[2][firstRay]);
+				unsigned int nearChild = node.leftFirst;
+				unsigned int farChild = node.leftFirst + 1;
+				float nearDistance = intersectNodeBounds(nodes[nearChild], origin, inverseDirection, packet.tMin, packet.tMax[firstRay]);
+				float farDistance = intersectNodeBounds(nodes[farChild], origin, inverseDirection, packet.tMin, packet.tMax[firstRay]);
+				if (farDistance < nearDistance)
+				{
+					std::swap(nearChild, farChild);
+				}
+				stackNodes[stackSize] = farChild;
+				stackFirstRays[stackSize] = firstRay;
+				stackSize++;
+				nodeIndex = nearChild;
+				continue;
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			return;
+		}
+		stackSize--;
+		nodeIndex = stackNodes[stackSize];
+		firstRay = stackFirstRays[stackSize];
+	}
+}
@@ -0,0 +1,313 @@
+// Bounding volume hierarchy accelerator
+#include "BVHAccelerator.h"
+
+// Standard libraries
+#include <chrono>
+#include <iostream>
+
+// RT Specific
+#include "CpuFeatures.h"
+
+BVHAccelerator::BVHAccelerator() : width(BVH_WIDTH_AUTO), quantiseBits(BVH_QUANTISE_OFF), triangleKernelWidth(TRIANGLE_KERNEL_AUTO)
+{
+}
+
+// Hash of the triangles' vertex positions and the build settings. Normals and texture coordinates don't affect the BVH
+uint64_t BVHAccelerator::computeCacheKey(const std::vector<Cartesian3>& triangleVertices) const
+{
+	uint64_t key = 0xcbf29ce484222325ull;
+	if (!triangleVertices.empty())
+	{
+		key = hashBytes(key, &triangleVertices[0], triangleVertices.size() * sizeof(Cartesian3));
+	}
+	return hashBVHSettings(key, bvh);
+}
+
+void BVHAccelerator::build(const std::vector<Cartesian3>& triangleVertices)
+{
+	size_t triangleCount = triangleVertices.size() / 3;
+
+	// Try the cache first
+	uint64_t cacheKey = 0;
+	bool loaded = false;
+	if (!cachePath.empty())
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		cacheKey = computeCacheKey(triangleVertices);
+		loaded = loadBVHCache(cachePath, cacheKey, triangleCount, bvh);
+		if (loaded)
+		{
+			double loadTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			std::cout << "Loaded BVH from " << cachePath << " in " << loadTimeMs << "ms, originally " << bvh.stats << std::endl;
+		}
+	}
+
+	if (!loaded)
+	{
+		// Bounds of each triangle in model space
+		std::vector<AABB> triangleBounds(triangleCount);
+		for (size_t i = 0; i < triangleCount; i++)
+		{
+			triangleBounds[i].grow(triangleVertices[3 * i]);
+			triangleBounds[i].grow(triangleVertices[3 * i + 1]);
+			triangleBounds[i].grow(triangleVertices[3 * i + 2]);
+		}
+		// Spatial splits clip the triangles themselves
+		bvh.build(triangleBounds, bvh.builder == BVH_BUILDER_SBVH ? &triangleVertices : nullptr);
+		std::cout << bvh.stats << std::endl;
+
+		// Missing or stale, so replace it
+		if (!cachePath.empty() && !bvh.isEmpty() && !saveBVHCache(cachePath, cacheKey, bvh))
+		{
+			std::cout << "Could not write BVH cache " << cachePath << std::endl;
+		}
+	}
+
+	// Widest the CPU has a SIMD box test for
+	if (width == BVH_WIDTH_AUTO)
+	{
+		const CpuFeatures& features = getCpuFeatures();
+		width = features.avx ? BVH_WIDTH_8 : (features.sse2 ? BVH_WIDTH_4 : BVH_WIDTH_BINARY);
+	}
+	if (width == BVH_WIDTH_8)
+	{
+		bvh8.collapse(bvh);
+		std::cout << "Collapsed to BVH8 with " << bvh8.nodes.size() << " nodes, " << bvh8.kernelName << " box tests" << std::endl;
+		quantise(bvh8, bvh8Quantised8, bvh8Quantised16, triangleCount);
+	}
+	else if (width == BVH_WIDTH_4)
+	{
+		bvh4.collapse(bvh);
+		std::cout << "Collapsed to BVH4 with " << bvh4.nodes.size() << " nodes, " << bvh4.kernelName << " box tests" << std::endl;
+		quantise(bvh4, bvh4Quantised8, bvh4Quantised16, triangleCount);
+	}
+	else if (quantiseBits != BVH_QUANTISE_OFF)
+	{
+		std::cout << "Only BVH4 and BVH8 nodes can be quantised, keeping float nodes" << std::endl;
+	}
+
+	// Intersection data in the traversed hierarchy's leaf order, duplicated where the SBVH references a triangle more than once
+	triangleStore.build(triangleVertices, getTraversedReferences(), triangleKernelWidth);
+	std::cout << "Triangles laid out for " << triangleStore.kernelName << " leaf tests" << std::endl;
+}
+
+void BVHAccelerator::clear()
+{
+	// The binary BVH's build settings stay
+	bvh.nodes = std::vector<BVHNode>();
+	bvh.primitiveIndices = std::vector<unsigned int>();
+	bvh4 = WideBVH<4>();
+	bvh8 = WideBVH<8>();
+	bvh4Quantised8 = QuantisedBVH<4, unsigned char>();
+	bvh4Quantised16 = QuantisedBVH<4, unsigned short>();
+	bvh8Quantised8 = QuantisedBVH<8, unsigned char>();
+	bvh8Quantised16 = QuantisedBVH<8, unsigned short>();
+	triangleStore = TriangleStore();
+}
+
+template <unsigned int Width>
+void BVHAccelerator::quantise(WideBVH<Width>& wide, QuantisedBVH<Width, unsigned char>& quantised8, QuantisedBVH<Width, unsigned short>& quantised16, size_t triangleCount)
+{
+	if (!isQuantised())
+	{
+		return;
+	}
+	size_t floatBytes = wide.nodes.size() * sizeof(WideBVHNode<Width>) + wide.primitiveIndices.size() * sizeof(unsigned int);
+	size_t quantisedBytes = 0;
+	const char* kernelName = "";
+	bool built;
+	if (quantiseBits == BVH_QUANTISE_8)
+	{
+		built = quantised8.build(wide);
+		quantisedBytes = quantised8.memoryUsed();
+		kernelName = quantised8.kernelName;
+	}
+	else
+	{
+		built = quantised16.build(wide);
+		quantisedBytes = quantised16.memoryUsed();
+		kernelName = quantised16.kernelName;
+	}
+	if (!built)
+	{
+		std::cout << "Leaves too large to quantise, keeping float nodes" << std::endl;
+		quantiseBits = BVH_QUANTISE_OFF;
+		return;
+	}
+	// Only the quantised nodes are traversed from now on
+	wide = WideBVH<Width>();
+
+	double perTriangle = triangleCount > 0 ? 1.0 / (double)triangleCount : 0.0;
+	std::cout << "Quantised to " << quantiseBits << " bit bounds: " << (double)quantisedBytes * perTriangle << " bytes per triangle for nodes and references, against "
+		<< (double)floatBytes * perTriangle << " with float bounds, " << kernelName << " box tests" << std::endl;
+}
+
+bool BVHAccelerator::isQuantised() const
+{
+	return (width == BVH_WIDTH_4 || width == BVH_WIDTH_8) && (quantiseBits == BVH_QUANTISE_8 || quantiseBits == BVH_QUANTISE_16);
+}
+
+template <typename Visitor>
+bool BVHAccelerator::visitHierarchy(Visitor visit) const
+{
+	if (width == BVH_WIDTH_8)
+	{
+		if (quantiseBits == BVH_QUANTISE_8)
+		{
+			return visit(bvh8Quantised8);
+		}
+		if (quantiseBits == BVH_QUANTISE_16)
+		{
+			return visit(bvh8Quantised16);
+		}
+		return visit(bvh8);
+	}
+	if (width == BVH_WIDTH_4)
+	{
+		if (quantiseBits == BVH_QUANTISE_8)
+		{
+			return visit(bvh4Quantised8);
+		}
+		if (quantiseBits == BVH_QUANTISE_16)
+		{
+			return visit(bvh4Quantised16);
+		}
+		return visit(bvh4);
+	}
+	return visit(bvh);
+}
+
+const std::vector<unsigned int>& BVHAccelerator::getTraversedReferences() const
+{
+	// The float hierarchies all share the binary BVH's order
+	if (width == BVH_WIDTH_8 && quantiseBits == BVH_QUANTISE_8)
+	{
+		return bvh8Quantised8.primitiveIndices;
+	}
+	if (width == BVH_WIDTH_8 && quantiseBits == BVH_QUANTISE_16)
+	{
+		return bvh8Quantised16.primitiveIndices;
+	}
+	if (width == BVH_WIDTH_4 && quantiseBits == BVH_QUANTISE_8)
+	{
+		return bvh4Quantised8.primitiveIndices;
+	}
+	if (width == BVH_WIDTH_4 && quantiseBits == BVH_QUANTISE_16)
+	{
+		return bvh4Quantised16.primitiveIndices;
+	}
+	return bvh.primitiveIndices;
+}
+
+// Nearest hit against the triangles of each leaf the BVH visits
+bool BVHAccelerator::intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const
+{
+	Cartesian3 rayOrigin = ray.getOrigin();
+	Cartesian3 rayDirection = ray.getDirection();
+	float origin[3] = { rayOrigin.x, rayOrigin.y, rayOrigin.z };
+	float direction[3] = { rayDirection.x, rayDirection.y, rayDirection.z };
+
+	// References index the triangle store directly, only the nearest hit looks up its triangle
+	unsigned int nearestReference = 0;
+	auto intersectLeaf = [&](unsigned int first, unsigned int count, float& tClosest)
+	{
+		if (triangleStore.intersectNearest(first, count, origin, direction, tMin, tClosest, hitOut.u, hitOut.v, nearestReference))
+		{
+			hitOut.t = tClosest;
+			return true;
+		}
+		return false;
+	};
+
+	// Same leaf test whichever hierarchy was built, each maps the nearest reference back through its own primitive order
+	return visitHierarchy([&](const auto& hierarchy)
+	{
+		if (!hierarchy.intersectNearest(ray, tMin, tMax, intersectLeaf))
+		{
+			return false;
+		}
+		hitOut.triangle = hierarchy.primitiveIndices[nearestReference];
+		return true;
+	});
+}
+
+bool BVHAccelerator::intersectAny(const Ray& ray, float tMin, float tMax) const
+{
+	Cartesian3 rayOrigin = ray.getOrigin();
+	Cartesian3 rayDirection = ray.getDirection();
+	float origin[3] = { rayOrigin.x, rayOrigin.y, rayOrigin.z };
+	float direction[3] = { rayDirection.x, rayDirection.y, rayDirection.z };
+
+	// Only the distance matters, no hit record or surface attributes
+	auto occludesLeaf = [&](unsigned int first, unsigned int count)
+	{
+		return triangleStore.intersectAny(first, count, origin, direction, tMin, tMax);
+	};
+
+	return visitHierarchy([&](const auto& hierarchy)
+	{
+		return hierarchy.intersectAny(ray, tMin, tMax, occludesLeaf);
+	});
+}
+
+void BVHAccelerator::intersectPacket(RayPacket& packet) const
+{
+	if (isQuantised())
+	{
+		Accelerator::intersectPacket(packet);
+		return;
+	}
+
+	// Each ray of the mask against the leaf's triangles, with the same test as a single ray
+	bvh.intersectPacket(packet, [&](unsigned int first, unsigned int count, RayPacketMask mask)
+	{
+		for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+		{
+			if (!(mask & 1))
+			{
+				continue;
+			}
+			float origin[3] = { packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane] };
+			float direction[3] = { packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane] };
+			RayHit& hit = packet.hits[lane];
+			unsigned int reference;
+			if (triangleStore.intersectNearest(first, count, origin, direction, packet.tMin, packet.tMax[lane], hit.u, hit.v, reference))
+			{
+				hit.t = packet.tMax[lane];
+				hit.triangle = bvh.primitiveIndices[reference];
+			}
+		}
+	});
+}
+
+static void remapReferences(std::vector<unsigned int>& references, const std::vector<unsigned int>& newIndices)
+{
+	for (auto& index : references)
+	{
+		index = newIndices[index];
+	}
+}
+
+// The triangle store holds vertices rather than indices, so only the references change
+void BVHAccelerator::remapTriangles(const std::vector<unsigned int>& newIndices)
+{
+	remapReferences(bvh.primitiveIndices, newIndices);
+	// The collapsed copies share the binary BVH's order
+	bvh4.primitiveIndices = bvh4.isEmpty() ? std::vector<unsigned int>() : bvh.primitiveIndices;
+	bvh8.primitiveIndices = bvh8.isEmpty() ? std::vector<unsigned int>() : bvh.primitiveIndices;
+	// The quantised ones have their own
+	remapReferences(bvh4Quantised8.primitiveIndices, newIndices);
+	remapReferences(bvh4Quantised16.primitiveIndices, newIndices);
+	remapReferences(bvh8Quantised8.primitiveIndices, newIndices);
+	remapReferences(bvh8Quantised16.primitiveIndices, newIndices);
+}
+
+AABB BVHAccelerator::getBounds() const
+{
+	if (bvh.isEmpty())
+	{
+		return AABB();
+	}
+	const BVHNode& root = bvh.nodes[0];
+	return AABB(Cartesian3(root.minBounds[0], root.minBounds[1], root.minBounds[2]), Cartesian3(root.maxBounds[0], root.maxBounds[1], root.maxBounds[2]));
+}
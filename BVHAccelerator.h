@@ -0,0 +1,75 @@
+// Bounding volume hierarchy accelerator
+// Builds the binary BVH, or loads it from the on disk cache, then collapses it to the chosen width, optionally
+// quantising the collapsed nodes, and lays the triangles out in the traversed hierarchy's leaf order for the SIMD leaf tests
+#pragma once
+
+// Standard libraries
+#include <string>
+
+// RT Specific
+#include "Accelerator.h"
+#include "BVH.h"
+#include "WideBVH.h"
+#include "QuantisedBVH.h"
+#include "BVHCache.h"
+#include "TriangleStore.h"
+
+class BVHAccelerator : public Accelerator
+{
+private:
+	// Collapsed copies for SIMD box tests, only the one for the chosen width is built
+	WideBVH<4> bvh4;
+	WideBVH<8> bvh8;
+	// Compressed copies, replacing the float ones above when quantisation is on
+	QuantisedBVH<4, unsigned char> bvh4Quantised8;
+	QuantisedBVH<4, unsigned short> bvh4Quantised16;
+	QuantisedBVH<8, unsigned char> bvh8Quantised8;
+	QuantisedBVH<8, unsigned short> bvh8Quantised16;
+
+	// Vertices and edges of the triangles in BVH leaf order, rebuilt with the BVH
+	TriangleStore triangleStore;
+
+	// Hash of the geometry the BVH depends on and the build settings
+	uint64_t computeCacheKey(const std::vector<Cartesian3>& triangleVertices) const;
+
+	// Compress the collapsed hierarchy of one width, freeing the float nodes
+	template <unsigned int Width>
+	void quantise(WideBVH<Width>& wide, QuantisedBVH<Width, unsigned char>& quantised8, QuantisedBVH<Width, unsigned short>& quantised16, size_t triangleCount);
+
+	// Call visit with the hierarchy chosen by width and quantiseBits, returning its result
+	template <typename Visitor>
+	bool visitHierarchy(Visitor visit) const;
+
+	// Whether the traversed hierarchy is a quantised one
+	bool isQuantised() const;
+	// Primitive order of the traversed hierarchy, which the triangle store follows
+	const std::vector<unsigned int>& getTraversedReferences() const;
+public:
+	// Binary hierarchy and its build settings
+	BVH bvh;
+	// Branching factor of the traversed BVH, 2, 4, 8 or BVH_WIDTH_AUTO for the widest the CPU supports
+	unsigned int width;
+	// Bits per quantised child bound of a BVH4 or BVH8, one of the BVH_QUANTISE constants
+	unsigned int quantiseBits;
+	// Triangles per leaf test, one of the TRIANGLE_KERNEL constants
+	unsigned int triangleKernelWidth;
+	// Cache file for the BVH, empty to always build
+	std::string cachePath;
+
+	// Constructor
+	BVHAccelerator();
+
+	void build(const std::vector<Cartesian3>& triangleVertices);
+	void clear();
+	bool isEmpty() const { return bvh.isEmpty(); };
+	bool intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const;
+	bool intersectAny(const Ray& ray, float tMin, float tMax) const;
+	// Traverses the binary BVH whatever the width, as its box test is across rays rather than children.
+	// Quantised hierarchies order the triangle store their own way, so their packets are traced ray by ray
+	void intersectPacket(RayPacket& packet) const;
+	const std::vector<unsigned int>& getTriangleReferences() const { return getTraversedReferences(); };
+	void remapTriangles(const std::vector<unsigned int>& newIndices);
+	AABB getBounds() const;
+	const char* getName() const { return "BVH"; };
+	Accelerator* clone() const { return new BVHAccelerator(*this); };
+};
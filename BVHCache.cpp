@@ -0,0 +1,263 @@
+// On disk cache of built BVHs
+#include "BVHCache.h"
+
+// Standard libraries
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+// Platform file mapping
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Identifies cache files, and catches files written with the other byte order
+const char BVH_CACHE_MAGIC[8] = { 'R', 'T', 'B', 'V', 'H', 'C', 'A', 'C' };
+const uint32_t BVH_CACHE_BYTE_ORDER = 0x01020304;
+
+// File header, followed by the nodes then the primitive indices
+struct BVHCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t key;
+	uint64_t nodeCount;
+	uint64_t primitiveCount;
+	// Statistics of the original build
+	double buildTimeMs;
+	uint32_t leafCount;
+	uint32_t maxDepth;
+	uint32_t builder;
+	uint32_t treeletsOptimised;
+	float sahCost;
+	uint32_t nodeSize;
+};
+
+MappedFile::MappedFile(const std::string& path) : data(nullptr), size(0)
+{
+#ifdef _WIN32
+	fileHandle = INVALID_HANDLE_VALUE;
+	mappingHandle = nullptr;
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	fileHandle = file;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		return;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		return;
+	}
+	mappingHandle = mapping;
+	data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data != nullptr)
+	{
+		size = (size_t)fileSize.QuadPart;
+	}
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return;
+	}
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) == 0 && fileStatus.st_size > 0)
+	{
+		void* mapping = mmap(nullptr, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapping != MAP_FAILED)
+		{
+			data = (const char*)mapping;
+			size = (size_t)fileStatus.st_size;
+		}
+	}
+	// The mapping keeps the file alive
+	close(file);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != nullptr)
+	{
+		CloseHandle((HANDLE)mappingHandle);
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle((HANDLE)fileHandle);
+	}
+#else
+	if (data != nullptr)
+	{
+		munmap((void*)data, size);
+	}
+#endif
+}
+
+uint64_t hashBytes(uint64_t hash, const void* bytes, size_t size)
+{
+	// FNV-1a over 64 bit words, then the remaining bytes
+	const uint64_t prime = 0x100000001b3ull;
+	const unsigned char* byte = (const unsigned char*)bytes;
+	size_t wordCount = size / 8;
+	for (size_t i = 0; i < wordCount; i++)
+	{
+		uint64_t word;
+		std::memcpy(&word, byte + 8 * i, 8);
+		hash = (hash ^ word) * prime;
+	}
+	for (size_t i = 8 * wordCount; i < size; i++)
+	{
+		hash = (hash ^ byte[i]) * prime;
+	}
+	// Final mix, so every input bit reaches the high bits
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+uint64_t hashBVHSettings(uint64_t hash, const BVH& bvh)
+{
+	uint32_t settings[10] = { BVH_CACHE_VERSION, bvh.builder, bvh.optimiseTreelets ? 1u : 0u, bvh.maxLeafSize, BVH_SAH_BINS, BVH_MAX_DEPTH, BVH_TREELET_SIZE, BVH_SPATIAL_BINS, bvh.layout, 0 };
+	std::memcpy(&settings[9], &bvh.spatialSplitBudget, sizeof(float));
+	return hashBytes(hash, settings, sizeof(settings));
+}
+
+bool loadBVHCache(const std::string& path, uint64_t key, size_t triangleCount, BVH& bvh)
+{
+	MappedFile file(path);
+	if (!file.isOpen() || file.size < sizeof(BVHCacheHeader))
+	{
+		return false;
+	}
+
+	// Check the header before trusting any sizes in it
+	BVHCacheHeader header;
+	std::memcpy(&header, file.data, sizeof(header));
+	if (std::memcmp(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic)) != 0 || header.version != BVH_CACHE_VERSION ||
+		header.byteOrder != BVH_CACHE_BYTE_ORDER || header.nodeSize != sizeof(BVHNode) || header.key != key)
+	{
+		return false;
+	}
+	if (header.nodeCount == 0 || header.nodeCount > file.size / sizeof(BVHNode) || header.primitiveCount > file.size / sizeof(unsigned int) ||
+		file.size != sizeof(header) + header.nodeCount * sizeof(BVHNode) + header.primitiveCount * sizeof(unsigned int))
+	{
+		return false;
+	}
+
+	// Copy the arrays straight out of the mapping
+	const BVHNode* nodes = (const BVHNode*)(file.data + sizeof(header));
+	const unsigned int* primitiveIndices = (const unsigned int*)(file.data + sizeof(header) + header.nodeCount * sizeof(BVHNode));
+	std::vector<BVHNode> loadedNodes(nodes, nodes + header.nodeCount);
+	std::vector<unsigned int> loadedIndices(primitiveIndices, primitiveIndices + header.primitiveCount);
+
+	// A truncated or corrupted file must not send traversal out of bounds, so walk the tree as traversal would.
+	// Unused slots left by depth limited LBVH leaves are never reached. Every layout places children after their
+	// parent, which rules out cycles, and no node may be reached twice or lie deeper than the traversal stacks allow
+	std::vector<bool> visited(header.nodeCount, false);
+	std::vector<std::pair<unsigned int, unsigned int>> toVisit(1, std::make_pair(0u, 0u));
+	visited[0] = true;
+	while (!toVisit.empty())
+	{
+		unsigned int nodeIndex = toVisit.back().first;
+		unsigned int depth = toVisit.back().second;
+		toVisit.pop_back();
+		const BVHNode& node = loadedNodes[nodeIndex];
+		if (node.isLeaf())
+		{
+			if (node.leftFirst > header.primitiveCount || node.primitiveCount > header.primitiveCount - node.leftFirst)
+			{
+				return false;
+			}
+			continue;
+		}
+		if (node.leftFirst <= nodeIndex || node.leftFirst + 1 >= header.nodeCount || depth + 1 >= BVH_MAX_DEPTH ||
+			visited[node.leftFirst] || visited[node.leftFirst + 1])
+		{
+			return false;
+		}
+		for (unsigned int child = node.leftFirst; child <= node.leftFirst + 1; child++)
+		{
+			visited[child] = true;
+			toVisit.push_back(std::make_pair(child, depth + 1));
+		}
+	}
+	// Spatial splits reference triangles more than once, so there can be more references than triangles
+	for (auto& primitive : loadedIndices)
+	{
+		if (primitive >= triangleCount)
+		{
+			return false;
+		}
+	}
+
+	bvh.nodes.swap(loadedNodes);
+	bvh.primitiveIndices.swap(loadedIndices);
+	bvh.stats = BVHBuildStats();
+	bvh.stats.buildTimeMs = header.buildTimeMs;
+	bvh.stats.nodeCount = (unsigned int)header.nodeCount;
+	bvh.stats.leafCount = header.leafCount;
+	bvh.stats.maxDepth = header.maxDepth;
+	bvh.stats.builder = header.builder;
+	bvh.stats.treeletsOptimised = header.treeletsOptimised != 0;
+	bvh.stats.sahCost = header.sahCost;
+	bvh.stats.referenceCount = bvh.primitiveIndices.size();
+	return true;
+}
+
+bool saveBVHCache(const std::string& path, uint64_t key, const BVH& bvh)
+{
+	BVHCacheHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, BVH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = BVH_CACHE_VERSION;
+	header.byteOrder = BVH_CACHE_BYTE_ORDER;
+	header.key = key;
+	header.nodeCount = bvh.nodes.size();
+	header.primitiveCount = bvh.primitiveIndices.size();
+	header.buildTimeMs = bvh.stats.buildTimeMs;
+	header.leafCount = bvh.stats.leafCount;
+	header.maxDepth = bvh.stats.maxDepth;
+	header.builder = bvh.stats.builder;
+	header.treeletsOptimised = bvh.stats.treeletsOptimised ? 1 : 0;
+	header.sahCost = bvh.stats.sahCost;
+	header.nodeSize = sizeof(BVHNode);
+
+	// Write beside the target then swap it in, so a crash never leaves a half written cache
+	std::string temporaryPath = path + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)bvh.nodes.data(), bvh.nodes.size() * sizeof(BVHNode));
+		file.write((const char*)bvh.primitiveIndices.data(), bvh.primitiveIndices.size() * sizeof(unsigned int));
+		if (!file.good())
+		{
+			file.close();
+			std::remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+	// rename() won't replace an existing file on Windows
+	std::remove(path.c_str());
+	return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+// On disk cache of built BVHs
+// A cache file holds one BVH with the key of the geometry and settings it was built from. Files from another
+// format version, another key or that fail validation are stale, and the caller rebuilds and saves over them
+#pragma once
+
+// Standard libraries
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// RT Specific
+#include "BVH.h"
+
+// Constants
+// Bump whenever the file layout or the build algorithms change
+const unsigned int BVH_CACHE_VERSION = 2;
+
+// Read only view of a whole file, mapped into memory
+class MappedFile
+{
+private:
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+public:
+	const char* data;
+	size_t size;
+
+	// Maps the file, leaving data null if it can't be opened
+	MappedFile(const std::string& path);
+	~MappedFile();
+
+	bool isOpen() const { return data != nullptr; };
+
+	// Mappings can't be shared
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+};
+
+// Running 64 bit hash of a block of memory
+uint64_t hashBytes(uint64_t hash, const void* bytes, size_t size);
+
+// Hash of the settings that change what a build produces, to combine with the geometry hash
+uint64_t hashBVHSettings(uint64_t hash, const BVH& bvh);
+
+// Replace bvh with the cached one if the file matches key and every reference is to one of triangleCount triangles.
+// Returns false, leaving bvh alone, if it is missing or stale
+bool loadBVHCache(const std::string& path, uint64_t key, size_t triangleCount, BVH& bvh);
+
+// Write bvh under key, replacing any existing file. Returns false if the file couldn't be written
+bool saveBVHCache(const std::string& path, uint64_t key, const BVH& bvh);
\ No newline at end of file
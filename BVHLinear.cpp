@@ -0,0 +1,681 @@
+// Linear BVH builder
+// Primitives are sorted by the Morton code of their centroid, then a binary radix tree over the sorted codes
+// gives the hierarchy (Karras 2012). Every stage runs in parallel, and an optional treelet pass (Karras and Aila 2013)
+// reorders small groups of nodes to recover most of the SAH quality
+#include "BVH.h"
+
+// Standard libraries
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Marks the root's parent
+const unsigned int LBVH_NO_PARENT = ~0u;
+
+// Node of the radix tree. Interior nodes come first, followed by one leaf per sorted primitive
+struct LinearNode
+{
+	float minBounds[3];
+	float maxBounds[3];
+	// The sorted primitive for leaves
+	unsigned int children[2];
+	unsigned int parent;
+	unsigned int primitiveCount;
+	// Nodes this subtree becomes once small subtrees are collapsed into leaves
+	unsigned int emittedCount;
+	// SAH cost, unnormalised like subdivide()
+	float cost;
+	// Emit the whole subtree as a single leaf
+	bool collapse;
+};
+
+// Work item for writing out part of the final tree
+struct EmitTask
+{
+	unsigned int linearNode;
+	unsigned int outIndex;
+	// Where this node's children, then its descendants, are written
+	unsigned int pairOffset;
+	unsigned int primitiveOffset;
+	unsigned int depth;
+};
+
+// Leaves and depth found by one thread while emitting
+struct EmitStats
+{
+	unsigned int leafCount;
+	unsigned int maxDepth;
+};
+
+// Split [0, count) into one contiguous range per thread. The calling thread takes the first range
+template <typename RangeFunction>
+static void parallelFor(unsigned int threadCount, size_t count, RangeFunction function)
+{
+	size_t chunk = (count + threadCount - 1) / threadCount;
+	std::vector<std::thread> threads;
+	for (unsigned int thread = 1; thread < threadCount; thread++)
+	{
+		size_t begin = std::min(count, thread * chunk);
+		size_t end = std::min(count, begin + chunk);
+		threads.push_back(std::thread(function, thread, begin, end));
+	}
+	function(0u, (size_t)0, std::min(count, chunk));
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+static int countLeadingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	return _BitScanReverse64(&index, value) ? 63 - (int)index : 64;
+#else
+	return value == 0 ? 64 : __builtin_clzll(value);
+#endif
+}
+
+// Spread the low 10 bits of a value so there are two zero bits between each
+static uint64_t expandBits10(uint64_t value)
+{
+	value &= 0x3ff;
+	value = (value | value << 16) & 0x30000ff;
+	value = (value | value << 8) & 0x300f00f;
+	value = (value | value << 4) & 0x30c30c3;
+	value = (value | value << 2) & 0x9249249;
+	return value;
+}
+
+// As above, for the low 21 bits
+static uint64_t expandBits21(uint64_t value)
+{
+	value &= 0x1fffff;
+	value = (value | value << 32) & 0x1f00000000ffffull;
+	value = (value | value << 16) & 0x1f0000ff0000ffull;
+	value = (value | value << 8) & 0x100f00f00f00f00full;
+	value = (value | value << 4) & 0x10c30c30c30c30c3ull;
+	value = (value | value << 2) & 0x1249249249249249ull;
+	return value;
+}
+
+static float boxArea(const float* minBounds, const float* maxBounds)
+{
+	float dx = maxBounds[0] - minBounds[0], dy = maxBounds[1] - minBounds[1], dz = maxBounds[2] - minBounds[2];
+	if (dx < 0.0f) return 0.0f;
+	return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+// Stable parallel LSD radix sort of keys and their values, 8 bits per pass
+static void radixSort(std::vector<uint64_t>& keys, std::vector<unsigned int>& values, unsigned int keyBits, unsigned int threadCount)
+{
+	size_t count = keys.size();
+	std::vector<uint64_t> keysOut(count);
+	std::vector<unsigned int> valuesOut(count);
+	std::vector<size_t> histograms(256 * threadCount);
+
+	for (unsigned int shift = 0; shift < keyBits; shift += 8)
+	{
+		// Count digits per thread
+		std::fill(histograms.begin(), histograms.end(), 0);
+		parallelFor(threadCount, count, [&](unsigned int thread, size_t begin, size_t end)
+		{
+			size_t* histogram = &histograms[256 * thread];
+			for (size_t i = begin; i < end; i++)
+			{
+				histogram[(keys[i] >> shift) & 0xff]++;
+			}
+		});
+
+		// Skip the pass if every key has the same digit
+		bool singleDigit = false;
+		for (unsigned int digit = 0; digit < 256; digit++)
+		{
+			size_t digitCount = 0;
+			for (unsigned int thread = 0; thread < threadCount; thread++)
+			{
+				digitCount += histograms[256 * thread + digit];
+			}
+			if (digitCount == count)
+			{
+				singleDigit = true;
+			}
+			if (digitCount != 0)
+			{
+				break;
+			}
+		}
+		if (singleDigit)
+		{
+			continue;
+		}
+
+		// Exclusive prefix sum by digit then thread, so each thread scatters to its own slots in order
+		size_t offset = 0;
+		for (unsigned int digit = 0; digit < 256; digit++)
+		{
+			for (unsigned int thread = 0; thread < threadCount; thread++)
+			{
+				size_t digitCount = histograms[256 * thread + digit];
+				histograms[256 * thread + digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		parallelFor(threadCount, count, [&](unsigned int thread, size_t begin, size_t end)
+		{
+			size_t* offsets = &histograms[256 * thread];
+			for (size_t i = begin; i < end; i++)
+			{
+				size_t destination = offsets[(keys[i] >> shift) & 0xff]++;
+				keysOut[destination] = keys[i];
+				valuesOut[destination] = values[i];
+			}
+		});
+		keys.swap(keysOut);
+		values.swap(valuesOut);
+	}
+}
+
+// State shared by the stages of one build
+class LinearBuilder
+{
+public:
+	const std::vector<float>& primitiveBounds;
+	unsigned int maxLeafSize;
+	bool optimiseTreelets;
+
+	// Sorted codes and the primitive each belongs to
+	std::vector<uint64_t> mortonCodes;
+	std::vector<unsigned int> sortedPrimitives;
+
+	// Interior nodes [0, n - 1), then leaves [n - 1, 2n - 1)
+	std::vector<LinearNode> linearNodes;
+	unsigned int leafStart;
+
+	LinearBuilder(const std::vector<float>& newPrimitiveBounds, unsigned int newMaxLeafSize, bool newOptimiseTreelets) :
+		primitiveBounds(newPrimitiveBounds), maxLeafSize(newMaxLeafSize), optimiseTreelets(newOptimiseTreelets), leafStart(0) {}
+
+	// Length of the common prefix of two sorted keys, with the index breaking ties between duplicates
+	int commonPrefix(int i, int j) const
+	{
+		if (j < 0 || j > (int)leafStart)
+		{
+			return -1;
+		}
+		uint64_t difference = mortonCodes[i] ^ mortonCodes[j];
+		if (difference != 0)
+		{
+			return countLeadingZeros(difference);
+		}
+		return 64 + countLeadingZeros((uint64_t)(i ^ j)) - 32;
+	}
+
+	// Find the range and split of one interior node, independently of all others
+	void buildInteriorNode(int i)
+	{
+		// Direction of the range from the difference in prefix with each neighbour
+		int direction = (commonPrefix(i, i + 1) - commonPrefix(i, i - 1)) >= 0 ? 1 : -1;
+		int minimumPrefix = commonPrefix(i, i - direction);
+
+		// Upper bound on the range length, then binary search for the other end
+		int maxLength = 2;
+		while (commonPrefix(i, i + maxLength * direction) > minimumPrefix)
+		{
+			maxLength *= 2;
+		}
+		int length = 0;
+		for (int step = maxLength / 2; step >= 1; step /= 2)
+		{
+			if (commonPrefix(i, i + (length + step) * direction) > minimumPrefix)
+			{
+				length += step;
+			}
+		}
+		int j = i + length * direction;
+
+		// Binary search for the split, where the prefix shared by the whole range ends
+		int nodePrefix = commonPrefix(i, j);
+		int split = 0;
+		int step = length;
+		do
+		{
+			step = (step + 1) / 2;
+			if (commonPrefix(i, i + (split + step) * direction) > nodePrefix)
+			{
+				split += step;
+			}
+		} while (step > 1);
+		int gamma = i + split * direction + std::min(direction, 0);
+
+		// Children are leaves when they cover a single primitive
+		LinearNode& node = linearNodes[i];
+		node.children[0] = (std::min(i, j) == gamma) ? leafStart + gamma : gamma;
+		node.children[1] = (std::max(i, j) == gamma + 1) ? leafStart + gamma + 1 : gamma + 1;
+		linearNodes[node.children[0]].parent = i;
+		linearNodes[node.children[1]].parent = i;
+	}
+
+	// Cost of a subtree with the given children, collapsing it into a leaf when that is cheaper
+	void evaluateCost(LinearNode& node, float area, float childCost) const
+	{
+		float interiorCost = BVH_TRAVERSAL_COST * area + childCost;
+		float leafCost = BVH_INTERSECTION_COST * node.primitiveCount * area;
+		node.collapse = node.primitiveCount <= maxLeafSize && leafCost <= interiorCost;
+		node.cost = node.collapse ? leafCost : interiorCost;
+	}
+
+	// Fit an interior node to its children
+	void refitNode(unsigned int nodeIndex)
+	{
+		LinearNode& node = linearNodes[nodeIndex];
+		const LinearNode& left = linearNodes[node.children[0]];
+		const LinearNode& right = linearNodes[node.children[1]];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.minBounds[axis] = std::min(left.minBounds[axis], right.minBounds[axis]);
+			node.maxBounds[axis] = std::max(left.maxBounds[axis], right.maxBounds[axis]);
+		}
+		node.primitiveCount = left.primitiveCount + right.primitiveCount;
+		evaluateCost(node, boxArea(node.minBounds, node.maxBounds), left.cost + right.cost);
+		node.emittedCount = node.collapse ? 1 : 1 + left.emittedCount + right.emittedCount;
+	}
+
+	// Find the best topology for the treelet below a node by trying every partition of its leaves,
+	// and rebuild it in place if that beats the current one
+	void optimiseTreelet(unsigned int rootIndex)
+	{
+		const unsigned int subsetCount = 1 << BVH_TREELET_SIZE;
+
+		// Grow the treelet by repeatedly opening the leaf with the largest area
+		unsigned int treeletLeaves[BVH_TREELET_SIZE];
+		unsigned int treeletInteriors[BVH_TREELET_SIZE - 1];
+		unsigned int leafCount = 2;
+		unsigned int interiorCount = 1;
+		treeletLeaves[0] = linearNodes[rootIndex].children[0];
+		treeletLeaves[1] = linearNodes[rootIndex].children[1];
+		treeletInteriors[0] = rootIndex;
+		while (leafCount < BVH_TREELET_SIZE)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (unsigned int i = 0; i < leafCount; i++)
+			{
+				const LinearNode& leaf = linearNodes[treeletLeaves[i]];
+				float area = boxArea(leaf.minBounds, leaf.maxBounds);
+				if (treeletLeaves[i] < leafStart && area > largestArea)
+				{
+					largest = (int)i;
+					largestArea = area;
+				}
+			}
+			if (largest < 0)
+			{
+				break;
+			}
+			unsigned int opened = treeletLeaves[largest];
+			treeletInteriors[interiorCount++] = opened;
+			treeletLeaves[largest] = linearNodes[opened].children[0];
+			treeletLeaves[leafCount++] = linearNodes[opened].children[1];
+		}
+		if (leafCount < 3)
+		{
+			return;
+		}
+
+		// Bounds and best cost of every subset of the leaves, smaller subsets always have smaller masks
+		float subsetMin[subsetCount][3];
+		float subsetMax[subsetCount][3];
+		float subsetCost[subsetCount];
+		unsigned int subsetPrimitives[subsetCount];
+		unsigned int bestPartition[subsetCount];
+		unsigned int fullSet = (1u << leafCount) - 1;
+		for (unsigned int subset = 1; subset <= fullSet; subset++)
+		{
+			unsigned int lowest = subset & (0u - subset);
+			unsigned int rest = subset ^ lowest;
+			unsigned int lowestLeaf = 0;
+			while ((1u << lowestLeaf) != lowest)
+			{
+				lowestLeaf++;
+			}
+			const LinearNode& leaf = linearNodes[treeletLeaves[lowestLeaf]];
+			if (rest == 0)
+			{
+				for (int axis = 0; axis < 3; axis++)
+				{
+					subsetMin[subset][axis] = leaf.minBounds[axis];
+					subsetMax[subset][axis] = leaf.maxBounds[axis];
+				}
+				subsetPrimitives[subset] = leaf.primitiveCount;
+				subsetCost[subset] = leaf.cost;
+				continue;
+			}
+			for (int axis = 0; axis < 3; axis++)
+			{
+				subsetMin[subset][axis] = std::min(subsetMin[rest][axis], leaf.minBounds[axis]);
+				subsetMax[subset][axis] = std::max(subsetMax[rest][axis], leaf.maxBounds[axis]);
+			}
+			subsetPrimitives[subset] = subsetPrimitives[rest] + leaf.primitiveCount;
+
+			// Each partition is visited once, with the lowest leaf always on the left
+			float bestChildCost = std::numeric_limits<float>::infinity();
+			for (unsigned int left = (subset - 1) & subset; left != 0; left = (left - 1) & subset)
+			{
+				if (!(left & lowest))
+				{
+					continue;
+				}
+				float childCost = subsetCost[left] + subsetCost[subset ^ left];
+				if (childCost < bestChildCost)
+				{
+					bestChildCost = childCost;
+					bestPartition[subset] = left;
+				}
+			}
+			LinearNode candidate;
+			candidate.primitiveCount = subsetPrimitives[subset];
+			evaluateCost(candidate, boxArea(subsetMin[subset], subsetMax[subset]), bestChildCost);
+			subsetCost[subset] = candidate.cost;
+		}
+
+		// Keep the current topology unless the new one is clearly cheaper
+		if (subsetCost[fullSet] >= linearNodes[rootIndex].cost * (1.0f - 1e-5f))
+		{
+			return;
+		}
+
+		// Rebuild top down, reusing the treelet's interior nodes, then refit bottom up
+		struct RebuildEntry
+		{
+			unsigned int subset;
+			unsigned int nodeIndex;
+		};
+		RebuildEntry order[BVH_TREELET_SIZE - 1];
+		unsigned int orderCount = 0;
+		unsigned int nextInterior = 1;
+		order[orderCount++] = { fullSet, rootIndex };
+		for (unsigned int entry = 0; entry < orderCount; entry++)
+		{
+			unsigned int subset = order[entry].subset;
+			unsigned int nodeIndex = order[entry].nodeIndex;
+			unsigned int parts[2] = { bestPartition[subset], subset ^ bestPartition[subset] };
+			for (int side = 0; side < 2; side++)
+			{
+				unsigned int child;
+				if ((parts[side] & (parts[side] - 1)) == 0)
+				{
+					unsigned int leaf = 0;
+					while ((1u << leaf) != parts[side])
+					{
+						leaf++;
+					}
+					child = treeletLeaves[leaf];
+				}
+				else
+				{
+					child = treeletInteriors[nextInterior++];
+					order[orderCount++] = { parts[side], child };
+				}
+				linearNodes[nodeIndex].children[side] = child;
+				linearNodes[child].parent = nodeIndex;
+			}
+		}
+		for (unsigned int entry = orderCount; entry > 0; entry--)
+		{
+			refitNode(order[entry - 1].nodeIndex);
+		}
+	}
+
+	// Fit a leaf, then walk up fitting each parent once both of its children are done
+	void refitFromLeaf(unsigned int leafIndex, std::atomic<unsigned int>* visits)
+	{
+		LinearNode& leaf = linearNodes[leafIndex];
+		const float* bounds = &primitiveBounds[6 * leaf.children[0]];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			leaf.minBounds[axis] = bounds[axis];
+			leaf.maxBounds[axis] = bounds[3 + axis];
+		}
+		leaf.primitiveCount = 1;
+		leaf.cost = BVH_INTERSECTION_COST * boxArea(leaf.minBounds, leaf.maxBounds);
+		leaf.collapse = false;
+		leaf.emittedCount = 1;
+
+		unsigned int nodeIndex = leaf.parent;
+		while (nodeIndex != LBVH_NO_PARENT)
+		{
+			// The first child to arrive stops, the second carries on with both children finished
+			if (visits[nodeIndex].fetch_add(1) == 0)
+			{
+				return;
+			}
+			refitNode(nodeIndex);
+			if (optimiseTreelets && linearNodes[nodeIndex].primitiveCount >= BVH_TREELET_SIZE)
+			{
+				optimiseTreelet(nodeIndex);
+			}
+			nodeIndex = linearNodes[nodeIndex].parent;
+		}
+	}
+
+	// Write one output node. Returns true with tasks for the children if it is an interior node
+	bool emitNode(const EmitTask& task, std::vector<BVHNode>& nodes, std::vector<unsigned int>& primitiveIndices, EmitStats& emitStats, EmitTask childTasks[2]) const
+	{
+		const LinearNode& linearNode = linearNodes[task.linearNode];
+		BVHNode& node = nodes[task.outIndex];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.minBounds[axis] = linearNode.minBounds[axis];
+			node.maxBounds[axis] = linearNode.maxBounds[axis];
+		}
+
+		if (task.linearNode >= leafStart || linearNode.collapse || task.depth >= BVH_MAX_DEPTH - 1)
+		{
+			// Gather the subtree's primitives. Leaves forced by depth leave unused slots in the output, which are never visited
+			std::vector<unsigned int> stack;
+			unsigned int primitive = task.primitiveOffset;
+			stack.push_back(task.linearNode);
+			while (!stack.empty())
+			{
+				unsigned int nodeIndex = stack.back();
+				stack.pop_back();
+				if (nodeIndex >= leafStart)
+				{
+					primitiveIndices[primitive++] = linearNodes[nodeIndex].children[0];
+				}
+				else
+				{
+					stack.push_back(linearNodes[nodeIndex].children[1]);
+					stack.push_back(linearNodes[nodeIndex].children[0]);
+				}
+			}
+			node.leftFirst = task.primitiveOffset;
+			node.primitiveCount = linearNode.primitiveCount;
+			emitStats.leafCount++;
+			emitStats.maxDepth = std::max(emitStats.maxDepth, task.depth);
+			return false;
+		}
+
+		// Children go next to each other, followed by the left subtree's descendants then the right's
+		const LinearNode& left = linearNodes[linearNode.children[0]];
+		node.leftFirst = task.pairOffset;
+		node.primitiveCount = 0;
+		childTasks[0] = { linearNode.children[0], task.pairOffset, task.pairOffset + 2, task.primitiveOffset, task.depth + 1 };
+		childTasks[1] = { linearNode.children[1], task.pairOffset + 1, task.pairOffset + 2 + left.emittedCount - 1, task.primitiveOffset + left.primitiveCount, task.depth + 1 };
+		return true;
+	}
+
+	void emitSubtree(const EmitTask& rootTask, std::vector<BVHNode>& nodes, std::vector<unsigned int>& primitiveIndices, EmitStats& emitStats) const
+	{
+		std::vector<EmitTask> stack;
+		stack.push_back(rootTask);
+		while (!stack.empty())
+		{
+			EmitTask task = stack.back();
+			stack.pop_back();
+			EmitTask childTasks[2];
+			if (emitNode(task, nodes, primitiveIndices, emitStats, childTasks))
+			{
+				stack.push_back(childTasks[1]);
+				stack.push_back(childTasks[0]);
+			}
+		}
+	}
+};
+
+void BVH::buildLinear()
+{
+	unsigned int threadCount = buildThreads > 0 ? buildThreads : std::max(1u, std::thread::hardware_concurrency());
+	size_t count = primitiveIndices.size();
+	LinearBuilder builder(primitiveBounds, maxLeafSize, optimiseTreelets);
+
+	// Centroid bounds, reduced per thread
+	std::vector<float> threadBounds(6 * threadCount);
+	parallelFor(threadCount, count, [&](unsigned int thread, size_t begin, size_t end)
+	{
+		float* minBounds = &threadBounds[6 * thread];
+		float* maxBounds = minBounds + 3;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minBounds[axis] = std::numeric_limits<float>::infinity();
+			maxBounds[axis] = -std::numeric_limits<float>::infinity();
+		}
+		for (size_t i = begin; i < end; i++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				minBounds[axis] = std::min(minBounds[axis], primitiveCentroids[3 * i + axis]);
+				maxBounds[axis] = std::max(maxBounds[axis], primitiveCentroids[3 * i + axis]);
+			}
+		}
+	});
+	float centroidMin[3], centroidScale[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float axisMin = std::numeric_limits<float>::infinity();
+		float axisMax = -std::numeric_limits<float>::infinity();
+		for (unsigned int thread = 0; thread < threadCount; thread++)
+		{
+			axisMin = std::min(axisMin, threadBounds[6 * thread + axis]);
+			axisMax = std::max(axisMax, threadBounds[6 * thread + 3 + axis]);
+		}
+		centroidMin[axis] = axisMin;
+		centroidScale[axis] = axisMax > axisMin ? 1.0f / (axisMax - axisMin) : 0.0f;
+	}
+
+	// Morton codes of the centroids, on a 2^10 or 2^21 grid per axis
+	bool wideCodes = count > BVH_WIDE_MORTON_THRESHOLD;
+	float gridSize = wideCodes ? (float)((1 << 21) - 1) : (float)((1 << 10) - 1);
+	builder.mortonCodes.resize(count);
+	builder.sortedPrimitives.resize(count);
+	parallelFor(threadCount, count, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			uint64_t cell[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				// Rounding can land just past the last cell
+				cell[axis] = (uint64_t)std::min(gridSize, (primitiveCentroids[3 * i + axis] - centroidMin[axis]) * centroidScale[axis] * gridSize);
+			}
+			if (wideCodes)
+			{
+				builder.mortonCodes[i] = (expandBits21(cell[0]) << 2) | (expandBits21(cell[1]) << 1) | expandBits21(cell[2]);
+			}
+			else
+			{
+				builder.mortonCodes[i] = (expandBits10(cell[0]) << 2) | (expandBits10(cell[1]) << 1) | expandBits10(cell[2]);
+			}
+			builder.sortedPrimitives[i] = (unsigned int)i;
+		}
+	});
+	radixSort(builder.mortonCodes, builder.sortedPrimitives, wideCodes ? 63 : 30, threadCount);
+	// Align codes to the top bit so prefix lengths compare the same for both widths
+	unsigned int codeShift = wideCodes ? 1 : 34;
+	parallelFor(threadCount, count, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			builder.mortonCodes[i] <<= codeShift;
+		}
+	});
+
+	// Radix tree, each interior node found independently
+	builder.leafStart = (unsigned int)(count - 1);
+	builder.linearNodes.resize(2 * count - 1);
+	builder.linearNodes[0].parent = LBVH_NO_PARENT;
+	parallelFor(threadCount, count, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			builder.linearNodes[builder.leafStart + i].children[0] = builder.sortedPrimitives[i];
+			if (i < count - 1)
+			{
+				builder.buildInteriorNode((int)i);
+			}
+		}
+	});
+
+	// Bounds, costs and treelets bottom up
+	std::unique_ptr<std::atomic<unsigned int>[]> visits(new std::atomic<unsigned int>[count]);
+	for (size_t i = 0; i < count; i++)
+	{
+		visits[i] = 0;
+	}
+	parallelFor(threadCount, count, [&](unsigned int, size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			builder.refitFromLeaf(builder.leafStart + (unsigned int)i, visits.get());
+		}
+	});
+
+	// Expand the top of the tree until there are enough subtrees to share between threads
+	unsigned int rootIndex = count > 1 ? 0 : builder.leafStart;
+	BVHNode emptyNode;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		emptyNode.minBounds[axis] = std::numeric_limits<float>::infinity();
+		emptyNode.maxBounds[axis] = -std::numeric_limits<float>::infinity();
+	}
+	emptyNode.leftFirst = 0;
+	emptyNode.primitiveCount = 0;
+	nodes.assign(builder.linearNodes[rootIndex].emittedCount, emptyNode);
+
+	std::vector<EmitStats> threadStats(threadCount, EmitStats());
+	std::vector<EmitTask> tasks;
+	tasks.push_back({ rootIndex, 0, 1, 0, 0 });
+	size_t expanded = 0;
+	while (expanded < tasks.size() && tasks.size() - expanded < 4 * threadCount)
+	{
+		EmitTask childTasks[2];
+		if (builder.emitNode(tasks[expanded], nodes, primitiveIndices, threadStats[0], childTasks))
+		{
+			tasks.push_back(childTasks[0]);
+			tasks.push_back(childTasks[1]);
+		}
+		expanded++;
+	}
+
+	// Then emit the subtrees in parallel, handing them out as threads finish
+	std::atomic<size_t> nextTask(expanded);
+	parallelFor(threadCount, threadCount, [&](unsigned int thread, size_t, size_t)
+	{
+		for (size_t task = nextTask++; task < tasks.size(); task = nextTask++)
+		{
+			builder.emitSubtree(tasks[task], nodes, primitiveIndices, threadStats[thread]);
+		}
+	});
+
+	for (auto& emitStats : threadStats)
+	{
+		stats.leafCount += emitStats.leafCount;
+		stats.maxDepth = std::max(stats.maxDepth, emitStats.maxDepth);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,474 @@
+// Spatial split BVH builder (Stich et al. 2009)
+// Alongside the usual binned object split, each node may split space at a plane, clipping the triangles that straddle it
+// so each side only bounds its own part. The straddling triangles are then referenced from both children, which a budget caps
+#include "BVH.h"
+
+// Standard libraries
+#include <algorithm>
+#include <utility>
+
+// A possibly clipped part of a triangle
+struct SpatialReference
+{
+	float minBounds[3];
+	float maxBounds[3];
+	unsigned int primitive;
+};
+
+// Plain float box, as BinBounds in BVH.cpp
+struct SpatialBounds
+{
+	float minBounds[3];
+	float maxBounds[3];
+
+	SpatialBounds()
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minBounds[axis] = std::numeric_limits<float>::infinity();
+			maxBounds[axis] = -std::numeric_limits<float>::infinity();
+		}
+	}
+	void grow(const float* otherMin, const float* otherMax)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			minBounds[axis] = std::min(minBounds[axis], otherMin[axis]);
+			maxBounds[axis] = std::max(maxBounds[axis], otherMax[axis]);
+		}
+	}
+	void grow(const SpatialBounds& other) { grow(other.minBounds, other.maxBounds); }
+	void grow(const SpatialReference& reference) { grow(reference.minBounds, reference.maxBounds); }
+	void growPoint(const float* point) { grow(point, point); }
+	float surfaceArea() const
+	{
+		float dx = maxBounds[0] - minBounds[0], dy = maxBounds[1] - minBounds[1], dz = maxBounds[2] - minBounds[2];
+		if (dx < 0.0f || dy < 0.0f || dz < 0.0f) return 0.0f;
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	}
+	SpatialBounds intersection(const SpatialBounds& other) const
+	{
+		SpatialBounds result;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			result.minBounds[axis] = std::max(minBounds[axis], other.minBounds[axis]);
+			result.maxBounds[axis] = std::min(maxBounds[axis], other.maxBounds[axis]);
+		}
+		return result;
+	}
+};
+
+// Best split found for a node
+struct SpatialSplit
+{
+	float cost;
+	int axis;
+	// Bin of the object split, or plane position of the spatial split
+	unsigned int bin;
+	float position;
+	// Children as the sweep saw them, used to decide whether straddling references are duplicated
+	SpatialBounds leftBounds, rightBounds;
+	unsigned int leftCount, rightCount;
+
+	SpatialSplit() : cost(std::numeric_limits<float>::infinity()), axis(-1), bin(0), position(0.0f), leftCount(0), rightCount(0) {}
+};
+
+class SpatialBuilder
+{
+public:
+	// Nine floats per primitive, the triangle's vertices
+	std::vector<float> triangles;
+	unsigned int maxLeafSize;
+	// References that may still be added by spatial splits
+	size_t remainingBudget;
+	float rootArea;
+
+	SpatialBuilder(const std::vector<Cartesian3>& triangleVertices, unsigned int newMaxLeafSize, size_t budget) :
+		triangles(3 * triangleVertices.size()), maxLeafSize(newMaxLeafSize), remainingBudget(budget), rootArea(0.0f)
+	{
+		for (size_t i = 0; i < triangleVertices.size(); i++)
+		{
+			triangles[3 * i] = triangleVertices[i].x;
+			triangles[3 * i + 1] = triangleVertices[i].y;
+			triangles[3 * i + 2] = triangleVertices[i].z;
+		}
+	}
+
+	static bool isEmpty(const SpatialReference& reference)
+	{
+		return reference.minBounds[0] > reference.maxBounds[0] || reference.minBounds[1] > reference.maxBounds[1] || reference.minBounds[2] > reference.maxBounds[2];
+	}
+
+	// Clip a reference's triangle at a plane, giving the bounds of the part on each side within the reference's box
+	void splitReference(const SpatialReference& reference, int axis, float position, SpatialReference& left, SpatialReference& right) const
+	{
+		const float infinity = std::numeric_limits<float>::infinity();
+		for (int component = 0; component < 3; component++)
+		{
+			left.minBounds[component] = right.minBounds[component] = infinity;
+			left.maxBounds[component] = right.maxBounds[component] = -infinity;
+		}
+		const float* vertices = &triangles[9 * reference.primitive];
+		for (int i = 0; i < 3; i++)
+		{
+			const float* start = vertices + 3 * i;
+			const float* end = vertices + 3 * ((i + 1) % 3);
+			float startDistance = start[axis] - position;
+			float endDistance = end[axis] - position;
+			if (startDistance <= 0.0f)
+			{
+				growPoint(left, start);
+			}
+			if (startDistance >= 0.0f)
+			{
+				growPoint(right, start);
+			}
+			// Edges crossing the plane add the crossing point to both sides
+			if ((startDistance < 0.0f && endDistance > 0.0f) || (startDistance > 0.0f && endDistance < 0.0f))
+			{
+				float t = std::min(1.0f, std::max(0.0f, startDistance / (startDistance - endDistance)));
+				float crossing[3];
+				for (int component = 0; component < 3; component++)
+				{
+					crossing[component] = start[component] + t * (end[component] - start[component]);
+				}
+				crossing[axis] = position;
+				growPoint(left, crossing);
+				growPoint(right, crossing);
+			}
+		}
+		left.maxBounds[axis] = std::min(left.maxBounds[axis], position);
+		right.minBounds[axis] = std::max(right.minBounds[axis], position);
+
+		// Keep within the box of the reference being split, which may already be clipped
+		for (int component = 0; component < 3; component++)
+		{
+			left.minBounds[component] = std::max(left.minBounds[component], reference.minBounds[component]);
+			left.maxBounds[component] = std::min(left.maxBounds[component], reference.maxBounds[component]);
+			right.minBounds[component] = std::max(right.minBounds[component], reference.minBounds[component]);
+			right.maxBounds[component] = std::min(right.maxBounds[component], reference.maxBounds[component]);
+		}
+		left.primitive = reference.primitive;
+		right.primitive = reference.primitive;
+	}
+
+	static void growPoint(SpatialReference& reference, const float* point)
+	{
+		for (int component = 0; component < 3; component++)
+		{
+			reference.minBounds[component] = std::min(reference.minBounds[component], point[component]);
+			reference.maxBounds[component] = std::max(reference.maxBounds[component], point[component]);
+		}
+	}
+
+	// Binned SAH over reference centroids, as BVH::subdivide
+	SpatialSplit findObjectSplit(const std::vector<SpatialReference>& references, float nodeArea, SpatialBounds& centroidBounds) const
+	{
+		SpatialSplit best;
+		for (auto& reference : references)
+		{
+			float centroid[3];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				centroid[axis] = 0.5f * (reference.minBounds[axis] + reference.maxBounds[axis]);
+			}
+			centroidBounds.growPoint(centroid);
+		}
+
+		unsigned int count = (unsigned int)references.size();
+		unsigned int binCount = std::min(BVH_SAH_BINS, std::max(4u, count));
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float axisMin = centroidBounds.minBounds[axis];
+			float axisExtent = centroidBounds.maxBounds[axis] - axisMin;
+			if (axisExtent <= 0.0f) continue;
+			float binScale = binCount / axisExtent;
+
+			SpatialBounds binBounds[BVH_SAH_BINS];
+			unsigned int binCounts[BVH_SAH_BINS] = {};
+			for (auto& reference : references)
+			{
+				float centroid = 0.5f * (reference.minBounds[axis] + reference.maxBounds[axis]);
+				unsigned int bin = std::min(binCount - 1, (unsigned int)((centroid - axisMin) * binScale));
+				binCounts[bin]++;
+				binBounds[bin].grow(reference);
+			}
+			sweep(binBounds, binCounts, binCounts, binCount, axis, nodeArea, best, [&](unsigned int plane) { return (float)plane; });
+		}
+		return best;
+	}
+
+	// Binned SAH over planes through the node's box, chopping each reference into the bins it crosses
+	SpatialSplit findSpatialSplit(const std::vector<SpatialReference>& references, const SpatialBounds& nodeBounds, float nodeArea) const
+	{
+		SpatialSplit best;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float axisMin = nodeBounds.minBounds[axis];
+			float axisExtent = nodeBounds.maxBounds[axis] - axisMin;
+			if (axisExtent <= 0.0f) continue;
+			float binWidth = axisExtent / BVH_SPATIAL_BINS;
+			float binScale = BVH_SPATIAL_BINS / axisExtent;
+
+			SpatialBounds binBounds[BVH_SPATIAL_BINS];
+			unsigned int entries[BVH_SPATIAL_BINS] = {};
+			unsigned int exits[BVH_SPATIAL_BINS] = {};
+			for (auto& reference : references)
+			{
+				unsigned int firstBin = std::min(BVH_SPATIAL_BINS - 1, (unsigned int)std::max(0.0f, (reference.minBounds[axis] - axisMin) * binScale));
+				unsigned int lastBin = std::min(BVH_SPATIAL_BINS - 1, (unsigned int)std::max(0.0f, (reference.maxBounds[axis] - axisMin) * binScale));
+				lastBin = std::max(firstBin, lastBin);
+				entries[firstBin]++;
+				exits[lastBin]++;
+
+				SpatialReference remaining = reference;
+				for (unsigned int bin = firstBin; bin < lastBin; bin++)
+				{
+					SpatialReference left, right;
+					splitReference(remaining, axis, axisMin + (bin + 1) * binWidth, left, right);
+					binBounds[bin].grow(left);
+					remaining = right;
+				}
+				binBounds[lastBin].grow(remaining);
+			}
+			sweep(binBounds, entries, exits, BVH_SPATIAL_BINS, axis, nodeArea, best, [&](unsigned int plane) { return axisMin + (plane + 1) * binWidth; });
+		}
+		return best;
+	}
+
+	// Evaluate every plane between bins, counting references that start left of it and end right of it
+	template <typename PlanePosition>
+	void sweep(const SpatialBounds* binBounds, const unsigned int* entries, const unsigned int* exits, unsigned int binCount, int axis, float nodeArea, SpatialSplit& best, PlanePosition planePosition) const
+	{
+		SpatialBounds leftBounds[BVH_SPATIAL_BINS], rightBounds[BVH_SPATIAL_BINS];
+		unsigned int leftCount[BVH_SPATIAL_BINS], rightCount[BVH_SPATIAL_BINS];
+		SpatialBounds leftBox, rightBox;
+		unsigned int leftSum = 0, rightSum = 0;
+		for (unsigned int plane = 0; plane < binCount - 1; plane++)
+		{
+			leftSum += entries[plane];
+			leftBox.grow(binBounds[plane]);
+			leftCount[plane] = leftSum;
+			leftBounds[plane] = leftBox;
+
+			rightSum += exits[binCount - 1 - plane];
+			rightBox.grow(binBounds[binCount - 1 - plane]);
+			rightCount[binCount - 2 - plane] = rightSum;
+			rightBounds[binCount - 2 - plane] = rightBox;
+		}
+		for (unsigned int plane = 0; plane < binCount - 1; plane++)
+		{
+			if (leftCount[plane] == 0 || rightCount[plane] == 0) continue;
+			float cost = BVH_TRAVERSAL_COST * nodeArea + BVH_INTERSECTION_COST * (leftCount[plane] * leftBounds[plane].surfaceArea() + rightCount[plane] * rightBounds[plane].surfaceArea());
+			if (cost < best.cost)
+			{
+				best.cost = cost;
+				best.axis = axis;
+				best.bin = plane;
+				best.position = planePosition(plane);
+				best.leftBounds = leftBounds[plane];
+				best.rightBounds = rightBounds[plane];
+				best.leftCount = leftCount[plane];
+				best.rightCount = rightCount[plane];
+			}
+		}
+	}
+
+	// Partition about a spatial split, duplicating straddling references unless moving them to one side is cheaper
+	void partitionSpatial(const std::vector<SpatialReference>& references, const SpatialSplit& split, std::vector<SpatialReference>& left, std::vector<SpatialReference>& right) const
+	{
+		SpatialBounds leftBounds = split.leftBounds;
+		SpatialBounds rightBounds = split.rightBounds;
+		int leftCount = (int)split.leftCount;
+		int rightCount = (int)split.rightCount;
+		int axis = split.axis;
+		for (auto& reference : references)
+		{
+			if (reference.maxBounds[axis] <= split.position)
+			{
+				left.push_back(reference);
+			}
+			else if (reference.minBounds[axis] >= split.position)
+			{
+				right.push_back(reference);
+			}
+			else
+			{
+				// Unsplitting test from the paper: keep the whole reference on one side if that is cheaper
+				SpatialBounds referenceBounds;
+				referenceBounds.grow(reference);
+				SpatialBounds leftGrown = leftBounds, rightGrown = rightBounds;
+				leftGrown.grow(referenceBounds);
+				rightGrown.grow(referenceBounds);
+				float splitCost = leftBounds.surfaceArea() * leftCount + rightBounds.surfaceArea() * rightCount;
+				float leftOnlyCost = leftGrown.surfaceArea() * leftCount + rightBounds.surfaceArea() * (rightCount - 1);
+				float rightOnlyCost = leftBounds.surfaceArea() * (leftCount - 1) + rightGrown.surfaceArea() * rightCount;
+				if (leftOnlyCost < splitCost && leftOnlyCost <= rightOnlyCost)
+				{
+					left.push_back(reference);
+					leftBounds = leftGrown;
+					rightCount--;
+				}
+				else if (rightOnlyCost < splitCost)
+				{
+					right.push_back(reference);
+					rightBounds = rightGrown;
+					leftCount--;
+				}
+				else
+				{
+					// Clipping can find the triangle misses one side of the box entirely
+					SpatialReference leftPart, rightPart;
+					splitReference(reference, axis, split.position, leftPart, rightPart);
+					if (!isEmpty(leftPart))
+					{
+						left.push_back(leftPart);
+					}
+					if (!isEmpty(rightPart))
+					{
+						right.push_back(rightPart);
+					}
+				}
+			}
+		}
+	}
+};
+
+// Work item for the iterative build
+struct SpatialTask
+{
+	unsigned int nodeIndex;
+	unsigned int depth;
+	std::vector<SpatialReference> references;
+};
+
+void BVH::buildSpatial(const std::vector<Cartesian3>& triangleVertices)
+{
+	size_t primitiveCount = primitiveIndices.size();
+	SpatialBuilder builder(triangleVertices, maxLeafSize, (size_t)(spatialSplitBudget * primitiveCount));
+	primitiveIndices.clear();
+	primitiveIndices.reserve(primitiveCount + builder.remainingBudget);
+
+	// Root references are the triangles' own bounds
+	SpatialTask rootTask;
+	rootTask.nodeIndex = 0;
+	rootTask.depth = 0;
+	rootTask.references.resize(primitiveCount);
+	SpatialBounds rootBounds;
+	for (size_t i = 0; i < primitiveCount; i++)
+	{
+		SpatialReference& reference = rootTask.references[i];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			reference.minBounds[axis] = primitiveBounds[6 * i + axis];
+			reference.maxBounds[axis] = primitiveBounds[6 * i + 3 + axis];
+		}
+		reference.primitive = (unsigned int)i;
+		rootBounds.grow(reference);
+	}
+	builder.rootArea = rootBounds.surfaceArea();
+	nodes.push_back(BVHNode());
+
+	std::vector<SpatialTask> stack;
+	stack.push_back(std::move(rootTask));
+	while (!stack.empty())
+	{
+		SpatialTask task = std::move(stack.back());
+		stack.pop_back();
+		std::vector<SpatialReference>& references = task.references;
+		unsigned int count = (unsigned int)references.size();
+
+		SpatialBounds nodeBounds;
+		for (auto& reference : references)
+		{
+			nodeBounds.grow(reference);
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			nodes[task.nodeIndex].minBounds[axis] = nodeBounds.minBounds[axis];
+			nodes[task.nodeIndex].maxBounds[axis] = nodeBounds.maxBounds[axis];
+		}
+
+		std::vector<SpatialReference> left, right;
+		if (count > 1 && task.depth < BVH_MAX_DEPTH - 1)
+		{
+			float nodeArea = nodeBounds.surfaceArea();
+			float leafCost = BVH_INTERSECTION_COST * count * nodeArea;
+			SpatialBounds centroidBounds;
+			SpatialSplit objectSplit = builder.findObjectSplit(references, nodeArea, centroidBounds);
+
+			// Only look for spatial splits where the object split's children overlap noticeably
+			SpatialSplit spatialSplit;
+			float overlap = objectSplit.leftBounds.intersection(objectSplit.rightBounds).surfaceArea();
+			if (builder.remainingBudget > 0 && (objectSplit.axis < 0 || overlap > BVH_SPATIAL_OVERLAP * builder.rootArea))
+			{
+				spatialSplit = builder.findSpatialSplit(references, nodeBounds, nodeArea);
+			}
+
+			bool useSpatial = spatialSplit.cost < objectSplit.cost && spatialSplit.leftCount + spatialSplit.rightCount - count <= builder.remainingBudget;
+			float bestCost = useSpatial ? spatialSplit.cost : objectSplit.cost;
+			if (bestCost < leafCost || count > maxLeafSize)
+			{
+				if (useSpatial)
+				{
+					builder.partitionSpatial(references, spatialSplit, left, right);
+					size_t added = left.size() + right.size() - count;
+					builder.remainingBudget -= std::min(builder.remainingBudget, added);
+				}
+				else if (objectSplit.axis >= 0)
+				{
+					int axis = objectSplit.axis;
+					float axisMin = centroidBounds.minBounds[axis];
+					unsigned int binCount = std::min(BVH_SAH_BINS, std::max(4u, count));
+					float binScale = binCount / (centroidBounds.maxBounds[axis] - axisMin);
+					for (auto& reference : references)
+					{
+						float centroid = 0.5f * (reference.minBounds[axis] + reference.maxBounds[axis]);
+						unsigned int bin = std::min(binCount - 1, (unsigned int)((centroid - axisMin) * binScale));
+						(bin <= objectSplit.bin ? left : right).push_back(reference);
+					}
+				}
+				if (left.empty() || right.empty())
+				{
+					// All centroids coincide but there are too many for one leaf, so split the list in half
+					left.assign(references.begin(), references.begin() + count / 2);
+					right.assign(references.begin() + count / 2, references.end());
+				}
+			}
+		}
+
+		if (left.empty())
+		{
+			// Leaf
+			BVHNode& node = nodes[task.nodeIndex];
+			node.leftFirst = (unsigned int)primitiveIndices.size();
+			node.primitiveCount = count;
+			for (auto& reference : references)
+			{
+				primitiveIndices.push_back(reference.primitive);
+			}
+			stats.leafCount++;
+			stats.maxDepth = std::max(stats.maxDepth, task.depth);
+			continue;
+		}
+
+		// Create children next to each other
+		unsigned int leftChild = (unsigned int)nodes.size();
+		nodes.push_back(BVHNode());
+		nodes.push_back(BVHNode());
+		nodes[task.nodeIndex].leftFirst = leftChild;
+		nodes[task.nodeIndex].primitiveCount = 0;
+
+		std::vector<SpatialReference>().swap(references);
+		SpatialTask rightTask;
+		rightTask.nodeIndex = leftChild + 1;
+		rightTask.depth = task.depth + 1;
+		rightTask.references.swap(right);
+		stack.push_back(std::move(rightTask));
+		SpatialTask leftTask;
+		leftTask.nodeIndex = leftChild;
+		leftTask.depth = task.depth + 1;
+		leftTask.references.swap(left);
+		stack.push_back(std::move(leftTask));
+	}
+}
\ No newline at end of file
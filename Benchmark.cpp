@@ -0,0 +1,443 @@
+// Benchmark suite
+#include "Benchmark.h"
+
+// Standard libraries
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <memory>
+
+// RT Specific
+#include "Raytracer.h"
+#include "CpuFeatures.h"
+#include "NumaTopology.h"
+
+// Platform
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+double BenchmarkSample::getMean() const
+{
+	double sum = 0.0;
+	for (auto value : values)
+	{
+		sum += value;
+	}
+	return values.empty() ? 0.0 : sum / values.size();
+}
+
+double BenchmarkSample::getVariance() const
+{
+	if (values.size() < 2)
+	{
+		return 0.0;
+	}
+	double mean = getMean();
+	double sumSquares = 0.0;
+	for (auto value : values)
+	{
+		sumSquares += (value - mean) * (value - mean);
+	}
+	return sumSquares / (values.size() - 1);
+}
+
+double BenchmarkSample::getMin() const
+{
+	return values.empty() ? 0.0 : *std::min_element(values.begin(), values.end());
+}
+
+double BenchmarkSample::getMax() const
+{
+	return values.empty() ? 0.0 : *std::max_element(values.begin(), values.end());
+}
+
+std::vector<BenchmarkResolution> getBenchmarkResolutions()
+{
+	return { { 640, 480 }, { 1920, 1080 } };
+}
+
+std::vector<BenchmarkPreset> getBenchmarkPresets()
+{
+	// Every preset fits the object to the frame from the same view, lit from above and in front
+	RenderParameters view;
+	view.centreObject = true;
+	view.scaleObject = true;
+	view.rotationMatrix = Matrix4::RotationMultMat(Cartesian3(1.0f, 1.0f, 0.0f), (float)M_PI / 6.0f);
+	view.lightMatrix = Matrix4::RotationMultMat(Cartesian3(1.0f, 0.0f, 0.0f), -0.6f);
+
+	std::vector<BenchmarkPreset> presets;
+	presets.push_back({ "unlit", view });
+	RenderParameters lit = view;
+	lit.useLighting = true;
+	presets.push_back({ "lit", lit });
+	RenderParameters shadows = lit;
+	shadows.shadows = true;
+	presets.push_back({ "shadows", shadows });
+	RenderParameters textured = view;
+	textured.texturedRendering = true;
+	presets.push_back({ "textured", textured });
+	RenderParameters gamma = lit;
+	gamma.gammaCorrection = true;
+	presets.push_back({ "gamma", gamma });
+	RenderParameters full = shadows;
+	full.texturedRendering = true;
+	full.textureModulation = true;
+	full.gammaCorrection = true;
+	presets.push_back({ "full", full });
+	return presets;
+}
+
+BenchmarkScene getStressBenchmarkScene(const StressSceneSpec& spec)
+{
+	BenchmarkScene scene;
+	scene.name = getStressSceneName(spec);
+	scene.generated = true;
+	scene.stress = spec;
+	return scene;
+}
+
+std::vector<BenchmarkScene> getStressBenchmarkScenes()
+{
+	std::vector<BenchmarkScene> scenes;
+	for (const char* description : { "sphere:100k", "soup:100k", "slivers:10k", "terrain:1M", "sphere:10k:1000" })
+	{
+		StressSceneSpec spec;
+		std::string error;
+		parseStressScene(description, spec, error);
+		scenes.push_back(getStressBenchmarkScene(spec));
+	}
+	return scenes;
+}
+
+std::vector<BenchmarkScene> getStressSweepScenes(const StressSceneSpec& largest)
+{
+	std::vector<BenchmarkScene> scenes;
+	StressSceneSpec spec = largest;
+	for (spec.triangles = 1; spec.triangles < largest.triangles; spec.triangles *= 10)
+	{
+		scenes.push_back(getStressBenchmarkScene(spec));
+	}
+	scenes.push_back(getStressBenchmarkScene(largest));
+	return scenes;
+}
+
+// Memory the process holds now, and the most it has held, in megabytes. 0 where the platform can't say
+static void getResidentMemory(double& residentMbOut, double& peakMbOut)
+{
+	residentMbOut = 0.0;
+	peakMbOut = 0.0;
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		residentMbOut = counters.WorkingSetSize / 1048576.0;
+		peakMbOut = counters.PeakWorkingSetSize / 1048576.0;
+	}
+#elif defined(__linux__)
+	std::ifstream statm("/proc/self/statm");
+	size_t totalPages, residentPages;
+	if (statm >> totalPages >> residentPages)
+	{
+		residentMbOut = (double)residentPages * sysconf(_SC_PAGESIZE) / 1048576.0;
+	}
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+	{
+		// Kilobytes on Linux
+		peakMbOut = usage.ru_maxrss / 1024.0;
+	}
+#endif
+}
+
+// Quoted and escaped for JSON
+static std::string jsonString(const std::string& text)
+{
+	std::ostringstream quoted;
+	quoted << '"';
+	for (char character : text)
+	{
+		if (character == '"' || character == '\\')
+		{
+			quoted << '\\' << character;
+		}
+		else if ((unsigned char)character < 0x20)
+		{
+			quoted << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)character << std::dec << std::setfill(' ');
+		}
+		else
+		{
+			quoted << character;
+		}
+	}
+	quoted << '"';
+	return quoted.str();
+}
+
+// Written on one line, so a change in one measurement is a change in one line
+static void writeJsonSample(std::ostream& jsonStream, const BenchmarkSample& sample)
+{
+	jsonStream << std::fixed << std::setprecision(BENCHMARK_JSON_PRECISION)
+		<< "{ \"mean\": " << sample.getMean() << ", \"variance\": " << sample.getVariance() << ", \"stddev\": " << std::sqrt(sample.getVariance())
+		<< ", \"min\": " << sample.getMin() << ", \"max\": " << sample.getMax() << " }" << std::defaultfloat << std::setprecision(6);
+}
+
+static std::string getCompilerName()
+{
+	std::ostringstream name;
+#if defined(_MSC_VER)
+	name << "msvc " << _MSC_VER;
+#elif defined(__clang__)
+	name << "clang " << __clang_major__ << "." << __clang_minor__ << "." << __clang_patchlevel__;
+#elif defined(__GNUC__)
+	name << "gcc " << __GNUC__ << "." << __GNUC_MINOR__ << "." << __GNUC_PATCHLEVEL__;
+#else
+	name << "unknown";
+#endif
+#if defined(NDEBUG)
+	name << " release";
+#else
+	name << " debug";
+#endif
+	return name.str();
+}
+
+// The scene as the benchmark renders it, and how long reading and building it took
+struct LoadedScene
+{
+	std::unique_ptr<RaytraceTexturedObject> object;
+	BenchmarkSample loadMs;
+	BenchmarkSample buildMs;
+};
+
+// Read or generate the scene once per repeat, keeping the last copy
+static bool loadScene(const BenchmarkScene& scene, const BenchmarkSettings& settings, LoadedScene& loadedOut)
+{
+	for (unsigned int repeat = 0; repeat < settings.repeats; repeat++)
+	{
+		// The last copy is freed first, so memory measured after is this scene's alone
+		loadedOut.object.reset();
+		std::unique_ptr<RaytraceTexturedObject> object(new RaytraceTexturedObject());
+		configureObject(settings.options, *object);
+		// Built as it's read, so the build can be told apart from the read
+		object->setBackgroundBuild(false);
+
+		auto startTime = std::chrono::steady_clock::now();
+		if (scene.generated)
+		{
+			generateStressScene(scene.stress, *object);
+			double generateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			loadedOut.buildMs.add(object->getAcceleratorBuildTime());
+			loadedOut.loadMs.add(generateMs - object->getAcceleratorBuildTime());
+			loadedOut.object = std::move(object);
+			continue;
+		}
+		std::ifstream geometryFile(scene.geometryPath);
+		std::ifstream textureFile(scene.texturePath);
+		if (!geometryFile.good() || !textureFile.good() || !object->ReadObjectStream(geometryFile, textureFile))
+		{
+			std::cout << "Read failed for object " << scene.geometryPath << " or texture " << scene.texturePath << std::endl;
+			return false;
+		}
+		double readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		loadedOut.buildMs.add(object->getAcceleratorBuildTime());
+		loadedOut.loadMs.add(readMs - object->getAcceleratorBuildTime());
+		loadedOut.object = std::move(object);
+	}
+	return true;
+}
+
+// Render one scene at one resolution under one preset, writing its case object
+static void runBenchmarkCase(const BenchmarkScene& scene, RaytraceTexturedObject& object, const BenchmarkResolution& resolution,
+	const BenchmarkPreset& preset, const BenchmarkSettings& settings, std::ostream& jsonStream, unsigned int& threadsOut)
+{
+	RenderOptions options = settings.options;
+	options.renderParameters = preset.renderParameters;
+	options.lights.clear();
+	std::vector<std::unique_ptr<DirectionalLight>> lights = createLights(options);
+	std::vector<Light*> lightPointers;
+	for (auto& light : lights)
+	{
+		lightPointers.push_back(light.get());
+	}
+	RGBAImage frameBuffer;
+	frameBuffer.Resize(resolution.width, resolution.height);
+	Raytracer raytracer(&frameBuffer, &object, &lightPointers, &options.renderParameters);
+	configureRaytracer(options, raytracer);
+	if (scene.generated)
+	{
+		placeStressInstances(scene.stress, raytracer.getScene());
+	}
+	threadsOut = raytracer.getThreadCount();
+
+	std::ostringstream imageName;
+	imageName << scene.name << "-" << preset.name << "-" << resolution.width << "x" << resolution.height << ".ppm";
+
+	// One untimed frame first, so caches, page placement and the pool's threads are warm
+	raytracer.raytrace();
+	// and the timed frames leave printing out, which would be timed with them
+	raytracer.setQuiet(true);
+
+	BenchmarkSample frameMs, mraysPerSecond, transformMs, traceMs, shadeMs, writeMs;
+	for (unsigned int repeat = 0; repeat < settings.repeats; repeat++)
+	{
+		auto startTime = std::chrono::steady_clock::now();
+		raytracer.raytrace();
+		double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		frameMs.add(renderMs);
+		mraysPerSecond.add(raytracer.getRenderStats().rays / renderMs / 1000.0);
+		transformMs.add(raytracer.getTransformTime());
+		if (options.wavefront)
+		{
+			// Making rays counts towards tracing them, so shading is only the shade stage
+			const WavefrontStageTimes& times = raytracer.getWavefrontTimes();
+			traceMs.add(times.generateMs + times.primaryTraceMs + times.shadowGenerateMs + times.shadowSortMs + times.shadowTraceMs);
+			shadeMs.add(times.shadeMs);
+		}
+		else
+		{
+			// Tiles shade each hit as it's found, so tracing includes shading
+			traceMs.add(renderMs - raytracer.getTransformTime());
+		}
+
+		startTime = std::chrono::steady_clock::now();
+		if (settings.imageDirectory.empty())
+		{
+			std::ostringstream imageStream;
+			frameBuffer.WritePPM(imageStream);
+		}
+		else
+		{
+			std::ofstream imageFile(settings.imageDirectory + "/" + imageName.str());
+			frameBuffer.WritePPM(imageFile);
+		}
+		writeMs.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+	}
+
+	const RayStats& stats = raytracer.getRenderStats();
+	jsonStream << "        {" << std::endl
+		<< "          \"preset\": " << jsonString(preset.name) << "," << std::endl
+		<< "          \"width\": " << resolution.width << "," << std::endl
+		<< "          \"height\": " << resolution.height << "," << std::endl
+		<< "          \"rays\": " << stats.rays << "," << std::endl
+		<< "          \"node_visits\": " << stats.nodeVisits << "," << std::endl
+		<< "          \"primitive_tests\": " << stats.primitiveTests << "," << std::endl
+		<< "          \"frame_ms\": ";
+	writeJsonSample(jsonStream, frameMs);
+	jsonStream << "," << std::endl << "          \"mrays_per_second\": ";
+	writeJsonSample(jsonStream, mraysPerSecond);
+	jsonStream << "," << std::endl << "          \"transform_ms\": ";
+	writeJsonSample(jsonStream, transformMs);
+	jsonStream << "," << std::endl << "          \"trace_ms\": ";
+	writeJsonSample(jsonStream, traceMs);
+	jsonStream << "," << std::endl << "          \"shade_ms\": ";
+	if (options.wavefront)
+	{
+		writeJsonSample(jsonStream, shadeMs);
+	}
+	else
+	{
+		jsonStream << "null";
+	}
+	jsonStream << "," << std::endl << "          \"write_ms\": ";
+	writeJsonSample(jsonStream, writeMs);
+	jsonStream << std::endl << "        }";
+
+	std::cout << "Benchmark " << scene.name << " " << preset.name << " " << resolution.width << "x" << resolution.height << ": " << std::fixed
+		<< std::setprecision(2) << frameMs.getMean() << "ms +- " << std::sqrt(frameMs.getVariance()) << ", " << mraysPerSecond.getMean()
+		<< " Mrays/s" << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+bool runBenchmarkSuite(const std::vector<BenchmarkScene>& scenes, const BenchmarkSettings& settings, std::ostream& jsonStream)
+{
+	std::vector<BenchmarkResolution> resolutions = settings.resolutions.empty() ? getBenchmarkResolutions() : settings.resolutions;
+	std::vector<BenchmarkPreset> presets = settings.presets.empty() ? getBenchmarkPresets() : settings.presets;
+	const RenderOptions& options = settings.options;
+
+	// Scenes are written first, as the header reports the thread count the raytracer settled on
+	std::ostringstream scenesJson;
+	unsigned int threads = 0;
+	for (size_t sceneIndex = 0; sceneIndex < scenes.size(); sceneIndex++)
+	{
+		const BenchmarkScene& scene = scenes[sceneIndex];
+		LoadedScene loaded;
+		if (!loadScene(scene, settings, loaded))
+		{
+			return false;
+		}
+		RaytraceTexturedObject& object = *loaded.object;
+		double residentMb, peakResidentMb;
+		getResidentMemory(residentMb, peakResidentMb);
+		std::cout << "Benchmark " << scene.name << ": " << object.getTriangleCount() << " triangles, loaded in " << loaded.loadMs.getMean()
+			<< "ms, built in " << loaded.buildMs.getMean() << "ms, " << residentMb << "MB resident" << std::endl;
+
+		scenesJson << "    {" << std::endl
+			<< "      \"name\": " << jsonString(scene.name) << "," << std::endl
+			<< "      \"geometry\": " << jsonString(scene.geometryPath) << "," << std::endl
+			<< "      \"texture\": " << jsonString(scene.texturePath) << "," << std::endl
+			<< "      \"generated\": " << (scene.generated ? "true" : "false") << "," << std::endl
+			<< "      \"triangles\": " << object.getTriangleCount() << "," << std::endl
+			<< "      \"vertices\": " << object.vertices.size() << "," << std::endl
+			<< "      \"instances\": " << (scene.generated ? scene.stress.instances : 1) << "," << std::endl
+			<< "      \"accelerator\": " << jsonString(object.getAcceleratorName()) << "," << std::endl
+			<< "      \"load_ms\": ";
+		writeJsonSample(scenesJson, loaded.loadMs);
+		scenesJson << "," << std::endl << "      \"build_ms\": ";
+		writeJsonSample(scenesJson, loaded.buildMs);
+		// With the scene loaded and built, before rendering
+		scenesJson << "," << std::endl << std::fixed << std::setprecision(BENCHMARK_JSON_PRECISION)
+			<< "      \"resident_mb\": " << residentMb << "," << std::endl
+			<< "      \"peak_resident_mb\": " << peakResidentMb << std::defaultfloat << std::setprecision(6);
+		scenesJson << "," << std::endl << "      \"cases\": [" << std::endl;
+		bool firstCase = true;
+		for (auto& resolution : resolutions)
+		{
+			for (auto& preset : presets)
+			{
+				if (!firstCase)
+				{
+					scenesJson << "," << std::endl;
+				}
+				firstCase = false;
+				runBenchmarkCase(scene, object, resolution, preset, settings, scenesJson, threads);
+			}
+		}
+		scenesJson << std::endl << "      ]" << std::endl << "    }" << (sceneIndex + 1 < scenes.size() ? "," : "") << std::endl;
+	}
+
+	// Header first, so everything describing the machine and settings sits together
+	jsonStream << std::boolalpha << "{" << std::endl
+		<< "  \"version\": " << BENCHMARK_JSON_VERSION << "," << std::endl
+		<< "  \"compiler\": " << jsonString(getCompilerName()) << "," << std::endl;
+	const CpuFeatures& cpu = getCpuFeatures();
+	jsonStream << "  \"cpu_features\": { \"sse2\": " << cpu.sse2 << ", \"sse41\": " << cpu.sse41 << ", \"avx\": " << cpu.avx
+		<< ", \"avx2\": " << cpu.avx2 << ", \"fma\": " << cpu.fma << " }," << std::endl
+		<< "  \"hardware_threads\": " << std::thread::hardware_concurrency() << "," << std::endl
+		<< "  \"numa_nodes\": " << detectNumaTopology().getNodeCount() << "," << std::endl
+		<< "  \"threads\": " << threads << "," << std::endl
+		<< "  \"repeats\": " << settings.repeats << "," << std::endl
+		<< "  \"packet_width\": " << options.packetWidth << "," << std::endl
+		<< "  \"wavefront\": " << options.wavefront << "," << std::endl
+		<< "  \"tile_size\": " << options.tileSize << "," << std::endl
+		<< "  \"projection\": " << jsonString(options.projectionMode == RT_PERSPECTIVE ? "perspective" : "ortho") << "," << std::endl
+		<< "  \"numa_aware\": " << options.numaAware << "," << std::endl
+		<< "  \"scenes\": [" << std::endl
+		<< scenesJson.str()
+		<< "  ]" << std::endl
+		<< "}" << std::noboolalpha << std::endl;
+	return true;
+}
@@ -0,0 +1,85 @@
+// Benchmark suite
+// Renders each scene at fixed resolutions under fixed RenderParameters presets, covering lighting, shadows, texturing
+// and gamma, and times every stage of the frame over repeated runs: loading, placing the scene, building its structure,
+// tracing, shading and writing the image. Results are written as JSON with a fixed layout and precision, so runs from
+// two builds can be diffed line by line. Scenes may be generated stress scenes instead of files, and sweeps of them
+// over triangle counts show how the structures, threads and memory scale
+#pragma once
+
+// Standard libraries
+#include <string>
+#include <vector>
+#include <ostream>
+
+// RT Specific
+#include "RenderOptions.h"
+#include "StressScene.h"
+
+// Constants
+const unsigned int BENCHMARK_REPEATS_DEFAULT = 5;
+// Version of the JSON layout, raised whenever fields change meaning
+const unsigned int BENCHMARK_JSON_VERSION = 2;
+// Decimal places of every time and rate written
+const int BENCHMARK_JSON_PRECISION = 3;
+
+// A mesh and texture to render, read from files or generated
+struct BenchmarkScene
+{
+	std::string name;
+	std::string geometryPath;
+	std::string texturePath;
+	bool generated = false;
+	StressSceneSpec stress;
+};
+
+// Named render parameters every scene is rendered with
+struct BenchmarkPreset
+{
+	std::string name;
+	RenderParameters renderParameters;
+};
+
+struct BenchmarkResolution
+{
+	long width;
+	long height;
+};
+
+struct BenchmarkSettings
+{
+	// Structure and raytracer settings shared by every case. Their render parameters and lights are replaced by
+	// each preset's
+	RenderOptions options;
+	unsigned int repeats = BENCHMARK_REPEATS_DEFAULT;
+	std::vector<BenchmarkResolution> resolutions;
+	std::vector<BenchmarkPreset> presets;
+	// Where each case's image is saved, empty to only write it to memory
+	std::string imageDirectory;
+};
+
+// Mean and spread of one measurement over the repeats
+struct BenchmarkSample
+{
+	std::vector<double> values;
+
+	void add(double value) { values.push_back(value); };
+	double getMean() const;
+	// Sample variance, 0 for fewer than two values
+	double getVariance() const;
+	double getMin() const;
+	double getMax() const;
+};
+
+// The fixed resolutions and presets, unless the settings name their own
+std::vector<BenchmarkResolution> getBenchmarkResolutions();
+std::vector<BenchmarkPreset> getBenchmarkPresets();
+
+BenchmarkScene getStressBenchmarkScene(const StressSceneSpec& spec);
+// Stress scenes run when no scenes are given: each shape at a size that renders in seconds, and many instances
+std::vector<BenchmarkScene> getStressBenchmarkScenes();
+// The stress scene at every power of ten triangles from 1 up to its own count, which ends the sweep
+std::vector<BenchmarkScene> getStressSweepScenes(const StressSceneSpec& largest);
+
+// Render every scene at every resolution under every preset, writing the results to the stream as JSON and progress to
+// std::cout. Returns false if a scene couldn't be read
+bool runBenchmarkSuite(const std::vector<BenchmarkScene>& scenes, const BenchmarkSettings& settings, std::ostream& jsonStream);
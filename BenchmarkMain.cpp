@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  -----------------------------
+//  BenchmarkMain.cpp
+//  -----------------------------
+//
+//  Runs the benchmark suite over the scenes given, writing the results
+//  as JSON. Built with RT_HEADLESS defined, like the headless renderer,
+//  and RT_BENCHMARK, which takes the main routine from HeadlessMain.cpp.
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifdef RT_BENCHMARK
+
+// system libraries
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// local includes
+#include "Benchmark.h"
+
+// print the options the benchmark takes on top of the renderer's
+static void printBenchmarkUsage(const char *program)
+    { // printBenchmarkUsage()
+    std::cout << "Usage: " << program << " [--option value ...] [geometry texture ...]" << std::endl
+        << "  --generate SHAPE:TRIANGLES[:INSTANCES[:SEED]]   stress scene to run, repeatable" << std::endl
+        << "  --sweep SHAPE:TRIANGLES[:INSTANCES[:SEED]]      the stress scene at every power of ten triangles up to its own" << std::endl
+        << "                           shapes are sphere, soup, slivers and terrain; with no scenes, a fixed set of them runs" << std::endl
+        << "  --json FILE              results written here, benchmark.json by default" << std::endl
+        << "  --repeats N              timed runs of every stage, " << BENCHMARK_REPEATS_DEFAULT << " by default" << std::endl
+        << "  --resolution WxH         replaces the fixed resolutions, repeatable" << std::endl
+        << "  --preset NAME            only this preset, repeatable:";
+    for (auto &preset : getBenchmarkPresets())
+        std::cout << " " << preset.name;
+    std::cout << std::endl
+        << "  --images DIR             save every case's image here" << std::endl
+        << "Structure and rendering options are as the headless renderer's, such as --accelerator, --threads or --wavefront." << std::endl
+        << "Lighting, texturing and the view come from the presets." << std::endl;
+    } // printBenchmarkUsage()
+
+// the geometry file's name without its directory or extension
+static std::string sceneName(const std::string &path)
+    { // sceneName()
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    return name.substr(0, name.rfind('.'));
+    } // sceneName()
+
+// main routine
+int main(int argc, char **argv)
+    { // main()
+    BenchmarkSettings settings;
+    std::vector<BenchmarkScene> scenes;
+    std::string jsonPath("benchmark.json");
+    std::vector<std::string> presetNames;
+    std::vector<std::string> files;
+    std::string error;
+
+    for (int i = 1; i < argc; i++)
+        { // each argument
+        std::string argument(argv[i]);
+        if (argument.compare(0, 2, "--") != 0)
+            { // scene file
+            files.push_back(argument);
+            continue;
+            } // scene file
+        std::string name = argument.substr(2);
+        // switches may leave out their value to mean on
+        std::string value("on");
+        if (!isRenderSwitchWithoutValue(name, i + 1 < argc ? argv[i + 1] : nullptr))
+            { // value given
+            if (i + 1 == argc)
+                { // no value
+                error = "no value for " + name;
+                break;
+                } // no value
+            value = argv[++i];
+            } // value given
+        if (name == "json")
+            jsonPath = value;
+        else if (name == "images")
+            settings.imageDirectory = value;
+        else if (name == "preset")
+            presetNames.push_back(value);
+        else if (name == "generate" || name == "sweep")
+            { // stress scenes
+            StressSceneSpec spec;
+            if (!parseStressScene(value, spec, error))
+                break;
+            if (name == "sweep")
+                { // sweep
+                std::vector<BenchmarkScene> sweep = getStressSweepScenes(spec);
+                scenes.insert(scenes.end(), sweep.begin(), sweep.end());
+                } // sweep
+            else
+                scenes.push_back(getStressBenchmarkScene(spec));
+            } // stress scenes
+        else if (name == "repeats")
+            { // repeats
+            if (!parseUnsigned(value, settings.repeats) || settings.repeats == 0)
+                error = "bad value \"" + value + "\" for repeats";
+            } // repeats
+        else if (name == "resolution")
+            { // resolution
+            // as the renderer's own width and height, each side a whole number above zero
+            size_t separator = value.find('x');
+            unsigned int width = 0, height = 0;
+            if (separator == std::string::npos || !parseUnsigned(value.substr(0, separator), width) || !parseUnsigned(value.substr(separator + 1), height) ||
+                width == 0 || height == 0)
+                error = "bad value \"" + value + "\" for resolution";
+            BenchmarkResolution resolution;
+            resolution.width = (long)width;
+            resolution.height = (long)height;
+            settings.resolutions.push_back(resolution);
+            } // resolution
+        else if (!applyRenderOption(settings.options, name, value, error))
+            break;
+        if (!error.empty())
+            break;
+        } // each argument
+
+    // scenes come in pairs of geometry and texture
+    if (error.empty() && files.size() % 2 != 0)
+        error = "a geometry and texture file are needed for each scene";
+    for (size_t i = 0; error.empty() && i < files.size(); i += 2)
+        { // scene files
+        BenchmarkScene scene;
+        scene.name = sceneName(files[i]);
+        scene.geometryPath = files[i];
+        scene.texturePath = files[i + 1];
+        scenes.push_back(scene);
+        } // scene files
+    if (scenes.empty())
+        scenes = getStressBenchmarkScenes();
+
+    // keep the presets asked for, in the suite's order
+    for (auto &preset : getBenchmarkPresets())
+        for (auto &presetName : presetNames)
+            if (preset.name == presetName)
+                settings.presets.push_back(preset);
+    if (error.empty() && settings.presets.size() != presetNames.size())
+        error = "unknown preset";
+
+    if (!error.empty())
+        { // bad arguments
+        std::cout << "Error: " << error << std::endl;
+        printBenchmarkUsage(argv[0]);
+        return 1;
+        } // bad arguments
+
+    // results go to a file, as the renderer reports progress on standard output
+    std::ofstream jsonFile(jsonPath);
+    if (!jsonFile.good())
+        { // open failed
+        std::cout << "Could not write results to " << jsonPath << std::endl;
+        return 1;
+        } // open failed
+    if (!runBenchmarkSuite(scenes, settings, jsonFile))
+        return 1;
+    std::cout << "Wrote " << jsonPath << std::endl;
+    return 0;
+    } // main()
+
+#endif // RT_BENCHMARK
@@ -0,0 +1,192 @@
+// Brute force accelerator
+#include "BruteForce.h"
+
+// Standard libraries
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+BruteForce::BruteForce() : triangleKernelWidth(TRIANGLE_KERNEL_AUTO)
+{
+}
+
+// Spread the low 10 bits of a value to every third bit
+static unsigned int expandBits10(unsigned int value)
+{
+	value &= 0x3ff;
+	value = (value | value << 16) & 0x030000ff;
+	value = (value | value << 8) & 0x0300f00f;
+	value = (value | value << 4) & 0x030c30c3;
+	value = (value | value << 2) & 0x09249249;
+	return value;
+}
+
+// Box around a range of entries, as a BVH leaf
+static BVHNode makeLeaf(unsigned int first, unsigned int count, const AABB& box)
+{
+	BVHNode leaf;
+	leaf.leftFirst = first;
+	leaf.primitiveCount = count;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		leaf.minBounds[axis] = box.minBounds[axis];
+		leaf.maxBounds[axis] = box.maxBounds[axis];
+	}
+	return leaf;
+}
+
+void BruteForce::build(const std::vector<Cartesian3>& triangleVertices)
+{
+	unsigned int triangleCount = (unsigned int)(triangleVertices.size() / 3);
+
+	// Morton codes of the centroids on a 2^10 grid per axis, so neighbouring entries are near each other
+	std::vector<Cartesian3> centroids(triangleCount);
+	AABB centroidBounds;
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		centroids[i] = (triangleVertices[3 * i] + triangleVertices[3 * i + 1] + triangleVertices[3 * i + 2]) / 3.0f;
+		centroidBounds.grow(centroids[i]);
+	}
+	std::vector<std::pair<unsigned int, unsigned int>> codes(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		const Cartesian3& centroid = centroids[i];
+		unsigned int code = 0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = centroidBounds.maxBounds[axis] - centroidBounds.minBounds[axis];
+			float cell = extent > 0.0f ? (centroid[axis] - centroidBounds.minBounds[axis]) / extent * 1024.0f : 0.0f;
+			code |= expandBits10((unsigned int)std::min(1023.0f, std::max(0.0f, cell))) << (2 - axis);
+		}
+		codes[i] = std::make_pair(code, i);
+	}
+	std::sort(codes.begin(), codes.end());
+	references.resize(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		references[i] = codes[i].second;
+	}
+	triangleStore.build(triangleVertices, references, triangleKernelWidth);
+
+	runs.clear();
+	groups.clear();
+	bounds = AABB();
+	AABB groupBounds;
+	for (unsigned int first = 0; first < triangleCount; first += BRUTE_FORCE_RUN_SIZE)
+	{
+		unsigned int count = std::min(BRUTE_FORCE_RUN_SIZE, triangleCount - first);
+		AABB runBounds;
+		for (unsigned int i = first; i < first + count; i++)
+		{
+			runBounds.grow(triangleVertices[3 * references[i]]);
+			runBounds.grow(triangleVertices[3 * references[i] + 1]);
+			runBounds.grow(triangleVertices[3 * references[i] + 2]);
+		}
+		runs.push_back(makeLeaf(first, count, runBounds));
+		groupBounds.grow(runBounds);
+
+		// Close the group when full or at the last run
+		unsigned int groupFirst = (unsigned int)(groups.size() * BRUTE_FORCE_GROUP_SIZE);
+		if (runs.size() - groupFirst == BRUTE_FORCE_GROUP_SIZE || first + count == triangleCount)
+		{
+			groups.push_back(makeLeaf(groupFirst, (unsigned int)runs.size() - groupFirst, groupBounds));
+			bounds.grow(groupBounds);
+			groupBounds = AABB();
+		}
+	}
+}
+
+void BruteForce::clear()
+{
+	runs = std::vector<BVHNode>();
+	groups = std::vector<BVHNode>();
+	references = std::vector<unsigned int>();
+	triangleStore = TriangleStore();
+	bounds = AABB();
+}
+
+bool BruteForce::intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const
+{
+	Cartesian3 rayOrigin = ray.getOrigin();
+	Cartesian3 rayDirection = ray.getDirection();
+	Cartesian3 inverseDirection(1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z);
+	float origin[3] = { rayOrigin.x, rayOrigin.y, rayOrigin.z };
+	float direction[3] = { rayDirection.x, rayDirection.y, rayDirection.z };
+	RayStats& threadStats = rayStats;
+
+	// Groups are in Morton order rather than near to far, so every group is tested, culled by the nearest hit so far
+	float tClosest = tMax;
+	unsigned int nearestEntry = 0;
+	bool hit = false;
+	for (auto& group : groups)
+	{
+		threadStats.nodeVisits++;
+		if (intersectNodeBounds(group, rayOrigin, inverseDirection, tMin, tClosest) == std::numeric_limits<float>::infinity())
+		{
+			continue;
+		}
+		for (unsigned int i = group.leftFirst; i < group.leftFirst + group.primitiveCount; i++)
+		{
+			const BVHNode& run = runs[i];
+			threadStats.nodeVisits++;
+			if (intersectNodeBounds(run, rayOrigin, inverseDirection, tMin, tClosest) == std::numeric_limits<float>::infinity())
+			{
+				continue;
+			}
+			threadStats.primitiveTests += run.primitiveCount;
+			if (triangleStore.intersectNearest(run.leftFirst, run.primitiveCount, origin, direction, tMin, tClosest, hitOut.u, hitOut.v, nearestEntry))
+			{
+				hit = true;
+			}
+		}
+	}
+	if (hit)
+	{
+		hitOut.t = tClosest;
+		hitOut.triangle = references[nearestEntry];
+	}
+	return hit;
+}
+
+bool BruteForce::intersectAny(const Ray& ray, float tMin, float tMax) const
+{
+	Cartesian3 rayOrigin = ray.getOrigin();
+	Cartesian3 rayDirection = ray.getDirection();
+	Cartesian3 inverseDirection(1.0f / rayDirection.x, 1.0f / rayDirection.y, 1.0f / rayDirection.z);
+	float origin[3] = { rayOrigin.x, rayOrigin.y, rayOrigin.z };
+	float direction[3] = { rayDirection.x, rayDirection.y, rayDirection.z };
+	RayStats& threadStats = rayStats;
+
+	for (auto& group : groups)
+	{
+		threadStats.nodeVisits++;
+		if (intersectNodeBounds(group, rayOrigin, inverseDirection, tMin, tMax) == std::numeric_limits<float>::infinity())
+		{
+			continue;
+		}
+		for (unsigned int i = group.leftFirst; i < group.leftFirst + group.primitiveCount; i++)
+		{
+			const BVHNode& run = runs[i];
+			threadStats.nodeVisits++;
+			if (intersectNodeBounds(run, rayOrigin, inverseDirection, tMin, tMax) == std::numeric_limits<float>::infinity())
+			{
+				continue;
+			}
+			threadStats.primitiveTests += run.primitiveCount;
+			if (triangleStore.intersectAny(run.leftFirst, run.primitiveCount, origin, direction, tMin, tMax))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// Entries name triangles, the triangle store holds their vertices
+void BruteForce::remapTriangles(const std::vector<unsigned int>& newIndices)
+{
+	for (auto& reference : references)
+	{
+		reference = newIndices[reference];
+	}
+}
@@ -0,0 +1,49 @@
+// Brute force accelerator
+// Triangles are sorted along a Morton curve through their centroids and cut into fixed runs, with fixed groups of runs
+// above them. Every group is tested with no ordering or culling beyond the boxes, but it builds in a sort and one pass,
+// so a freshly loaded mesh can be traced at once while a real structure builds in the background
+#pragma once
+
+// Standard libraries
+#include <vector>
+
+// RT Specific
+#include "Accelerator.h"
+#include "BVH.h"
+#include "TriangleStore.h"
+
+// Constants
+// Triangles per run and runs per group
+const unsigned int BRUTE_FORCE_RUN_SIZE = 32;
+const unsigned int BRUTE_FORCE_GROUP_SIZE = 32;
+
+class BruteForce : public Accelerator
+{
+private:
+	// Box and range of entries of each run, and of runs of each group, stored as BVH leaves so they share its box test
+	std::vector<BVHNode> runs;
+	std::vector<BVHNode> groups;
+	// Triangle behind each entry, in Morton order
+	std::vector<unsigned int> references;
+	// Vertices and edges of the triangles in reference order
+	TriangleStore triangleStore;
+	AABB bounds;
+public:
+	// Triangles per leaf test, one of the TRIANGLE_KERNEL constants
+	unsigned int triangleKernelWidth;
+
+	// Constructor
+	BruteForce();
+
+	void build(const std::vector<Cartesian3>& triangleVertices);
+	// Free everything once the real structure takes over
+	void clear();
+	bool isEmpty() const { return references.empty(); };
+	bool intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const;
+	bool intersectAny(const Ray& ray, float tMin, float tMax) const;
+	const std::vector<unsigned int>& getTriangleReferences() const { return references; };
+	void remapTriangles(const std::vector<unsigned int>& newIndices);
+	AABB getBounds() const { return bounds; };
+	const char* getName() const { return "brute force"; };
+	Accelerator* clone() const { return new BruteForce(*this); };
+};
@@ -0,0 +1,89 @@
+// Runtime detection of SIMD instruction sets
+#include "CpuFeatures.h"
+
+// Standard libraries
+#include <iostream>
+
+#ifdef RT_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef RT_X86
+// Registers returned by cpuid for a leaf and subleaf
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+	int values[4];
+	__cpuidex(values, (int)leaf, (int)subleaf);
+	for (int i = 0; i < 4; i++)
+	{
+		registers[i] = (unsigned int)values[i];
+	}
+#else
+	__cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// Extended control register, tells which register states the OS saves
+static unsigned long long readXCR0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int low, high;
+	__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+	return ((unsigned long long)high << 32) | low;
+#endif
+}
+#endif
+
+static CpuFeatures detectCpuFeatures()
+{
+	CpuFeatures features = CpuFeatures();
+#ifdef RT_X86
+	unsigned int registers[4];
+	cpuid(0, 0, registers);
+	unsigned int maxLeaf = registers[0];
+	if (maxLeaf < 1)
+	{
+		return features;
+	}
+
+	cpuid(1, 0, registers);
+	features.sse2 = (registers[3] & (1u << 26)) != 0;
+	features.sse41 = (registers[2] & (1u << 19)) != 0;
+	bool osSavesRegisters = (registers[2] & (1u << 27)) != 0;
+	bool cpuHasAVX = (registers[2] & (1u << 28)) != 0;
+	bool cpuHasFMA = (registers[2] & (1u << 12)) != 0;
+
+	// Both SSE and AVX register state must be enabled by the OS
+	if (osSavesRegisters && cpuHasAVX && (readXCR0() & 0x6) == 0x6)
+	{
+		features.avx = true;
+		features.fma = cpuHasFMA;
+		if (maxLeaf >= 7)
+		{
+			cpuid(7, 0, registers);
+			features.avx2 = (registers[1] & (1u << 5)) != 0;
+		}
+	}
+#endif
+	return features;
+}
+
+const CpuFeatures& getCpuFeatures()
+{
+	static const CpuFeatures features = detectCpuFeatures();
+	return features;
+}
+
+// stream output for the supported instruction sets
+std::ostream& operator << (std::ostream& outStream, const CpuFeatures& value)
+{
+	outStream << "CPU features:" << (value.sse2 ? " SSE2" : "") << (value.sse41 ? " SSE4.1" : "") << (value.avx ? " AVX" : "") << (value.avx2 ? " AVX2" : "") << (value.fma ? " FMA" : "");
+	return outStream;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+// Runtime detection of SIMD instruction sets
+// SIMD kernels are compiled for their instruction set per function and only called when the CPU supports it,
+// so one binary runs on older machines
+#pragma once
+
+// Standard libraries
+#include <ostream>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define RT_X86 1
+#endif
+
+// Compile a single function for an instruction set. MSVC allows intrinsics anywhere, so needs nothing
+#if defined(RT_X86) && defined(__GNUC__)
+#define RT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RT_TARGET(isa)
+#endif
+
+struct CpuFeatures
+{
+	bool sse2;
+	bool sse41;
+	// AVX also requires the OS to save the wider registers
+	bool avx;
+	bool avx2;
+	bool fma;
+};
+
+// Detected once, on first use
+const CpuFeatures& getCpuFeatures();
+
+// stream output for the supported instruction sets
+std::ostream& operator << (std::ostream& outStream, const CpuFeatures& value);
\ No newline at end of file
@@ -0,0 +1,654 @@
+// Rendering one frame across several processes
+#include "DistributedRender.h"
+
+// Standard libraries
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+// RT Specific
+#include "Raytracer.h"
+#include "DirectionalLight.h"
+
+// Milliseconds since a time
+static double millisecondsSince(std::chrono::steady_clock::time_point startTime)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// Everything a worker needs to trace the same view, in a fixed order
+static void writeRenderParameters(RenderMessage& message, const RenderParameters& parameters)
+{
+	message.writeFloat(parameters.xTranslate);
+	message.writeFloat(parameters.yTranslate);
+	message.writeFloat(parameters.zoomScale);
+	for (int i = 0; i < 4; i++)
+	{
+		message.writeFloat(parameters.lightPosition[i]);
+		message.writeFloat(parameters.lightColor[i]);
+	}
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			message.writeFloat(parameters.rotationMatrix[row][col]);
+			message.writeFloat(parameters.lightMatrix[row][col]);
+		}
+	}
+	message.writeFloat(parameters.emissive);
+	message.writeFloat(parameters.ambient);
+	message.writeFloat(parameters.diffuse);
+	message.writeFloat(parameters.specular);
+	message.writeFloat(parameters.specularExponent);
+	const bool flags[] = { parameters.useLighting, parameters.texturedRendering, parameters.textureModulation, parameters.centreObject,
+		parameters.scaleObject, parameters.mapUVWToRGB, parameters.gammaCorrection, parameters.shadows };
+	for (auto flag : flags)
+	{
+		message.writeUInt(flag ? 1 : 0);
+	}
+}
+
+static void readRenderParameters(RenderMessage& message, RenderParameters& parametersOut)
+{
+	parametersOut.xTranslate = message.readFloat();
+	parametersOut.yTranslate = message.readFloat();
+	parametersOut.zoomScale = message.readFloat();
+	for (int i = 0; i < 4; i++)
+	{
+		parametersOut.lightPosition[i] = message.readFloat();
+		parametersOut.lightColor[i] = message.readFloat();
+	}
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			parametersOut.rotationMatrix[row][col] = message.readFloat();
+			parametersOut.lightMatrix[row][col] = message.readFloat();
+		}
+	}
+	parametersOut.emissive = message.readFloat();
+	parametersOut.ambient = message.readFloat();
+	parametersOut.diffuse = message.readFloat();
+	parametersOut.specular = message.readFloat();
+	parametersOut.specularExponent = message.readFloat();
+	bool* flags[] = { &parametersOut.useLighting, &parametersOut.texturedRendering, &parametersOut.textureModulation, &parametersOut.centreObject,
+		&parametersOut.scaleObject, &parametersOut.mapUVWToRGB, &parametersOut.gammaCorrection, &parametersOut.shadows };
+	for (auto flag : flags)
+	{
+		*flag = message.readUInt() != 0;
+	}
+}
+
+// Pixel rows and columns of a tile
+struct DistributedTile
+{
+	unsigned int rowBegin;
+	unsigned int rowEnd;
+	unsigned int colBegin;
+	unsigned int colEnd;
+};
+
+RenderCoordinator::WorkerConnection::~WorkerConnection()
+{
+	if (uploadThread.joinable())
+	{
+		uploadThread.join();
+	}
+}
+
+RenderCoordinator::RenderCoordinator(const std::string& newGeometryText, const std::string& newTextureText, unsigned int newAcceleratorType) :
+	sceneMessage(DISTRIBUTED_MESSAGE_SCENE), stallTimeoutMs(DISTRIBUTED_STALL_TIMEOUT_MS), frameNumber(0), lastFrameMs(0.0)
+{
+	sceneMessage.writeString(newGeometryText);
+	sceneMessage.writeString(newTextureText);
+	sceneMessage.writeUInt(newAcceleratorType);
+}
+
+RenderCoordinator::~RenderCoordinator()
+{
+	for (auto& worker : workers)
+	{
+		if (worker->uploadThread.joinable())
+		{
+			worker->uploadThread.join();
+		}
+		worker->socket.send(RenderMessage(DISTRIBUTED_MESSAGE_QUIT));
+	}
+}
+
+bool RenderCoordinator::listen(unsigned short port)
+{
+	if (!listener.listen(port))
+	{
+		std::cout << "Could not listen for render workers on port " << port << std::endl;
+		return false;
+	}
+	std::cout << "Listening for render workers on port " << getPort() << std::endl;
+	return true;
+}
+
+void RenderCoordinator::acceptWorker()
+{
+	std::unique_ptr<WorkerConnection> worker(new WorkerConnection());
+	worker->socket = listener.accept();
+	if (!worker->socket.isOpen())
+	{
+		return;
+	}
+	worker->socket.setTimeout(stallTimeoutMs);
+	worker->stats.name = worker->socket.getPeerName();
+	worker->lastHeard = std::chrono::steady_clock::now();
+	std::cout << "Render worker " << worker->stats.name << " connected, sending the scene" << std::endl;
+	// Scenes can take a while to send, and the frame goes on meanwhile. A failed send leaves the socket closed
+	WorkerConnection* connection = worker.get();
+	connection->uploading = true;
+	connection->uploadThread = std::thread([this, connection]()
+	{
+		connection->socket.send(sceneMessage);
+		connection->uploading = false;
+	});
+	workers.push_back(std::move(worker));
+}
+
+void RenderCoordinator::finishUploads()
+{
+	for (auto& worker : workers)
+	{
+		if (worker->uploadThread.joinable() && !worker->uploading)
+		{
+			worker->uploadThread.join();
+			if (!worker->socket.isOpen())
+			{
+				worker->stats.alive = false;
+				std::cout << "Render worker " << worker->stats.name << " disconnected while being sent the scene" << std::endl;
+			}
+		}
+	}
+}
+
+std::vector<const RenderSocket*> RenderCoordinator::getPolledSockets(std::vector<WorkerConnection*>& workersOut) const
+{
+	std::vector<const RenderSocket*> sockets(1, &listener);
+	workersOut.clear();
+	for (auto& worker : workers)
+	{
+		if (!worker->uploading && worker->socket.isOpen())
+		{
+			sockets.push_back(&worker->socket);
+			workersOut.push_back(worker.get());
+		}
+	}
+	return sockets;
+}
+
+void RenderCoordinator::dropWorker(WorkerConnection& worker, std::deque<size_t>& pendingTiles, const char* reason)
+{
+	worker.socket.close();
+	worker.stats.alive = false;
+	worker.stats.tilesLost += worker.tilesOut.size();
+	std::cout << "Render worker " << worker.stats.name << " " << reason << ", " << worker.tilesOut.size() << " tiles reassigned" << std::endl;
+	// Back at the front, as the frame is waiting on them more than on the rest
+	pendingTiles.insert(pendingTiles.begin(), worker.tilesOut.begin(), worker.tilesOut.end());
+	worker.tilesOut.clear();
+}
+
+size_t RenderCoordinator::getConnectedCount() const
+{
+	size_t count = 0;
+	for (auto& worker : workers)
+	{
+		// A worker being sent the scene is connected, but its socket is the upload thread's to read
+		if (worker->uploading || worker->socket.isOpen())
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+size_t RenderCoordinator::acceptWorkers(size_t count, unsigned int timeoutMs)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	size_t readyCount = 0;
+	while (true)
+	{
+		finishUploads();
+		readyCount = 0;
+		for (auto& worker : workers)
+		{
+			if (!worker->uploading && worker->ready && worker->socket.isOpen())
+			{
+				readyCount++;
+			}
+		}
+		double waitedMs = millisecondsSince(startTime);
+		if (readyCount >= count || waitedMs >= timeoutMs)
+		{
+			break;
+		}
+
+		std::vector<WorkerConnection*> polledWorkers;
+		std::vector<const RenderSocket*> sockets = getPolledSockets(polledWorkers);
+		for (auto index : RenderSocket::waitReadable(sockets, std::min((unsigned int)(timeoutMs - waitedMs) + 1, DISTRIBUTED_POLL_MS)))
+		{
+			if (index == 0)
+			{
+				acceptWorker();
+				continue;
+			}
+			WorkerConnection& worker = *polledWorkers[index - 1];
+			RenderMessage message;
+			if (!worker.socket.receive(message))
+			{
+				std::cout << "Render worker " << worker.stats.name << " disconnected while loading" << std::endl;
+				continue;
+			}
+			if (message.type == DISTRIBUTED_MESSAGE_READY)
+			{
+				worker.ready = true;
+				worker.stats.threads = message.readUInt();
+				std::cout << "Render worker " << worker.stats.name << " ready with " << worker.stats.threads << " threads" << std::endl;
+			}
+		}
+	}
+	return readyCount;
+}
+
+bool RenderCoordinator::render(RGBAImage& image, const RenderParameters& renderParameters, unsigned int projectionMode)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	frameNumber++;
+
+	// Workers lost last frame are forgotten, the rest start counting again
+	finishUploads();
+	workers.erase(std::remove_if(workers.begin(), workers.end(), [](const std::unique_ptr<WorkerConnection>& worker) { return !worker->uploading && !worker->socket.isOpen(); }), workers.end());
+	for (auto& worker : workers)
+	{
+		DistributedWorkerStats fresh;
+		fresh.name = worker->stats.name;
+		fresh.threads = worker->stats.threads;
+		worker->stats = fresh;
+	}
+
+	std::vector<DistributedTile> tiles;
+	for (unsigned int row = 0; row < (unsigned int)image.height; row += DISTRIBUTED_TILE_SIZE)
+	{
+		for (unsigned int col = 0; col < (unsigned int)image.width; col += DISTRIBUTED_TILE_SIZE)
+		{
+			DistributedTile tile = { row, std::min(row + DISTRIBUTED_TILE_SIZE, (unsigned int)image.height),
+				col, std::min(col + DISTRIBUTED_TILE_SIZE, (unsigned int)image.width) };
+			tiles.push_back(tile);
+		}
+	}
+	std::deque<size_t> pendingTiles;
+	for (size_t tile = 0; tile < tiles.size(); tile++)
+	{
+		pendingTiles.push_back(tile);
+	}
+	std::vector<bool> tileDone(tiles.size(), false);
+	size_t tilesRemaining = tiles.size();
+
+	RenderMessage frame(DISTRIBUTED_MESSAGE_FRAME);
+	frame.writeUInt(frameNumber);
+	frame.writeUInt((uint32_t)image.width);
+	frame.writeUInt((uint32_t)image.height);
+	frame.writeUInt(projectionMode);
+	writeRenderParameters(frame, renderParameters);
+
+	// The last time any worker was connected, to give up once none have been for a while
+	auto lastConnected = std::chrono::steady_clock::now();
+	while (tilesRemaining > 0)
+	{
+		finishUploads();
+		// Ready workers get the frame once, then tiles up to their limit
+		for (auto& worker : workers)
+		{
+			if (worker->uploading || !worker->ready || !worker->socket.isOpen())
+			{
+				continue;
+			}
+			if (worker->frame != frameNumber)
+			{
+				worker->frame = frameNumber;
+				if (!worker->socket.send(frame))
+				{
+					dropWorker(*worker, pendingTiles, "disconnected or stopped reading");
+					continue;
+				}
+			}
+			while (worker->tilesOut.size() < DISTRIBUTED_TILES_IN_FLIGHT && !pendingTiles.empty())
+			{
+				size_t tileIndex = pendingTiles.front();
+				pendingTiles.pop_front();
+				if (tileDone[tileIndex])
+				{
+					continue;
+				}
+				const DistributedTile& tile = tiles[tileIndex];
+				RenderMessage message(DISTRIBUTED_MESSAGE_TILE);
+				message.writeUInt(frameNumber);
+				message.writeUInt((uint32_t)tileIndex);
+				message.writeUInt(tile.rowBegin);
+				message.writeUInt(tile.rowEnd);
+				message.writeUInt(tile.colBegin);
+				message.writeUInt(tile.colEnd);
+				if (worker->tilesOut.empty())
+				{
+					// The timeout runs from when it was given work, not from its last message
+					worker->lastHeard = std::chrono::steady_clock::now();
+				}
+				worker->tilesOut.push_back(tileIndex);
+				if (!worker->socket.send(message))
+				{
+					dropWorker(*worker, pendingTiles, "disconnected or stopped reading");
+					break;
+				}
+			}
+		}
+
+		if (getConnectedCount() > 0)
+		{
+			lastConnected = std::chrono::steady_clock::now();
+		}
+		else if (millisecondsSince(lastConnected) > DISTRIBUTED_WORKER_TIMEOUT_MS)
+		{
+			std::cout << "Distributed render gave up with " << tilesRemaining << " tiles left and no workers" << std::endl;
+			lastFrameMs = millisecondsSince(startTime);
+			return false;
+		}
+
+		std::vector<WorkerConnection*> polledWorkers;
+		std::vector<const RenderSocket*> sockets = getPolledSockets(polledWorkers);
+		for (auto index : RenderSocket::waitReadable(sockets, DISTRIBUTED_POLL_MS))
+		{
+			if (index == 0)
+			{
+				acceptWorker();
+				continue;
+			}
+			WorkerConnection& worker = *polledWorkers[index - 1];
+			RenderMessage message;
+			if (!worker.socket.receive(message))
+			{
+				dropWorker(worker, pendingTiles, "disconnected or stalled");
+				continue;
+			}
+			worker.lastHeard = std::chrono::steady_clock::now();
+			if (message.type == DISTRIBUTED_MESSAGE_READY)
+			{
+				// Joined while the frame was under way
+				worker.ready = true;
+				worker.stats.threads = message.readUInt();
+				std::cout << "Render worker " << worker.stats.name << " ready with " << worker.stats.threads << " threads" << std::endl;
+				continue;
+			}
+			if (message.type != DISTRIBUTED_MESSAGE_RESULT)
+			{
+				continue;
+			}
+			uint32_t resultFrame = message.readUInt();
+			uint32_t tileIndex = message.readUInt();
+			unsigned long long rays = message.readUInt();
+			float renderMs = message.readFloat();
+			auto outstanding = std::find(worker.tilesOut.begin(), worker.tilesOut.end(), (size_t)tileIndex);
+			if (resultFrame != frameNumber || outstanding == worker.tilesOut.end())
+			{
+				continue;
+			}
+			worker.tilesOut.erase(outstanding);
+
+			const DistributedTile& tile = tiles[tileIndex];
+			std::vector<unsigned char> pixels((size_t)(tile.rowEnd - tile.rowBegin) * (tile.colEnd - tile.colBegin) * 4);
+			message.readBytes(pixels.data(), pixels.size());
+			if (!message.isValid())
+			{
+				dropWorker(worker, pendingTiles, "sent a malformed tile");
+				continue;
+			}
+			// A tile reassigned from a worker that only seemed dead may come back twice
+			if (tileDone[tileIndex])
+			{
+				continue;
+			}
+			const unsigned char* pixel = pixels.data();
+			for (unsigned int row = tile.rowBegin; row < tile.rowEnd; row++)
+			{
+				for (unsigned int col = tile.colBegin; col < tile.colEnd; col++, pixel += 4)
+				{
+					image[(int)row][col] = RGBAValue(pixel[0], pixel[1], pixel[2], pixel[3]);
+				}
+			}
+			tileDone[tileIndex] = true;
+			tilesRemaining--;
+			worker.stats.tiles++;
+			worker.stats.pixels += (unsigned long long)(tile.rowEnd - tile.rowBegin) * (tile.colEnd - tile.colBegin);
+			worker.stats.rays += rays;
+			worker.stats.renderMs += renderMs;
+		}
+
+		for (auto& worker : workers)
+		{
+			if (!worker->uploading && worker->socket.isOpen() && !worker->tilesOut.empty() && millisecondsSince(worker->lastHeard) > DISTRIBUTED_WORKER_TIMEOUT_MS)
+			{
+				dropWorker(*worker, pendingTiles, "timed out");
+			}
+		}
+	}
+
+	lastFrameMs = millisecondsSince(startTime);
+	std::cout << "Distributed render of " << tiles.size() << " tiles in " << lastFrameMs << "ms" << std::endl;
+	return true;
+}
+
+std::vector<DistributedWorkerStats> RenderCoordinator::getWorkerStats() const
+{
+	std::vector<DistributedWorkerStats> stats;
+	for (auto& worker : workers)
+	{
+		stats.push_back(worker->stats);
+	}
+	return stats;
+}
+
+void RenderCoordinator::printWorkerStats() const
+{
+	unsigned long long totalPixels = 0;
+	for (auto& worker : workers)
+	{
+		totalPixels += worker->stats.pixels;
+	}
+	for (auto& worker : workers)
+	{
+		const DistributedWorkerStats& stats = worker->stats;
+		// Throughput over the worker's own render time, and its share of the frame
+		std::cout << "  " << stats.name << (stats.alive ? "" : " (lost)") << ", " << stats.threads << " threads: " << stats.tiles << " tiles, "
+			<< std::fixed << std::setprecision(1) << (totalPixels > 0 ? 100.0 * stats.pixels / totalPixels : 0.0) << "% of pixels, "
+			<< std::setprecision(2) << (stats.renderMs > 0.0 ? stats.rays / stats.renderMs / 1000.0 : 0.0) << " Mrays/s, busy "
+			<< std::setprecision(0) << (lastFrameMs > 0.0 ? 100.0 * stats.renderMs / lastFrameMs : 0.0) << "%";
+		if (stats.tilesLost > 0)
+		{
+			std::cout << ", " << stats.tilesLost << " tiles lost";
+		}
+		std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+	}
+}
+
+bool runRenderWorker(const std::string& host, unsigned short port)
+{
+	RenderSocket socket;
+	for (unsigned int attempt = 0; attempt < DISTRIBUTED_CONNECT_ATTEMPTS && !socket.connect(host, port); attempt++)
+	{
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+	}
+	if (!socket.isOpen())
+	{
+		std::cout << "Could not reach the render coordinator at " << host << ":" << port << std::endl;
+		return false;
+	}
+	std::cout << "Connected to the render coordinator at " << host << ":" << port << std::endl;
+
+	// Built before the first tile, so no tile is traced by the brute force fallback
+	RaytraceTexturedObject object;
+	object.setBackgroundBuild(false);
+	RGBAImage frameBuffer;
+	RenderParameters renderParameters;
+	std::unique_ptr<DirectionalLight> light;
+	std::vector<Light*> lights;
+	std::unique_ptr<Raytracer> raytracer;
+	uint32_t frameNumber = 0;
+
+	RenderMessage message;
+	while (socket.receive(message))
+	{
+		if (message.type == DISTRIBUTED_MESSAGE_QUIT)
+		{
+			break;
+		}
+		if (message.type == DISTRIBUTED_MESSAGE_SCENE)
+		{
+			std::istringstream geometryStream(message.readString());
+			std::istringstream textureStream(message.readString());
+			object.setAccelerator(message.readUInt());
+			if (!message.isValid() || !object.ReadObjectStream(geometryStream, textureStream))
+			{
+				std::cout << "Could not read the scene from the render coordinator" << std::endl;
+				return true;
+			}
+			raytracer.reset(new Raytracer(&frameBuffer, &object, &lights, &renderParameters));
+			RenderMessage ready(DISTRIBUTED_MESSAGE_READY);
+			ready.writeUInt(raytracer->getThreadCount());
+			socket.send(ready);
+		}
+		else if (message.type == DISTRIBUTED_MESSAGE_FRAME && raytracer)
+		{
+			frameNumber = message.readUInt();
+			long width = (long)message.readUInt();
+			long height = (long)message.readUInt();
+			if (message.readUInt() == RT_PERSPECTIVE)
+			{
+				raytracer->setProjectionPerspective();
+			}
+			else
+			{
+				raytracer->setProjectionOrtho();
+			}
+			readRenderParameters(message, renderParameters);
+			if (width != frameBuffer.width || height != frameBuffer.height)
+			{
+				frameBuffer.Resize(width, height);
+			}
+			// Same light as the render widget
+			Cartesian3 lightColor(renderParameters.lightColor[0], renderParameters.lightColor[1], renderParameters.lightColor[2]);
+			light.reset(new DirectionalLight(renderParameters.lightMatrix, lightColor));
+			lights.assign(1, light.get());
+		}
+		else if (message.type == DISTRIBUTED_MESSAGE_TILE && raytracer)
+		{
+			uint32_t tileFrame = message.readUInt();
+			uint32_t tileIndex = message.readUInt();
+			unsigned int rowBegin = message.readUInt();
+			unsigned int rowEnd = std::min(message.readUInt(), (uint32_t)frameBuffer.height);
+			unsigned int colBegin = message.readUInt();
+			unsigned int colEnd = std::min(message.readUInt(), (uint32_t)frameBuffer.width);
+			if (tileFrame != frameNumber || rowBegin >= rowEnd || colBegin >= colEnd)
+			{
+				continue;
+			}
+			auto startTime = std::chrono::steady_clock::now();
+			raytracer->raytraceRegion(rowBegin, rowEnd, colBegin, colEnd);
+			float renderMs = (float)millisecondsSince(startTime);
+
+			RenderMessage result(DISTRIBUTED_MESSAGE_RESULT);
+			result.writeUInt(tileFrame);
+			result.writeUInt(tileIndex);
+			result.writeUInt((uint32_t)raytracer->getRenderStats().rays);
+			result.writeFloat(renderMs);
+			std::vector<unsigned char> pixels;
+			pixels.reserve((size_t)(rowEnd - rowBegin) * (colEnd - colBegin) * 4);
+			for (unsigned int row = rowBegin; row < rowEnd; row++)
+			{
+				for (unsigned int col = colBegin; col < colEnd; col++)
+				{
+					const RGBAValue& pixel = frameBuffer[(int)row][col];
+					unsigned char bytes[4] = { pixel.red, pixel.green, pixel.blue, pixel.alpha };
+					pixels.insert(pixels.end(), bytes, bytes + 4);
+				}
+			}
+			result.writeBytes(pixels.data(), pixels.size());
+			if (!socket.send(result))
+			{
+				break;
+			}
+		}
+	}
+	std::cout << "Render coordinator finished" << std::endl;
+	return true;
+}
+
+bool parseWorkerAddress(const std::string& address, std::string& hostOut, unsigned short& portOut)
+{
+	size_t colon = address.rfind(':');
+	hostOut = address.substr(0, colon);
+	if (hostOut.empty())
+	{
+		std::cout << "No coordinator host in " << address << std::endl;
+		return false;
+	}
+	if (colon == std::string::npos)
+	{
+		return true;
+	}
+
+	// Digits only, so signs, spaces and trailing text are refused rather than read as far as they make sense
+	std::string portText = address.substr(colon + 1);
+	unsigned long port = 0;
+	for (auto digit : portText)
+	{
+		if (digit < '0' || digit > '9' || port > 0xffff)
+		{
+			port = 0;
+			break;
+		}
+		port = port * 10 + (digit - '0');
+	}
+	if (port == 0 || port > 0xffff)
+	{
+		std::cout << "Invalid coordinator port " << portText << ", expected a number from 1 to 65535" << std::endl;
+		return false;
+	}
+	portOut = (unsigned short)port;
+	return true;
+}
+
+bool renderDistributed(const std::string& geometryPath, const std::string& texturePath, unsigned int acceleratorType, unsigned short port,
+	size_t workerCount, RGBAImage& image, const RenderParameters& renderParameters, unsigned int projectionMode)
+{
+	// Workers get the files as they are, and read them just as this process did
+	std::ifstream geometryFile(geometryPath);
+	std::ifstream textureFile(texturePath);
+	std::stringstream geometryText, textureText;
+	geometryText << geometryFile.rdbuf();
+	textureText << textureFile.rdbuf();
+	RenderCoordinator coordinator(geometryText.str(), textureText.str(), acceleratorType);
+	// The coordinator reports its own failure to listen
+	if (!coordinator.listen(port))
+	{
+		return false;
+	}
+	// Later workers join during the frame
+	if (coordinator.acceptWorkers(workerCount, DISTRIBUTED_ACCEPT_TIMEOUT_MS) == 0)
+	{
+		std::cout << "No render workers connected" << std::endl;
+		return false;
+	}
+	if (!coordinator.render(image, renderParameters, projectionMode))
+	{
+		std::cout << "Every render worker was lost before the frame finished" << std::endl;
+		return false;
+	}
+	coordinator.printWorkerStats();
+	return true;
+}
@@ -0,0 +1,150 @@
+// Rendering one frame across several processes, on this machine or others
+// A coordinator listens for workers, sends each the mesh and texture as read from disk, then per frame the image size
+// and render parameters. Tiles are handed out a few at a time to every worker, each getting more as its results come
+// back, so faster workers take more of the frame. A worker that disconnects, goes quiet or stalls partway through a
+// message is dropped and its outstanding tiles go back on the queue. Workers may also join while a frame renders, each
+// sent the scene on a thread of its own so the frame carries on meanwhile
+#pragma once
+
+// Standard libraries
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+// Utils
+#include <RGBAImage.h>
+
+// Custom classes
+#include "RenderParameters.h"
+
+// RT Specific
+#include "RenderSocket.h"
+
+// Constants
+// Port workers connect to unless told otherwise
+const unsigned short DISTRIBUTED_PORT_DEFAULT = 5812;
+// Side of the tiles handed out, larger than the renderer's own so each message carries plenty of work
+const unsigned int DISTRIBUTED_TILE_SIZE = 64;
+// Tiles a worker holds at once, so it has the next while its last result is on the way back
+const unsigned int DISTRIBUTED_TILES_IN_FLIGHT = 2;
+// A worker holding tiles that sends nothing for this long is dropped
+const unsigned int DISTRIBUTED_WORKER_TIMEOUT_MS = 60000;
+// A worker that stops taking or giving the bytes of a message for this long is dropped, as the coordinator is blocked on it
+const unsigned int DISTRIBUTED_STALL_TIMEOUT_MS = 10000;
+// How often the coordinator stops waiting for messages to check timeouts and whether any workers are left
+const unsigned int DISTRIBUTED_POLL_MS = 100;
+// Attempts a worker makes to reach the coordinator, a second apart
+const unsigned int DISTRIBUTED_CONNECT_ATTEMPTS = 10;
+// Wait for the first worker, and the frame rendered, when run from the command line
+const unsigned int DISTRIBUTED_ACCEPT_TIMEOUT_MS = 60000;
+const long DISTRIBUTED_FRAME_WIDTH = 1024;
+const long DISTRIBUTED_FRAME_HEIGHT = 768;
+
+// Message types
+// Coordinator to worker: geometry text, texture text, accelerator type
+const uint32_t DISTRIBUTED_MESSAGE_SCENE = 1;
+// Worker to coordinator, once the scene is loaded and its structure built: thread count
+const uint32_t DISTRIBUTED_MESSAGE_READY = 2;
+// Coordinator to worker: frame number, width, height, projection mode, render parameters
+const uint32_t DISTRIBUTED_MESSAGE_FRAME = 3;
+// Coordinator to worker: frame number, tile index, pixel rows and columns
+const uint32_t DISTRIBUTED_MESSAGE_TILE = 4;
+// Worker to coordinator: frame number, tile index, rays traced, milliseconds taken, RGBA pixels
+const uint32_t DISTRIBUTED_MESSAGE_RESULT = 5;
+// Coordinator to worker: stop
+const uint32_t DISTRIBUTED_MESSAGE_QUIT = 6;
+
+// What each worker did over the last frame
+struct DistributedWorkerStats
+{
+	// Peer address and the worker's render threads
+	std::string name;
+	unsigned int threads = 0;
+	bool alive = true;
+	size_t tiles = 0;
+	unsigned long long pixels = 0;
+	unsigned long long rays = 0;
+	// Time the worker spent rendering, as it reported
+	double renderMs = 0.0;
+	// Tiles it held when dropped, rendered again by others
+	size_t tilesLost = 0;
+};
+
+class RenderCoordinator
+{
+private:
+	struct WorkerConnection
+	{
+		RenderSocket socket;
+		DistributedWorkerStats stats;
+		// Sending the scene, which the upload thread does with the socket to itself until it clears this
+		std::atomic<bool> uploading{ false };
+		std::thread uploadThread;
+		// Has loaded the scene
+		bool ready = false;
+		// Has been sent the current frame
+		unsigned int frame = 0;
+		std::deque<size_t> tilesOut;
+		std::chrono::steady_clock::time_point lastHeard;
+
+		// Waits for the scene to be sent, or the send to time out
+		~WorkerConnection();
+	};
+
+	RenderSocket listener;
+	std::vector<std::unique_ptr<WorkerConnection>> workers;
+
+	// Scene sent to every worker
+	RenderMessage sceneMessage;
+	unsigned int stallTimeoutMs;
+
+	unsigned int frameNumber;
+	double lastFrameMs;
+
+	// Accept a waiting connection and start sending it the scene
+	void acceptWorker();
+	// Report workers whose scene has been sent since the last call, which may now be read from and sent to
+	void finishUploads();
+	// Open workers that have their scene, with the listener first, for waiting on. Workers are in their order in the list
+	std::vector<const RenderSocket*> getPolledSockets(std::vector<WorkerConnection*>& workersOut) const;
+	// Close a worker's connection, putting its tiles back on the queue
+	void dropWorker(WorkerConnection& worker, std::deque<size_t>& pendingTiles, const char* reason);
+	size_t getConnectedCount() const;
+public:
+	// Constructor takes the mesh and texture files' contents
+	RenderCoordinator(const std::string& newGeometryText, const std::string& newTextureText, unsigned int newAcceleratorType);
+	// Tells every worker to stop
+	~RenderCoordinator();
+
+	// Listen for workers, port 0 for any free one
+	bool listen(unsigned short port = DISTRIBUTED_PORT_DEFAULT);
+	unsigned short getPort() const { return listener.getLocalPort(); };
+	// Stall timeout for workers that connect from now on
+	void setStallTimeout(unsigned int timeoutMs) { stallTimeoutMs = timeoutMs; };
+	// Accept workers until count have loaded the scene or timeoutMs passes. Returns how many are ready
+	size_t acceptWorkers(size_t count, unsigned int timeoutMs);
+
+	// Render a frame the size of the image into it. Returns false if every worker was lost before it finished
+	bool render(RGBAImage& image, const RenderParameters& renderParameters, unsigned int projectionMode);
+
+	// Per worker work and throughput over the last frame
+	std::vector<DistributedWorkerStats> getWorkerStats() const;
+	void printWorkerStats() const;
+};
+
+// Connect to a coordinator and render tiles for it until told to stop or the connection closes.
+// Returns false if it couldn't connect
+bool runRenderWorker(const std::string& host, unsigned short port = DISTRIBUTED_PORT_DEFAULT);
+
+// Split a coordinator address given as host[:port], leaving the port alone when there is none. Returns false, with
+// a message, for an empty host or a port that isn't a number from 1 to 65535
+bool parseWorkerAddress(const std::string& address, std::string& hostOut, unsigned short& portOut);
+
+// Render the image on workers from the command line: listen on the port, send the files as they are on disk, wait
+// for workerCount workers, render and print each worker's share. Returns false, with a message, if it couldn't
+bool renderDistributed(const std::string& geometryPath, const std::string& texturePath, unsigned int acceleratorType, unsigned short port,
+	size_t workerCount, RGBAImage& image, const RenderParameters& renderParameters, unsigned int projectionMode);
@@ -10,6 +10,13 @@ std::ostream& operator << (std::ostream& outStream, const Ray& value)
     return outStream;
 }
 
+// Transform to another space. The direction isn't renormalised, so distances along the ray carry over
+Ray Ray::transformed(const Matrix4& matrix) const
+{
+    return Ray((matrix * Homogeneous4(origin.x, origin.y, origin.z, 1.0f)).Point(),
+               (matrix * Homogeneous4(direction.x, direction.y, direction.z, 0.0f)).Vector());
+}
+
 // Init to safe values
 Triangle::Triangle()
 {
@@ -120,4 +127,28 @@ std::ostream& operator << (std::ostream& outStream, const Triangle& value)
 { // stream output
     outStream << "v0: " << value.getV0() << ", v1: " << value.getV1() << ", v2: " << value.getV2();
     return outStream;
+}
+
+Cartesian3 AABB::centroid() const
+{
+    return (minBounds + maxBounds) * 0.5f;
+}
+
+Cartesian3 AABB::extent() const
+{
+    return maxBounds - minBounds;
+}
+
+int AABB::longestAxis() const
+{
+    Cartesian3 e = extent();
+    if (e.x > e.y && e.x > e.z) return 0;
+    return (e.y > e.z) ? 1 : 2;
+}
+
+// stream output for bounding box
+std::ostream& operator << (std::ostream& outStream, const AABB& value)
+{ // stream output
+    outStream << "Min: " << value.minBounds << " Max: " << value.maxBounds;
+    return outStream;
 }
\ No newline at end of file
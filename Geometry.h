@@ -5,6 +5,9 @@
 #include <Matrix4.h>
 #include <Surfel.h>
 
+#include <algorithm>
+#include <limits>
+
 class Ray
 {
 	// Minimal class for representing a ray
@@ -15,12 +18,15 @@ public:
 	// Constructors: default, inplace, and copy
 	Ray() : origin(0.0f, 0.0f, 0.0f), direction(0.0f, 0.0f, -1.0f) {};
 	Ray(const Cartesian3& otherOrigin, const Cartesian3& otherDirection) : origin(otherOrigin), direction(otherDirection) {};
-	Ray(Ray& other) : origin(other.getOrigin()), direction(other.getDirection()) {};
+	Ray(const Ray& other) : origin(other.getOrigin()), direction(other.getDirection()) {};
 
 	// Getters
 	Cartesian3 getOrigin() const { return origin; };
 	Cartesian3 getDirection() const { return direction; };
 	Cartesian3 getHalfLine() const { return (origin + direction); };
+
+	// Transform to another space. The direction isn't renormalised, so distances along the ray carry over
+	Ray transformed(const Matrix4& matrix) const;
 };
 
 // stream output for ray
@@ -52,3 +58,55 @@ public:
 
 // stream output for triangle
 std::ostream& operator << (std::ostream& outStream, const Triangle& value);
+
+class AABB
+{
+	// Axis aligned bounding box, used when building acceleration structures
+public:
+	// Attributes
+	Cartesian3 minBounds, maxBounds;
+
+	// Constructors: default is empty (inverted) so that any grow() replaces it
+	AABB() : minBounds(std::numeric_limits<float>::infinity()), maxBounds(-std::numeric_limits<float>::infinity()) {};
+	AABB(const Cartesian3& newMinBounds, const Cartesian3& newMaxBounds) : minBounds(newMinBounds), maxBounds(newMaxBounds) {};
+
+	// Expand to contain a point or another box
+	// Inline and component-wise, as these are the inner loop of every build
+	void grow(const Cartesian3& point)
+	{
+		minBounds.x = std::min(minBounds.x, point.x); minBounds.y = std::min(minBounds.y, point.y); minBounds.z = std::min(minBounds.z, point.z);
+		maxBounds.x = std::max(maxBounds.x, point.x); maxBounds.y = std::max(maxBounds.y, point.y); maxBounds.z = std::max(maxBounds.z, point.z);
+	};
+	void grow(const AABB& other)
+	{
+		minBounds.x = std::min(minBounds.x, other.minBounds.x); minBounds.y = std::min(minBounds.y, other.minBounds.y); minBounds.z = std::min(minBounds.z, other.minBounds.z);
+		maxBounds.x = std::max(maxBounds.x, other.maxBounds.x); maxBounds.y = std::max(maxBounds.y, other.maxBounds.y); maxBounds.z = std::max(maxBounds.z, other.maxBounds.z);
+	};
+
+	// Queries
+	bool isEmpty() const { return minBounds.x > maxBounds.x || minBounds.y > maxBounds.y || minBounds.z > maxBounds.z; };
+	Cartesian3 centroid() const;
+	Cartesian3 extent() const;
+	// Surface area, used as the probability measure by the SAH
+	float surfaceArea() const
+	{
+		if (isEmpty()) return 0.0f;
+		float dx = maxBounds.x - minBounds.x, dy = maxBounds.y - minBounds.y, dz = maxBounds.z - minBounds.z;
+		return 2.0f * (dx * dy + dy * dz + dz * dx);
+	};
+	int longestAxis() const;
+};
+
+// stream output for bounding box
+std::ostream& operator << (std::ostream& outStream, const AABB& value);
+
+// Nearest hit found by an acceleration structure
+// Surface attributes are only interpolated once, for this triangle
+struct RayHit
+{
+	float t;
+	// Barycentric coordinates of v1 and v2
+	float u, v;
+	// Index into the owning object's triangle list
+	unsigned int triangle;
+};
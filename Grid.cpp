@@ -0,0 +1,531 @@
+// Uniform and two level grid accelerators
+#include "Grid.h"
+
+// Standard libraries
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <utility>
+
+// RT Specific
+#include "RayStats.h"
+
+// Ray data shared by every level
+struct GridRay
+{
+	float origin[3];
+	float direction[3];
+	float inverseDirection[3];
+
+	GridRay(const Ray& ray)
+	{
+		Cartesian3 rayOrigin = ray.getOrigin();
+		Cartesian3 rayDirection = ray.getDirection();
+		for (int axis = 0; axis < 3; axis++)
+		{
+			origin[axis] = rayOrigin[axis];
+			direction[axis] = rayDirection[axis];
+			inverseDirection[axis] = 1.0f / rayDirection[axis];
+		}
+	}
+};
+
+// Cells per axis for cube shaped cells of a given size, capped at GRID_MAX_RESOLUTION
+static unsigned int resolutionForCellSize(float extent, float cellSize)
+{
+	float cells = std::ceil(extent / cellSize);
+	return (unsigned int)std::min((float)GRID_MAX_RESOLUTION, std::max(1.0f, cells));
+}
+
+// Fit a level to a box, with about targetCells roughly cube shaped cells
+static void setupLevel(GridLevel& level, const float* minBounds, const float* maxBounds, float targetCells)
+{
+	float extent[3];
+	float maxExtent = 0.0f;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		level.minBounds[axis] = minBounds[axis];
+		level.maxBounds[axis] = maxBounds[axis];
+		extent[axis] = maxBounds[axis] - minBounds[axis];
+		maxExtent = std::max(maxExtent, extent[axis]);
+	}
+
+	// Search for the cell size giving the target count, as a guess from the volume fails for flat boxes
+	float smallest = maxExtent / GRID_MAX_RESOLUTION;
+	float largest = maxExtent;
+	for (int iteration = 0; iteration < 32; iteration++)
+	{
+		float cellSize = std::sqrt(smallest * largest);
+		double count = 1.0;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			count *= resolutionForCellSize(extent[axis], cellSize);
+		}
+		if (count > targetCells)
+		{
+			smallest = cellSize;
+		}
+		else
+		{
+			largest = cellSize;
+		}
+	}
+	for (int axis = 0; axis < 3; axis++)
+	{
+		level.resolution[axis] = resolutionForCellSize(extent[axis], largest);
+		level.cellSize[axis] = extent[axis] / level.resolution[axis];
+		level.inverseCellSize[axis] = level.resolution[axis] / extent[axis];
+	}
+}
+
+// Cell of a level holding a coordinate along one axis, clamped to the level
+static unsigned int cellCoordinate(const GridLevel& level, int axis, float position)
+{
+	float cell = std::floor((position - level.minBounds[axis]) * level.inverseCellSize[axis]);
+	return (unsigned int)std::min((float)(level.resolution[axis] - 1), std::max(0.0f, cell));
+}
+
+// Whether a triangle overlaps a box it's already known to overlap the bounds of, by the separating axis test
+// on the triangle's plane and the cross products of its edges with the box axes
+static bool triangleOverlapsBox(const Cartesian3* triangle, const float* boxCenter, const float* halfSize)
+{
+	float vertices[3][3];
+	for (int corner = 0; corner < 3; corner++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			vertices[corner][axis] = triangle[corner][axis] - boxCenter[axis];
+		}
+	}
+	float edges[3][3];
+	for (int edge = 0; edge < 3; edge++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			edges[edge][axis] = vertices[(edge + 1) % 3][axis] - vertices[edge][axis];
+		}
+	}
+
+	// Plane of the triangle
+	float normal[3] = { edges[0][1] * edges[1][2] - edges[0][2] * edges[1][1],
+						edges[0][2] * edges[1][0] - edges[0][0] * edges[1][2],
+						edges[0][0] * edges[1][1] - edges[0][1] * edges[1][0] };
+	float planeDistance = normal[0] * vertices[0][0] + normal[1] * vertices[0][1] + normal[2] * vertices[0][2];
+	float planeRadius = halfSize[0] * std::fabs(normal[0]) + halfSize[1] * std::fabs(normal[1]) + halfSize[2] * std::fabs(normal[2]);
+	if (std::fabs(planeDistance) > planeRadius)
+	{
+		return false;
+	}
+
+	// Each box axis crossed with each edge
+	for (int edge = 0; edge < 3; edge++)
+	{
+		for (int boxAxis = 0; boxAxis < 3; boxAxis++)
+		{
+			int a = (boxAxis + 1) % 3;
+			int b = (boxAxis + 2) % 3;
+			float axis[3];
+			axis[boxAxis] = 0.0f;
+			axis[a] = -edges[edge][b];
+			axis[b] = edges[edge][a];
+			float low = std::numeric_limits<float>::infinity();
+			float high = -low;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				float projection = axis[a] * vertices[corner][a] + axis[b] * vertices[corner][b];
+				low = std::min(low, projection);
+				high = std::max(high, projection);
+			}
+			float radius = halfSize[a] * std::fabs(axis[a]) + halfSize[b] * std::fabs(axis[b]);
+			if (low > radius || high < -radius)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// Bin triangles into the level's cells they overlap, appending the level's cells and their references
+static void fillLevel(GridLevel& level, const std::vector<unsigned int>& triangles, const std::vector<Cartesian3>& triangleVertices,
+						const std::vector<float>& triangleBounds, float padding, std::vector<GridCell>& cells, std::vector<unsigned int>& references)
+{
+	level.firstCell = (unsigned int)cells.size();
+	GridCell emptyCell = { 0, 0 };
+	cells.resize(cells.size() + level.cellCount(), emptyCell);
+	GridCell* levelCells = &cells[level.firstCell];
+	unsigned int rowSize = level.resolution[0];
+	unsigned int sliceSize = level.resolution[0] * level.resolution[1];
+
+	// Whether a triangle overlaps a block of cells, padded so rounding can't drop a triangle on a cell boundary
+	auto overlapsCells = [&](unsigned int triangle, const unsigned int* low, const unsigned int* high)
+	{
+		float center[3], halfSize[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			center[axis] = level.minBounds[axis] + 0.5f * (low[axis] + high[axis] + 1) * level.cellSize[axis];
+			halfSize[axis] = 0.5f * (high[axis] - low[axis] + 1) * level.cellSize[axis] + padding;
+		}
+		return triangleOverlapsBox(&triangleVertices[3 * triangle], center, halfSize);
+	};
+
+	// Cells each triangle overlaps, in triangle order. Large or diagonal triangles cross far fewer cells than
+	// their bounds do, so the cells within the bounds are tested a slice, then a row, then a cell at a time
+	std::vector<std::pair<unsigned int, unsigned int>> overlaps;
+	overlaps.reserve(triangles.size());
+	for (auto triangle : triangles)
+	{
+		const float* box = &triangleBounds[6 * triangle];
+		unsigned int low[3], high[3];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			low[axis] = cellCoordinate(level, axis, box[axis]);
+			high[axis] = cellCoordinate(level, axis, box[3 + axis]);
+		}
+		bool singleCell = low[0] == high[0] && low[1] == high[1] && low[2] == high[2];
+		for (unsigned int z = low[2]; z <= high[2]; z++)
+		{
+			unsigned int sliceLow[3] = { low[0], low[1], z };
+			unsigned int sliceHigh[3] = { high[0], high[1], z };
+			if (!singleCell && low[2] != high[2] && !overlapsCells(triangle, sliceLow, sliceHigh))
+			{
+				continue;
+			}
+			for (unsigned int y = low[1]; y <= high[1]; y++)
+			{
+				unsigned int rowLow[3] = { low[0], y, z };
+				unsigned int rowHigh[3] = { high[0], y, z };
+				if (!singleCell && low[1] != high[1] && !overlapsCells(triangle, rowLow, rowHigh))
+				{
+					continue;
+				}
+				for (unsigned int x = low[0]; x <= high[0]; x++)
+				{
+					unsigned int cell[3] = { x, y, z };
+					if (singleCell || low[0] == high[0] || overlapsCells(triangle, cell, cell))
+					{
+						overlaps.push_back(std::make_pair(z * sliceSize + y * rowSize + x, triangle));
+					}
+				}
+			}
+		}
+	}
+
+	// Count, then give each cell its range, then fill the ranges
+	for (auto& overlap : overlaps)
+	{
+		levelCells[overlap.first].count++;
+	}
+	unsigned int next = (unsigned int)references.size();
+	for (unsigned int i = 0; i < level.cellCount(); i++)
+	{
+		levelCells[i].first = next;
+		next += levelCells[i].count;
+		levelCells[i].count = 0;
+	}
+	references.resize(next);
+	for (auto& overlap : overlaps)
+	{
+		GridCell& cell = levelCells[overlap.first];
+		references[cell.first + cell.count++] = overlap.second;
+	}
+}
+
+// Walk the cells of a level a ray passes through between tEnter and tExit, nearest first, with a 3D-DDA.
+// visitCell(cell, cellEntry, cellExit) gets the cell's index in the grid's cell array, and returns true to stop.
+// Levels within a top cell are walked over the interval the top level found, rather than clipping again,
+// so rounding can't lose a ray that grazes the cell
+template <typename CellVisitor>
+static bool walkLevel(const GridLevel& level, const GridRay& ray, float tEnter, float tExit, bool clipToBounds, CellVisitor visitCell)
+{
+	if (clipToBounds)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t1 = (level.minBounds[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+			float t2 = (level.maxBounds[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+			// A NaN from 0 * infinity keeps the current interval
+			tEnter = std::max(tEnter, std::min(t1, t2));
+			tExit = std::min(tExit, std::max(t1, t2));
+		}
+		if (!(tEnter <= tExit))
+		{
+			return false;
+		}
+	}
+
+	// Starting cell, the step direction, and the distance to the next cell boundary on each axis
+	int cell[3], step[3];
+	float tNext[3], tDelta[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		cell[axis] = (int)cellCoordinate(level, axis, ray.origin[axis] + tEnter * ray.direction[axis]);
+		if (ray.direction[axis] > 0.0f)
+		{
+			step[axis] = 1;
+			tNext[axis] = (level.minBounds[axis] + (cell[axis] + 1) * level.cellSize[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+			tDelta[axis] = level.cellSize[axis] * ray.inverseDirection[axis];
+		}
+		else if (ray.direction[axis] < 0.0f)
+		{
+			step[axis] = -1;
+			tNext[axis] = (level.minBounds[axis] + cell[axis] * level.cellSize[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+			tDelta[axis] = -level.cellSize[axis] * ray.inverseDirection[axis];
+		}
+		else
+		{
+			step[axis] = 0;
+			tNext[axis] = std::numeric_limits<float>::infinity();
+			tDelta[axis] = std::numeric_limits<float>::infinity();
+		}
+	}
+
+	unsigned int rowSize = level.resolution[0];
+	unsigned int sliceSize = level.resolution[0] * level.resolution[1];
+	float cellEntry = tEnter;
+	while (true)
+	{
+		int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+		float cellExit = std::min(tNext[axis], tExit);
+		if (visitCell(level.firstCell + cell[2] * sliceSize + cell[1] * rowSize + cell[0], cellEntry, cellExit))
+		{
+			return true;
+		}
+		if (tNext[axis] >= tExit)
+		{
+			return false;
+		}
+		cell[axis] += step[axis];
+		if (cell[axis] < 0 || cell[axis] >= (int)level.resolution[axis])
+		{
+			return false;
+		}
+		cellEntry = tNext[axis];
+		tNext[axis] += tDelta[axis];
+	}
+}
+
+Grid::Grid(bool newTwoLevel) : twoLevel(newTwoLevel), triangleKernelWidth(TRIANGLE_KERNEL_AUTO)
+{
+}
+
+void Grid::clear()
+{
+	topLevel = GridLevel();
+	subLevels = std::vector<GridLevel>();
+	topCellSubLevels = std::vector<unsigned int>();
+	cells = std::vector<GridCell>();
+	references = std::vector<unsigned int>();
+	triangleStore = TriangleStore();
+	bounds = AABB();
+}
+
+void Grid::build(const std::vector<Cartesian3>& triangleVertices)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	subLevels.clear();
+	topCellSubLevels.clear();
+	cells.clear();
+	references.clear();
+	bounds = AABB();
+
+	// Bounds of each triangle, as six floats
+	unsigned int triangleCount = (unsigned int)(triangleVertices.size() / 3);
+	std::vector<float> triangleBounds(6 * triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		AABB triangleBox;
+		triangleBox.grow(triangleVertices[3 * i]);
+		triangleBox.grow(triangleVertices[3 * i + 1]);
+		triangleBox.grow(triangleVertices[3 * i + 2]);
+		bounds.grow(triangleBox);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			triangleBounds[6 * i + axis] = triangleBox.minBounds[axis];
+			triangleBounds[6 * i + 3 + axis] = triangleBox.maxBounds[axis];
+		}
+	}
+	if (triangleCount == 0)
+	{
+		topLevel = GridLevel();
+		triangleStore.build(triangleVertices, references, triangleKernelWidth);
+		return;
+	}
+
+	// Pad the triangles and cells so one on a cell boundary is in the cells either side, and the grid so no axis is flat
+	Cartesian3 extent = bounds.extent();
+	float padding = 1e-5f * std::max(extent.x, std::max(extent.y, extent.z)) + 1e-30f;
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			triangleBounds[6 * i + axis] -= padding;
+			triangleBounds[6 * i + 3 + axis] += padding;
+		}
+	}
+	float gridMin[3], gridMax[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		gridMin[axis] = bounds.minBounds[axis] - 2.0f * padding;
+		gridMax[axis] = bounds.maxBounds[axis] + 2.0f * padding;
+	}
+	std::vector<unsigned int> allTriangles(triangleCount);
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		allTriangles[i] = i;
+	}
+
+	if (!twoLevel)
+	{
+		setupLevel(topLevel, gridMin, gridMax, GRID_DENSITY * triangleCount);
+		fillLevel(topLevel, allTriangles, triangleVertices, triangleBounds, padding, cells, references);
+		topCellSubLevels.assign(topLevel.cellCount(), GRID_NO_SUBGRID);
+	}
+	else
+	{
+		// Coarse top level first, then a grid of its own for each crowded top cell
+		setupLevel(topLevel, gridMin, gridMax, TWO_LEVEL_GRID_TOP_DENSITY * triangleCount);
+		std::vector<GridCell> topCells;
+		std::vector<unsigned int> topReferences;
+		fillLevel(topLevel, allTriangles, triangleVertices, triangleBounds, padding, topCells, topReferences);
+
+		unsigned int topCount = topLevel.cellCount();
+		cells.resize(topCount);
+		topCellSubLevels.assign(topCount, GRID_NO_SUBGRID);
+		for (unsigned int z = 0, index = 0; z < topLevel.resolution[2]; z++)
+		{
+			for (unsigned int y = 0; y < topLevel.resolution[1]; y++)
+			{
+				for (unsigned int x = 0; x < topLevel.resolution[0]; x++, index++)
+				{
+					const GridCell& topCell = topCells[index];
+					std::vector<unsigned int> cellTriangles(topReferences.begin() + topCell.first, topReferences.begin() + topCell.first + topCell.count);
+					if (topCell.count <= TWO_LEVEL_GRID_LEAF_SIZE)
+					{
+						cells[index].first = (unsigned int)references.size();
+						cells[index].count = topCell.count;
+						references.insert(references.end(), cellTriangles.begin(), cellTriangles.end());
+						continue;
+					}
+
+					unsigned int coordinates[3] = { x, y, z };
+					float cellMin[3], cellMax[3];
+					for (int axis = 0; axis < 3; axis++)
+					{
+						cellMin[axis] = topLevel.minBounds[axis] + coordinates[axis] * topLevel.cellSize[axis];
+						cellMax[axis] = topLevel.minBounds[axis] + (coordinates[axis] + 1) * topLevel.cellSize[axis];
+					}
+					GridLevel subLevel;
+					setupLevel(subLevel, cellMin, cellMax, TWO_LEVEL_GRID_CELL_DENSITY * topCell.count);
+					fillLevel(subLevel, cellTriangles, triangleVertices, triangleBounds, padding, cells, references);
+					topCellSubLevels[index] = (unsigned int)subLevels.size();
+					subLevels.push_back(subLevel);
+				}
+			}
+		}
+	}
+
+	// Intersection data in reference order, so each cell is a contiguous leaf
+	triangleStore.build(triangleVertices, references, triangleKernelWidth);
+
+	double buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << (twoLevel ? "Two level grid" : "Uniform grid") << " built in " << buildTimeMs << "ms: " << topLevel.resolution[0] << "x" << topLevel.resolution[1] << "x" << topLevel.resolution[2] << " cells";
+	if (twoLevel)
+	{
+		std::cout << ", " << subLevels.size() << " with their own grids, " << cells.size() << " cells in all";
+	}
+	std::cout << ", " << references.size() << " references, " << triangleStore.kernelName << " cell tests" << std::endl;
+}
+
+bool Grid::intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const
+{
+	if (references.empty())
+	{
+		return false;
+	}
+	GridRay gridRay(ray);
+	RayStats& threadStats = rayStats;
+
+	float tClosest = tMax;
+	unsigned int nearestEntry = 0;
+	bool hit = false;
+	// A hit inside the cell can't be beaten by a later cell, but a triangle reaching past the cell might be
+	auto testCell = [&](unsigned int cell, float cellEntry, float cellExit)
+	{
+		if (cellEntry > tClosest)
+		{
+			return true;
+		}
+		const GridCell& gridCell = cells[cell];
+		threadStats.nodeVisits++;
+		threadStats.primitiveTests += gridCell.count;
+		if (gridCell.count > 0 && triangleStore.intersectNearest(gridCell.first, gridCell.count, gridRay.origin, gridRay.direction, tMin, tClosest, hitOut.u, hitOut.v, nearestEntry))
+		{
+			hit = true;
+		}
+		return hit && tClosest <= cellExit;
+	};
+	auto visitTopCell = [&](unsigned int cell, float cellEntry, float cellExit)
+	{
+		unsigned int subLevel = topCellSubLevels[cell];
+		if (subLevel == GRID_NO_SUBGRID)
+		{
+			return testCell(cell, cellEntry, cellExit);
+		}
+		if (cellEntry > tClosest)
+		{
+			return true;
+		}
+		threadStats.nodeVisits++;
+		walkLevel(subLevels[subLevel], gridRay, cellEntry, cellExit, false, testCell);
+		return hit && tClosest <= cellExit;
+	};
+	walkLevel(topLevel, gridRay, tMin, tMax, true, visitTopCell);
+
+	if (hit)
+	{
+		hitOut.t = tClosest;
+		hitOut.triangle = references[nearestEntry];
+	}
+	return hit;
+}
+
+bool Grid::intersectAny(const Ray& ray, float tMin, float tMax) const
+{
+	if (references.empty())
+	{
+		return false;
+	}
+	GridRay gridRay(ray);
+	RayStats& threadStats = rayStats;
+
+	auto testCell = [&](unsigned int cell, float, float)
+	{
+		const GridCell& gridCell = cells[cell];
+		threadStats.nodeVisits++;
+		threadStats.primitiveTests += gridCell.count;
+		return gridCell.count > 0 && triangleStore.intersectAny(gridCell.first, gridCell.count, gridRay.origin, gridRay.direction, tMin, tMax);
+	};
+	auto visitTopCell = [&](unsigned int cell, float cellEntry, float cellExit)
+	{
+		unsigned int subLevel = topCellSubLevels[cell];
+		if (subLevel == GRID_NO_SUBGRID)
+		{
+			return testCell(cell, cellEntry, cellExit);
+		}
+		threadStats.nodeVisits++;
+		return walkLevel(subLevels[subLevel], gridRay, cellEntry, cellExit, false, testCell);
+	};
+	return walkLevel(topLevel, gridRay, tMin, tMax, true, visitTopCell);
+}
+
+// Entries name triangles, the triangle store holds their vertices
+void Grid::remapTriangles(const std::vector<unsigned int>& newIndices)
+{
+	for (auto& reference : references)
+	{
+		reference = newIndices[reference];
+	}
+}
@@ -0,0 +1,83 @@
+// Uniform and two level grid accelerators
+// The mesh's box is divided into equal cells, each listing the triangles whose bounds overlap it, and rays walk
+// the cells they pass through in order with a 3D-DDA. The two level grid gives each crowded top level cell a grid of
+// its own, sized for the triangles in it, so uneven meshes don't need a fine grid everywhere
+#pragma once
+
+// Standard libraries
+#include <vector>
+
+// RT Specific
+#include "Accelerator.h"
+#include "TriangleStore.h"
+
+// Constants
+// Cells per triangle of the uniform grid
+const float GRID_DENSITY = 2.0f;
+// Cells per triangle of the two level grid's top level, and of the grid within each crowded top cell
+const float TWO_LEVEL_GRID_TOP_DENSITY = 0.0625f;
+const float TWO_LEVEL_GRID_CELL_DENSITY = 2.0f;
+// Top cells with at most this many triangles are tested directly rather than given their own grid
+const unsigned int TWO_LEVEL_GRID_LEAF_SIZE = 8;
+// Cells per axis are capped, so flat or thin meshes can't ask for huge grids
+const unsigned int GRID_MAX_RESOLUTION = 1024;
+// Marks top cells without their own grid
+const unsigned int GRID_NO_SUBGRID = 0xffffffff;
+
+// A box divided into equal cells
+struct GridLevel
+{
+	float minBounds[3];
+	float maxBounds[3];
+	float cellSize[3];
+	float inverseCellSize[3];
+	unsigned int resolution[3];
+	// Index of this level's first cell in the grid's cell array, cells are stored x fastest
+	unsigned int firstCell;
+
+	unsigned int cellCount() const { return resolution[0] * resolution[1] * resolution[2]; };
+};
+
+// Range of entries in the grid's reference array
+struct GridCell
+{
+	unsigned int first;
+	unsigned int count;
+};
+
+class Grid : public Accelerator
+{
+private:
+	// Top level, and the grids within crowded top cells of a two level grid
+	GridLevel topLevel;
+	std::vector<GridLevel> subLevels;
+	// Sub level of each top cell, or GRID_NO_SUBGRID
+	std::vector<unsigned int> topCellSubLevels;
+	// Cells of every level
+	std::vector<GridCell> cells;
+	// Triangle behind each entry, cells reference ranges of this array
+	std::vector<unsigned int> references;
+	// Vertices and edges of the triangles in reference order, so each cell is one leaf test
+	TriangleStore triangleStore;
+	// Unpadded bounds of the triangles
+	AABB bounds;
+public:
+	// Two levels, or a single uniform grid
+	bool twoLevel;
+	// Triangles per cell test, one of the TRIANGLE_KERNEL constants
+	unsigned int triangleKernelWidth;
+
+	// Constructor
+	Grid(bool newTwoLevel);
+
+	void build(const std::vector<Cartesian3>& triangleVertices);
+	void clear();
+	bool isEmpty() const { return references.empty(); };
+	bool intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const;
+	bool intersectAny(const Ray& ray, float tMin, float tMax) const;
+	const std::vector<unsigned int>& getTriangleReferences() const { return references; };
+	void remapTriangles(const std::vector<unsigned int>& newIndices);
+	AABB getBounds() const { return bounds; };
+	const char* getName() const { return twoLevel ? "two level grid" : "uniform grid"; };
+	Accelerator* clone() const { return new Grid(*this); };
+};
@@ -0,0 +1,144 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  -----------------------------
+//  HeadlessMain.cpp
+//  -----------------------------
+//
+//  Renders one frame to a file without a window, for servers and batch
+//  runs. Built with RT_HEADLESS defined, so nothing here needs Qt or
+//  OpenGL. Without it this file is empty, leaving main.cpp's window, and
+//  benchmark builds, with RT_BENCHMARK too, have BenchmarkMain.cpp's.
+//
+////////////////////////////////////////////////////////////////////////
+
+#if defined(RT_HEADLESS) && !defined(RT_BENCHMARK)
+
+// system libraries
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+
+// local includes
+#include "RenderOptions.h"
+#include "RaytraceTexturedObject.h"
+#include "StressScene.h"
+#include "Raytracer.h"
+#include "DistributedRender.h"
+#include "RGBAImage.h"
+
+// main routine
+int main(int argc, char **argv)
+    { // main()
+    // render tiles for a coordinator elsewhere, which sends the scene, so no files are needed
+    if (argc >= 2 && argc <= 3 && std::string(argv[1]) == "worker")
+        { // render worker
+        std::string host;
+        unsigned short port = DISTRIBUTED_PORT_DEFAULT;
+        if (!parseWorkerAddress(argc == 3 ? argv[2] : "localhost", host, port))
+            return 1;
+        return runRenderWorker(host, port) ? 0 : 1;
+        } // render worker
+
+    // read the flags, and any config files they name
+    RenderOptions options;
+    std::string error;
+    if (argc < 2 || !parseRenderArguments(argc - 1, argv + 1, options, error))
+        { // bad arguments
+        if (!error.empty())
+            std::cout << "Error: " << error << std::endl;
+        printRenderOptionsUsage(argv[0]);
+        return 1;
+        } // bad arguments
+
+    // the structure settings must be in place before the read builds it
+    RaytraceTexturedObject rtTexturedObject;
+    configureObject(options, rtTexturedObject);
+
+    if (options.generateScene)
+        { // stress scene
+        // workers read the scene from OBJ text, which generated scenes never had
+        if (options.distributedPort != 0)
+            { // not distributable
+            std::cout << "Generated scenes can't be rendered on workers" << std::endl;
+            return 1;
+            } // not distributable
+        generateStressScene(options.stressScene, rtTexturedObject);
+        } // stress scene
+    else
+        { // scene files
+        // open the input files for the geometry & texture
+        std::ifstream geometryFile(options.geometryPath);
+        std::ifstream textureFile(options.texturePath);
+        if (!(geometryFile.good()) || !(textureFile.good()) || (!rtTexturedObject.ReadObjectStream(geometryFile, textureFile)))
+            { // object read failed
+            std::cout << "Read failed for object " << options.geometryPath << " or texture " << options.texturePath << std::endl;
+            return 1;
+            } // object read failed
+        } // scene files
+    rtTexturedObject.waitForAccelerator();
+
+    RGBAImage image;
+    PixelDiagnostics pixelDiagnostics;
+    if (!image.Resize(options.width, options.height))
+        return 1;
+
+    if (options.distributedPort != 0)
+        { // distributed render
+        // costs are counted by the threads doing the work, which are in other processes
+        if (options.pixelDiagnostics)
+            { // not distributable
+            std::cout << "Diagnostic renders can't be rendered on workers" << std::endl;
+            return 1;
+            } // not distributable
+        // workers light the frame from the render parameters, which hold one light
+        if (options.lights.size() > 1)
+            { // too many lights
+            std::cout << "Distributed renders take at most one light" << std::endl;
+            return 1;
+            } // too many lights
+        RenderParameters renderParameters = options.renderParameters;
+        if (options.lights.size() == 1)
+            { // light given
+            const RenderLight& light = options.lights[0];
+            renderParameters.lightMatrix = getLightToWorld(light);
+            renderParameters.lightColor[0] = light.color.x * light.intensity;
+            renderParameters.lightColor[1] = light.color.y * light.intensity;
+            renderParameters.lightColor[2] = light.color.z * light.intensity;
+            } // light given
+
+        if (!renderDistributed(options.geometryPath, options.texturePath, rtTexturedObject.getAcceleratorType(), options.distributedPort,
+                options.distributedWorkers, image, renderParameters, options.projectionMode))
+            return 1;
+        } // distributed render
+    else
+        { // local render
+        std::vector<std::unique_ptr<DirectionalLight>> lights = createLights(options);
+        std::vector<Light*> lightPointers;
+        for (auto& light : lights)
+            lightPointers.push_back(light.get());
+
+        Raytracer raytracer(&image, &rtTexturedObject, &lightPointers, &options.renderParameters);
+        configureRaytracer(options, raytracer);
+        if (options.generateScene)
+            placeStressInstances(options.stressScene, raytracer.getScene());
+        if (options.pixelDiagnostics)
+            raytracer.setPixelDiagnostics(&pixelDiagnostics);
+        raytracer.raytrace();
+        } // local render
+
+    std::ofstream imageFile(options.outputPath);
+    image.WritePPM(imageFile);
+    if (!imageFile.good())
+        { // write failed
+        std::cout << "Write failed for image " << options.outputPath << std::endl;
+        return 1;
+        } // write failed
+    std::cout << "Wrote " << options.outputPath << std::endl;
+    if (options.pixelDiagnostics && !pixelDiagnostics.writeFiles(options.outputPath))
+        return 1;
+    return 0;
+    } // main()
+
+#endif // RT_HEADLESS && !RT_BENCHMARK
@@ -20,6 +20,8 @@
 
 #include <iostream>
 #include <iomanip>
+#include <cmath>
+#include <utility>
 #include "Matrix4.h"
 #include "Quaternion.h"
 
@@ -168,6 +170,60 @@ Matrix4 Matrix4::transpose() const
 	return transposeMatrix;
 	} // transpose()
 
+// matrix inverse (returns the zero matrix if singular)
+Matrix4 Matrix4::inverse() const
+	{ // inverse()
+	// Gauss-Jordan elimination with partial pivoting on [this | I]
+	Matrix4 source(*this);
+	Matrix4 inverseMatrix;
+	inverseMatrix.SetIdentity();
+
+	for (int col = 0; col < 4; col++)
+		{ // per column
+		// find the largest pivot in this column
+		int pivotRow = col;
+		for (int row = col + 1; row < 4; row++)
+			if (fabs(source.coordinates[row][col]) > fabs(source.coordinates[pivotRow][col]))
+				pivotRow = row;
+
+		// singular matrix
+		if (source.coordinates[pivotRow][col] == 0.0)
+			return Matrix4();
+
+		// swap the pivot row into place
+		if (pivotRow != col)
+			for (int entry = 0; entry < 4; entry++)
+				{ // swap entries
+				std::swap(source.coordinates[col][entry], source.coordinates[pivotRow][entry]);
+				std::swap(inverseMatrix.coordinates[col][entry], inverseMatrix.coordinates[pivotRow][entry]);
+				} // swap entries
+
+		// scale the pivot row to 1
+		float pivotScale = 1.0 / source.coordinates[col][col];
+		for (int entry = 0; entry < 4; entry++)
+			{ // scale entries
+			source.coordinates[col][entry] *= pivotScale;
+			inverseMatrix.coordinates[col][entry] *= pivotScale;
+			} // scale entries
+
+		// and eliminate the column from every other row
+		for (int row = 0; row < 4; row++)
+			{ // per row
+			if (row == col)
+				continue;
+			float factor = source.coordinates[row][col];
+			for (int entry = 0; entry < 4; entry++)
+				{ // subtract entries
+				source.coordinates[row][entry] -= factor * source.coordinates[col][entry];
+				inverseMatrix.coordinates[row][entry] -= factor * inverseMatrix.coordinates[col][entry];
+				} // subtract entries
+			} // per row
+		} // per column
+
+	// return the result
+	return inverseMatrix;
+	} // inverse()
+
 // returns a column-major array of 16 values
 // for use with OpenGL
 columnMajorMatrix Matrix4::columnMajor() const
@@ -0,0 +1,210 @@
+// NUMA topology, thread pinning and page placement queries
+#include "NumaTopology.h"
+
+// Standard libraries
+#include <algorithm>
+#include <thread>
+#include <string>
+#include <set>
+
+// Platform
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__linux__)
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// Node of the calling thread, set when it's pinned
+static thread_local unsigned int threadNumaNode = 0;
+
+#if defined(__linux__)
+// Numbers in a sysfs list such as "0-3,8-11"
+static std::vector<unsigned int> parseSysfsList(const std::string& list)
+{
+	std::vector<unsigned int> values;
+	size_t position = 0;
+	while (position < list.size())
+	{
+		size_t end = list.find(',', position);
+		if (end == std::string::npos)
+		{
+			end = list.size();
+		}
+		std::string range = list.substr(position, end - position);
+		size_t dash = range.find('-');
+		if (!range.empty() && range.find_first_not_of(" \n") != std::string::npos)
+		{
+			unsigned int first = (unsigned int)std::stoul(range.substr(0, dash));
+			unsigned int last = dash == std::string::npos ? first : (unsigned int)std::stoul(range.substr(dash + 1));
+			for (unsigned int value = first; value <= last; value++)
+			{
+				values.push_back(value);
+			}
+		}
+		position = end + 1;
+	}
+	return values;
+}
+
+// Whole first line of a sysfs file, empty if it can't be read
+static std::string readSysfsLine(const std::string& path)
+{
+	std::ifstream file(path);
+	std::string line;
+	std::getline(file, line);
+	return line;
+}
+#endif
+
+NumaTopology detectNumaTopology()
+{
+	NumaTopology topology;
+#if defined(_WIN32)
+	ULONG highestNode = 0;
+	if (GetNumaHighestNodeNumber(&highestNode))
+	{
+		for (ULONG node = 0; node <= highestNode; node++)
+		{
+			// Only the first processor group, which covers up to 64 logical CPUs
+			ULONGLONG mask = 0;
+			if (!GetNumaNodeProcessorMask((UCHAR)node, &mask) || mask == 0)
+			{
+				continue;
+			}
+			std::vector<unsigned int> cpus;
+			for (unsigned int cpu = 0; cpu < 64; cpu++)
+			{
+				if (mask & (1ull << cpu))
+				{
+					cpus.push_back(cpu);
+				}
+			}
+			topology.nodeCpus.push_back(cpus);
+			topology.systemNodes.push_back((int)node);
+		}
+	}
+#elif defined(__linux__)
+	for (auto node : parseSysfsList(readSysfsLine("/sys/devices/system/node/online")))
+	{
+		std::vector<unsigned int> cpus = parseSysfsList(readSysfsLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+		if (!cpus.empty())
+		{
+			topology.nodeCpus.push_back(cpus);
+			topology.systemNodes.push_back((int)node);
+		}
+	}
+#endif
+	if (topology.nodeCpus.empty())
+	{
+		std::vector<unsigned int> cpus;
+		for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++)
+		{
+			cpus.push_back(cpu);
+		}
+		topology.nodeCpus.push_back(cpus);
+		topology.systemNodes.push_back(0);
+	}
+	return topology;
+}
+
+unsigned int getPhysicalCoreCount()
+{
+	unsigned int coreCount = 0;
+#if defined(_WIN32)
+	DWORD size = 0;
+	GetLogicalProcessorInformation(nullptr, &size);
+	std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> processors(size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	if (!processors.empty() && GetLogicalProcessorInformation(processors.data(), &size))
+	{
+		for (auto& processor : processors)
+		{
+			if (processor.Relationship == RelationProcessorCore)
+			{
+				coreCount++;
+			}
+		}
+	}
+#elif defined(__linux__)
+	// CPUs on the same core list the same siblings
+	std::set<std::string> cores;
+	for (auto cpu : parseSysfsList(readSysfsLine("/sys/devices/system/cpu/online")))
+	{
+		std::string siblings = readSysfsLine("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list");
+		if (!siblings.empty())
+		{
+			cores.insert(siblings);
+		}
+	}
+	coreCount = (unsigned int)cores.size();
+#endif
+	if (coreCount == 0)
+	{
+		coreCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	return coreCount;
+}
+
+bool pinThreadToNumaNode(const NumaTopology& topology, unsigned int node)
+{
+	if (node >= topology.getNodeCount())
+	{
+		return false;
+	}
+	bool pinned = false;
+#if defined(_WIN32)
+	DWORD_PTR mask = 0;
+	for (auto cpu : topology.nodeCpus[node])
+	{
+		mask |= (DWORD_PTR)1 << cpu;
+	}
+	pinned = SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (auto cpu : topology.nodeCpus[node])
+	{
+		CPU_SET(cpu, &cpuSet);
+	}
+	pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#endif
+	// Recorded either way, so work is still grouped by node where pinning isn't allowed
+	threadNumaNode = node;
+	return pinned;
+}
+
+unsigned int getThreadNumaNode()
+{
+	return threadNumaNode;
+}
+
+int getPageNumaNode(const NumaTopology& topology, const void* address)
+{
+	int systemNode = NUMA_NODE_UNKNOWN;
+#if defined(_WIN32)
+	PSAPI_WORKING_SET_EX_INFORMATION information;
+	information.VirtualAddress = const_cast<void*>(address);
+	if (QueryWorkingSetEx(GetCurrentProcess(), &information, sizeof(information)) && information.VirtualAttributes.Valid)
+	{
+		systemNode = (int)information.VirtualAttributes.Node;
+	}
+#elif defined(__linux__) && defined(SYS_get_mempolicy)
+	// MPOL_F_NODE | MPOL_F_ADDR asks for the node of the page at the address, without needing libnuma
+	const unsigned long MEMPOLICY_NODE_OF_ADDRESS = 1 | 2;
+	int node = 0;
+	if (syscall(SYS_get_mempolicy, &node, nullptr, 0ul, const_cast<void*>(address), MEMPOLICY_NODE_OF_ADDRESS) == 0)
+	{
+		systemNode = node;
+	}
+#endif
+	auto found = std::find(topology.systemNodes.begin(), topology.systemNodes.end(), systemNode);
+	return found == topology.systemNodes.end() ? NUMA_NODE_UNKNOWN : (int)(found - topology.systemNodes.begin());
+}
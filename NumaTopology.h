@@ -0,0 +1,37 @@
+// NUMA topology, thread pinning and page placement queries
+// Linux reads the nodes from sysfs, pins with thread affinity and asks get_mempolicy where a page lives. Windows uses the
+// Win32 NUMA calls and QueryWorkingSetEx. Elsewhere, or if the system reports nothing, the whole machine is one node.
+// Nodes are numbered densely from 0 in the order the system lists them, skipping any without CPUs.
+// Physical cores come from each CPU's thread siblings on Linux and GetLogicalProcessorInformation on Windows
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <cstddef>
+
+// Constants
+// Page placement the system can't report, or a page not yet touched
+const int NUMA_NODE_UNKNOWN = -1;
+
+struct NumaTopology
+{
+	// Logical CPUs of each node
+	std::vector<std::vector<unsigned int>> nodeCpus;
+	// The system's own number for each node
+	std::vector<int> systemNodes;
+
+	size_t getNodeCount() const { return nodeCpus.size(); };
+};
+
+// The machine's nodes, always at least one
+NumaTopology detectNumaTopology();
+// Cores, each counted once however many hardware threads it runs. The logical CPU count where the system doesn't say
+unsigned int getPhysicalCoreCount();
+
+// Restrict the calling thread to a node's CPUs and record it as the thread's node. Returns false if the system refused
+bool pinThreadToNumaNode(const NumaTopology& topology, unsigned int node);
+// Node the calling thread was pinned to, 0 for threads never pinned
+unsigned int getThreadNumaNode();
+
+// Node holding the page an address is on, or NUMA_NODE_UNKNOWN
+int getPageNumaNode(const NumaTopology& topology, const void* address);
@@ -0,0 +1,169 @@
+// Per pixel cost of a render
+#include "PixelDiagnostics.h"
+
+// Standard libraries
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+// RT Specific
+#include "CpuFeatures.h"
+
+#if defined(RT_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Constants
+const char* const PIXEL_DIAGNOSTIC_NAMES[PIXEL_DIAGNOSTIC_COUNT] = { "node_visits", "triangle_tests", "shadow_rays", "cycles" };
+// Colours false colour images pass through, evenly spaced from no cost to the scale
+const float FALSE_COLOUR_RAMP[][3] = { { 0.0f, 0.0f, 0.5f }, { 0.0f, 0.3f, 1.0f }, { 0.0f, 0.9f, 0.9f }, { 0.2f, 0.9f, 0.1f },
+	{ 1.0f, 0.9f, 0.0f }, { 1.0f, 0.4f, 0.0f }, { 0.8f, 0.0f, 0.0f } };
+const unsigned int FALSE_COLOUR_RAMP_SIZE = sizeof(FALSE_COLOUR_RAMP) / sizeof(FALSE_COLOUR_RAMP[0]);
+
+uint64_t readCycleCounter()
+{
+#if defined(RT_X86)
+	return __rdtsc();
+#else
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+PixelCost& PixelCost::operator += (const PixelCost& other)
+{
+	for (unsigned int measure = 0; measure < PIXEL_DIAGNOSTIC_COUNT; measure++)
+	{
+		values[measure] += other.values[measure];
+	}
+	return *this;
+}
+
+PixelCost PixelCost::operator * (float factor) const
+{
+	PixelCost scaled;
+	for (unsigned int measure = 0; measure < PIXEL_DIAGNOSTIC_COUNT; measure++)
+	{
+		scaled.values[measure] = values[measure] * factor;
+	}
+	return scaled;
+}
+
+void PixelDiagnostics::reset(size_t newWidth, size_t newHeight)
+{
+	width = newWidth;
+	height = newHeight;
+	for (auto& buffer : buffers)
+	{
+		buffer.assign(width * height, 0.0f);
+	}
+}
+
+void PixelDiagnostics::set(size_t row, size_t col, const PixelCost& cost)
+{
+	for (unsigned int measure = 0; measure < PIXEL_DIAGNOSTIC_COUNT; measure++)
+	{
+		buffers[measure][row * width + col] = cost.values[measure];
+	}
+}
+
+const char* PixelDiagnostics::getMeasureName(unsigned int measure)
+{
+	return PIXEL_DIAGNOSTIC_NAMES[measure];
+}
+
+float PixelDiagnostics::getScale(unsigned int measure) const
+{
+	const std::vector<float>& buffer = buffers[measure];
+	if (buffer.empty())
+	{
+		return 0.0f;
+	}
+	std::vector<float> sorted(buffer);
+	size_t index = std::min(sorted.size() - 1, (size_t)(PIXEL_DIAGNOSTIC_SCALE_PERCENTILE * sorted.size()));
+	std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+	// A measure mostly zero still shows what it has
+	return sorted[index] > 0.0f ? sorted[index] : *std::max_element(buffer.begin(), buffer.end());
+}
+
+void PixelDiagnostics::drawFalseColour(unsigned int measure, RGBAImage& imageOut) const
+{
+	imageOut.Resize((long)width, (long)height);
+	float scale = getScale(measure);
+	for (size_t row = 0; row < height; row++)
+	{
+		for (size_t col = 0; col < width; col++)
+		{
+			// Position along the ramp, between two of its colours
+			float position = scale > 0.0f ? std::min(1.0f, get(measure, row, col) / scale) * (FALSE_COLOUR_RAMP_SIZE - 1) : 0.0f;
+			unsigned int lower = std::min((unsigned int)position, FALSE_COLOUR_RAMP_SIZE - 2);
+			float fraction = position - lower;
+			float colour[3];
+			for (unsigned int channel = 0; channel < 3; channel++)
+			{
+				colour[channel] = FALSE_COLOUR_RAMP[lower][channel] * (1.0f - fraction) + FALSE_COLOUR_RAMP[lower + 1][channel] * fraction;
+			}
+			imageOut[(int)row][col] = RGBAValue(colour[0] * 255.0f, colour[1] * 255.0f, colour[2] * 255.0f, 255.0f);
+		}
+	}
+}
+
+void PixelDiagnostics::writePFM(unsigned int measure, std::ostream& outStream) const
+{
+	// A negative scale marks the floats as little endian, so the bytes are swapped on machines that aren't
+	const uint32_t one = 1;
+	bool littleEndian = *(const unsigned char*)&one == 1;
+	outStream << "Pf\n" << width << " " << height << "\n-1.0\n";
+	std::vector<unsigned char> rowBytes(width * sizeof(float));
+	for (size_t row = height; row-- > 0;)
+	{
+		std::memcpy(rowBytes.data(), &buffers[measure][row * width], rowBytes.size());
+		if (!littleEndian)
+		{
+			for (size_t offset = 0; offset < rowBytes.size(); offset += sizeof(float))
+			{
+				std::reverse(rowBytes.begin() + offset, rowBytes.begin() + offset + sizeof(float));
+			}
+		}
+		outStream.write((const char*)rowBytes.data(), rowBytes.size());
+	}
+}
+
+bool PixelDiagnostics::writeFiles(const std::string& imagePath) const
+{
+	// Beside the image, its extension replaced
+	size_t slash = imagePath.find_last_of("/\\");
+	size_t dot = imagePath.rfind('.');
+	std::string basePath = dot != std::string::npos && (slash == std::string::npos || dot > slash) ? imagePath.substr(0, dot) : imagePath;
+	for (unsigned int measure = 0; measure < PIXEL_DIAGNOSTIC_COUNT; measure++)
+	{
+		std::string measurePath = basePath + "." + getMeasureName(measure);
+		RGBAImage image;
+		drawFalseColour(measure, image);
+		std::ofstream imageFile(measurePath + ".ppm");
+		image.WritePPM(imageFile);
+		std::ofstream bufferFile(measurePath + ".pfm", std::ios::binary);
+		writePFM(measure, bufferFile);
+		if (!imageFile.good() || !bufferFile.good())
+		{
+			std::cout << "Write failed for diagnostics " << measurePath << std::endl;
+			return false;
+		}
+
+		const std::vector<float>& buffer = buffers[measure];
+		double sum = 0.0;
+		for (auto value : buffer)
+		{
+			sum += value;
+		}
+		std::cout << "Diagnostics " << getMeasureName(measure) << ": mean " << (buffer.empty() ? 0.0 : sum / buffer.size()) << ", max "
+			<< (buffer.empty() ? 0.0f : *std::max_element(buffer.begin(), buffer.end())) << ", red at " << getScale(measure) << std::endl;
+	}
+	std::cout << "Wrote diagnostics to " << basePath << ".*" << std::endl;
+	return true;
+}
@@ -0,0 +1,64 @@
+// Per pixel cost of a render
+// A diagnostic render records, for every pixel, the traversal steps, triangle tests and shadow rays its rays took and
+// the cycles spent on it, so the parts of the image that make a frame slow can be found. Each measure is written as a
+// false colour image, from blue for free through green to red for the dearest pixels, and as a float buffer
+#pragma once
+
+// Standard libraries
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+// Utils
+#include "RGBAImage.h"
+
+// Constants
+// Measures
+const unsigned int PIXEL_DIAGNOSTIC_NODE_VISITS = 0;
+const unsigned int PIXEL_DIAGNOSTIC_PRIMITIVE_TESTS = 1;
+const unsigned int PIXEL_DIAGNOSTIC_SHADOW_RAYS = 2;
+const unsigned int PIXEL_DIAGNOSTIC_CYCLES = 3;
+const unsigned int PIXEL_DIAGNOSTIC_COUNT = 4;
+// False colour images reach red at this percentile, so a few pixels held up by the system don't leave the rest blue
+const float PIXEL_DIAGNOSTIC_SCALE_PERCENTILE = 0.995f;
+
+// Cycles counted by the processor's time stamp counter, or nanoseconds where there is none. Only differences mean anything
+uint64_t readCycleCounter();
+
+// One pixel's worth of every measure
+struct PixelCost
+{
+	float values[PIXEL_DIAGNOSTIC_COUNT] = {};
+
+	PixelCost& operator += (const PixelCost& other);
+	PixelCost operator * (float factor) const;
+};
+
+class PixelDiagnostics
+{
+private:
+	size_t width = 0;
+	size_t height = 0;
+	// One buffer per measure, in rows as the frame buffer
+	std::vector<float> buffers[PIXEL_DIAGNOSTIC_COUNT];
+public:
+	// Match the frame's size, clearing every measure
+	void reset(size_t newWidth, size_t newHeight);
+	// Replace a pixel's measures. Threads may set different pixels at once
+	void set(size_t row, size_t col, const PixelCost& cost);
+	float get(unsigned int measure, size_t row, size_t col) const { return buffers[measure][row * width + col]; };
+	size_t getWidth() const { return width; };
+	size_t getHeight() const { return height; };
+
+	// Name of a measure, as used in file names
+	static const char* getMeasureName(unsigned int measure);
+	// Value false colour images of a measure reach red at
+	float getScale(unsigned int measure) const;
+	void drawFalseColour(unsigned int measure, RGBAImage& imageOut) const;
+	// Greyscale PFM, little endian floats with rows bottom to top as the format has them
+	void writePFM(unsigned int measure, std::ostream& outStream) const;
+	// Write every measure beside the image, as "image.cycles.ppm" and "image.cycles.pfm" for "image.ppm", with a summary
+	// of each to std::cout. Returns false if a file couldn't be written
+	bool writeFiles(const std::string& imagePath) const;
+};
@@ -0,0 +1,302 @@
+// Compressed multi branching bounding volume hierarchy
+#include "QuantisedBVH.h"
+
+// Standard libraries
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cstring>
+
+// RT Specific
+#include "CpuFeatures.h"
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+// Distance along the ray of one step and of the node's origin per axis, so a plane s steps out is at s * step + origin
+static void computeStepDistances(const float* origin, const float* scale, const WideRay& ray, float* stepDistances, float* originDistances)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		stepDistances[axis] = scale[axis] * ray.inverseDirection[axis];
+		originDistances[axis] = (origin[axis] - ray.origin[axis]) * ray.inverseDirection[axis];
+	}
+}
+
+// Plain loop, for CPUs without a matching SIMD kernel
+template <unsigned int Width, typename Quantum>
+static unsigned int intersectQuantisedScalar(const QuantisedBVHNode<Width, Quantum>& node, const WideRay& ray, float tMin, float tMax, float* distances)
+{
+	float stepDistances[3], originDistances[3];
+	computeStepDistances(node.origin, node.scale, ray, stepDistances, originDistances);
+	unsigned int hitMask = 0;
+	for (unsigned int slot = 0; slot < Width; slot++)
+	{
+		float tNear = tMin;
+		float tFar = tMax;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float nearPlane = (float)node.bounds[ray.nearRow[axis]][slot] * stepDistances[axis] + originDistances[axis];
+			float farPlane = (float)node.bounds[ray.farRow[axis]][slot] * stepDistances[axis] + originDistances[axis];
+			// A NaN from 0 * infinity only makes the test conservative
+			tNear = std::max(tNear, nearPlane);
+			tFar = std::min(tFar, farPlane);
+		}
+		distances[slot] = tNear;
+		if (tNear <= tFar)
+		{
+			hitMask |= 1u << slot;
+		}
+	}
+	return hitMask;
+}
+
+#ifdef RT_X86
+// Four steps widened to floats
+RT_TARGET("sse4.1")
+static inline __m128 loadSteps4(const unsigned char* steps)
+{
+	int packed;
+	std::memcpy(&packed, steps, sizeof(packed));
+	return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+RT_TARGET("sse4.1")
+static inline __m128 loadSteps4(const unsigned short* steps)
+{
+	return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)steps)));
+}
+
+// Four children with SSE4.1, which has the widening loads
+template <typename Quantum>
+RT_TARGET("sse4.1")
+static unsigned int intersectQuantisedSSE(const QuantisedBVHNode<4, Quantum>& node, const WideRay& ray, float tMin, float tMax, float* distances)
+{
+	float stepDistances[3], originDistances[3];
+	computeStepDistances(node.origin, node.scale, ray, stepDistances, originDistances);
+	__m128 tNear = _mm_set1_ps(tMin);
+	__m128 tFar = _mm_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m128 stepDistance = _mm_set1_ps(stepDistances[axis]);
+		__m128 originDistance = _mm_set1_ps(originDistances[axis]);
+		__m128 nearPlane = _mm_add_ps(_mm_mul_ps(loadSteps4(node.bounds[ray.nearRow[axis]]), stepDistance), originDistance);
+		__m128 farPlane = _mm_add_ps(_mm_mul_ps(loadSteps4(node.bounds[ray.farRow[axis]]), stepDistance), originDistance);
+		// max and min return the second operand for NaNs, keeping the test conservative
+		tNear = _mm_max_ps(nearPlane, tNear);
+		tFar = _mm_min_ps(farPlane, tFar);
+	}
+	_mm_storeu_ps(distances, tNear);
+	return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+
+// Eight steps widened to floats, in two halves as AVX has no 256 bit integer conversions
+RT_TARGET("avx")
+static inline __m256 loadSteps8(const unsigned char* steps)
+{
+	__m128i packed = _mm_loadl_epi64((const __m128i*)steps);
+	__m128i low = _mm_cvtepu8_epi32(packed);
+	__m128i high = _mm_cvtepu8_epi32(_mm_srli_si128(packed, 4));
+	return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+
+RT_TARGET("avx")
+static inline __m256 loadSteps8(const unsigned short* steps)
+{
+	__m128i packed = _mm_loadu_si128((const __m128i*)steps);
+	__m128i low = _mm_cvtepu16_epi32(packed);
+	__m128i high = _mm_cvtepu16_epi32(_mm_srli_si128(packed, 8));
+	return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+
+// Eight children with AVX
+template <typename Quantum>
+RT_TARGET("avx")
+static unsigned int intersectQuantisedAVX(const QuantisedBVHNode<8, Quantum>& node, const WideRay& ray, float tMin, float tMax, float* distances)
+{
+	float stepDistances[3], originDistances[3];
+	computeStepDistances(node.origin, node.scale, ray, stepDistances, originDistances);
+	__m256 tNear = _mm256_set1_ps(tMin);
+	__m256 tFar = _mm256_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m256 stepDistance = _mm256_set1_ps(stepDistances[axis]);
+		__m256 originDistance = _mm256_set1_ps(originDistances[axis]);
+		__m256 nearPlane = _mm256_add_ps(_mm256_mul_ps(loadSteps8(node.bounds[ray.nearRow[axis]]), stepDistance), originDistance);
+		__m256 farPlane = _mm256_add_ps(_mm256_mul_ps(loadSteps8(node.bounds[ray.farRow[axis]]), stepDistance), originDistance);
+		tNear = _mm256_max_ps(nearPlane, tNear);
+		tFar = _mm256_min_ps(farPlane, tFar);
+	}
+	_mm256_storeu_ps(distances, tNear);
+	return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+}
+#endif
+
+// Pick the box test for a width and precision on this CPU
+template <typename Quantum>
+static typename QuantisedBVH<4, Quantum>::BoxKernel selectQuantisedKernel(const QuantisedBVH<4, Quantum>&, const char*& kernelName)
+{
+#ifdef RT_X86
+	if (getCpuFeatures().sse41)
+	{
+		kernelName = "SSE4.1";
+		return intersectQuantisedSSE<Quantum>;
+	}
+#endif
+	kernelName = "scalar";
+	return intersectQuantisedScalar<4, Quantum>;
+}
+
+template <typename Quantum>
+static typename QuantisedBVH<8, Quantum>::BoxKernel selectQuantisedKernel(const QuantisedBVH<8, Quantum>&, const char*& kernelName)
+{
+#ifdef RT_X86
+	if (getCpuFeatures().avx)
+	{
+		kernelName = "AVX";
+		return intersectQuantisedAVX<Quantum>;
+	}
+#endif
+	kernelName = "scalar";
+	return intersectQuantisedScalar<8, Quantum>;
+}
+
+template <unsigned int Width, typename Quantum>
+QuantisedBVH<Width, Quantum>::QuantisedBVH() : boxKernel(intersectQuantisedScalar<Width, Quantum>), kernelName("scalar")
+{
+}
+
+// Power of two step that covers low to high in steps steps, so decoding multiplies by it exactly
+static float chooseScale(float low, float high, unsigned int steps)
+{
+	float extent = high - low;
+	if (!(extent > 0.0f))
+	{
+		// Flat axis, every bound decodes to the origin
+		return 1.0f;
+	}
+	int exponent;
+	std::frexp(extent / (float)steps, &exponent);
+	float scale = std::ldexp(1.0f, exponent);
+	// Rounding in the sum can still fall short of the top
+	while (low + (float)steps * scale < high)
+	{
+		scale *= 2.0f;
+	}
+	return scale;
+}
+
+template <unsigned int Width, typename Quantum>
+bool QuantisedBVH<Width, Quantum>::build(const WideBVH<Width>& wide)
+{
+	boxKernel = selectQuantisedKernel(*this, kernelName);
+	nodes.clear();
+	primitiveIndices.clear();
+	if (wide.isEmpty())
+	{
+		return true;
+	}
+	primitiveIndices.reserve(wide.primitiveIndices.size());
+	const unsigned int steps = std::numeric_limits<Quantum>::max();
+
+	// Pairs of compressed node and the wide node it copies. A node's interior children are created together when it is
+	// filled, then filled depth first from the first slot, so subtrees and their references stay close in memory
+	std::vector<std::pair<unsigned int, unsigned int>> stack;
+	nodes.push_back(QuantisedBVHNode<Width, Quantum>());
+	stack.push_back(std::make_pair(0u, 0u));
+	while (!stack.empty())
+	{
+		unsigned int nodeIndex = stack.back().first;
+		const WideBVHNode<Width>& wideNode = wide.nodes[stack.back().second];
+		stack.pop_back();
+		size_t firstPushed = stack.size();
+
+		QuantisedBVHNode<Width, Quantum> node;
+		node.firstChild = (unsigned int)nodes.size();
+		node.firstReference = (unsigned int)primitiveIndices.size();
+		node.childMask = 0;
+		node.interiorMask = 0;
+
+		// The root is never a child, so a zero child with no primitives is an empty slot
+		float minBounds[3] = { std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity() };
+		float maxBounds[3] = { -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			unsigned int count = wideNode.primitiveCounts[slot];
+			node.primitiveCounts[slot] = 0;
+			if (count > 0)
+			{
+				if (count > 255)
+				{
+					nodes.clear();
+					primitiveIndices.clear();
+					return false;
+				}
+				node.primitiveCounts[slot] = (unsigned char)count;
+				primitiveIndices.insert(primitiveIndices.end(), wide.primitiveIndices.begin() + wideNode.children[slot], wide.primitiveIndices.begin() + wideNode.children[slot] + count);
+			}
+			else if (wideNode.children[slot] != 0)
+			{
+				node.interiorMask |= 1u << slot;
+				stack.push_back(std::make_pair((unsigned int)nodes.size(), wideNode.children[slot]));
+				nodes.push_back(QuantisedBVHNode<Width, Quantum>());
+			}
+			else
+			{
+				continue;
+			}
+			node.childMask |= 1u << slot;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				minBounds[axis] = std::min(minBounds[axis], wideNode.bounds[axis][slot]);
+				maxBounds[axis] = std::max(maxBounds[axis], wideNode.bounds[3 + axis][slot]);
+			}
+		}
+
+		std::reverse(stack.begin() + firstPushed, stack.end());
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			node.origin[axis] = minBounds[axis];
+			node.scale[axis] = chooseScale(minBounds[axis], maxBounds[axis], steps);
+		}
+		// Round each bound outwards, then step it further out while decoding would still land inside the original
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				if (!(node.childMask & (1u << slot)))
+				{
+					node.bounds[axis][slot] = 0;
+					node.bounds[3 + axis][slot] = 0;
+					continue;
+				}
+				float origin = node.origin[axis];
+				float scale = node.scale[axis];
+				float low = std::floor((wideNode.bounds[axis][slot] - origin) / scale);
+				float high = std::ceil((wideNode.bounds[3 + axis][slot] - origin) / scale);
+				unsigned int lowSteps = (unsigned int)std::min((float)steps, std::max(0.0f, low));
+				unsigned int highSteps = (unsigned int)std::min((float)steps, std::max(0.0f, high));
+				while (lowSteps > 0 && origin + (float)lowSteps * scale > wideNode.bounds[axis][slot])
+				{
+					lowSteps--;
+				}
+				while (highSteps < steps && origin + (float)highSteps * scale < wideNode.bounds[3 + axis][slot])
+				{
+					highSteps++;
+				}
+				node.bounds[axis][slot] = (Quantum)lowSteps;
+				node.bounds[3 + axis][slot] = (Quantum)highSteps;
+			}
+		}
+		nodes[nodeIndex] = node;
+	}
+	return true;
+}
+
+// Widths and precisions in use
+template class QuantisedBVH<4, unsigned char>;
+template class QuantisedBVH<4, unsigned short>;
+template class QuantisedBVH<8, unsigned char>;
+template class QuantisedBVH<8, unsigned short>;
@@ -0,0 +1,205 @@
+// Compressed multi branching bounding volume hierarchy
+// Built from a collapsed WideBVH, each node keeps its own box as a float origin and a power of two step per axis,
+// and its children's boxes as 8 or 16 bit steps from that origin, rounded outwards so they never shrink.
+// Interior children of a node are stored one after another, as are the references of its leaf children,
+// so a node holds two indices rather than one per child. Rays are tested in each node's own steps, with the
+// planes' distances found from the steps directly, so bounds are never decoded back to floats
+#pragma once
+
+// Standard libraries
+#include <vector>
+
+// RT Specific
+#include "Geometry.h"
+#include "BVH.h"
+#include "WideBVH.h"
+
+// Constants
+// Bits per quantised bound, 0 keeps float boxes
+const unsigned int BVH_QUANTISE_OFF = 0;
+const unsigned int BVH_QUANTISE_8 = 8;
+const unsigned int BVH_QUANTISE_16 = 16;
+
+template <unsigned int Width, typename Quantum>
+struct QuantisedBVHNode
+{
+	// Low corner of the node's box and the size of one step per axis
+	float origin[3];
+	float scale[3];
+	// First interior child, the rest follow it in slot order
+	unsigned int firstChild;
+	// First entry of primitiveIndices for the leaf children, the rest follow it in slot order
+	unsigned int firstReference;
+	// Child boxes in steps from origin: min x, y, z then max x, y, z, one per child
+	Quantum bounds[6][Width];
+	// Primitives in leaf children, zero for interior children and empty slots
+	unsigned char primitiveCounts[Width];
+	// Bit per slot in use, and per slot holding an interior child
+	unsigned char childMask;
+	unsigned char interiorMask;
+};
+
+template <unsigned int Width, typename Quantum>
+class QuantisedBVH
+{
+public:
+	// Tests a ray against all children of a node, as a WideBoxKernel. Empty slots are left to the caller to mask out
+	typedef unsigned int (*BoxKernel)(const QuantisedBVHNode<Width, Quantum>& node, const WideRay& ray, float tMin, float tMax, float* distances);
+private:
+	// Box test chosen for the CPU when building
+	BoxKernel boxKernel;
+public:
+	// Nodes, root is at index 0
+	std::vector<QuantisedBVHNode<Width, Quantum>> nodes;
+	// Input primitives in this hierarchy's own order, which keeps each node's leaves together
+	std::vector<unsigned int> primitiveIndices;
+	// Name of the box test in use, for reporting
+	const char* kernelName;
+
+	// Constructor
+	QuantisedBVH();
+
+	// Compress a collapsed BVH. Returns false, leaving this empty, if a leaf is too large to count in a byte
+	bool build(const WideBVH<Width>& wide);
+
+	bool isEmpty() const { return nodes.empty(); };
+
+	// Bytes held by the nodes and references
+	size_t memoryUsed() const { return nodes.size() * sizeof(QuantisedBVHNode<Width, Quantum>) + primitiveIndices.size() * sizeof(unsigned int); };
+
+	// Nearest hit and occlusion traversals, as WideBVH's
+	template <typename LeafIntersector>
+	bool intersectNearest(const Ray& ray, float tMin, float tMax, LeafIntersector intersectLeaf) const;
+	template <typename LeafOccluder>
+	bool intersectAny(const Ray& ray, float tMin, float tMax, LeafOccluder occludesLeaf) const;
+};
+
+template <unsigned int Width, typename Quantum>
+template <typename LeafIntersector>
+bool QuantisedBVH<Width, Quantum>::intersectNearest(const Ray& ray, float tMin, float tMax, LeafIntersector intersectLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+	WideRay wideRay(ray);
+
+	// Stack of children still to visit, each level adds at most Width - 1 entries
+	unsigned int stackChildren[BVH_MAX_DEPTH * Width];
+	unsigned int stackCounts[BVH_MAX_DEPTH * Width];
+	float stackDistances[BVH_MAX_DEPTH * Width];
+	int stackSize = 0;
+	stackChildren[0] = 0;
+	stackCounts[0] = 0;
+	stackDistances[0] = tMin;
+	stackSize = 1;
+
+	RayStats& threadStats = rayStats;
+	bool intersection = false;
+	while (stackSize > 0)
+	{
+		stackSize--;
+		if (stackDistances[stackSize] >= tMax)
+		{
+			continue;
+		}
+		unsigned int child = stackChildren[stackSize];
+		unsigned int count = stackCounts[stackSize];
+		if (count > 0)
+		{
+			threadStats.primitiveTests += count;
+			if (intersectLeaf(child, count, tMax))
+			{
+				intersection = true;
+			}
+			continue;
+		}
+
+		const QuantisedBVHNode<Width, Quantum>& node = nodes[child];
+		threadStats.nodeVisits++;
+		float distances[Width];
+		unsigned int hitMask = boxKernel(node, wideRay, tMin, tMax, distances) & node.childMask;
+
+		// Push hit children farthest first so the nearest is popped next, counting off the indices of every slot
+		int first = stackSize;
+		unsigned int nextChild = node.firstChild;
+		unsigned int nextReference = node.firstReference;
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			unsigned int slotCount = node.primitiveCounts[slot];
+			unsigned int slotChild = (node.interiorMask & (1u << slot)) ? nextChild++ : nextReference;
+			nextReference += slotCount;
+			if (!(hitMask & (1u << slot)))
+			{
+				continue;
+			}
+			int position = stackSize++;
+			while (position > first && stackDistances[position - 1] < distances[slot])
+			{
+				stackChildren[position] = stackChildren[position - 1];
+				stackCounts[position] = stackCounts[position - 1];
+				stackDistances[position] = stackDistances[position - 1];
+				position--;
+			}
+			stackChildren[position] = slotChild;
+			stackCounts[position] = slotCount;
+			stackDistances[position] = distances[slot];
+		}
+	}
+	return intersection;
+}
+
+template <unsigned int Width, typename Quantum>
+template <typename LeafOccluder>
+bool QuantisedBVH<Width, Quantum>::intersectAny(const Ray& ray, float tMin, float tMax, LeafOccluder occludesLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+	WideRay wideRay(ray);
+
+	// Interior children still to visit, each level adds at most Width - 1 entries
+	unsigned int stackNodes[BVH_MAX_DEPTH * Width];
+	int stackSize = 0;
+
+	RayStats& threadStats = rayStats;
+	unsigned int nodeIndex = 0;
+	while (true)
+	{
+		const QuantisedBVHNode<Width, Quantum>& node = nodes[nodeIndex];
+		threadStats.nodeVisits++;
+		float distances[Width];
+		unsigned int hitMask = boxKernel(node, wideRay, tMin, tMax, distances) & node.childMask;
+
+		unsigned int nextChild = node.firstChild;
+		unsigned int nextReference = node.firstReference;
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			unsigned int count = node.primitiveCounts[slot];
+			bool interior = (node.interiorMask & (1u << slot)) != 0;
+			unsigned int slotChild = interior ? nextChild++ : nextReference;
+			nextReference += count;
+			if (!(hitMask & (1u << slot)))
+			{
+				continue;
+			}
+			if (interior)
+			{
+				stackNodes[stackSize++] = slotChild;
+				continue;
+			}
+			threadStats.primitiveTests += count;
+			if (occludesLeaf(slotChild, count))
+			{
+				return true;
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			return false;
+		}
+		nodeIndex = stackNodes[--stackSize];
+	}
+}
@@ -0,0 +1,296 @@
+// Packets of coherent rays traced together
+#include "RayPacket.h"
+
+// Standard libraries
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// RT Specific
+#include "CpuFeatures.h"
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+RayPacket::RayPacket(unsigned int newSize, float newTMin) : size(newSize), tMin(newTMin)
+{
+	// Every lane is filled, so the box tests never read uninitialised rays past the end of a small packet
+	for (unsigned int lane = 0; lane < RAY_PACKET_MAX_SIZE; lane++)
+	{
+		clearRay(lane);
+	}
+}
+
+void RayPacket::setRay(unsigned int lane, const Ray& ray, float rayTMax)
+{
+	Cartesian3 rayOrigin = ray.getOrigin();
+	Cartesian3 rayDirection = ray.getDirection();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		origin[axis][lane] = rayOrigin[axis];
+		direction[axis][lane] = rayDirection[axis];
+	}
+	tMax[lane] = rayTMax;
+}
+
+void RayPacket::clearRay(unsigned int lane)
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		origin[axis][lane] = 0.0f;
+		direction[axis][lane] = 1.0f;
+		inverseDirection[axis][lane] = 1.0f;
+	}
+	tMax[lane] = -std::numeric_limits<float>::infinity();
+}
+
+Ray RayPacket::getRay(unsigned int lane) const
+{
+	return Ray(Cartesian3(origin[0][lane], origin[1][lane], origin[2][lane]), Cartesian3(direction[0][lane], direction[1][lane], direction[2][lane]));
+}
+
+void RayPacket::copyRays(const RayPacket& source, RayPacketMask mask)
+{
+	for (unsigned int lane = 0; mask != 0; lane++, mask >>= 1)
+	{
+		if (!(mask & 1))
+		{
+			continue;
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			origin[axis][lane] = source.origin[axis][lane];
+			direction[axis][lane] = source.direction[axis][lane];
+		}
+		tMax[lane] = source.tMax[lane];
+	}
+}
+
+void RayPacket::transform(const Matrix4& matrix)
+{
+	// Local copy, as Matrix4's row lookup isn't inlined
+	float elements[4][4];
+	for (int row = 0; row < 4; row++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			elements[row][col] = matrix[row][col];
+		}
+	}
+	for (unsigned int lane = 0; lane < size; lane++)
+	{
+		if (!isActive(lane))
+		{
+			continue;
+		}
+		// Origins are points, divided through by w, and directions are vectors with w = 0
+		float point[4] = { origin[0][lane], origin[1][lane], origin[2][lane], 1.0f };
+		float vector[4] = { direction[0][lane], direction[1][lane], direction[2][lane], 0.0f };
+		float transformedPoint[4], transformedVector[4];
+		for (int row = 0; row < 4; row++)
+		{
+			transformedPoint[row] = 0.0f;
+			transformedVector[row] = 0.0f;
+			for (int col = 0; col < 4; col++)
+			{
+				transformedPoint[row] += elements[row][col] * point[col];
+				transformedVector[row] += elements[row][col] * vector[col];
+			}
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			origin[axis][lane] = transformedPoint[axis] / transformedPoint[3];
+			direction[axis][lane] = transformedVector[axis];
+		}
+	}
+}
+
+bool RayPacket::prepare()
+{
+	for (int axis = 0; axis < 3; axis++)
+	{
+		minOrigin[axis] = std::numeric_limits<float>::infinity();
+		maxOrigin[axis] = -std::numeric_limits<float>::infinity();
+		minInverseDirection[axis] = std::numeric_limits<float>::infinity();
+		maxInverseDirection[axis] = -std::numeric_limits<float>::infinity();
+	}
+	maxDistance = -std::numeric_limits<float>::infinity();
+
+	bool anyActive = false;
+	bool negative[3] = { false, false, false };
+	for (unsigned int lane = 0; lane < size; lane++)
+	{
+		if (!isActive(lane))
+		{
+			continue;
+		}
+		for (int axis = 0; axis < 3; axis++)
+		{
+			// Sign bits, so -0 and +0 directions count as different signs like the single ray box tests
+			bool laneNegative = std::signbit(direction[axis][lane]);
+			if (anyActive && laneNegative != negative[axis])
+			{
+				return false;
+			}
+			negative[axis] = laneNegative;
+			inverseDirection[axis][lane] = 1.0f / direction[axis][lane];
+			minOrigin[axis] = std::min(minOrigin[axis], origin[axis][lane]);
+			maxOrigin[axis] = std::max(maxOrigin[axis], origin[axis][lane]);
+			minInverseDirection[axis] = std::min(minInverseDirection[axis], inverseDirection[axis][lane]);
+			maxInverseDirection[axis] = std::max(maxInverseDirection[axis], inverseDirection[axis][lane]);
+		}
+		maxDistance = std::max(maxDistance, tMax[lane]);
+		anyActive = true;
+	}
+	return true;
+}
+
+// Range of a product of two ranges. Returns false if any product is NaN, from 0 * infinity
+static bool multiplyRanges(float low1, float high1, float low2, float high2, float& lowOut, float& highOut)
+{
+	float products[4] = { low1 * low2, low1 * high2, high1 * low2, high1 * high2 };
+	lowOut = products[0];
+	highOut = products[0];
+	for (int i = 0; i < 4; i++)
+	{
+		if (std::isnan(products[i]))
+		{
+			return false;
+		}
+		lowOut = std::min(lowOut, products[i]);
+		highOut = std::max(highOut, products[i]);
+	}
+	return true;
+}
+
+bool packetMissesBox(const float* minBounds, const float* maxBounds, const RayPacket& packet)
+{
+	// Earliest any ray can enter the box, and latest any can leave it
+	float tNear = packet.tMin;
+	float tFar = packet.maxDistance;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		// The sign of the inverse direction is shared, so every ray meets the same plane first
+		bool negative = std::signbit(packet.minInverseDirection[axis]);
+		float nearPlane = negative ? maxBounds[axis] : minBounds[axis];
+		float farPlane = negative ? minBounds[axis] : maxBounds[axis];
+		float nearLow, nearHigh, farLow, farHigh;
+		if (!multiplyRanges(nearPlane - packet.maxOrigin[axis], nearPlane - packet.minOrigin[axis],
+							packet.minInverseDirection[axis], packet.maxInverseDirection[axis], nearLow, nearHigh) ||
+			!multiplyRanges(farPlane - packet.maxOrigin[axis], farPlane - packet.minOrigin[axis],
+							packet.minInverseDirection[axis], packet.maxInverseDirection[axis], farLow, farHigh))
+		{
+			// An origin on a slab plane of an axis parallel ray, so this axis can't rule anything out
+			continue;
+		}
+		tNear = std::max(tNear, nearLow);
+		tFar = std::min(tFar, farHigh);
+	}
+	return tNear > tFar;
+}
+
+// Plain loop, for CPUs without SIMD
+static unsigned int intersectPacketBoxScalar(const float* minBounds, const float* maxBounds, const RayPacket& packet, unsigned int firstLane)
+{
+	unsigned int hitMask = 0;
+	for (unsigned int i = 0; i < RAY_PACKET_LANES; i++)
+	{
+		unsigned int lane = firstLane + i;
+		float tNear = packet.tMin;
+		float tFar = packet.tMax[lane];
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float t1 = (minBounds[axis] - packet.origin[axis][lane]) * packet.inverseDirection[axis][lane];
+			float t2 = (maxBounds[axis] - packet.origin[axis][lane]) * packet.inverseDirection[axis][lane];
+			// A NaN from 0 * infinity only makes the test conservative
+			tNear = std::max(tNear, std::min(t1, t2));
+			tFar = std::min(tFar, std::max(t1, t2));
+		}
+		if (tNear <= tFar)
+		{
+			hitMask |= 1u << i;
+		}
+	}
+	return hitMask;
+}
+
+#ifdef RT_X86
+// Two sets of four rays with SSE
+RT_TARGET("sse2")
+static unsigned int intersectPacketBoxSSE(const float* minBounds, const float* maxBounds, const RayPacket& packet, unsigned int firstLane)
+{
+	unsigned int hitMask = 0;
+	for (unsigned int half = 0; half < 2; half++)
+	{
+		unsigned int lane = firstLane + 4 * half;
+		__m128 tNear = _mm_set1_ps(packet.tMin);
+		__m128 tFar = _mm_loadu_ps(packet.tMax + lane);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			__m128 origin = _mm_loadu_ps(packet.origin[axis] + lane);
+			__m128 inverseDirection = _mm_loadu_ps(packet.inverseDirection[axis] + lane);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minBounds[axis]), origin), inverseDirection);
+			__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxBounds[axis]), origin), inverseDirection);
+			// max and min return the second operand for NaNs, keeping the test conservative
+			tNear = _mm_max_ps(_mm_min_ps(t1, t2), tNear);
+			tFar = _mm_min_ps(_mm_max_ps(t1, t2), tFar);
+		}
+		hitMask |= (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) << (4 * half);
+	}
+	return hitMask;
+}
+
+// Eight rays with AVX
+RT_TARGET("avx")
+static unsigned int intersectPacketBoxAVX(const float* minBounds, const float* maxBounds, const RayPacket& packet, unsigned int firstLane)
+{
+	__m256 tNear = _mm256_set1_ps(packet.tMin);
+	__m256 tFar = _mm256_loadu_ps(packet.tMax + firstLane);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m256 origin = _mm256_loadu_ps(packet.origin[axis] + firstLane);
+		__m256 inverseDirection = _mm256_loadu_ps(packet.inverseDirection[axis] + firstLane);
+		__m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(minBounds[axis]), origin), inverseDirection);
+		__m256 t2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(maxBounds[axis]), origin), inverseDirection);
+		tNear = _mm256_max_ps(_mm256_min_ps(t1, t2), tNear);
+		tFar = _mm256_min_ps(_mm256_max_ps(t1, t2), tFar);
+	}
+	return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+}
+#endif
+
+// Pick the box test for this CPU
+static PacketBoxKernel selectPacketBoxKernel(const char*& kernelName)
+{
+#ifdef RT_X86
+	const CpuFeatures& features = getCpuFeatures();
+	if (features.avx)
+	{
+		kernelName = "AVX";
+		return intersectPacketBoxAVX;
+	}
+	if (features.sse2)
+	{
+		kernelName = "SSE";
+		return intersectPacketBoxSSE;
+	}
+#endif
+	kernelName = "scalar";
+	return intersectPacketBoxScalar;
+}
+
+static const char* packetBoxKernelName = "scalar";
+
+PacketBoxKernel getPacketBoxKernel()
+{
+	// Thread safe initialisation of the local static
+	static const PacketBoxKernel kernel = selectPacketBoxKernel(packetBoxKernelName);
+	return kernel;
+}
+
+const char* getPacketBoxKernelName()
+{
+	getPacketBoxKernel();
+	return packetBoxKernelName;
+}
@@ -0,0 +1,83 @@
+// Packets of coherent rays traced together
+// Rays are stored as structure of arrays, so one SIMD box test covers several rays against a node, and the bounds
+// of the packet's origins and directions let a whole packet skip a node none of its rays can hit
+#pragma once
+
+// Custom classes
+#include "Matrix4.h"
+// RT Specific
+#include "Geometry.h"
+
+// Constants
+// Rays in the largest packet, an 8 x 8 tile
+const unsigned int RAY_PACKET_MAX_SIZE = 64;
+// Rays tested against a box at once
+const unsigned int RAY_PACKET_LANES = 8;
+// Side of the square tiles of primary rays traced as packets, 0 traces each ray on its own
+const unsigned int RAY_PACKET_OFF = 0;
+const unsigned int RAY_PACKET_4X4 = 4;
+const unsigned int RAY_PACKET_8X8 = 8;
+
+// One bit per ray of a packet
+typedef unsigned long long RayPacketMask;
+
+struct RayPacket
+{
+	// Rays in use, from the first lane
+	unsigned int size;
+	float origin[3][RAY_PACKET_MAX_SIZE];
+	float direction[3][RAY_PACKET_MAX_SIZE];
+	float inverseDirection[3][RAY_PACKET_MAX_SIZE];
+	// Interval each ray is traced over. tMax shrinks to the nearest hit so far, and is below tMin for rays left out
+	float tMin;
+	float tMax[RAY_PACKET_MAX_SIZE];
+	// Nearest hit of each ray, valid where tMax shrank
+	RayHit hits[RAY_PACKET_MAX_SIZE];
+
+	// Bounds of the active rays' origins, inverse directions and far distances, set by prepare()
+	float minOrigin[3];
+	float maxOrigin[3];
+	float minInverseDirection[3];
+	float maxInverseDirection[3];
+	float maxDistance;
+
+	// Constructor makes size rays, all left out until set
+	RayPacket(unsigned int newSize, float newTMin);
+
+	void setRay(unsigned int lane, const Ray& ray, float rayTMax);
+	// Leave a ray out, so it misses every box
+	void clearRay(unsigned int lane);
+	Ray getRay(unsigned int lane) const;
+	// Copy the rays of a mask from another packet, with their intervals
+	void copyRays(const RayPacket& source, RayPacketMask mask);
+	// Take the active rays to another space, with the same arithmetic as Ray::transformed so each ray matches
+	// one traced on its own
+	void transform(const Matrix4& matrix);
+	bool isActive(unsigned int lane) const { return tMax[lane] >= tMin; };
+
+	// Work out the inverse directions and packet bounds once every ray is set. Returns false when the active rays'
+	// directions differ in sign on any axis, as the rays then diverge and are better traced one at a time
+	bool prepare();
+};
+
+// Tests a box against the RAY_PACKET_LANES rays from firstLane, returning a bit mask of the rays that hit it
+typedef unsigned int (*PacketBoxKernel)(const float* minBounds, const float* maxBounds, const RayPacket& packet, unsigned int firstLane);
+
+// Box test for this CPU, chosen on first use
+PacketBoxKernel getPacketBoxKernel();
+const char* getPacketBoxKernelName();
+
+// Whether no active ray of a prepared packet can hit a box, by interval arithmetic on the packet's bounds.
+// Conservative, so a false answer doesn't mean any ray hits it
+bool packetMissesBox(const float* minBounds, const float* maxBounds, const RayPacket& packet);
+
+// Rays in a mask
+inline unsigned int countPacketRays(RayPacketMask mask)
+{
+	unsigned int count = 0;
+	for (; mask != 0; mask &= mask - 1)
+	{
+		count++;
+	}
+	return count;
+}
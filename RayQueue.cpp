@@ -0,0 +1,68 @@
+// Queues of rays for the wavefront renderer
+#include "RayQueue.h"
+
+// Standard libraries
+#include <algorithm>
+#include <cmath>
+
+// Spread the low 16 bits of a value to every third bit
+static uint64_t expandBits16(uint64_t value)
+{
+	value &= 0xffff;
+	value = (value | value << 32) & 0x1f00000000ffffull;
+	value = (value | value << 16) & 0x1f0000ff0000ffull;
+	value = (value | value << 8) & 0x100f00f00f00f00full;
+	value = (value | value << 4) & 0x10c30c30c30c30c3ull;
+	value = (value | value << 2) & 0x1249249249249249ull;
+	return value;
+}
+
+// Cell of a value within a range, on a grid of 2^bits cells
+static uint64_t quantise(float value, float low, float high, unsigned int bits)
+{
+	float cells = (float)(1u << bits);
+	float cell = high > low ? (value - low) / (high - low) * cells : 0.0f;
+	return (uint64_t)std::min(cells - 1.0f, std::max(0.0f, cell));
+}
+
+uint64_t computeRaySortKey(const Ray& ray, const AABB& originBounds)
+{
+	Cartesian3 origin = ray.getOrigin();
+	Cartesian3 direction = ray.getDirection();
+
+	uint64_t octant = 0;
+	uint64_t directionKey = 0;
+	uint64_t originKey = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		octant = (octant << 1) | (std::signbit(direction[axis]) ? 1 : 0);
+		directionKey = (directionKey << RAY_SORT_DIRECTION_BITS) | quantise(direction[axis], -1.0f, 1.0f, RAY_SORT_DIRECTION_BITS);
+		originKey |= expandBits16(quantise(origin[axis], originBounds.minBounds[axis], originBounds.maxBounds[axis], RAY_SORT_ORIGIN_BITS)) << (2 - axis);
+	}
+	return (octant << (3 * (RAY_SORT_DIRECTION_BITS + RAY_SORT_ORIGIN_BITS))) | (directionKey << (3 * RAY_SORT_ORIGIN_BITS)) | originKey;
+}
+
+void sortRayQueue(std::vector<QueuedRay>& queue)
+{
+	AABB originBounds;
+	for (auto& queuedRay : queue)
+	{
+		originBounds.grow(queuedRay.ray.getOrigin());
+	}
+	for (auto& queuedRay : queue)
+	{
+		queuedRay.sortKey = computeRaySortKey(queuedRay.ray, originBounds);
+	}
+	std::sort(queue.begin(), queue.end(), [](const QueuedRay& first, const QueuedRay& second)
+	{
+		return first.sortKey < second.sortKey;
+	});
+}
+
+// stream output, one time per stage
+std::ostream& operator << (std::ostream& outStream, const WavefrontStageTimes& value)
+{
+	outStream << "generate " << value.generateMs << "ms, primary trace " << value.primaryTraceMs << "ms, shadow generate " << value.shadowGenerateMs
+		<< "ms, shadow sort " << value.shadowSortMs << "ms, shadow trace " << value.shadowTraceMs << "ms, shade " << value.shadeMs << "ms";
+	return outStream;
+}
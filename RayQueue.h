@@ -0,0 +1,52 @@
+// Queues of rays for the wavefront renderer
+// Rays are generated in bulk, sorted so neighbours in the queue start near each other and head the same way,
+// then traced in order, which keeps scattered rays from thrashing the cache with unrelated parts of the BVH
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+// RT Specific
+#include "Geometry.h"
+
+// Constants
+// Primary rays per wave, each wave runs every stage before the next is generated, bounding queue memory
+const unsigned int WAVEFRONT_WAVE_SIZE = 1 << 18;
+// Bits per axis of the quantised direction and origin in a sort key, with 3 bits of octant they fill 63 bits
+const unsigned int RAY_SORT_DIRECTION_BITS = 4;
+const unsigned int RAY_SORT_ORIGIN_BITS = 16;
+
+// A ray waiting in a queue, with where its result goes
+struct QueuedRay
+{
+	Ray ray;
+	// Entry of the primary queue the ray contributes to
+	unsigned int source;
+	// Light a shadow ray is cast towards
+	unsigned int light;
+	uint64_t sortKey;
+};
+
+// Key ordering rays by direction octant, then quantised direction, then origin along a Morton curve through the bounds
+uint64_t computeRaySortKey(const Ray& ray, const AABB& originBounds);
+
+// Sort a queue by key, so rays traced one after another visit the same nodes
+void sortRayQueue(std::vector<QueuedRay>& queue);
+
+// Time spent in each wavefront stage, summed over the waves of a frame
+struct WavefrontStageTimes
+{
+	double generateMs;
+	double primaryTraceMs;
+	double shadowGenerateMs;
+	double shadowSortMs;
+	double shadowTraceMs;
+	double shadeMs;
+
+	WavefrontStageTimes() : generateMs(0.0), primaryTraceMs(0.0), shadowGenerateMs(0.0), shadowSortMs(0.0), shadowTraceMs(0.0), shadeMs(0.0) {};
+};
+
+// stream output, one time per stage
+std::ostream& operator << (std::ostream& outStream, const WavefrontStageTimes& value);
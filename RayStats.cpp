@@ -0,0 +1,21 @@
+// Counters of traversal work, for comparing acceleration structures
+#include "RayStats.h"
+
+thread_local RayStats rayStats;
+
+RayStats& RayStats::operator += (const RayStats& other)
+{
+	rays += other.rays;
+	nodeVisits += other.nodeVisits;
+	primitiveTests += other.primitiveTests;
+	shadowRays += other.shadowRays;
+	return *this;
+}
+
+// stream output, as totals and per ray averages
+std::ostream& operator << (std::ostream& outStream, const RayStats& value)
+{
+	double perRay = value.rays > 0 ? 1.0 / (double)value.rays : 0.0;
+	outStream << value.rays << " rays, " << value.nodeVisits * perRay << " node visits and " << value.primitiveTests * perRay << " primitive tests per ray";
+	return outStream;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+// Counters of traversal work, for comparing acceleration structures
+// Each thread counts into its own copy, so tracing never contends on shared counters
+#pragma once
+
+// Standard libraries
+#include <ostream>
+
+struct RayStats
+{
+	unsigned long long rays;
+	unsigned long long nodeVisits;
+	unsigned long long primitiveTests;
+	// Of the rays, those traced towards lights
+	unsigned long long shadowRays;
+
+	RayStats() : rays(0), nodeVisits(0), primitiveTests(0), shadowRays(0) {};
+
+	RayStats& operator += (const RayStats& other);
+};
+
+// Counters for the calling thread
+extern thread_local RayStats rayStats;
+
+// stream output, as totals and per ray averages
+std::ostream& operator << (std::ostream& outStream, const RayStats& value);
\ No newline at end of file
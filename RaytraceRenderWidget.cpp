@@ -18,6 +18,18 @@
 // include the header file
 #include "RaytraceRenderWidget.h"
 #include <DirectionalLight.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// how often to check for a structure building in the background
+const int ACCELERATOR_POLL_MS = 100;
+// interactive mode aims to finish each render in this time
+const double INTERACTIVE_FRAME_BUDGET_MS = 33.0;
+// and redraws at full resolution once changes stop for this long
+const int INTERACTIVE_REFINE_DELAY_MS = 200;
+// coarsest blocks it will draw with, in pixels a side
+const unsigned int INTERACTIVE_MAX_DIVISOR = 16;
 
 // constructor
 RaytraceRenderWidget::RaytraceRenderWidget
@@ -36,13 +48,47 @@ RaytraceRenderWidget::RaytraceRenderWidget
 	QOpenGLWidget(parent),
 	// then store the pointers that were passed in
 	texturedObject(newTexturedObject),
-	renderParameters(newRenderParameters)
+	renderParameters(newRenderParameters),
+	cancelRender(false),
+	renderRunning(false),
+	repaintQueued(false),
+	interactiveDivisor(4),
+	lastRenderMs(0.0),
+	renderInteractive(false),
+	renderPending(false)
 { // constructor
+	// one shot timer for refining, restarted by each change
+	refineTimer = new QTimer(this);
+	refineTimer->setSingleShot(true);
+	connect(refineTimer, SIGNAL(timeout()), this, SLOT(RefineRender()));
+
 	// Create the lights here. Ideally move this to some scene specification
 	Cartesian3 lightColor(renderParameters->lightColor[0], renderParameters->lightColor[1], renderParameters->lightColor[2]);
 	DirectionalLight* directionalLight = new DirectionalLight(renderParameters->lightMatrix, lightColor);
 	lights.push_back(directionalLight);
-	raytracer = new Raytracer(&frameBuffer, texturedObject, &lights, renderParameters);
+	// the render thread only sees its snapshot of the parameters and its own image
+	raytracer = new Raytracer(&renderBuffer, texturedObject, &lights, &renderSnapshot);
+	raytracer->setCancelFlag(&cancelRender);
+	// switching structures moves the mesh's triangles, which the OpenGL view draws, so only this thread does it
+	raytracer->setAcceleratorSwitching(false);
+	// multi socket machines keep each node's tiles and a copy of the structures in its own memory
+	if (detectNumaTopology().getNodeCount() > 1)
+		{ // NUMA machine
+		raytracer->setNumaAware(true);
+		raytracer->setAcceleratorReplication(true);
+		} // NUMA machine
+	raytracer->setTileCallback([this](size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+		{ // tile finished
+		// copy the tile across for display
+			{ // frame buffer locked
+			std::lock_guard<std::mutex> lock(frameBufferLock);
+			for (size_t row = rowBegin; row < rowEnd; row++)
+				std::copy(renderBuffer[(int)row] + colBegin, renderBuffer[(int)row] + colEnd, frameBuffer[(int)row] + colBegin);
+			} // frame buffer locked
+		// one repaint at a time is enough, it draws every tile finished before it runs
+		if (!repaintQueued.exchange(true))
+			QMetaObject::invokeMethod(this, "RepaintTiles", Qt::QueuedConnection);
+		}); // tile finished
 	// Set raytrace to perspective projection
 	//raytracer->setProjectionPerspective();
 } // constructor    
@@ -50,7 +96,8 @@ RaytraceRenderWidget::RaytraceRenderWidget
 // destructor
 RaytraceRenderWidget::~RaytraceRenderWidget()
 	{ // destructor
-	// empty (for now)
+	// the render thread uses our buffers, so it has to stop first
+	StopRender();
 	// all of our pointers are to data owned by another class
 	// so we have no responsibility for destruction
 	// and OpenGL cleanup is taken care of by Qt
@@ -58,10 +105,62 @@ RaytraceRenderWidget::~RaytraceRenderWidget()
 
 void RaytraceRenderWidget::invokeRt()
 {
-	// Call raytrace
-	Raytrace();
+	StartRender(1, false);
 }
 
+void RaytraceRenderWidget::StartRender(unsigned int divisor, bool interactive)
+	{ // RaytraceRenderWidget::StartRender()
+	// Supersede any render in progress
+	StopRender();
+	// Snapshot the parameters, the interface may change them while the render runs
+	renderSnapshot = *renderParameters;
+	raytracer->setResolutionDivisor(divisor);
+	// interactive frames come many times a second, so only full renders print their times
+	raytracer->setQuiet(interactive);
+	renderInteractive = interactive;
+	renderPending = false;
+	cancelRender = false;
+	// pick up structures finished in the background while nothing else is reading the mesh
+	raytracer->getScene().updateAccelerators();
+	renderRunning = true;
+	renderThread = std::thread([this]()
+		{ // render thread
+		auto startTime = std::chrono::steady_clock::now();
+		Raytrace();
+		lastRenderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		renderRunning = false;
+		QMetaObject::invokeMethod(this, "RenderFinished", Qt::QueuedConnection);
+		}); // render thread
+	} // RaytraceRenderWidget::StartRender()
+
+void RaytraceRenderWidget::ParametersChanged()
+	{ // RaytraceRenderWidget::ParametersChanged()
+	if (renderParameters->interactiveRaytrace)
+		{ // interactive
+		// changes are still coming, so hold off refining
+		refineTimer->stop();
+		// let a short interactive render finish rather than restarting it on every mouse move and never showing one
+		if (renderRunning && renderInteractive)
+			renderPending = true;
+		else
+			StartRender(interactiveDivisor, true);
+		} // interactive
+	// otherwise only renders in progress restart, and the next one waits for the raytrace button
+	else if (renderRunning)
+		invokeRt();
+	} // RaytraceRenderWidget::ParametersChanged()
+
+bool RaytraceRenderWidget::StopRender()
+	{ // RaytraceRenderWidget::StopRender()
+	if (!renderThread.joinable())
+		return false;
+	bool wasRunning = renderRunning;
+	// the render checks the flag between rows, so this returns within a few milliseconds
+	cancelRender = true;
+	renderThread.join();
+	return wasRunning;
+	} // RaytraceRenderWidget::StopRender()
+
 // called when OpenGL context is set up
 void RaytraceRenderWidget::initializeGL()
 	{ // RaytraceRenderWidget::initializeGL()
@@ -71,8 +170,17 @@ void RaytraceRenderWidget::initializeGL()
 // called every time the widget is resized
 void RaytraceRenderWidget::resizeGL(int w, int h)
 	{ // RaytraceRenderWidget::resizeGL()
+	// a render in progress is drawing at the old size
+	bool wasRendering = StopRender();
 	// resize the render image
-	frameBuffer.Resize(w, h);
+		{ // frame buffer locked
+		std::lock_guard<std::mutex> lock(frameBufferLock);
+		frameBuffer.Resize(w, h);
+		} // frame buffer locked
+	renderBuffer.Resize(w, h);
+	// and start again at the new size
+	if (wasRendering)
+		invokeRt();
 	} // RaytraceRenderWidget::resizeGL()
 	
 // called every time the widget needs painting
@@ -82,7 +190,8 @@ void RaytraceRenderWidget::paintGL()
 	glClearColor(1.0, 1.0, 1.0, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	// and display the image
+	// and display the image, while no tiles are being copied in
+	std::lock_guard<std::mutex> lock(frameBufferLock);
 	glDrawPixels(frameBuffer.width, frameBuffer.height, GL_RGBA, GL_UNSIGNED_BYTE, frameBuffer.block);
 	} // RaytraceRenderWidget::paintGL()
 	
@@ -93,11 +202,66 @@ void RaytraceRenderWidget::Raytrace()
 	// Update from light matrix
 	// Going by the convention of exactly one directional light currently
 	// Would be changed as scene is expanded to contain multiple lights
-	lights[0]->replaceLightToWorld(renderParameters->lightMatrix);
+	lights[0]->replaceLightToWorld(renderSnapshot.lightMatrix);
 
 	(*raytracer).raytrace();
 	
 } // RaytraceRenderWidget::Raytrace()
+
+void RaytraceRenderWidget::RenderFinished()
+	{ // RaytraceRenderWidget::RenderFinished()
+	// a newer render may have started since this one posted
+	if (renderRunning || !renderThread.joinable())
+		return;
+	renderThread.join();
+	update();
+
+	if (renderInteractive && !cancelRender)
+		{ // interactive render finished
+		// time scales with the rays traced, so pick the divisor whose ray count fits the budget
+		unsigned int divisor = raytracer->getResolutionDivisor();
+		double fullResolutionMs = lastRenderMs * divisor * divisor;
+		interactiveDivisor = (unsigned int)std::ceil(std::sqrt(fullResolutionMs / INTERACTIVE_FRAME_BUDGET_MS));
+		interactiveDivisor = std::min(INTERACTIVE_MAX_DIVISOR, std::max(1u, interactiveDivisor));
+		// catch up with changes made while it ran
+		if (renderPending)
+			{ // more changes
+			StartRender(interactiveDivisor, true);
+			return;
+			} // more changes
+		// and refine once they stop
+		if (divisor > 1)
+			refineTimer->start(INTERACTIVE_REFINE_DELAY_MS);
+		} // interactive render finished
+
+	// the first frames of a new mesh are traced by brute force, so redraw once its structure is ready
+	if (!cancelRender && raytracer->getScene().isAcceleratorPending())
+		QTimer::singleShot(ACCELERATOR_POLL_MS, this, SLOT(PollAccelerator()));
+	} // RaytraceRenderWidget::RenderFinished()
+
+void RaytraceRenderWidget::RepaintTiles()
+	{ // RaytraceRenderWidget::RepaintTiles()
+	repaintQueued = false;
+	update();
+	} // RaytraceRenderWidget::RepaintTiles()
+
+void RaytraceRenderWidget::RefineRender()
+	{ // RaytraceRenderWidget::RefineRender()
+	// a change since the timer started has already begun another render
+	if (!renderRunning)
+		invokeRt();
+	} // RaytraceRenderWidget::RefineRender()
+
+void RaytraceRenderWidget::PollAccelerator()
+	{ // RaytraceRenderWidget::PollAccelerator()
+	// the scene belongs to the render thread while it runs, and the poll starts again when it finishes
+	if (renderThread.joinable())
+		return;
+	if (raytracer->getScene().updateAccelerators())
+		invokeRt();
+	else if (raytracer->getScene().isAcceleratorPending())
+		QTimer::singleShot(ACCELERATOR_POLL_MS, this, SLOT(PollAccelerator()));
+	} // RaytraceRenderWidget::PollAccelerator()
 	
 // mouse-handling
 void RaytraceRenderWidget::mousePressEvent(QMouseEvent *event)
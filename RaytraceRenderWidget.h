@@ -22,6 +22,12 @@
 // include the relevant QT headers
 #include <QOpenGLWidget>
 #include <QMouseEvent>
+#include <QTimer>
+
+// and the threading we need to render in the background
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 // and include all of our own headers that we need
 #include "TexturedObject.h"
@@ -39,6 +45,29 @@ class RaytraceRenderWidget : public QOpenGLWidget
 	// Raytrace context
 	Raytracer *raytracer;
 
+	// the render thread, with its own copy of the parameters and its own image,
+	// so the interface can change both while it runs
+	std::thread renderThread;
+	RenderParameters renderSnapshot;
+	RGBAImage renderBuffer;
+	// set to cancel the render, and cleared by the render thread once it stops
+	std::atomic<bool> cancelRender;
+	std::atomic<bool> renderRunning;
+	// guards frameBuffer, which finished tiles are copied into
+	std::mutex frameBufferLock;
+	// set while a repaint for finished tiles is waiting in the event queue
+	std::atomic<bool> repaintQueued;
+
+	// interactive mode: the resolution divisor expected to fit the frame budget,
+	// and the time the last render took, written by the render thread before it finishes
+	unsigned int interactiveDivisor;
+	double lastRenderMs;
+	// whether the current render is an interactive one, and whether changes arrived while it ran
+	bool renderInteractive;
+	bool renderPending;
+	// fires once input stops, to redraw at full resolution
+	QTimer *refineTimer;
+
 	public:
 	// the geometric object to be rendered
 	RaytraceTexturedObject* texturedObject;
@@ -63,8 +92,11 @@ class RaytraceRenderWidget : public QOpenGLWidget
 	// destructor
 	~RaytraceRenderWidget();
 
-	// for starting raytrace from window
+	// for starting raytrace from window, cancelling any render in progress
 	void invokeRt();
+
+	// restarts a render in progress with the current parameters
+	void ParametersChanged();
 			
 	protected:
 	// called when OpenGL context is set up
@@ -74,9 +106,25 @@ class RaytraceRenderWidget : public QOpenGLWidget
 	// called every time the widget needs painting
 	void paintGL();
 	
-	// routine that generates the image
+	// routine that generates the image, run on the render thread
 	void Raytrace();
 
+	// cancels any render in progress and starts one with the current parameters,
+	// tracing a ray per block of divisor pixels a side
+	void StartRender(unsigned int divisor, bool interactive);
+	// cancels any render in progress and waits for it, returning true if there was one
+	bool StopRender();
+
+	protected slots:
+	// redraws once a structure building in the background is ready, polled while any is pending
+	void PollAccelerator();
+	// repaints with the tiles finished so far
+	void RepaintTiles();
+	// tidies up after the render thread, on the interface thread
+	void RenderFinished();
+	// redraws at full resolution after interactive changes stop
+	void RefineRender();
+
 	// mouse-handling
 	virtual void mousePressEvent(QMouseEvent *event);
 	virtual void mouseMoveEvent(QMouseEvent *event);
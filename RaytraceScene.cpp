@@ -0,0 +1,336 @@
+#include "RaytraceScene.h"
+
+// Standard libraries
+#include <limits>
+#include <cmath>
+
+// For homogeneous coords
+#include "Homogeneous4.h"
+
+// Inverse transpose, rescaled to unit determinant so uniform scales leave normal lengths alone
+static Matrix4 normalMatrix(const Matrix4& matrix, const Matrix4& inverse)
+{
+	const float (*m)[4] = matrix.coordinates;
+	float determinant =	m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+						m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+						m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	return inverse.transpose() * std::cbrt(std::fabs(determinant));
+}
+
+RaytraceInstance::RaytraceInstance(RaytraceTexturedObject* newObject, const Matrix4& newTransform) : object(newObject)
+{
+	setTransform(newTransform);
+}
+
+void RaytraceInstance::setTransform(const Matrix4& newTransform)
+{
+	transform = newTransform;
+	inverseTransform = transform.inverse();
+	normalToWorld = normalMatrix(transform, inverseTransform);
+
+	// Transform all eight corners, the box stays conservative under rotation
+	AABB objectBounds = object->getBounds();
+	bounds = AABB();
+	if (objectBounds.isEmpty())
+	{
+		return;
+	}
+	for (unsigned int corner = 0; corner < 8; corner++)
+	{
+		Cartesian3 point(	(corner & 1) ? objectBounds.maxBounds.x : objectBounds.minBounds.x,
+							(corner & 2) ? objectBounds.maxBounds.y : objectBounds.minBounds.y,
+							(corner & 4) ? objectBounds.maxBounds.z : objectBounds.minBounds.z);
+		bounds.grow((transform * Homogeneous4(point.x, point.y, point.z, 1.0f)).Point());
+	}
+}
+
+RaytraceScene::RaytraceScene(RaytraceTexturedObject* newPrimaryObject) : primaryObject(newPrimaryObject), topLevelDirty(true),
+	sceneToWorld(Matrix4::Identity()), worldToScene(Matrix4::Identity())
+{
+	// Geometry may not be loaded yet, so bounds are recalculated before the top level is built
+	addInstance(primaryObject, Matrix4::Identity());
+}
+
+unsigned int RaytraceScene::addInstance(RaytraceTexturedObject* object, const Matrix4& transform)
+{
+	instances.push_back(RaytraceInstance(object, transform));
+	topLevelDirty = true;
+	return (unsigned int)(instances.size() - 1);
+}
+
+void RaytraceScene::setInstanceTransform(unsigned int instance, const Matrix4& transform)
+{
+	instances[instance].setTransform(transform);
+	topLevelDirty = true;
+}
+
+void RaytraceScene::setAccelerator(unsigned int type)
+{
+	// Meshes shared by several instances only build once, as each keeps what it has built
+	for (auto& instance : instances)
+	{
+		instance.object->setAccelerator(type);
+	}
+	topLevelDirty = true;
+}
+
+bool RaytraceScene::updateAccelerators()
+{
+	bool switched = false;
+	for (auto& instance : instances)
+	{
+		if (instance.object->updateAccelerator())
+		{
+			switched = true;
+		}
+	}
+	// Instance bounds come from each mesh's structure
+	if (switched)
+	{
+		topLevelDirty = true;
+	}
+	return switched;
+}
+
+bool RaytraceScene::isAcceleratorPending() const
+{
+	for (auto& instance : instances)
+	{
+		if (instance.object->isAcceleratorPending())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void RaytraceScene::replicateAccelerators(ThreadPool& threadPool)
+{
+	// Meshes shared by several instances are only copied once
+	for (auto& instance : instances)
+	{
+		instance.object->replicateAccelerator(threadPool);
+	}
+}
+
+void RaytraceScene::dropAcceleratorReplicas()
+{
+	for (auto& instance : instances)
+	{
+		instance.object->dropAcceleratorReplicas();
+	}
+}
+
+void RaytraceScene::calculateTransformations(RenderParameters* renderParameters)
+{
+	// Create transformation matrix
+	Matrix4 transformationMat;
+	transformationMat.SetIdentity();
+
+	// World transformations
+	// Visual translation first, -1 in z so image plane can be at 0
+	transformationMat = transformationMat * Matrix4::TranslationMultMat(Cartesian3(renderParameters->xTranslate, renderParameters->yTranslate, -1.0f));
+	// Rotation
+	transformationMat = transformationMat * renderParameters->rotationMatrix;
+
+	// Apply additional requested params, relative to the primary object
+	float scale = renderParameters->zoomScale;
+	if (renderParameters->scaleObject)
+	{
+		scale /= primaryObject->objectSize;
+	}
+	if (renderParameters->centreObject)
+	{
+		Cartesian3 centreOfGravity = primaryObject->centreOfGravity;
+		transformationMat = transformationMat * Matrix4::TranslationMultMat(Cartesian3(-centreOfGravity.x * scale, -centreOfGravity.y * scale, -centreOfGravity.z * scale));
+	}
+
+	// Scale is applied to the scene first
+	sceneToWorld = transformationMat * Matrix4::ScaleMultMat(scale);
+
+	// Rays are taken to scene space, then to each instance's model space, instead of moving any vertices
+	worldToScene = sceneToWorld.inverse();
+
+	if (topLevelDirty)
+	{
+		std::vector<AABB> instanceBounds(instances.size());
+		for (size_t i = 0; i < instances.size(); i++)
+		{
+			// Refresh bounds in case meshes were loaded after being added
+			instances[i].setTransform(instances[i].transform);
+			instanceBounds[i] = instances[i].bounds;
+		}
+		topLevel.build(instanceBounds);
+		topLevelDirty = false;
+	}
+
+	// Normals go straight from model space to world space
+	for (auto& instance : instances)
+	{
+		Matrix4 objectToWorld = sceneToWorld * instance.transform;
+		instance.normalToWorld = normalMatrix(objectToWorld, objectToWorld.inverse());
+	}
+}
+
+bool RaytraceScene::intersectInstances(const Ray& sceneRay, float tMax, RayHit& hitOut, unsigned int& instanceOut) const
+{
+	rayStats.rays++;
+	return topLevel.intersectNearest(sceneRay, 0.0f, tMax, [&](unsigned int first, unsigned int count, float& tClosest)
+	{
+		bool hit = false;
+		for (unsigned int reference = first; reference < first + count; reference++)
+		{
+			unsigned int instanceIndex = topLevel.primitiveIndices[reference];
+			const RaytraceInstance& instance = instances[instanceIndex];
+			// The model space direction isn't renormalised, so t is the same in every space
+			if (instance.object->intersect(sceneRay.transformed(instance.inverseTransform), 0.0f, tClosest, hitOut))
+			{
+				tClosest = hitOut.t;
+				instanceOut = instanceIndex;
+				hit = true;
+			}
+		}
+		return hit;
+	});
+}
+
+void RaytraceScene::buildSurfel(const Ray& ray, const RayHit& hit, unsigned int instanceIndex, Surfel& surfelOut) const
+{
+	const RaytraceInstance& instance = instances[instanceIndex];
+	Surfel surfel;
+	instance.object->interpolateSurfel(hit, surfel);
+	surfel.position = ray.getOrigin() + hit.t * ray.getDirection();
+	surfel.normal = (instance.normalToWorld * Homogeneous4(surfel.normal.x, surfel.normal.y, surfel.normal.z, 0.0f)).Vector();
+	surfel.texture = &(instance.object->texture);
+
+	surfelOut = surfel;
+}
+
+// Test intersection with a ray
+// Tests against input ray, returns true if there was an intersection, and writes the nearest intersection to tNear and surfelOut
+bool RaytraceScene::intersect(Ray ray, float& tNear, Surfel& surfelOut) const
+{
+	RayHit hit;
+	unsigned int instanceIndex;
+	if (!intersectInstances(ray.transformed(worldToScene), tNear, hit, instanceIndex))
+	{
+		return false;
+	}
+	tNear = hit.t;
+
+	// Only build the surfel for the nearest triangle
+	buildSurfel(ray, hit, instanceIndex, surfelOut);
+	return true;
+}
+
+bool RaytraceScene::intersect(Ray ray, float& tNear) const
+{
+	RayHit hit;
+	unsigned int instanceIndex;
+	if (!intersectInstances(ray.transformed(worldToScene), tNear, hit, instanceIndex))
+	{
+		return false;
+	}
+	tNear = hit.t;
+	return true;
+}
+
+bool RaytraceScene::intersect(Ray ray) const
+{
+	// Any hit in front of the origin counts
+	return occluded(ray, 0.0f, std::numeric_limits<float>::infinity());
+}
+
+bool RaytraceScene::occluded(Ray ray, float tMin, float tMax) const
+{
+	rayStats.rays++;
+	Ray sceneRay = ray.transformed(worldToScene);
+	return topLevel.intersectAny(sceneRay, tMin, tMax, [&](unsigned int first, unsigned int count)
+	{
+		for (unsigned int reference = first; reference < first + count; reference++)
+		{
+			const RaytraceInstance& instance = instances[topLevel.primitiveIndices[reference]];
+			if (instance.object->intersectAny(sceneRay.transformed(instance.inverseTransform), tMin, tMax))
+			{
+				return true;
+			}
+		}
+		return false;
+	});
+}
+
+RayPacketMask RaytraceScene::intersectPacket(const Ray* rays, unsigned int count, Surfel* surfelsOut) const
+{
+	RayPacketMask hitMask = 0;
+	RayPacket scenePacket(count, 0.0f);
+	for (unsigned int lane = 0; lane < count; lane++)
+	{
+		scenePacket.setRay(lane, rays[lane], std::numeric_limits<float>::infinity());
+	}
+	scenePacket.transform(worldToScene);
+	if (!scenePacket.prepare())
+	{
+		for (unsigned int lane = 0; lane < count; lane++)
+		{
+			float tNear = std::numeric_limits<float>::infinity();
+			if (intersect(rays[lane], tNear, surfelsOut[lane]))
+			{
+				hitMask |= (RayPacketMask)1 << lane;
+			}
+		}
+		return hitMask;
+	}
+	rayStats.rays += count;
+
+	// The top level hands each instance the rays that reach it, taken to its model space as a packet of their own
+	unsigned int instanceIndices[RAY_PACKET_MAX_SIZE];
+	topLevel.intersectPacket(scenePacket, [&](unsigned int first, unsigned int referenceCount, RayPacketMask mask)
+	{
+		for (unsigned int reference = first; reference < first + referenceCount; reference++)
+		{
+			unsigned int instanceIndex = topLevel.primitiveIndices[reference];
+			const RaytraceInstance& instance = instances[instanceIndex];
+			RayPacket modelPacket(count, 0.0f);
+			modelPacket.copyRays(scenePacket, mask);
+			modelPacket.transform(instance.inverseTransform);
+
+			// A transform can split the direction signs, leaving the rays to go one at a time
+			if (modelPacket.prepare())
+			{
+				instance.object->intersectPacket(modelPacket);
+			}
+			else
+			{
+				for (unsigned int lane = 0; lane < count; lane++)
+				{
+					RayHit hit;
+					if (modelPacket.isActive(lane) && instance.object->intersect(modelPacket.getRay(lane), 0.0f, modelPacket.tMax[lane], hit))
+					{
+						modelPacket.tMax[lane] = hit.t;
+						modelPacket.hits[lane] = hit;
+					}
+				}
+			}
+
+			for (unsigned int lane = 0; lane < count; lane++)
+			{
+				if ((mask & ((RayPacketMask)1 << lane)) && modelPacket.tMax[lane] < scenePacket.tMax[lane])
+				{
+					scenePacket.tMax[lane] = modelPacket.tMax[lane];
+					scenePacket.hits[lane] = modelPacket.hits[lane];
+					instanceIndices[lane] = instanceIndex;
+					hitMask |= (RayPacketMask)1 << lane;
+				}
+			}
+		}
+	});
+
+	for (unsigned int lane = 0; lane < count; lane++)
+	{
+		if (hitMask & ((RayPacketMask)1 << lane))
+		{
+			buildSurfel(rays[lane], scenePacket.hits[lane], instanceIndices[lane], surfelsOut[lane]);
+		}
+	}
+	return hitMask;
+}
\ No newline at end of file
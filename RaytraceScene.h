@@ -0,0 +1,98 @@
+// Two level scene for ray tracing
+// Instances place a shared RaytraceTexturedObject (the bottom level, with its own BVH) in the scene,
+// and a top level BVH over the instance bounds finds which instances a ray may hit
+#pragma once
+
+// Standard libraries
+#include <vector>
+
+// Custom classes
+#include "Matrix4.h"
+#include "RenderParameters.h"
+
+// RT Specific
+#include "Geometry.h"
+#include "Surfel.h"
+#include "BVH.h"
+#include "RaytraceTexturedObject.h"
+
+// A placement of a mesh in the scene. The mesh isn't owned, so many instances may share one
+class RaytraceInstance
+{
+public:
+	// Mesh and its placement
+	RaytraceTexturedObject* object;
+	Matrix4 transform;
+	Matrix4 inverseTransform;
+
+	// Normal matrix for the current view, from model space to world space
+	Matrix4 normalToWorld;
+
+	// Scene space bounds of the transformed mesh bounds
+	AABB bounds;
+
+	// Constructor
+	RaytraceInstance(RaytraceTexturedObject* newObject, const Matrix4& newTransform);
+
+	// Replace the placement, updating the inverse and bounds
+	void setTransform(const Matrix4& newTransform);
+};
+
+class RaytraceScene
+{
+private:
+	// Object the view centres and scales around
+	RaytraceTexturedObject* primaryObject;
+
+	// Instances and the top level BVH over them, rebuilt only when instances change
+	std::vector<RaytraceInstance> instances;
+	BVH topLevel;
+	bool topLevelDirty;
+
+	// View transformation for the current render parameters, and its inverse
+	Matrix4 sceneToWorld;
+	Matrix4 worldToScene;
+
+	// Nearest hit for a scene space ray, writing the instance that was hit
+	bool intersectInstances(const Ray& sceneRay, float tMax, RayHit& hitOut, unsigned int& instanceOut) const;
+	// World space surfel at an instance's nearest hit
+	void buildSurfel(const Ray& ray, const RayHit& hit, unsigned int instanceIndex, Surfel& surfelOut) const;
+public:
+	// Constructor places the primary object once, untransformed
+	RaytraceScene(RaytraceTexturedObject* newPrimaryObject);
+
+	// Add another placement of a mesh, returns its index
+	unsigned int addInstance(RaytraceTexturedObject* object, const Matrix4& transform);
+	void setInstanceTransform(unsigned int instance, const Matrix4& transform);
+	size_t getInstanceCount() const { return instances.size(); };
+
+	// Structure every mesh is traced with, one of the ACCELERATOR constants, building any not yet built
+	void setAccelerator(unsigned int type);
+	// Switch meshes whose background build has finished to their structure, call between renders.
+	// Returns true if any switched
+	bool updateAccelerators();
+	// Whether any mesh is still traced by brute force while its structure builds
+	bool isAcceleratorPending() const;
+	// Copy every mesh's structure to each NUMA node the pool's workers are pinned to, or drop the copies
+	void replicateAccelerators(ThreadPool& threadPool);
+	void dropAcceleratorReplicas();
+
+	// Updates transformation matrices based on current render parameters, and rebuilds the top level if needed
+	void calculateTransformations(RenderParameters* renderParameters);
+
+	// Test ray intersection, for world space rays
+	bool intersect(Ray ray, float& tNear, Surfel& surfelOut) const;
+	// Test intersection, but don't save surfel
+	bool intersect(Ray ray, float& tNear) const;
+	// Test intersection, saving nothing
+	bool intersect(Ray ray) const;
+	// Whether anything lies between tMin and tMax along a world space ray, stopping at the first hit found
+	bool occluded(Ray ray, float tMin, float tMax) const;
+	// Nearest hits for up to RAY_PACKET_MAX_SIZE world space rays, as intersect(ray, tNear, surfel) for each.
+	// Coherent rays are traced as a packet, and rays whose directions diverge one at a time. Returns a mask of the rays that hit
+	RayPacketMask intersectPacket(const Ray* rays, unsigned int count, Surfel* surfelsOut) const;
+
+	RaytraceTexturedObject* getPrimaryObject() { return primaryObject; };
+	const RaytraceTexturedObject* getPrimaryObject() const { return primaryObject; };
+	const BVHBuildStats& getTopLevelStats() const { return topLevel.stats; };
+};
\ No newline at end of file
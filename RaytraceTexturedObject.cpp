@@ -1,140 +1,388 @@
 #include "RaytraceTexturedObject.h"
 
 // Standard libraries
-#include <limits>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
 
-// For homogeneous coords
-#include "Homogeneous4.h"
+// Constants
+// Marks entries not yet given a new index while reordering
+const unsigned int UNPLACED_INDEX = 0xffffffff;
 
-RaytraceTexturedObject::RaytraceTexturedObject() : TexturedObject::TexturedObject(), objectWorldMatrix(Matrix4::Identity())
+RaytraceTexturedObject::RaytraceTexturedObject() : TexturedObject::TexturedObject(), uniformGrid(false), twoLevelGrid(true), acceleratorType(ACCELERATOR_BVH),
+	buildFinished(false), backgroundBuild(true), buildTimeMs(0.0)
 {
 }
 
+RaytraceTexturedObject::~RaytraceTexturedObject()
+{
+	// The build thread works on its own copy of the vertices but writes into this object's structures
+	if (buildThread.joinable())
+	{
+		buildThread.join();
+	}
+}
+
 bool RaytraceTexturedObject::ReadObjectStream(std::istream& geometryStream, std::istream& textureStream)
 {
+	// A previous mesh's build must finish before its triangles are replaced
+	clearGeometry();
 	// Call base class' read and then triangulate
 	if (TexturedObject::ReadObjectStream(geometryStream, textureStream))
 	{
-		// Start with transformed vertices equal to vertices
-		transformedVertices.resize(vertices.size());
-		transformedNormals.resize(normals.size());
-		for (size_t i = 0; i < vertices.size(); i++)
-		{
-			transformedVertices[i] = Homogeneous4(vertices[i]);
-		}
-		for (size_t i = 0; i < normals.size(); i++)
-		{
-			transformedNormals[i] = normals[i];
-		}
 		initTriangles();
+		startBuild();
 		return true;
 	}
 	return false;
 }
 
-// Test intersection with a ray
-// Tests against input ray, returns true if there was an intersection, and writes the nearest intersection to tNear and surfelOut
-bool RaytraceTexturedObject::intersect(Ray ray, float& tNear, Surfel& surfelOut)
+void RaytraceTexturedObject::setTriangles(std::vector<IndexedTriangularFace>&& newTriangles)
+{
+	clearGeometry();
+	faceVertices.clear();
+	faceNormals.clear();
+	faceTexCoords.clear();
+	triangles = std::move(newTriangles);
+
+	// Centre and radius as reading a file finds them, summed in double as generated meshes can be very large
+	double sum[3] = { 0.0, 0.0, 0.0 };
+	for (auto& vertex : vertices)
+	{
+		sum[0] += vertex.x;
+		sum[1] += vertex.y;
+		sum[2] += vertex.z;
+	}
+	size_t count = std::max((size_t)1, vertices.size());
+	centreOfGravity = Cartesian3((float)(sum[0] / count), (float)(sum[1] / count), (float)(sum[2] / count));
+	objectSize = 0.0f;
+	for (auto& vertex : vertices)
+	{
+		objectSize = std::max(objectSize, (vertex - centreOfGravity).length());
+	}
+	startBuild();
+}
+
+void RaytraceTexturedObject::clearGeometry()
+{
+	waitForAccelerator();
+	dropAcceleratorReplicas();
+	Accelerator* accelerators[4] = { &bvhAccelerator, &uniformGrid, &twoLevelGrid, &bruteForce };
+	for (auto accelerator : accelerators)
+	{
+		accelerator->clear();
+	}
+	triangles.clear();
+}
+
+void RaytraceTexturedObject::startBuild()
 {
-	bool intersection = false;
-	for (auto& indexedTriangularFace : triangles)
+	// Geometry stays in model space, so the structure only needs building once
+	if (backgroundBuild)
+	{
+		startBackgroundBuild();
+	}
+	else
 	{
-		// Get triangle positions to test against
-		Triangle triangle(	transformedVertices[indexedTriangularFace.v0].Point(),
-							transformedVertices[indexedTriangularFace.v1].Point(), 
-							transformedVertices[indexedTriangularFace.v2].Point());
-		
-		// Initialise closest triangle to infinity
-		float t = std::numeric_limits<float>::infinity();
-		float u, v;
-		Surfel surfel;
+		buildAccelerator();
+	}
+}
 
-		// Test intersection of this triangle, update values if it is closer
-		if (triangle.intersection(ray, t, u, v) && t < tNear)
+// Interpolate model space normal and texture coordinates at a hit
+void RaytraceTexturedObject::interpolateSurfel(const RayHit& hit, Surfel& surfelOut) const
+{
+	const IndexedTriangularFace& indexedTriangularFace = triangles[hit.triangle];
+	// Barycentric coordinates
+	float beta = hit.u;
+	float gamma = hit.v;
+	float alpha = 1.0f - beta - gamma;
+	// Interpolate normals
+	surfelOut.normal =	alpha * normals[indexedTriangularFace.vn0] +
+						beta * normals[indexedTriangularFace.vn1] +
+						gamma * normals[indexedTriangularFace.vn2];
+	// Interpolate texture coord
+	surfelOut.u =	alpha * textureCoords[indexedTriangularFace.vt0].x +
+					beta * textureCoords[indexedTriangularFace.vt1].x +
+					gamma * textureCoords[indexedTriangularFace.vt2].x;
+	surfelOut.v =	alpha * textureCoords[indexedTriangularFace.vt0].y +
+					beta * textureCoords[indexedTriangularFace.vt1].y +
+					gamma * textureCoords[indexedTriangularFace.vt2].y;
+}
+
+const Accelerator& RaytraceTexturedObject::getAccelerator() const
+{
+	// The active structure isn't safe to read until its build thread is joined
+	if (buildThread.joinable())
+	{
+		return bruteForce;
+	}
+	// Threads that were never pinned are counted as node 0, so use its copy
+	unsigned int node = getThreadNumaNode();
+	if (node < nodeReplicas.size() && nodeReplicas[node])
+	{
+		return *nodeReplicas[node];
+	}
+	switch (acceleratorType)
+	{
+	case ACCELERATOR_UNIFORM_GRID:
+		return uniformGrid;
+	case ACCELERATOR_TWO_LEVEL_GRID:
+		return twoLevelGrid;
+	default:
+		return bvhAccelerator;
+	}
+}
+
+void RaytraceTexturedObject::setAccelerator(unsigned int type)
+{
+	waitForAccelerator();
+	dropAcceleratorReplicas();
+	acceleratorType = type;
+	// Structures are kept once built, so switching back doesn't rebuild
+	if (!triangles.empty() && getAccelerator().isEmpty())
+	{
+		buildAccelerator();
+	}
+}
+
+void RaytraceTexturedObject::replicateAccelerator(ThreadPool& threadPool)
+{
+	if (isAcceleratorPending() || isAcceleratorReplicated() || triangles.empty())
+	{
+		return;
+	}
+	auto startTime = std::chrono::steady_clock::now();
+	const Accelerator& active = getAccelerator();
+	std::vector<std::unique_ptr<Accelerator>> replicas(threadPool.getTopology().getNodeCount());
+	threadPool.runOnEachWorker([&](unsigned int worker)
+	{
+		// The first worker of each node copies for it. Workers are spread over nodes in blocks, so it's the one whose
+		// predecessor is on another node
+		unsigned int node = threadPool.getWorkerNode(worker);
+		if (worker == 0 || threadPool.getWorkerNode(worker - 1) != node)
 		{
-			tNear = t;
-			// Create surfel
-			surfel.position = ray.getOrigin() + t * ray.getDirection();
-			// Barycentric coordinates
-			float beta = u;
-			float gamma = v;
-			float alpha = 1.0f - beta - gamma;
-			// Interpolate normals
-			surfel.normal = alpha * transformedNormals[indexedTriangularFace.vn0] + 
-							beta * transformedNormals[indexedTriangularFace.vn1] +
-							gamma * transformedNormals[indexedTriangularFace.vn2];
-			// Interpolate texture coord
-			surfel.u =	alpha * textureCoords[indexedTriangularFace.vt0].x +
-						beta * textureCoords[indexedTriangularFace.vt1].x +
-						gamma * textureCoords[indexedTriangularFace.vt2].x;
-			surfel.v =	alpha * textureCoords[indexedTriangularFace.vt0].y +
-						beta * textureCoords[indexedTriangularFace.vt1].y +
-						gamma * textureCoords[indexedTriangularFace.vt2].y;
-
-			surfelOut = surfel;
-			intersection = true;
+			replicas[node].reset(active.clone());
 		}
+	});
+	nodeReplicas.swap(replicas);
+	double replicateTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "Replicated " << active.getName() << " to " << nodeReplicas.size() << " NUMA nodes in " << replicateTimeMs << "ms" << std::endl;
+}
+
+int RaytraceTexturedObject::getAcceleratorNumaNode(const NumaTopology& topology) const
+{
+	// Every kind of structure has references, and copies allocate them with the rest, so their first page stands for it
+	const std::vector<unsigned int>& references = getAccelerator().getTriangleReferences();
+	return references.empty() ? NUMA_NODE_UNKNOWN : getPageNumaNode(topology, references.data());
+}
+
+AABB RaytraceTexturedObject::getBounds() const
+{
+	return getAccelerator().getBounds();
+}
+
+bool RaytraceTexturedObject::intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const
+{
+	return getAccelerator().intersect(ray, tMin, tMax, hitOut);
+}
+
+bool RaytraceTexturedObject::intersectAny(const Ray& ray, float tMin, float tMax) const
+{
+	return getAccelerator().intersectAny(ray, tMin, tMax);
+}
+
+void RaytraceTexturedObject::intersectPacket(RayPacket& packet) const
+{
+	getAccelerator().intersectPacket(packet);
+}
+
+bool RaytraceTexturedObject::updateAccelerator()
+{
+	if (!buildThread.joinable() || !buildFinished)
+	{
+		return false;
+	}
+	waitForAccelerator();
+	return true;
+}
+
+void RaytraceTexturedObject::waitForAccelerator()
+{
+	if (!buildThread.joinable())
+	{
+		return;
 	}
-	return intersection;
+	auto startTime = std::chrono::steady_clock::now();
+	buildThread.join();
+	double waitTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "Switched from brute force to " << getAccelerator().getName() << " after waiting " << waitTimeMs << "ms for its build" << std::endl;
+	bruteForce.clear();
+	// Triangles can only move now nothing else is reading them
+	reorderTriangles();
 }
 
-bool RaytraceTexturedObject::intersect(Ray ray, float& tNear)
+std::vector<Cartesian3> RaytraceTexturedObject::getTriangleVertices() const
 {
-	// Dummy surfel
-	Surfel dummy;
-	return intersect(ray, tNear, dummy);
+	std::vector<Cartesian3> triangleVertices;
+	triangleVertices.reserve(3 * triangles.size());
+	for (auto& triangle : triangles)
+	{
+		triangleVertices.push_back(vertices[triangle.v0]);
+		triangleVertices.push_back(vertices[triangle.v1]);
+		triangleVertices.push_back(vertices[triangle.v2]);
+	}
+	return triangleVertices;
 }
 
-bool RaytraceTexturedObject::intersect(Ray ray)
+void RaytraceTexturedObject::buildStructure(unsigned int type, const std::vector<Cartesian3>& triangleVertices)
 {
-	// Dummy float
-	float dummy = 0.0f;
-	return intersect(ray, dummy);
+	auto startTime = std::chrono::steady_clock::now();
+	switch (type)
+	{
+	case ACCELERATOR_UNIFORM_GRID:
+		uniformGrid.build(triangleVertices);
+		break;
+	case ACCELERATOR_TWO_LEVEL_GRID:
+		twoLevelGrid.build(triangleVertices);
+		break;
+	default:
+		bvhAccelerator.build(triangleVertices);
+		break;
+	}
+	buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
 }
 
-void RaytraceTexturedObject::calculateTransformations(RenderParameters* renderParameters)
+void RaytraceTexturedObject::buildAccelerator()
 {
-	// Create transformation matrix
-	Matrix4 transformationMat;
-	transformationMat.SetIdentity();
+	buildStructure(acceleratorType, getTriangleVertices());
+	reorderTriangles();
+}
 
-	// Local transformations
-	transformationMat = transformationMat * objectWorldMatrix;
+void RaytraceTexturedObject::startBackgroundBuild()
+{
+	std::vector<Cartesian3> triangleVertices = getTriangleVertices();
+	// Brute force needs no more than the triangles in file order, so the first frame can start straight away
+	auto startTime = std::chrono::steady_clock::now();
+	bruteForce.build(triangleVertices);
+	double buildTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "Brute force fallback ready in " << buildTimeMs << "ms, building the acceleration structure in the background" << std::endl;
 
-	// World transformations
-	// Visual translation first, -1 in z so image plane can be at 0
-	transformationMat = transformationMat * Matrix4::TranslationMultMat(Cartesian3(renderParameters->xTranslate, renderParameters->yTranslate, -1.0f));
-	// Rotation
-	transformationMat = transformationMat * renderParameters->rotationMatrix;
+	// The thread owns its vertices, renders only read the fallback and the triangles until it's joined
+	buildFinished = false;
+	unsigned int type = acceleratorType;
+	buildThread = std::thread([this, type, triangleVertices = std::move(triangleVertices)]()
+	{
+		buildStructure(type, triangleVertices);
+		buildFinished = true;
+	});
+}
 
-	// Apply additional requested params
-	float scale = renderParameters->zoomScale;
-	if (renderParameters->scaleObject)
+// Reorder an attribute array by first use from the triangles' corners, renumbering the corners to match.
+// Returns the new index of each old entry, entries no triangle uses keep their relative order at the end
+static std::vector<unsigned int> reorderByFirstUse(std::vector<Cartesian3>& values, std::vector<IndexedTriangularFace>& triangles,
+	unsigned int IndexedTriangularFace::* corner0, unsigned int IndexedTriangularFace::* corner1, unsigned int IndexedTriangularFace::* corner2)
+{
+	unsigned int IndexedTriangularFace::* corners[3] = { corner0, corner1, corner2 };
+	std::vector<unsigned int> newIndices(values.size(), UNPLACED_INDEX);
+	std::vector<Cartesian3> newValues;
+	newValues.reserve(values.size());
+	for (auto& triangle : triangles)
 	{
-		scale /= objectSize;
+		for (auto corner : corners)
+		{
+			unsigned int& index = triangle.*corner;
+			// Out of range indices from a bad file are left for interpolation to trip over as before
+			if (index >= values.size())
+			{
+				continue;
+			}
+			if (newIndices[index] == UNPLACED_INDEX)
+			{
+				newIndices[index] = (unsigned int)newValues.size();
+				newValues.push_back(values[index]);
+			}
+			index = newIndices[index];
+		}
 	}
-	if (renderParameters->centreObject)
+	for (size_t i = 0; i < values.size(); i++)
 	{
-		transformationMat = transformationMat * Matrix4::TranslationMultMat(Cartesian3(-centreOfGravity.x * scale, -centreOfGravity.y * scale, -centreOfGravity.z * scale));
+		if (newIndices[i] == UNPLACED_INDEX)
+		{
+			newIndices[i] = (unsigned int)newValues.size();
+			newValues.push_back(values[i]);
+		}
 	}
+	values.swap(newValues);
+	return newIndices;
+}
 
-	// Transform all vertices
-	for (size_t i = 0; i < vertices.size(); i++)
+// Renumber the polygon faces the base class renders and writes, so they stay in step with the reordered arrays
+static void remapFaces(std::vector<std::vector<unsigned int> >& faces, const std::vector<unsigned int>& newIndices)
+{
+	for (auto& face : faces)
 	{
-		transformedVertices[i] = transformationMat * (Homogeneous4(scale * vertices[i]));
+		for (auto& index : face)
+		{
+			if (index < newIndices.size())
+			{
+				index = newIndices[index];
+			}
+		}
 	}
+}
+
+void RaytraceTexturedObject::reorderTriangles()
+{
+	auto startTime = std::chrono::steady_clock::now();
+	// Copies would keep the old indices, and the active structure below must be the original
+	dropAcceleratorReplicas();
 
-	// Transform all normals
-	for (size_t i = 0; i < normals.size(); i++)
+	// First reference to each triangle, in the structure's storage order
+	std::vector<unsigned int> newIndices(triangles.size(), UNPLACED_INDEX);
+	std::vector<IndexedTriangularFace> newTriangles;
+	newTriangles.reserve(triangles.size());
+	for (auto reference : getAccelerator().getTriangleReferences())
 	{
-		transformedNormals[i] = renderParameters->rotationMatrix * normals[i];
+		if (newIndices[reference] == UNPLACED_INDEX)
+		{
+			newIndices[reference] = (unsigned int)newTriangles.size();
+			newTriangles.push_back(triangles[reference]);
+		}
 	}
+	// Triangles the structure leaves out keep their relative order at the end
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		if (newIndices[i] == UNPLACED_INDEX)
+		{
+			newIndices[i] = (unsigned int)newTriangles.size();
+			newTriangles.push_back(triangles[i]);
+		}
+	}
+	triangles.swap(newTriangles);
+
+	// Structures built earlier still hold the old indices
+	Accelerator* accelerators[4] = { &bvhAccelerator, &uniformGrid, &twoLevelGrid, &bruteForce };
+	for (auto accelerator : accelerators)
+	{
+		if (!accelerator->isEmpty())
+		{
+			accelerator->remapTriangles(newIndices);
+		}
+	}
+
+	remapFaces(faceVertices, reorderByFirstUse(vertices, triangles, &IndexedTriangularFace::v0, &IndexedTriangularFace::v1, &IndexedTriangularFace::v2));
+	remapFaces(faceNormals, reorderByFirstUse(normals, triangles, &IndexedTriangularFace::vn0, &IndexedTriangularFace::vn1, &IndexedTriangularFace::vn2));
+	remapFaces(faceTexCoords, reorderByFirstUse(textureCoords, triangles, &IndexedTriangularFace::vt0, &IndexedTriangularFace::vt1, &IndexedTriangularFace::vt2));
+
+	double reorderTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "Triangles and vertices put in " << getAccelerator().getName() << " order in " << reorderTimeMs << "ms" << std::endl;
 }
 
 // Triangulate if neccasary. Returns true if any triangulation took place.
 bool RaytraceTexturedObject::initTriangles()
 {
 	bool trianglesGenerated = false;
+	triangles.clear();
 	//for (auto& face : faceVertices)
 	for (size_t i = 0; i < faceVertices.size(); i++)
 	{
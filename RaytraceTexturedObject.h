@@ -4,12 +4,21 @@
 
 #pragma once
 
+// Standard libraries
+#include <thread>
+#include <atomic>
+#include <memory>
+
 // Custom classes
 #include "TexturedObject.h"
 #include "Matrix4.h"
 // RT Specific
 #include "Geometry.h"
 #include "Surfel.h"
+#include "BVHAccelerator.h"
+#include "Grid.h"
+#include "BruteForce.h"
+#include "ThreadPool.h"
 
 // Struct holding indices for vertices, normals and texture coords
 struct IndexedTriangularFace
@@ -19,6 +28,8 @@ struct IndexedTriangularFace
     unsigned int vt0, vt1, vt2;
 };
 
+// A mesh is the bottom level of the scene: geometry and its BVH stay in model space and are shared
+// by every RaytraceInstance that references it
 class RaytraceTexturedObject :
     public TexturedObject
 {
@@ -26,29 +37,113 @@ private:
     // Always stored as triangles for RT
     std::vector<IndexedTriangularFace> triangles;
 
-    // Transformed vertices
-    std::vector<Homogeneous4> transformedVertices;
-    std::vector<Cartesian3> transformedNormals;
+    // Acceleration structures over triangles, only the active one is built
+    BVHAccelerator bvhAccelerator;
+    Grid uniformGrid;
+    Grid twoLevelGrid;
+    unsigned int acceleratorType;
+
+    // Traced while the active structure builds in the background, which runs on buildThread until joined
+    BruteForce bruteForce;
+    std::thread buildThread;
+    std::atomic<bool> buildFinished;
+    bool backgroundBuild;
+    // Time the last structure took to build, written by the build thread before it finishes
+    double buildTimeMs;
 
-    // Matrix for translating this object
-    Matrix4 objectWorldMatrix;
+    // Copies of the active structure on each NUMA node, traced by threads pinned there. Empty when not replicated
+    std::vector<std::unique_ptr<Accelerator>> nodeReplicas;
 
     // Convert to triangles if neccasary (assuming convex polygons)
     bool initTriangles();
+
+    // Corners of each triangle in model space, every structure works from these
+    std::vector<Cartesian3> getTriangleVertices() const;
+    // Build one acceleration structure over model space vertices
+    void buildStructure(unsigned int type, const std::vector<Cartesian3>& triangleVertices);
+    // Build the active acceleration structure now
+    void buildAccelerator();
+    // Build the brute force fallback now and the active structure on buildThread
+    void startBackgroundBuild();
+    // Build as set by backgroundBuild, once the triangles are in place
+    void startBuild();
+
+    // Put the triangles in the order the active structure stores them, and the vertices, normals and texture
+    // coordinates in the order those triangles first use them, so hits near each other in the structure interpolate
+    // from memory near each other. Every built structure is renumbered to match
+    void reorderTriangles();
+
+    // Free every structure and the triangles, before new geometry replaces them. Structures are kept once built, so
+    // one left over would otherwise be reused, and renumbered, against triangles it wasn't built over
+    void clearGeometry();
+
+    // Structure chosen by acceleratorType, or the calling thread's node's copy of it
+    const Accelerator& getAccelerator() const;
 public:
     // Constructor calls base class for now
     RaytraceTexturedObject();
+    // Waits for any background build
+    ~RaytraceTexturedObject();
 
     // Override reading to automatically triangulate
     bool ReadObjectStream(std::istream& geometryStream, std::istream& textureStream);
+    // Take generated triangles in place of reading a file, indexing the vertices, normals, texture coordinates and
+    // texture already filled in. No face lists are kept, so the mesh can be raytraced but not drawn with OpenGL
+    void setTriangles(std::vector<IndexedTriangularFace>&& newTriangles);
+
+    // Find the nearest triangle hit with tMin < t < tMax, for a model space ray
+    bool intersect(const Ray& ray, float tMin, float tMax, RayHit& hitOut) const;
+    // Whether any triangle is hit with tMin < t < tMax, for shadow rays. Stops at the first hit found
+    bool intersectAny(const Ray& ray, float tMin, float tMax) const;
+    // Nearest hits for the active rays of a prepared packet of model space rays
+    void intersectPacket(RayPacket& packet) const;
+
+    // Interpolate model space normal and texture coordinates at a hit
+    void interpolateSurfel(const RayHit& hit, Surfel& surfelOut) const;
+
+    // Model space bounds of all triangles
+    AABB getBounds() const;
+
+    // Structure to trace with, one of the ACCELERATOR constants. Built now if the geometry is already loaded
+    void setAccelerator(unsigned int type);
+    // Build the structure on a background thread once the mesh is read, tracing by brute force until it's ready.
+    // The thread reads the build settings, so set them before reading or after waitForAccelerator()
+    void setBackgroundBuild(bool enabled) { backgroundBuild = enabled; };
+    // Switch to the structure if its background build has finished. Call between renders, as switching reorders
+    // the triangles. Returns true if it switched
+    bool updateAccelerator();
+    // Block until the background build finishes, then switch to its structure
+    void waitForAccelerator();
+    // Whether the brute force fallback is still in use
+    bool isAcceleratorPending() const { return buildThread.joinable(); };
+    unsigned int getAcceleratorType() const { return acceleratorType; };
+    const char* getAcceleratorName() const { return getAccelerator().getName(); };
+    // Time the active structure took to build, once any background build has been waited for
+    double getAcceleratorBuildTime() const { return buildTimeMs; };
+    size_t getTriangleCount() const { return triangles.size(); };
 
-    // Test ray intersection
-    bool intersect(Ray ray, float& tNear, Surfel& surfelOut);
-    // Test intersection, but don't save surfel
-    bool intersect(Ray ray, float& tNear);
-    // Test intersection, saving nothing
-    bool intersect(Ray ray);
+    // Copy the active structure to every node the pool's workers are pinned to, each copy made by a worker on its
+    // node so its pages are local there. Call between renders. Does nothing while the brute force fallback is in use,
+    // or if already replicated. Switching or rebuilding structures drops the copies
+    void replicateAccelerator(ThreadPool& threadPool);
+    void dropAcceleratorReplicas() { nodeReplicas.clear(); };
+    bool isAcceleratorReplicated() const { return !nodeReplicas.empty(); };
+    // Node holding the structure the calling thread traces, or NUMA_NODE_UNKNOWN
+    int getAcceleratorNumaNode(const NumaTopology& topology) const;
 
-    // Updates array with transformed vertices based on current render parameters
-    void calculateTransformations(RenderParameters* renderParameters);
+    // BVH settings and statistics
+    void setBVHMaxLeafSize(unsigned int maxLeafSize) { bvhAccelerator.bvh.maxLeafSize = maxLeafSize; };
+    void setBVHBuilder(unsigned int builder, bool optimiseTreelets = false) { bvhAccelerator.bvh.builder = builder; bvhAccelerator.bvh.optimiseTreelets = optimiseTreelets; };
+    // Node layout, one of the BVH_LAYOUT constants
+    void setBVHLayout(unsigned int layout) { bvhAccelerator.bvh.layout = layout; };
+    // Branching factor of the traversed BVH, 2, 4, 8 or BVH_WIDTH_AUTO for the widest the CPU supports
+    void setBVHWidth(unsigned int width) { bvhAccelerator.width = width; };
+    unsigned int getBVHWidth() const { return bvhAccelerator.width; };
+    // Bits per child bound of BVH4 and BVH8 nodes, BVH_QUANTISE_8 or BVH_QUANTISE_16, or BVH_QUANTISE_OFF for floats
+    void setBVHQuantisation(unsigned int bits) { bvhAccelerator.quantiseBits = bits; };
+    // Triangles per leaf or cell test, 1, 4, 8 or TRIANGLE_KERNEL_AUTO for the widest the CPU supports
+    void setTriangleKernelWidth(unsigned int width) { bvhAccelerator.triangleKernelWidth = width; uniformGrid.triangleKernelWidth = width; twoLevelGrid.triangleKernelWidth = width; bruteForce.triangleKernelWidth = width; };
+    // Load the BVH from this file when it matches the geometry and settings, otherwise build and save it there
+    void setBVHCachePath(const std::string& path) { bvhAccelerator.cachePath = path; };
+    const BVHBuildStats& getBVHStats() const { return bvhAccelerator.bvh.stats; };
 };
\ No newline at end of file
@@ -5,6 +5,12 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <limits>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <iomanip>
 // GCC
 #ifdef __GNUC__
 #include <cmath>
@@ -15,17 +21,92 @@
 
 // RT Specific
 #include "Geometry.h"
+#include "NumaTopology.h"
+
+// NUMA accesses of the task running on this thread, moved to its worker's slot when the task finishes
+static thread_local NumaAccessStats taskNumaStats;
 
 // Constructor
-Raytracer::Raytracer(RGBAImage* newFrameBuffer, RaytraceTexturedObject* objectIn, std::vector<Light*>* lightsIn, RenderParameters* newRenderParameters)
+Raytracer::Raytracer(RGBAImage* newFrameBuffer, RaytraceTexturedObject* objectIn, std::vector<Light*>* lightsIn, RenderParameters* newRenderParameters) : scene(objectIn)
 {
 	// Set framebuffer pointer
 	frameBuffer = newFrameBuffer;
-	// and render obj
-	object = objectIn;
+	// and lights, the scene holds the render obj
 	lights = lightsIn;
 	// and params
 	renderParameters = newRenderParameters;
+	setThreadCount(THREAD_POOL_AUTO);
+}
+
+void Raytracer::setThreadCount(unsigned int threadCount)
+{
+	// The old pool's threads are joined before the new one starts
+	threadPool.reset();
+	threadPool.reset(new ThreadPool(threadCount, numaAware));
+	if (quiet)
+	{
+		return;
+	}
+	std::cout << "Rendering with " << threadPool->getThreadCount() << " threads" << std::endl;
+	if (numaAware)
+	{
+		std::cout << "Workers pinned over " << threadPool->getTopology().getNodeCount() << " NUMA nodes" << std::endl;
+	}
+}
+
+void Raytracer::setNumaAware(bool enabled)
+{
+	if (enabled == numaAware)
+	{
+		return;
+	}
+	numaAware = enabled;
+	// Copies belong to the old pool's nodes, and unpinned workers all count as node 0
+	scene.dropAcceleratorReplicas();
+	setThreadCount(threadPool->getThreadCount());
+}
+
+void Raytracer::setAcceleratorReplication(bool enabled)
+{
+	replicateAccelerators = enabled;
+	if (!enabled)
+	{
+		scene.dropAcceleratorReplicas();
+	}
+}
+
+void Raytracer::runParallel(size_t taskCount, const std::function<void(size_t task)>& function)
+{
+	threadPool->run(taskCount, [this, &function](size_t task, unsigned int worker)
+	{
+		// Tasks still queued when a render is cancelled are skipped
+		if (isCancelled())
+		{
+			return;
+		}
+		// Counters are per thread, so each task's work is moved to its worker's slot
+		RayStats& threadStats = rayStats;
+		threadStats = RayStats();
+		function(task);
+		workerStats[worker] += threadStats;
+		if (numaAware)
+		{
+			// Traversal is counted as remote by where the structure this thread traced lives
+			NumaAccessStats& numaTaskStats = taskNumaStats;
+			numaTaskStats.nodeVisits = threadStats.nodeVisits;
+			int structureNode = scene.getPrimaryObject()->getAcceleratorNumaNode(threadPool->getTopology());
+			if (structureNode == NUMA_NODE_UNKNOWN)
+			{
+				numaTaskStats.unknownNodeVisits = threadStats.nodeVisits;
+			}
+			else if ((unsigned int)structureNode != threadPool->getWorkerNode(worker))
+			{
+				numaTaskStats.remoteNodeVisits = threadStats.nodeVisits;
+			}
+			workerNumaStats[worker] += numaTaskStats;
+			numaTaskStats = NumaAccessStats();
+		}
+	});
 }
 
 Cartesian3 Raytracer::castRay(Ray ray)
@@ -33,167 +114,695 @@ Cartesian3 Raytracer::castRay(Ray ray)
 	// For now, return white if there was an intersection, otherwise return ray direction as color
 	float t = std::numeric_limits<float>::infinity();
 	Surfel surfel;
-	if (object->intersect(ray, t, surfel))
+	if (scene.intersect(ray, t, surfel))
 	{
-		Cartesian3 color(0.7f, 0.7f, 0.7f);
-		if (renderParameters->useLighting)
+		return shade(surfel);
+	}
+	return missColor(ray);
+}
+
+// Ray from a surfel towards a light
+Ray Raytracer::shadowRay(const Surfel& surfel, Light* light)
+{
+	Cartesian3 shadowRayDirection = light->getDirection(surfel).unit();
+	// Directional lights only currently
+	// These don't really have a position, so there is no use in comparing the intersection distance to check behind the light source
+	Cartesian3 offsetOrigin = surfel.position + (surfel.normal * 1e-3);		// push intersection along normal by small epsilon to combat shadow acne
+	return Ray(offsetOrigin, shadowRayDirection);
+}
+
+// Shadow rays are traced here, unless the wavefront shadow stage has already found each light's visibility
+Cartesian3 Raytracer::shade(const Surfel& surfel, const unsigned char* lightVisibility)
+{
+	Cartesian3 color(0.7f, 0.7f, 0.7f);
+	if (renderParameters->useLighting)
+	{
+		color = Cartesian3(0.0f, 0.0f, 0.0f);
+		for (size_t lightIndex = 0; lightIndex < lights->size(); lightIndex++)
 		{
-			color = Cartesian3(0.0f, 0.0f, 0.0f);
-			for (auto& light : *lights)
+			Light* light = (*lights)[lightIndex];
+			// Ambient first
+			color = color + Cartesian3(renderParameters->ambient * light->color * light->intensity);
+
+			bool visible = true;
+			// If shadows are enabled, check for intersections towards light
+			if (renderParameters->shadows && lightVisibility)
+			{
+				visible = lightVisibility[lightIndex] != 0;
+			}
+			else if (renderParameters->shadows)
+			{
+				rayStats.shadowRays++;
+				visible = !scene.occluded(shadowRay(surfel, light), 0.0f, std::numeric_limits<float>::infinity());
+			}
+			if (visible)
 			{
-				// Ambient first
-				color = color + Cartesian3(renderParameters->ambient * light->color * light->intensity);
+				// Direction returned is calculated by a subclass of light, so directional and point are handled implicitly
+				Cartesian3 lightDirection = light->getDirection(surfel);
+				Cartesian3 surfaceNormal = surfel.normal;
+				float diffuseAmount = surfaceNormal.dot(lightDirection);
+				if (diffuseAmount > 0.0f)
+				{
+					color = color + Cartesian3(renderParameters->diffuse * diffuseAmount * light->color * light->intensity);
+				}
 
-				bool visible = true;
-				// If shadows are enabled, check for intersections towards light
-				if (renderParameters->shadows)
+				// Finally, specular
+				// 'Camera' is at world origin
+				Cartesian3 eyeVec = Cartesian3(0.0f, 0.0f, 0.0f) - Cartesian3(0.0f, 0.0f, 0.0f);
+				Cartesian3 bisector = ((eyeVec + lightDirection) / 2.0f).unit();
+				// Calculate specular
+				// Check if the dot product is negative before raising to exponent, to avoid negatives becoming positives
+				float dotProduct = surfaceNormal.dot(bisector);
+				if (dotProduct < 0.0f)
 				{
-					Cartesian3 reverseLightDirection = (-1.0f * (light->getDirection(surfel))).unit();
-					// Directional lights only currently
-					// These don't really have a position, so there is no use in comparing the intersection distance to check behind the light source
-					Cartesian3 offsetOrigin = surfel.position + (surfel.normal * 1e-3);		// push intersection along normal by small epsilon to combat shadow acne
-					Ray reverseLightRay(offsetOrigin, reverseLightDirection);
-					visible = !object->intersect(reverseLightRay);
+					dotProduct = 0.0f;
 				}
-				if (visible)
+				float specularAmount = pow(dotProduct, renderParameters->specularExponent);
+				// If there is any specular, add it to the light
+				if (specularAmount > 0.0f)
 				{
-					// Direction returned is calculated by a subclass of light, so directional and point are handled implicitly
-					Cartesian3 lightDirection = light->getDirection(surfel);
-					Cartesian3 surfaceNormal = surfel.normal;
-					float diffuseAmount = surfaceNormal.dot(lightDirection);
-					if (diffuseAmount > 0.0f)
-					{
-						color = color + Cartesian3(renderParameters->diffuse * diffuseAmount * light->color * light->intensity);
-					}
-
-					// Finally, specular
-					// 'Camera' is at world origin
-					Cartesian3 eyeVec = Cartesian3(0.0f, 0.0f, 0.0f) - Cartesian3(0.0f, 0.0f, 0.0f);
-					Cartesian3 bisector = ((eyeVec + lightDirection) / 2.0f).unit();
-					// Calculate specular
-					// Check if the dot product is negative before raising to exponent, to avoid negatives becoming positives
-					float dotProduct = surfaceNormal.dot(bisector);
-					if (dotProduct < 0.0f)
-					{
-						dotProduct = 0.0f;
-					}
-					float specularAmount = pow(dotProduct, renderParameters->specularExponent);
-					// If there is any specular, add it to the light
-					if (specularAmount > 0.0f)
-					{
-						color = color + (Cartesian3(renderParameters->specular * light->color * light->intensity) * specularAmount);
-					}
+					color = color + (Cartesian3(renderParameters->specular * light->color * light->intensity) * specularAmount);
 				}
 			}
 		}
-		if (renderParameters->texturedRendering)
+	}
+	if (renderParameters->texturedRendering)
+	{
+		// Convert to discrete texture coords
+		const RGBAImage* texture = surfel.texture;
+		int texCol = std::round(surfel.u * texture->width);
+		int texRow = std::round(surfel.v * texture->height);
+		float red, green, blue;
+		if (renderParameters->gammaCorrection)
 		{
-			// Convert to discrete texture coords
-			RGBAImage* texture = &(object->texture);
-			int texCol = std::round(surfel.u * texture->width);
-			int texRow = std::round(surfel.v * texture->height);
-			float red, green, blue;
-			if (renderParameters->gammaCorrection)
-			{
-				// Images already gamma corrected, so return to linear
-				red = pow((float)((*texture)[texRow][texCol]).red / 255.0f, 2.2f);
-				green = pow((float)((*texture)[texRow][texCol]).green / 255.0f, 2.2f);
-				blue = pow((float)((*texture)[texRow][texCol]).blue / 255.0f, 2.2f);
-			}
-			else
-			{
-				red = (float)((*texture)[texRow][texCol]).red / 255.0f;
-				green = (float)((*texture)[texRow][texCol]).green / 255.0f;
-				blue = (float)((*texture)[texRow][texCol]).blue / 255.0f;
-			}
+			// Images already gamma corrected, so return to linear
+			red = pow((float)((*texture)[texRow][texCol]).red / 255.0f, 2.2f);
+			green = pow((float)((*texture)[texRow][texCol]).green / 255.0f, 2.2f);
+			blue = pow((float)((*texture)[texRow][texCol]).blue / 255.0f, 2.2f);
+		}
+		else
+		{
+			red = (float)((*texture)[texRow][texCol]).red / 255.0f;
+			green = (float)((*texture)[texRow][texCol]).green / 255.0f;
+			blue = (float)((*texture)[texRow][texCol]).blue / 255.0f;
+		}
 
-			if (renderParameters->textureModulation)
-			{
-				color = Cartesian3(red * color[0], green * color[1], blue * color[2]);
-			}
-			else
-			{
-				color = Cartesian3(red, green, blue);
-			}
+		if (renderParameters->textureModulation)
+		{
+			color = Cartesian3(red * color[0], green * color[1], blue * color[2]);
+		}
+		else
+		{
+			color = Cartesian3(red, green, blue);
 		}
-		return color;
 	}
+	return color;
+}
 
+Cartesian3 Raytracer::missColor(const Ray& ray)
+{
 	// Return direction as colour
 	Cartesian3 rayDirection(ray.getDirection());
 	Cartesian3 rayDirectionColor = (rayDirection + Cartesian3(1.0f, 1.0f, 1.0f) * 0.5f);
 	return rayDirectionColor;
 }
 
+// Ray through the centre of a pixel
+Ray Raytracer::primaryRay(size_t row, size_t col)
+{
+	// Convert rows and columns to NDC
+	// note that range used is [0:1] compared to [-1:1] for rasterisation
+	// At reduced resolution, rows and columns are blocks of pixels, and the ray passes through the block's centre
+	float colNdc = ((float)col + 0.5f) * (float)resolutionDivisor / (float)(*frameBuffer).width;
+	float rowNdc = ((float)row + 0.5f) * (float)resolutionDivisor / (float)(*frameBuffer).height;
+
+	// Convert to screen space for image plane
+	float colScreen = 2.0f * colNdc - 1.0f;
+	float rowScreen = 2.0f * rowNdc - 1.0f;
+
+	// Convert to camera space, accounting for aspect ratio, and field of view
+	float fovRadians = 90.0f * (M_PI / 2.0f);
+	float aspectRatio = (float)((*frameBuffer).width) / (float)((*frameBuffer).height);
+	float colCamera = colScreen;
+	float rowCamera = rowScreen;
+	// Check if width of height wider
+	if (aspectRatio > 1.0f)
+	{
+		colCamera *= aspectRatio;
+	}
+	else
+	{
+		rowCamera *= 1.0f / aspectRatio;
+	}
+
+	// Calculate a ray through the image plane
+	Cartesian3 rayOrigin(0.0f, 0.0f, 0.0f);
+	Cartesian3 rayDirection(0.0f, 0.0f, 0.0f);
+
+	// Depends on projection mode ortho = true;
+	if (projectionMode == RT_ORTHO)
+	{
+		rayOrigin = Cartesian3(colCamera, rowCamera, 0.0f);
+		rayDirection = Cartesian3(colCamera, rowCamera, -1.0f) - Cartesian3(colCamera, rowCamera, 0.0f);
+	}
+	else
+	{
+		rayDirection = Cartesian3(colCamera, rowCamera, -1.0f) - rayOrigin;
+	}
+
+	// Normalise to get direction vector
+	rayDirection = rayDirection.unit();
+
+	// Initialise a ray
+	return Ray(rayOrigin, rayDirection);
+}
+
+void Raytracer::writePixel(size_t row, size_t col, const Cartesian3& rayDirectionColor)
+{
+	RGBAValue hitColor;
+	if (renderParameters->gammaCorrection)
+	{
+		hitColor = RGBAValue(pow(rayDirectionColor.x, 1.0f / 2.2f) * 255.0f, pow(rayDirectionColor.y, 1.0f / 2.2f) * 255.0f, pow(rayDirectionColor.z, 1.0f / 2.2f) * 255.0f, 1.0f);
+	}
+	else
+	{
+		hitColor = RGBAValue(rayDirectionColor.x * 255.0f, rayDirectionColor.y * 255.0f, rayDirectionColor.z * 255.0f, 1.0f);
+	}
+	// At reduced resolution each ray colours a block, cut short at the right and bottom edges
+	size_t rowEnd = std::min((row + 1) * resolutionDivisor, (size_t)(*frameBuffer).height);
+	size_t colEnd = std::min((col + 1) * resolutionDivisor, (size_t)(*frameBuffer).width);
+	for (size_t pixelRow = row * resolutionDivisor; pixelRow < rowEnd; pixelRow++)
+	{
+		for (size_t pixelCol = col * resolutionDivisor; pixelCol < colEnd; pixelCol++)
+		{
+			(*frameBuffer)[pixelRow][pixelCol] = hitColor;
+		}
+	}
+}
+
+void Raytracer::writePixelCost(size_t row, size_t col, const PixelCost& cost)
+{
+	size_t rowEnd = std::min((row + 1) * resolutionDivisor, pixelDiagnostics->getHeight());
+	size_t colEnd = std::min((col + 1) * resolutionDivisor, pixelDiagnostics->getWidth());
+	for (size_t pixelRow = row * resolutionDivisor; pixelRow < rowEnd; pixelRow++)
+	{
+		for (size_t pixelCol = col * resolutionDivisor; pixelCol < colEnd; pixelCol++)
+		{
+			pixelDiagnostics->set(pixelRow, pixelCol, cost);
+		}
+	}
+}
+
+// Work this thread has counted, and cycles passed, since the counters and cycle counter were read
+static PixelCost getCostSince(const RayStats& statsBefore, uint64_t cyclesBefore)
+{
+	const RayStats& stats = rayStats;
+	PixelCost cost;
+	cost.values[PIXEL_DIAGNOSTIC_NODE_VISITS] = (float)(stats.nodeVisits - statsBefore.nodeVisits);
+	cost.values[PIXEL_DIAGNOSTIC_PRIMITIVE_TESTS] = (float)(stats.primitiveTests - statsBefore.primitiveTests);
+	cost.values[PIXEL_DIAGNOSTIC_SHADOW_RAYS] = (float)(stats.shadowRays - statsBefore.shadowRays);
+	cost.values[PIXEL_DIAGNOSTIC_CYCLES] = (float)(readCycleCounter() - cyclesBefore);
+	return cost;
+}
+
+void Raytracer::reportTile(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+	if (!tileCallback || isCancelled())
+	{
+		return;
+	}
+	// The callback is told in pixels of the frame, not blocks
+	size_t height = (size_t)(*frameBuffer).height;
+	size_t width = (size_t)(*frameBuffer).width;
+	tileCallback(std::min(rowBegin * resolutionDivisor, height), std::min(rowEnd * resolutionDivisor, height),
+		std::min(colBegin * resolutionDivisor, width), std::min(colEnd * resolutionDivisor, width));
+}
+
 // Main ray tracing routine
-void Raytracer::raytrace()
+bool Raytracer::raytrace()
+{
+	prepareRender(true);
+	auto startTime = std::chrono::steady_clock::now();
+
+	if (wavefront && pixelDiagnostics == nullptr)
+	{
+		raytraceWavefront();
+	}
+	else
+	{
+		renderTiles(0, getRenderHeight(), 0, getRenderWidth());
+	}
+
+	finishRender();
+	double renderTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	if (quiet)
+	{
+		return !isCancelled();
+	}
+	if (isCancelled())
+	{
+		std::cout << "Render cancelled after " << renderTimeMs << "ms" << std::endl;
+		return false;
+	}
+	std::cout << "Rendered in " << renderTimeMs << "ms: " << renderStats << std::endl;
+	if (numaAware)
+	{
+		printNumaReport();
+	}
+	return true;
+}
+
+bool Raytracer::raytraceRegion(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+	prepareRender(false);
+	// Blocks the region only partly covers are rendered whole
+	rowEnd = std::min(rowEnd, (size_t)(*frameBuffer).height);
+	colEnd = std::min(colEnd, (size_t)(*frameBuffer).width);
+	if (rowBegin < rowEnd && colBegin < colEnd)
+	{
+		renderTiles(rowBegin / resolutionDivisor, (rowEnd + resolutionDivisor - 1) / resolutionDivisor,
+			colBegin / resolutionDivisor, (colEnd + resolutionDivisor - 1) / resolutionDivisor);
+	}
+	finishRender();
+	return !isCancelled();
+}
+
+void Raytracer::prepareRender(bool wholeFrame)
 {
+	// Pick up structures finished in the background since the last render, unless the caller does
+	if (acceleratorSwitching)
+	{
+		scene.updateAccelerators();
+	}
 	// Calculate transformations for all objects
-	object->calculateTransformations(renderParameters);
+	auto transformStart = std::chrono::steady_clock::now();
+	scene.calculateTransformations(renderParameters);
+	transformTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - transformStart).count();
 
-	// Cast a ray for every pixel
-	// For rows
-	for (size_t row = 0; row < (*frameBuffer).height; row++)
+	// Count traversal work for this render only
+	renderStats = RayStats();
+	workerStats.assign(threadPool->getThreadCount(), RayStats());
+	numaStats = NumaAccessStats();
+	workerNumaStats.assign(threadPool->getThreadCount(), NumaAccessStats());
+	// Every pixel a render reaches is overwritten, so the buffers are only cleared when the frame changes size
+	size_t frameWidth = (size_t)(*frameBuffer).width;
+	size_t frameHeight = (size_t)(*frameBuffer).height;
+	if (pixelDiagnostics != nullptr && (pixelDiagnostics->getWidth() != frameWidth || pixelDiagnostics->getHeight() != frameHeight))
+	{
+		pixelDiagnostics->reset(frameWidth, frameHeight);
+	}
+	if (numaAware)
 	{
-		// For columns
-		for (size_t col = 0; col < (*frameBuffer).width; col++)
+		if (replicateAccelerators)
 		{
-			// Convert rows and columns to NDC
-			// note that range used is [0:1] compared to [-1:1] for rasterisation
-			float colNdc = ((float)col + 0.5f) / (float)(*frameBuffer).width;
-			float rowNdc = ((float)row + 0.5f) / (float)(*frameBuffer).height;
+			scene.replicateAccelerators(*threadPool);
+		}
+		// Only whole frames are laid out the same way render after render
+		if (wholeFrame)
+		{
+			placeFrameBuffer();
+		}
+	}
+}
+
+void Raytracer::finishRender()
+{
+	// Report work per ray, so acceleration structures can be compared
+	for (auto& stats : workerStats)
+	{
+		renderStats += stats;
+	}
+	for (auto& stats : workerNumaStats)
+	{
+		numaStats += stats;
+	}
+}
 
-			// Convert to screen space for image plane
-			float colScreen = 2.0f * colNdc - 1.0f;
-			float rowScreen = 2.0f * rowNdc - 1.0f;
+size_t Raytracer::getTileSide() const
+{
+	// Tiles are whole packets, so only tiles on the right and bottom edges cut packets short
+	return packetWidth == RT_PACKET_OFF ? tileSize : (tileSize + packetWidth - 1) / packetWidth * packetWidth;
+}
+
+void Raytracer::renderTiles(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+	size_t tileSide = getTileSide();
+	size_t tilesAcross = (colEnd - colBegin + tileSide - 1) / tileSide;
+	size_t tilesDown = (rowEnd - rowBegin + tileSide - 1) / tileSide;
+	runParallel(tilesAcross * tilesDown, [&](size_t tile)
+	{
+		size_t tileRowBegin = rowBegin + tile / tilesAcross * tileSide;
+		size_t tileColBegin = colBegin + tile % tilesAcross * tileSide;
+		size_t tileRowEnd = std::min(tileRowBegin + tileSide, rowEnd);
+		size_t tileColEnd = std::min(tileColBegin + tileSide, colEnd);
+		renderTile(tileRowBegin, tileRowEnd, tileColBegin, tileColEnd);
+		reportTile(tileRowBegin, tileRowEnd, tileColBegin, tileColEnd);
+		if (numaAware)
+		{
+			countTileNumaAccess(tileRowBegin, tileRowEnd, tileColBegin, tileColEnd);
+		}
+	});
+}
 
-			// Convert to camera space, accounting for aspect ratio, and field of view
-			float fovRadians = 90.0f * (M_PI / 2.0f);
-			float aspectRatio = (float)((*frameBuffer).width) / (float)((*frameBuffer).height);
-			float colCamera = colScreen;
-			float rowCamera = rowScreen;
-			// Check if width of height wider
-			if (aspectRatio > 1.0f)
+void Raytracer::placeFrameBuffer()
+{
+	// The same tiles renderTiles() hands out for the whole frame
+	size_t tileSide = getTileSide();
+	size_t tilesAcross = (getRenderWidth() + tileSide - 1) / tileSide;
+	size_t tilesDown = (getRenderHeight() + tileSide - 1) / tileSide;
+	size_t tileCount = tilesAcross * tilesDown;
+	size_t pixelHeight = (size_t)(*frameBuffer).height;
+	size_t pixelWidth = (size_t)(*frameBuffer).width;
+	// A page's node is chosen by the first write to it, so each worker writes to its own first tiles before any
+	// rendering. Tiles stolen later are rendered remotely, but stealing favours workers on the same node
+	threadPool->runOnEachWorker([&](unsigned int worker)
+	{
+		size_t tileBegin;
+		size_t tileEnd;
+		threadPool->getInitialRange(tileCount, worker, tileBegin, tileEnd);
+		for (size_t tile = tileBegin; tile < tileEnd; tile++)
+		{
+			size_t rowBegin = std::min(tile / tilesAcross * tileSide * resolutionDivisor, pixelHeight);
+			size_t rowEnd = std::min(rowBegin + tileSide * resolutionDivisor, pixelHeight);
+			size_t colBegin = std::min(tile % tilesAcross * tileSide * resolutionDivisor, pixelWidth);
+			size_t colEnd = std::min(colBegin + tileSide * resolutionDivisor, pixelWidth);
+			if (colBegin == colEnd)
 			{
-				colCamera *= aspectRatio;
+				continue;
 			}
-			else
+			for (size_t row = rowBegin; row < rowEnd; row++)
 			{
-				rowCamera *= 1.0f / aspectRatio;
+				// Rewriting a byte keeps the pixels, and pages already placed stay where they are
+				volatile unsigned char* begin = (volatile unsigned char*)&(*frameBuffer)[(int)row][colBegin];
+				size_t bytes = (colEnd - colBegin) * sizeof(RGBAValue);
+				for (size_t offset = 0; offset < bytes; offset += RT_FIRST_TOUCH_STRIDE)
+				{
+					begin[offset] = begin[offset];
+				}
+				begin[bytes - 1] = begin[bytes - 1];
 			}
+		}
+	});
+}
 
-			// Calculate a ray through the image plane
-			Cartesian3 rayOrigin(0.0f, 0.0f, 0.0f);
-			Cartesian3 rayDirection(0.0f, 0.0f, 0.0f);
+void Raytracer::countTileNumaAccess(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+	size_t pixelHeight = (size_t)(*frameBuffer).height;
+	size_t pixelWidth = (size_t)(*frameBuffer).width;
+	size_t pixelRowBegin = std::min(rowBegin * resolutionDivisor, pixelHeight);
+	size_t pixelRowEnd = std::min(rowEnd * resolutionDivisor, pixelHeight);
+	size_t pixelColBegin = std::min(colBegin * resolutionDivisor, pixelWidth);
+	size_t pixelColEnd = std::min(colEnd * resolutionDivisor, pixelWidth);
+	if (pixelRowBegin == pixelRowEnd || pixelColBegin == pixelColEnd)
+	{
+		return;
+	}
+	// One page, from the tile's middle row, stands for the whole tile
+	size_t middleRow = (pixelRowBegin + pixelRowEnd) / 2;
+	int pageNode = getPageNumaNode(threadPool->getTopology(), &(*frameBuffer)[(int)middleRow][pixelColBegin]);
+	unsigned long long pixels = (pixelRowEnd - pixelRowBegin) * (pixelColEnd - pixelColBegin);
+	NumaAccessStats& numaTaskStats = taskNumaStats;
+	numaTaskStats.pixels += pixels;
+	if (pageNode == NUMA_NODE_UNKNOWN)
+	{
+		numaTaskStats.unknownPixels += pixels;
+	}
+	else if ((unsigned int)pageNode != getThreadNumaNode())
+	{
+		numaTaskStats.remotePixels += pixels;
+	}
+}
 
-			// Depends on projection mode ortho = true;
-			if (projectionMode == RT_ORTHO)
+// Percentage of the accesses whose placement is known that were remote. Wavefront renders write pixels in their
+// shading stage, away from any tile, so leave the framebuffer unmeasured
+static std::string remotePercentage(unsigned long long total, unsigned long long remote, unsigned long long unknown)
+{
+	if (total == 0)
+	{
+		return "not measured";
+	}
+	if (total == unknown)
+	{
+		return "unknown";
+	}
+	std::ostringstream percentage;
+	percentage << std::fixed << std::setprecision(1) << 100.0 * remote / (total - unknown) << "%";
+	return percentage.str();
+}
+
+void Raytracer::printNumaReport() const
+{
+	std::cout << "NUMA: " << threadPool->getTopology().getNodeCount() << " nodes, framebuffer remote writes "
+		<< remotePercentage(numaStats.pixels, numaStats.remotePixels, numaStats.unknownPixels) << ", acceleration remote traversal "
+		<< remotePercentage(numaStats.nodeVisits, numaStats.remoteNodeVisits, numaStats.unknownNodeVisits)
+		<< (scene.getPrimaryObject()->isAcceleratorReplicated() ? " (replicated)" : "") << std::endl;
+}
+
+void Raytracer::renderTile(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)
+{
+	if (packetWidth == RT_PACKET_OFF)
+	{
+		// Cast a ray for every pixel
+		for (size_t row = rowBegin; row < rowEnd && !isCancelled(); row++)
+		{
+			for (size_t col = colBegin; col < colEnd; col++)
 			{
-				rayOrigin = Cartesian3(colCamera, rowCamera, 0.0f);
-				rayDirection = Cartesian3(colCamera, rowCamera, -1.0f) - Cartesian3(colCamera, rowCamera, 0.0f);
+				// Counters are only read around each pixel for diagnostic renders
+				RayStats statsBefore;
+				uint64_t cyclesBefore = 0;
+				if (pixelDiagnostics != nullptr)
+				{
+					statsBefore = rayStats;
+					cyclesBefore = readCycleCounter();
+				}
+				writePixel(row, col, castRay(primaryRay(row, col)));
+				if (pixelDiagnostics != nullptr)
+				{
+					writePixelCost(row, col, getCostSince(statsBefore, cyclesBefore));
+				}
+			}
+		}
+		return;
+	}
+
+	// Trace square packets of neighbouring pixels, then shade each ray on its own
+	Ray rays[RAY_PACKET_MAX_SIZE];
+	Surfel surfels[RAY_PACKET_MAX_SIZE];
+	for (size_t packetRow = rowBegin; packetRow < rowEnd && !isCancelled(); packetRow += packetWidth)
+	{
+		for (size_t packetCol = colBegin; packetCol < colEnd; packetCol += packetWidth)
+		{
+			// Packets on the right and bottom edges may be cut short
+			size_t packetRowEnd = std::min(packetRow + packetWidth, rowEnd);
+			size_t packetColEnd = std::min(packetCol + packetWidth, colEnd);
+			RayStats statsBefore;
+			uint64_t cyclesBefore = 0;
+			if (pixelDiagnostics != nullptr)
+			{
+				statsBefore = rayStats;
+				cyclesBefore = readCycleCounter();
 			}
-			else
+			unsigned int count = 0;
+			for (size_t row = packetRow; row < packetRowEnd; row++)
 			{
-				rayDirection = Cartesian3(colCamera, rowCamera, -1.0f) - rayOrigin;
+				for (size_t col = packetCol; col < packetColEnd; col++)
+				{
+					rays[count++] = primaryRay(row, col);
+				}
+			}
+
+			RayPacketMask hitMask = scene.intersectPacket(rays, count, surfels);
+			// The packet's rays are traced together, so each pixel is given an even share of the tracing
+			PixelCost packetShare;
+			if (pixelDiagnostics != nullptr)
+			{
+				packetShare = getCostSince(statsBefore, cyclesBefore) * (1.0f / count);
 			}
+			unsigned int lane = 0;
+			for (size_t row = packetRow; row < packetRowEnd; row++)
+			{
+				for (size_t col = packetCol; col < packetColEnd; col++, lane++)
+				{
+					if (pixelDiagnostics != nullptr)
+					{
+						statsBefore = rayStats;
+						cyclesBefore = readCycleCounter();
+					}
+					bool hit = (hitMask & ((RayPacketMask)1 << lane)) != 0;
+					writePixel(row, col, hit ? shade(surfels[lane]) : missColor(rays[lane]));
+					if (pixelDiagnostics != nullptr)
+					{
+						// Shading, and its shadow rays, are the pixel's own
+						PixelCost cost = getCostSince(statsBefore, cyclesBefore);
+						cost += packetShare;
+						writePixelCost(row, col, cost);
+					}
+				}
+			}
+		}
+	}
+}
+
+// Milliseconds since a stage started
+static double stageTimeMs(std::chrono::steady_clock::time_point stageStart)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stageStart).count();
+}
+
+// Wavefront rendering: each stage runs over a whole wave of rays before the next stage starts
+void Raytracer::raytraceWavefront()
+{
+	wavefrontTimes = WavefrontStageTimes();
+	size_t width = getRenderWidth();
+	size_t height = getRenderHeight();
+	// Primary rays are queued packet by packet, which already groups them, so only shadow rays are sorted
+	size_t packetSide = packetWidth == RT_PACKET_OFF ? RT_PACKET_8X8 : packetWidth;
+	// Waves are bands of whole packet rows
+	size_t bandHeight = std::max(packetSide, WAVEFRONT_WAVE_SIZE / std::max(width, (size_t)1) / packetSide * packetSide);
+	bool traceShadows = renderParameters->useLighting && renderParameters->shadows;
+	size_t lightCount = lights->size();
+
+	// Queues and results, reused by every wave
+	std::vector<QueuedRay> primaryQueue;
+	// Where each packet of the primary queue starts, and the queue's end after the last
+	std::vector<size_t> packetStarts;
+	std::vector<Surfel> surfels;
+	std::vector<unsigned char> hits;
+	std::vector<QueuedRay> shadowQueue;
+	std::vector<unsigned char> lightVisibility;
+	for (size_t bandRow = 0; bandRow < height && !isCancelled(); bandRow += bandHeight)
+	{
+		size_t bandEnd = std::min(bandRow + bandHeight, height);
 
-			// Normalise to get direction vector
-			rayDirection = rayDirection.unit();
+		// Generate the band's primary rays, with the pixel each belongs to. A packet row of the band fills
+		// packetRows * width entries, each packet in it packetRows * packetCols, so every packet knows where it starts
+		auto stageStart = std::chrono::steady_clock::now();
+		size_t packetsAcross = (width + packetSide - 1) / packetSide;
+		size_t packetsDown = (bandEnd - bandRow + packetSide - 1) / packetSide;
+		size_t packetCount = packetsAcross * packetsDown;
+		primaryQueue.resize((bandEnd - bandRow) * width);
+		packetStarts.resize(packetCount + 1);
+		packetStarts[packetCount] = primaryQueue.size();
+		runParallel(packetCount, [&](size_t packet)
+		{
+			size_t packetRow = bandRow + packet / packetsAcross * packetSide;
+			size_t packetCol = packet % packetsAcross * packetSide;
+			size_t packetRowEnd = std::min(packetRow + packetSide, bandEnd);
+			size_t packetColEnd = std::min(packetCol + packetSide, width);
+			size_t entry = (packetRow - bandRow) * width + (packetRowEnd - packetRow) * packetCol;
+			packetStarts[packet] = entry;
+			for (size_t row = packetRow; row < packetRowEnd; row++)
+			{
+				for (size_t col = packetCol; col < packetColEnd; col++)
+				{
+					QueuedRay& queuedRay = primaryQueue[entry++];
+					queuedRay.ray = primaryRay(row, col);
+					queuedRay.source = (unsigned int)(row * width + col);
+					queuedRay.light = 0;
+					queuedRay.sortKey = 0;
+				}
+			}
+		});
+		wavefrontTimes.generateMs += stageTimeMs(stageStart);
 
-			// Initialise a ray
-			Ray ray(rayOrigin, rayDirection);
-			// Cast the ray
-			Cartesian3 rayDirectionColor = castRay(ray);
-			RGBAValue hitColor;
-			if (renderParameters->gammaCorrection)
+		// Trace them a packet at a time. Packets at the right and bottom edges can be smaller, so each is traced
+		// over its own range rather than fixed sized chunks that would straddle two of them
+		stageStart = std::chrono::steady_clock::now();
+		surfels.resize(primaryQueue.size());
+		hits.assign(primaryQueue.size(), 0);
+		runParallel(packetCount, [&](size_t packet)
+		{
+			size_t first = packetStarts[packet];
+			unsigned int count = (unsigned int)(packetStarts[packet + 1] - first);
+			if (packetWidth == RT_PACKET_OFF)
+			{
+				for (size_t i = first; i < first + count; i++)
+				{
+					float tNear = std::numeric_limits<float>::infinity();
+					hits[i] = scene.intersect(primaryQueue[i].ray, tNear, surfels[i]) ? 1 : 0;
+				}
+				return;
+			}
+			Ray rays[RAY_PACKET_MAX_SIZE];
+			Surfel packetSurfels[RAY_PACKET_MAX_SIZE];
+			for (unsigned int lane = 0; lane < count; lane++)
 			{
-				hitColor = RGBAValue(pow(rayDirectionColor.x, 1.0f / 2.2f) * 255.0f, pow(rayDirectionColor.y, 1.0f / 2.2f) * 255.0f, pow(rayDirectionColor.z, 1.0f / 2.2f) * 255.0f, 1.0f);
+				rays[lane] = primaryQueue[first + lane].ray;
 			}
-			else
+			RayPacketMask hitMask = scene.intersectPacket(rays, count, packetSurfels);
+			for (unsigned int lane = 0; lane < count; lane++)
 			{
-				hitColor = RGBAValue(rayDirectionColor.x * 255.0f, rayDirectionColor.y * 255.0f, rayDirectionColor.z * 255.0f, 1.0f);
+				if (hitMask & ((RayPacketMask)1 << lane))
+				{
+					hits[first + lane] = 1;
+					surfels[first + lane] = packetSurfels[lane];
+				}
 			}
-			(*frameBuffer)[row][col] = hitColor;
+		});
+		wavefrontTimes.primaryTraceMs += stageTimeMs(stageStart);
+
+		if (traceShadows)
+		{
+			// A shadow ray from every hit towards every light
+			stageStart = std::chrono::steady_clock::now();
+			shadowQueue.clear();
+			for (size_t i = 0; i < primaryQueue.size(); i++)
+			{
+				if (!hits[i])
+				{
+					continue;
+				}
+				for (size_t lightIndex = 0; lightIndex < lightCount; lightIndex++)
+				{
+					QueuedRay queuedRay;
+					queuedRay.ray = shadowRay(surfels[i], (*lights)[lightIndex]);
+					queuedRay.source = (unsigned int)i;
+					queuedRay.light = (unsigned int)lightIndex;
+					queuedRay.sortKey = 0;
+					shadowQueue.push_back(queuedRay);
+				}
+			}
+			wavefrontTimes.shadowGenerateMs += stageTimeMs(stageStart);
+
+			// Sorted by direction and origin, as scattered shadow rays would each visit unrelated nodes
+			stageStart = std::chrono::steady_clock::now();
+			sortRayQueue(shadowQueue);
+			wavefrontTimes.shadowSortMs += stageTimeMs(stageStart);
+
+			// Traced in runs of the sorted order, so each worker keeps the coherence the sort found
+			stageStart = std::chrono::steady_clock::now();
+			lightVisibility.assign(primaryQueue.size() * lightCount, 1);
+			runParallel((shadowQueue.size() + RT_QUEUE_TASK_SIZE - 1) / RT_QUEUE_TASK_SIZE, [&](size_t task)
+			{
+				size_t end = std::min((task + 1) * RT_QUEUE_TASK_SIZE, shadowQueue.size());
+				for (size_t i = task * RT_QUEUE_TASK_SIZE; i < end; i++)
+				{
+					const QueuedRay& queuedRay = shadowQueue[i];
+					rayStats.shadowRays++;
+					bool occluded = scene.occluded(queuedRay.ray, 0.0f, std::numeric_limits<float>::infinity());
+					lightVisibility[queuedRay.source * lightCount + queuedRay.light] = occluded ? 0 : 1;
+				}
+			});
+			wavefrontTimes.shadowTraceMs += stageTimeMs(stageStart);
 		}
+
+		// Shade every pixel from the traced results
+		stageStart = std::chrono::steady_clock::now();
+		runParallel((primaryQueue.size() + RT_QUEUE_TASK_SIZE - 1) / RT_QUEUE_TASK_SIZE, [&](size_t task)
+		{
+			size_t end = std::min((task + 1) * RT_QUEUE_TASK_SIZE, primaryQueue.size());
+			for (size_t i = task * RT_QUEUE_TASK_SIZE; i < end; i++)
+			{
+				size_t pixel = primaryQueue[i].source;
+				Cartesian3 color = hits[i] ? shade(surfels[i], traceShadows ? lightVisibility.data() + i * lightCount : nullptr) : missColor(primaryQueue[i].ray);
+				writePixel(pixel / width, pixel % width, color);
+			}
+		});
+		wavefrontTimes.shadeMs += stageTimeMs(stageStart);
+		reportTile(bandRow, bandEnd, 0, width);
+	}
+	if (!quiet)
+	{
+		std::cout << "Wavefront stages: " << wavefrontTimes << std::endl;
 	}
 }
\ No newline at end of file
@@ -10,17 +10,61 @@
 // Raytrace specific
 #include "Geometry.h"
 #include "RaytraceTexturedObject.h"
+#include "RaytraceScene.h"
+#include "RayStats.h"
+#include "RayQueue.h"
+#include "ThreadPool.h"
+#include "PixelDiagnostics.h"
+
+// Standard libraries
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <functional>
 
 // Constants
 // Rendering modes
 const unsigned int RT_ORTHO = 0;
 const unsigned int RT_PERSPECTIVE = 1;
+// Primary rays traced one at a time, or in square packets of this many rays a side
+const unsigned int RT_PACKET_OFF = RAY_PACKET_OFF;
+const unsigned int RT_PACKET_4X4 = RAY_PACKET_4X4;
+const unsigned int RT_PACKET_8X8 = RAY_PACKET_8X8;
+// Side of the square tiles each pool task renders, rounded up to whole packets
+const unsigned int RT_TILE_SIZE_DEFAULT = 32;
+// Rays per pool task for the wavefront stages that work through a queue
+const unsigned int RT_QUEUE_TASK_SIZE = 1024;
+// Bytes apart framebuffer writes are made to touch every page, the smallest page size in use
+const size_t RT_FIRST_TOUCH_STRIDE = 4096;
+
+// Work on memory held by another NUMA node than the worker doing it, sampled once per tile or task.
+// Accesses whose page placement the system won't report are counted as unknown
+struct NumaAccessStats
+{
+	unsigned long long pixels = 0;
+	unsigned long long remotePixels = 0;
+	unsigned long long unknownPixels = 0;
+	unsigned long long nodeVisits = 0;
+	unsigned long long remoteNodeVisits = 0;
+	unsigned long long unknownNodeVisits = 0;
+
+	NumaAccessStats& operator += (const NumaAccessStats& other)
+	{
+		pixels += other.pixels;
+		remotePixels += other.remotePixels;
+		unknownPixels += other.unknownPixels;
+		nodeVisits += other.nodeVisits;
+		remoteNodeVisits += other.remoteNodeVisits;
+		unknownNodeVisits += other.unknownNodeVisits;
+		return *this;
+	};
+};
 
 class Raytracer
 {
 private:
-	// Pointer to object
-	RaytraceTexturedObject* object;
+	// Scene holding the object and any instances of it
+	RaytraceScene scene;
 	// Pointer to list of lights
 	std::vector<Light*>* lights;
 	// and to render params
@@ -31,18 +75,125 @@ private:
 
 	// Rendering options
 	unsigned int projectionMode = RT_ORTHO;
+	unsigned int packetWidth = RT_PACKET_8X8;
+	bool wavefront = false;
+	unsigned int tileSize = RT_TILE_SIZE_DEFAULT;
+	// Pixels a side of the block each primary ray covers, 1 for full resolution
+	unsigned int resolutionDivisor = 1;
+
+	// Workers kept across frames, and their traversal counts for the current render
+	std::unique_ptr<ThreadPool> threadPool;
+	std::vector<RayStats> workerStats;
+	// Pin workers to NUMA nodes, place the frame and optionally the acceleration structures on the nodes using them,
+	// and count remote accesses
+	bool numaAware = false;
+	bool replicateAccelerators = false;
+	std::vector<NumaAccessStats> workerNumaStats;
+	NumaAccessStats numaStats;
+
+	// Stops the render when set, checked between tiles and rows. Owned by the caller, so a cancel can't be missed
+	// by a render that hasn't started yet
+	const std::atomic<bool>* cancelFlag = nullptr;
+	// Called from the rendering thread as each tile or wavefront band finishes
+	std::function<void(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)> tileCallback;
+
+	// Traversal work done by the last render
+	RayStats renderStats;
+	// Stage times of the last wavefront render
+	WavefrontStageTimes wavefrontTimes;
+	// Time the last render spent placing the scene's instances in the world
+	double transformTimeMs = 0.0;
+	// Each pixel's cost is recorded here when set. Owned by the caller
+	PixelDiagnostics* pixelDiagnostics = nullptr;
+	// Leave out the thread count, and the time, work and NUMA report printed after each render, for renders timed or repeated many times a second
+	bool quiet = false;
+	// Switch meshes to structures finished in the background at the start of each render. Switching moves triangles,
+	// so callers sharing the mesh with another thread turn this off and switch between renders themselves
+	bool acceleratorSwitching = true;
 
 	// Internal ray tracing methods
 	Cartesian3 castRay(Ray ray);
+	Ray primaryRay(size_t row, size_t col);
+	Ray shadowRay(const Surfel& surfel, Light* light);
+	Cartesian3 shade(const Surfel& surfel, const unsigned char* lightVisibility = nullptr);
+	Cartesian3 missColor(const Ray& ray);
+	void writePixel(size_t row, size_t col, const Cartesian3& color);
+	// Record a ray's cost for the pixels it colours, as writePixel() does its colour
+	void writePixelCost(size_t row, size_t col, const PixelCost& cost);
+	bool isCancelled() const { return cancelFlag != nullptr && *cancelFlag; };
+	// Rows and columns of rays at the current resolution
+	size_t getRenderWidth() const { return ((size_t)(*frameBuffer).width + resolutionDivisor - 1) / resolutionDivisor; };
+	size_t getRenderHeight() const { return ((size_t)(*frameBuffer).height + resolutionDivisor - 1) / resolutionDivisor; };
+	// Pass a finished range of rows and columns of rays to the tile callback, as pixels
+	void reportTile(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+	// Render the pixels in rows [rowBegin, rowEnd) and columns [colBegin, colEnd)
+	void renderTile(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+	// Side of the tiles, in rays
+	size_t getTileSide() const;
+	// Render rows [rowBegin, rowEnd) and columns [colBegin, colEnd) of rays as tiles on the pool
+	void renderTiles(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+	// Update the scene and reset the counters before a render, and total the counters after it
+	void prepareRender(bool wholeFrame);
+	void finishRender();
+	// Have each worker write to the pages of the tiles it starts the render with, so pages not yet used are placed
+	// on its node. Contents are kept, so it's safe on a frame already placed
+	void placeFrameBuffer();
+	// Count a finished tile's pixels as local, remote or unknown to the calling worker's node
+	void countTileNumaAccess(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+	void printNumaReport() const;
+	// Run tasks on the pool, counting each worker's traversal work into workerStats
+	void runParallel(size_t taskCount, const std::function<void(size_t task)>& function);
+	void raytraceWavefront();
 public:
 	// Constructor
 	Raytracer(RGBAImage* newFrameBuffer, RaytraceTexturedObject* object, std::vector<Light*>* lightsIn, RenderParameters* newRenderParameters);
 
-	// Main ray tracing routine
-	void raytrace();
+	// Main ray tracing routine. Returns false if it was cancelled, leaving the frame part drawn
+	bool raytrace();
+	// Render only pixel rows [rowBegin, rowEnd) and columns [colBegin, colEnd) of the frame, quietly, for frames
+	// rendered in parts. Always in tiles, as wavefront renders work over whole frames
+	bool raytraceRegion(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
 
 	// Getters and setters
+	RaytraceScene& getScene() { return scene; };
+	const RayStats& getRenderStats() const { return renderStats; };
+	// Acceleration structure for every mesh, one of the ACCELERATOR constants
+	void setAccelerator(unsigned int type) { scene.setAccelerator(type); };
 	const unsigned int getProjectionMode() { return projectionMode; };
 	void setProjectionOrtho() { projectionMode = RT_ORTHO; };
 	void setProjectionPerspective() { projectionMode = RT_PERSPECTIVE; };
+	// Side of the primary ray packets, one of the RT_PACKET constants
+	void setPacketWidth(unsigned int width) { packetWidth = width; };
+	unsigned int getPacketWidth() const { return packetWidth; };
+	// Render in separately timed stages over queues of rays, rather than pixel by pixel
+	void setWavefront(bool enabled) { wavefront = enabled; };
+	// Threads to render with, THREAD_POOL_AUTO for one per hardware thread. Restarts the pool
+	void setThreadCount(unsigned int threadCount);
+	unsigned int getThreadCount() const { return threadPool->getThreadCount(); };
+	// Pin the workers to NUMA nodes, every worker being a pool thread, and report remote accesses after each render.
+	// Restarts the pool with the same thread count
+	void setNumaAware(bool enabled);
+	bool isNumaAware() const { return numaAware; };
+	// Give each node its own copy of the acceleration structures while NUMA aware
+	void setAcceleratorReplication(bool enabled);
+	const NumaAccessStats& getNumaStats() const { return numaStats; };
+	// Side of the tiles the frame is split into
+	void setTileSize(unsigned int size) { tileSize = std::max(1u, size); };
+	unsigned int getTileSize() const { return tileSize; };
+	// Trace one ray per block of this many pixels a side, filling the block with its colour. Tiles are in blocks too
+	void setResolutionDivisor(unsigned int divisor) { resolutionDivisor = std::max(1u, divisor); };
+	unsigned int getResolutionDivisor() const { return resolutionDivisor; };
+	// Flag to cancel renders with, or nullptr for none
+	void setCancelFlag(const std::atomic<bool>* flag) { cancelFlag = flag; };
+	// Told about each finished part of the frame, from whichever thread rendered it
+	void setTileCallback(const std::function<void(size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd)>& callback) { tileCallback = callback; };
+	const WavefrontStageTimes& getWavefrontTimes() const { return wavefrontTimes; };
+	// Record every pixel's traversal steps, triangle tests, shadow rays and cycles into this during renders, or nullptr
+	// to stop. Diagnostic renders are always in tiles, as wavefront stages don't work a pixel at a time
+	void setPixelDiagnostics(PixelDiagnostics* diagnostics) { pixelDiagnostics = diagnostics; };
+	double getTransformTime() const { return transformTimeMs; };
+	// Render without printing anything; the stats are still there through the getters
+	void setQuiet(bool enabled) { quiet = enabled; };
+	// Whether renders switch to finished structures themselves, rather than the caller through getScene()
+	void setAcceleratorSwitching(bool enabled) { acceleratorSwitching = enabled; };
 };
\ No newline at end of file
@@ -144,6 +144,10 @@ RenderController::RenderController
     QObject::connect(   renderWindow->shadowsCheckbox,              SIGNAL(stateChanged(int)),
                         this,                                       SLOT(shadowsCheckChanged(int)));
 
+    // interactive raytrace box
+    QObject::connect(   renderWindow->interactiveCheckbox,          SIGNAL(stateChanged(int)),
+                        this,                                       SLOT(interactiveCheckChanged(int)));
+
     // copy the rotation matrix from the widgets to the model
     renderParameters->rotationMatrix = renderWindow->modelRotator->RotationMatrix();
     renderParameters->lightMatrix = renderWindow->lightRotator->RotationMatrix();
@@ -469,10 +473,9 @@ void RenderController::EndScaledDrag(float x, float y)
 
 void RenderController::raytraceButtonPressed()
 {
-    // Start tracing
+    // Start tracing in the background, the window stays responsive while it runs. Nothing in the model changed,
+    // so the interface isn't reset, which would start a render of its own only for this one to replace it
     renderWindow->raytraceRenderWidget->invokeRt();
-    // Update the interface
-    renderWindow->ResetInterface();
 }
 
 void RenderController::gammaCheckChanged(int state)
@@ -491,3 +494,10 @@ void RenderController::shadowsCheckChanged(int state)
     renderWindow->ResetInterface();
 }
 
+void RenderController::interactiveCheckChanged(int state)
+{
+    renderParameters->interactiveRaytrace = (state == Qt::Checked);
+
+    // reset the interface, which starts tracing if it was turned on
+    renderWindow->ResetInterface();
+}
@@ -99,6 +99,7 @@ class RenderController : public QObject
     void raytraceButtonPressed();
     void gammaCheckChanged(int state);
     void shadowsCheckChanged(int state);
+    void interactiveCheckChanged(int state);
 
     }; // class RenderController
 
@@ -0,0 +1,463 @@
+// Render settings for runs without a window
+#include "RenderOptions.h"
+
+// Standard libraries
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+// GCC
+#ifdef __GNUC__
+#include <cmath>
+#endif
+
+// Utilities
+#include "Matrix4.h"
+
+// Whitespace trimmed from both ends
+static std::string trim(const std::string& text)
+{
+	size_t first = text.find_first_not_of(" \t\r\n");
+	if (first == std::string::npos)
+	{
+		return std::string();
+	}
+	size_t last = text.find_last_not_of(" \t\r\n");
+	return text.substr(first, last - first + 1);
+}
+
+// Exactly count numbers separated by spaces, or at least minimum of them when count is larger
+static bool parseFloats(const std::string& value, float* valuesOut, size_t minimum, size_t count)
+{
+	std::istringstream stream(value);
+	size_t parsed = 0;
+	while (parsed < count && stream >> valuesOut[parsed])
+	{
+		parsed++;
+	}
+	std::string rest;
+	return parsed >= minimum && !(stream.clear(), stream >> rest);
+}
+
+static bool parseFloat(const std::string& value, float& valueOut)
+{
+	return parseFloats(value, &valueOut, 1, 1);
+}
+
+bool parseUnsigned(const std::string& value, unsigned int& valueOut)
+{
+	std::istringstream stream(value);
+	long long parsed;
+	std::string rest;
+	if (!(stream >> parsed) || (stream >> rest) || parsed < 0 || parsed > 0xffffffffll)
+	{
+		return false;
+	}
+	valueOut = (unsigned int)parsed;
+	return true;
+}
+
+static bool parseBool(const std::string& value, bool& valueOut)
+{
+	if (value == "on" || value == "true" || value == "yes" || value == "1")
+	{
+		valueOut = true;
+		return true;
+	}
+	if (value == "off" || value == "false" || value == "no" || value == "0")
+	{
+		valueOut = false;
+		return true;
+	}
+	return false;
+}
+
+// Unsigned value, or the given constant for "auto"
+static bool parseUnsignedOrAuto(const std::string& value, unsigned int autoValue, unsigned int& valueOut)
+{
+	if (value == "auto")
+	{
+		valueOut = autoValue;
+		return true;
+	}
+	return parseUnsigned(value, valueOut);
+}
+
+// Options that are on or off, and may be given as a bare flag
+static bool* getSwitch(RenderOptions& options, const std::string& name)
+{
+	RenderParameters& parameters = options.renderParameters;
+	if (name == "lighting") return &parameters.useLighting;
+	if (name == "shadows") return &parameters.shadows;
+	if (name == "textured") return &parameters.texturedRendering;
+	if (name == "modulation") return &parameters.textureModulation;
+	if (name == "gamma") return &parameters.gammaCorrection;
+	if (name == "centre") return &parameters.centreObject;
+	if (name == "scale") return &parameters.scaleObject;
+	if (name == "wavefront") return &options.wavefront;
+	if (name == "numa") return &options.numaAware;
+	if (name == "replicate") return &options.replicateAccelerators;
+	if (name == "diagnostics") return &options.pixelDiagnostics;
+	return nullptr;
+}
+
+bool applyRenderOption(RenderOptions& options, const std::string& name, const std::string& value, std::string& errorOut, unsigned int depth)
+{
+	RenderParameters& parameters = options.renderParameters;
+	bool parsed = true;
+	if (bool* flag = getSwitch(options, name))
+	{
+		parsed = parseBool(value, *flag);
+	}
+	else if (name == "config")
+	{
+		return readRenderOptionsFile(value, options, errorOut, depth + 1);
+	}
+	else if (name == "geometry")
+	{
+		options.geometryPath = value;
+	}
+	else if (name == "texture")
+	{
+		options.texturePath = value;
+	}
+	else if (name == "generate")
+	{
+		options.generateScene = true;
+		return parseStressScene(value, options.stressScene, errorOut);
+	}
+	else if (name == "output")
+	{
+		options.outputPath = value;
+	}
+	else if (name == "width" || name == "height")
+	{
+		unsigned int size;
+		parsed = parseUnsigned(value, size) && size > 0;
+		(name == "width" ? options.width : options.height) = (long)size;
+	}
+	else if (name == "projection")
+	{
+		parsed = value == "ortho" || value == "perspective";
+		options.projectionMode = value == "perspective" ? RT_PERSPECTIVE : RT_ORTHO;
+	}
+	else if (name == "ambient")
+	{
+		parsed = parseFloat(value, parameters.ambient);
+	}
+	else if (name == "diffuse")
+	{
+		parsed = parseFloat(value, parameters.diffuse);
+	}
+	else if (name == "specular")
+	{
+		parsed = parseFloat(value, parameters.specular);
+	}
+	else if (name == "specular-exponent")
+	{
+		parsed = parseFloat(value, parameters.specularExponent);
+	}
+	else if (name == "emissive")
+	{
+		parsed = parseFloat(value, parameters.emissive);
+	}
+	else if (name == "zoom")
+	{
+		parsed = parseFloat(value, parameters.zoomScale);
+	}
+	else if (name == "x-translate")
+	{
+		parsed = parseFloat(value, parameters.xTranslate);
+	}
+	else if (name == "y-translate")
+	{
+		parsed = parseFloat(value, parameters.yTranslate);
+	}
+	else if (name == "rotate")
+	{
+		// Axis and degrees, each rotation applied after those before it
+		float rotation[4];
+		parsed = parseFloats(value, rotation, 4, 4) && Cartesian3(rotation[0], rotation[1], rotation[2]).length() > 0.0f;
+		if (parsed)
+		{
+			parameters.rotationMatrix = Matrix4::RotationMultMat(Cartesian3(rotation[0], rotation[1], rotation[2]), rotation[3] * (float)M_PI / 180.0f) * parameters.rotationMatrix;
+		}
+	}
+	else if (name == "light")
+	{
+		// Direction towards the light, then optionally its colour and intensity
+		float light[7] = { 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+		parsed = parseFloats(value, light, 3, 7) && Cartesian3(light[0], light[1], light[2]).length() > 0.0f;
+		RenderLight renderLight = { Cartesian3(light[0], light[1], light[2]).unit(), Cartesian3(light[3], light[4], light[5]), light[6] };
+		options.lights.push_back(renderLight);
+	}
+	else if (name == "accelerator")
+	{
+		parsed = value == "bvh" || value == "grid" || value == "grid2";
+		options.accelerator = value == "grid" ? ACCELERATOR_UNIFORM_GRID : value == "grid2" ? ACCELERATOR_TWO_LEVEL_GRID : ACCELERATOR_BVH;
+	}
+	else if (name == "builder")
+	{
+		parsed = value == "sah" || value == "sbvh" || value == "lbvh" || value == "lbvh-treelets";
+		options.bvhBuilder = value == "sbvh" ? BVH_BUILDER_SBVH : value.compare(0, 4, "lbvh") == 0 ? BVH_BUILDER_LBVH : BVH_BUILDER_SAH;
+		options.optimiseTreelets = value == "lbvh-treelets";
+	}
+	else if (name == "bvh-width")
+	{
+		parsed = parseUnsignedOrAuto(value, BVH_WIDTH_AUTO, options.bvhWidth) &&
+			(options.bvhWidth == BVH_WIDTH_AUTO || options.bvhWidth == BVH_WIDTH_BINARY || options.bvhWidth == BVH_WIDTH_4 || options.bvhWidth == BVH_WIDTH_8);
+	}
+	else if (name == "bvh-layout")
+	{
+		parsed = value == "depth-first" || value == "van-emde-boas";
+		options.bvhLayout = value == "van-emde-boas" ? BVH_LAYOUT_VAN_EMDE_BOAS : BVH_LAYOUT_DEPTH_FIRST;
+	}
+	else if (name == "bvh-leaf-size")
+	{
+		parsed = parseUnsigned(value, options.bvhMaxLeafSize) && options.bvhMaxLeafSize > 0;
+	}
+	else if (name == "quantise")
+	{
+		parsed = value == "off" || value == "8" || value == "16";
+		options.bvhQuantisation = value == "8" ? BVH_QUANTISE_8 : value == "16" ? BVH_QUANTISE_16 : BVH_QUANTISE_OFF;
+	}
+	else if (name == "triangle-kernel")
+	{
+		parsed = parseUnsignedOrAuto(value, TRIANGLE_KERNEL_AUTO, options.triangleKernelWidth) &&
+			(options.triangleKernelWidth == TRIANGLE_KERNEL_AUTO || options.triangleKernelWidth == TRIANGLE_KERNEL_SCALAR ||
+			options.triangleKernelWidth == TRIANGLE_KERNEL_4 || options.triangleKernelWidth == TRIANGLE_KERNEL_8);
+	}
+	else if (name == "bvh-cache")
+	{
+		options.bvhCachePath = value;
+	}
+	else if (name == "packet")
+	{
+		parsed = value == "off" || value == "4" || value == "8";
+		options.packetWidth = value == "off" ? RT_PACKET_OFF : value == "4" ? RT_PACKET_4X4 : RT_PACKET_8X8;
+	}
+	else if (name == "threads")
+	{
+		parsed = parseUnsignedOrAuto(value, THREAD_POOL_AUTO, options.threads);
+	}
+	else if (name == "tile")
+	{
+		parsed = parseUnsigned(value, options.tileSize) && options.tileSize > 0;
+	}
+	else if (name == "divisor")
+	{
+		parsed = parseUnsigned(value, options.resolutionDivisor) && options.resolutionDivisor > 0;
+	}
+	else if (name == "distribute")
+	{
+		unsigned int port;
+		parsed = parseUnsigned(value, port) && port <= 0xffff;
+		options.distributedPort = (unsigned short)port;
+	}
+	else if (name == "distribute-workers")
+	{
+		parsed = parseUnsigned(value, options.distributedWorkers) && options.distributedWorkers > 0;
+	}
+	else
+	{
+		errorOut = "unknown option " + name;
+		return false;
+	}
+	if (!parsed)
+	{
+		errorOut = "bad value \"" + value + "\" for " + name;
+		return false;
+	}
+	return true;
+}
+
+bool readRenderOptions(std::istream& configStream, RenderOptions& options, std::string& errorOut, unsigned int depth)
+{
+	if (depth > RENDER_OPTIONS_MAX_CONFIG_DEPTH)
+	{
+		errorOut = "config files nested too deeply";
+		return false;
+	}
+	std::string line;
+	for (unsigned int lineNumber = 1; std::getline(configStream, line); lineNumber++)
+	{
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty())
+		{
+			continue;
+		}
+		size_t equals = line.find('=');
+		std::string name = trim(line.substr(0, equals));
+		// A switch alone on its line means on
+		std::string value = equals == std::string::npos ? "on" : trim(line.substr(equals + 1));
+		if (!applyRenderOption(options, name, value, errorOut, depth))
+		{
+			errorOut = "line " + std::to_string(lineNumber) + ": " + errorOut;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool readRenderOptionsFile(const std::string& path, RenderOptions& options, std::string& errorOut, unsigned int depth)
+{
+	std::ifstream configFile(path);
+	if (!configFile.good())
+	{
+		errorOut = "could not read config file " + path;
+		return false;
+	}
+	if (!readRenderOptions(configFile, options, errorOut, depth))
+	{
+		errorOut = path + ", " + errorOut;
+		return false;
+	}
+	return true;
+}
+
+bool isRenderSwitchWithoutValue(const std::string& name, const char* nextArgument)
+{
+	RenderOptions options;
+	bool value;
+	return getSwitch(options, name) != nullptr && (nextArgument == nullptr || !parseBool(nextArgument, value));
+}
+
+bool parseRenderArguments(int argc, char** argv, RenderOptions& options, std::string& errorOut)
+{
+	const char* positionalNames[] = { "geometry", "texture", "output" };
+	unsigned int positionalCount = 0;
+	for (int i = 0; i < argc; i++)
+	{
+		std::string argument(argv[i]);
+		if (argument.compare(0, 2, "--") != 0)
+		{
+			if (positionalCount == 3)
+			{
+				errorOut = "unexpected argument " + argument;
+				return false;
+			}
+			if (!applyRenderOption(options, positionalNames[positionalCount++], argument, errorOut))
+			{
+				return false;
+			}
+			continue;
+		}
+		std::string name = argument.substr(2);
+		std::string value;
+		if (isRenderSwitchWithoutValue(name, i + 1 < argc ? argv[i + 1] : nullptr))
+		{
+			value = "on";
+		}
+		else if (i + 1 < argc)
+		{
+			value = argv[++i];
+		}
+		else
+		{
+			errorOut = "no value for " + name;
+			return false;
+		}
+		if (!applyRenderOption(options, name, value, errorOut))
+		{
+			return false;
+		}
+	}
+	if (!options.generateScene && (options.geometryPath.empty() || options.texturePath.empty()))
+	{
+		errorOut = "a geometry and texture file, or a scene to generate, are needed";
+		return false;
+	}
+	return true;
+}
+
+void printRenderOptionsUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [geometry texture [output]] [--option value ...]" << std::endl
+		<< "   or: " << program << " worker [host[:port]]" << std::endl
+		<< "Config files take the same options as name = value lines" << std::endl
+		<< "  --config FILE                     read options from a file" << std::endl
+		<< "  --geometry FILE  --texture FILE   OBJ and ASCII PPM to render" << std::endl
+		<< "  --generate SHAPE:TRIANGLES[:INSTANCES[:SEED]]   render a stress scene instead, sphere|soup|slivers|terrain" << std::endl
+		<< "  --output FILE                     PPM written, render.ppm by default" << std::endl
+		<< "  --width N  --height N             image size, 1024x768 by default" << std::endl
+		<< "  --projection ortho|perspective" << std::endl
+		<< "  --lighting  --shadows  --textured  --modulation  --gamma  --centre  --scale   on|off" << std::endl
+		<< "  --ambient X  --diffuse X  --specular X  --specular-exponent X  --emissive X" << std::endl
+		<< "  --zoom X  --x-translate X  --y-translate X" << std::endl
+		<< "  --rotate \"AX AY AZ DEGREES\"       rotate the object, repeatable" << std::endl
+		<< "  --light \"DX DY DZ [R G B [I]]\"    directional light towards DX DY DZ, repeatable" << std::endl
+		<< "  --accelerator bvh|grid|grid2  --builder sah|sbvh|lbvh|lbvh-treelets" << std::endl
+		<< "  --bvh-width 2|4|8|auto  --bvh-layout depth-first|van-emde-boas  --bvh-leaf-size N" << std::endl
+		<< "  --quantise off|8|16  --triangle-kernel 1|4|8|auto  --bvh-cache FILE" << std::endl
+		<< "  --packet off|4|8  --wavefront  --threads N|auto  --tile N  --divisor N  --numa  --replicate" << std::endl
+		<< "  --diagnostics                     also write per pixel cost images and float buffers beside the output" << std::endl
+		<< "  --distribute PORT  --distribute-workers N   render on worker processes" << std::endl;
+}
+
+void configureObject(const RenderOptions& options, RaytraceTexturedObject& object)
+{
+	object.setAccelerator(options.accelerator);
+	object.setBVHBuilder(options.bvhBuilder, options.optimiseTreelets);
+	object.setBVHWidth(options.bvhWidth);
+	object.setBVHLayout(options.bvhLayout);
+	object.setBVHMaxLeafSize(options.bvhMaxLeafSize);
+	object.setBVHQuantisation(options.bvhQuantisation);
+	object.setTriangleKernelWidth(options.triangleKernelWidth);
+	object.setBVHCachePath(options.bvhCachePath);
+}
+
+void configureRaytracer(const RenderOptions& options, Raytracer& raytracer)
+{
+	if (options.projectionMode == RT_PERSPECTIVE)
+	{
+		raytracer.setProjectionPerspective();
+	}
+	else
+	{
+		raytracer.setProjectionOrtho();
+	}
+	raytracer.setPacketWidth(options.packetWidth);
+	raytracer.setWavefront(options.wavefront);
+	raytracer.setTileSize(options.tileSize);
+	raytracer.setResolutionDivisor(options.resolutionDivisor);
+	// Pinning restarts the pool, so the count is set after
+	raytracer.setNumaAware(options.numaAware);
+	raytracer.setAcceleratorReplication(options.replicateAccelerators);
+	if (options.threads != THREAD_POOL_AUTO && options.threads != raytracer.getThreadCount())
+	{
+		raytracer.setThreadCount(options.threads);
+	}
+}
+
+Matrix4 getLightToWorld(const RenderLight& light)
+{
+	const Cartesian3& direction = light.direction;
+	Cartesian3 forward(0.0f, 0.0f, 1.0f);
+	Cartesian3 axis = forward.cross(direction);
+	float cosine = std::max(-1.0f, std::min(1.0f, forward.dot(direction)));
+	if (axis.length() < 1e-6f)
+	{
+		// Facing straight along z, either way
+		return cosine > 0.0f ? Matrix4::Identity() : Matrix4::RotationMultMat(Cartesian3(0.0f, 1.0f, 0.0f), (float)M_PI);
+	}
+	return Matrix4::RotationMultMat(axis, acos(cosine));
+}
+
+std::vector<std::unique_ptr<DirectionalLight>> createLights(const RenderOptions& options)
+{
+	std::vector<std::unique_ptr<DirectionalLight>> lights;
+	const RenderParameters& parameters = options.renderParameters;
+	if (options.lights.empty())
+	{
+		// Same light as the render widget
+		Cartesian3 lightColor(parameters.lightColor[0], parameters.lightColor[1], parameters.lightColor[2]);
+		lights.emplace_back(new DirectionalLight(parameters.lightMatrix, lightColor));
+	}
+	for (auto& light : options.lights)
+	{
+		lights.emplace_back(new DirectionalLight(getLightToWorld(light), light.color, light.intensity));
+	}
+	return lights;
+}
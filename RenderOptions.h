@@ -0,0 +1,103 @@
+// Render settings for runs without a window, from command line flags and config files
+// Flags are "--name value" and config files hold "name = value" lines, with # starting a comment, so anything that can
+// be set one way can be set the other. Later settings override earlier ones, and "config" reads a file in place, so
+// flags after it override the file. Switches such as --shadows may leave out their value to mean on
+#pragma once
+
+// Standard libraries
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+
+// Custom classes
+#include "RenderParameters.h"
+#include "Cartesian3.h"
+
+// RT Specific
+#include "Raytracer.h"
+#include "DirectionalLight.h"
+#include "StressScene.h"
+
+// Constants
+// Config files may read others, up to this deep, so a file can't read itself forever
+const unsigned int RENDER_OPTIONS_MAX_CONFIG_DEPTH = 8;
+
+// A directional light of the rig
+struct RenderLight
+{
+	// Towards the light, in world space
+	Cartesian3 direction;
+	Cartesian3 color;
+	float intensity;
+};
+
+struct RenderOptions
+{
+	// Files read and written
+	std::string geometryPath;
+	std::string texturePath;
+	std::string outputPath = "render.ppm";
+	// Generate this stress scene instead of reading the geometry and texture
+	bool generateScene = false;
+	StressSceneSpec stressScene;
+
+	// Image and view
+	long width = 1024;
+	long height = 768;
+	unsigned int projectionMode = RT_ORTHO;
+	RenderParameters renderParameters;
+	// Lights to render with. If none are given, one light as the render window has
+	std::vector<RenderLight> lights;
+
+	// Acceleration structure, one of the ACCELERATOR constants, and BVH settings
+	unsigned int accelerator = ACCELERATOR_BVH;
+	unsigned int bvhBuilder = BVH_BUILDER_SAH;
+	bool optimiseTreelets = false;
+	unsigned int bvhWidth = BVH_WIDTH_AUTO;
+	unsigned int bvhLayout = BVH_LAYOUT_DEPTH_FIRST;
+	unsigned int bvhMaxLeafSize = BVH_DEFAULT_MAX_LEAF_SIZE;
+	unsigned int bvhQuantisation = BVH_QUANTISE_OFF;
+	unsigned int triangleKernelWidth = TRIANGLE_KERNEL_AUTO;
+	// Empty to always build
+	std::string bvhCachePath;
+
+	// Rendering
+	unsigned int packetWidth = RT_PACKET_8X8;
+	bool wavefront = false;
+	unsigned int threads = THREAD_POOL_AUTO;
+	unsigned int tileSize = RT_TILE_SIZE_DEFAULT;
+	unsigned int resolutionDivisor = 1;
+	bool numaAware = false;
+	bool replicateAccelerators = false;
+	// Write each pixel's traversal steps, triangle tests, shadow rays and cycles beside the output
+	bool pixelDiagnostics = false;
+
+	// Render on worker processes through this port instead, 0 to render here, starting once this many are ready
+	unsigned short distributedPort = 0;
+	unsigned int distributedWorkers = 1;
+};
+
+// A whole number from 0 to 2^32 - 1 and nothing else, so signs and trailing text are refused rather than wrapped or ignored
+bool parseUnsigned(const std::string& value, unsigned int& valueOut);
+// Set one option by name. Returns false, with a message, for unknown names or values that don't parse
+bool applyRenderOption(RenderOptions& options, const std::string& name, const std::string& value, std::string& errorOut, unsigned int depth = 0);
+// Set the options in a config file, reporting errors by line
+bool readRenderOptions(std::istream& configStream, RenderOptions& options, std::string& errorOut, unsigned int depth = 0);
+bool readRenderOptionsFile(const std::string& path, RenderOptions& options, std::string& errorOut, unsigned int depth = 0);
+// Whether a flag is a switch given without a value, meaning on, as the argument after it isn't one. nextArgument is
+// nullptr at the end of the arguments
+bool isRenderSwitchWithoutValue(const std::string& name, const char* nextArgument);
+// Set options from command line arguments after the program name. Up to three leading arguments without a name are
+// the geometry, texture and output paths
+bool parseRenderArguments(int argc, char** argv, RenderOptions& options, std::string& errorOut);
+void printRenderOptionsUsage(const char* program);
+
+// Apply the structure and BVH settings to an object, before it's read
+void configureObject(const RenderOptions& options, RaytraceTexturedObject& object);
+// Apply the rendering settings to a raytracer
+void configureRaytracer(const RenderOptions& options, Raytracer& raytracer);
+// Rotation taking a light's +z, the way it faces in light space, to its direction
+Matrix4 getLightToWorld(const RenderLight& light);
+// Lights of the rig, or the render window's one light if there are none
+std::vector<std::unique_ptr<DirectionalLight>> createLights(const RenderOptions& options);
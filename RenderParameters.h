@@ -65,6 +65,8 @@ class RenderParameters
 
     bool gammaCorrection;
     bool shadows;
+    // raytrace on every change, at whatever resolution fits the frame budget
+    bool interactiveRaytrace;
 
     // constructor
     RenderParameters()
@@ -87,7 +89,8 @@ class RenderParameters
         scaleObject(false),
         mapUVWToRGB(false),
         gammaCorrection(false),
-        shadows(false)
+        shadows(false),
+        interactiveRaytrace(false)
         { // constructor
         
         // start the lighting at the viewer's direction
@@ -0,0 +1,418 @@
+// Blocking TCP connections carrying typed messages
+#include "RenderSocket.h"
+
+// Standard libraries
+#include <cstring>
+#include <algorithm>
+
+// Platform
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int SocketLength;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef socklen_t SocketLength;
+#endif
+
+// Constants
+// Writes to a closed connection fail rather than raising SIGPIPE. Linux asks for that per send, macOS and the BSDs per
+// socket with SO_NOSIGPIPE, and Windows has no SIGPIPE
+#if defined(MSG_NOSIGNAL)
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+// Connections waiting to be accepted
+const int LISTEN_BACKLOG = 16;
+
+// Winsock must be started before any other call, once per process
+static bool startSockets()
+{
+#if defined(_WIN32)
+	static bool started = false;
+	if (!started)
+	{
+		WSADATA data;
+		started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}
+	return started;
+#else
+	return true;
+#endif
+}
+
+// Options every connection gets, accepted or connected
+static void configureConnection(intptr_t handle)
+{
+	// Tiles are small messages, answered one at a time
+	int noDelay = 1;
+	setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#if !defined(MSG_NOSIGNAL) && defined(SO_NOSIGPIPE)
+	int noSignal = 1;
+	setsockopt(handle, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&noSignal, sizeof(noSignal));
+#endif
+}
+
+static void closeHandle(intptr_t handle)
+{
+#if defined(_WIN32)
+	closesocket((SOCKET)handle);
+#else
+	::close((int)handle);
+#endif
+}
+
+RenderMessage::RenderMessage(uint32_t newType) : readPosition(0), readFailed(false), type(newType)
+{
+}
+
+void RenderMessage::writeUInt(uint32_t value)
+{
+	unsigned char bytes[4] = { (unsigned char)(value >> 24), (unsigned char)(value >> 16), (unsigned char)(value >> 8), (unsigned char)value };
+	payload.insert(payload.end(), bytes, bytes + 4);
+}
+
+void RenderMessage::writeFloat(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	writeUInt(bits);
+}
+
+void RenderMessage::writeString(const std::string& value)
+{
+	writeUInt((uint32_t)value.size());
+	writeBytes(value.data(), value.size());
+}
+
+void RenderMessage::writeBytes(const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	payload.insert(payload.end(), bytes, bytes + size);
+}
+
+uint32_t RenderMessage::readUInt()
+{
+	unsigned char bytes[4];
+	readBytes(bytes, 4);
+	return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+float RenderMessage::readFloat()
+{
+	uint32_t bits = readUInt();
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+std::string RenderMessage::readString()
+{
+	uint32_t size = readUInt();
+	if (readFailed || size > payload.size() - readPosition)
+	{
+		readFailed = true;
+		return std::string();
+	}
+	std::string value((const char*)payload.data() + readPosition, size);
+	readPosition += size;
+	return value;
+}
+
+void RenderMessage::readBytes(void* data, size_t size)
+{
+	if (readFailed || size > payload.size() - readPosition)
+	{
+		readFailed = true;
+		std::memset(data, 0, size);
+		return;
+	}
+	std::memcpy(data, payload.data() + readPosition, size);
+	readPosition += size;
+}
+
+RenderSocket::RenderSocket() : handle(RENDER_SOCKET_CLOSED)
+{
+}
+
+RenderSocket::~RenderSocket()
+{
+	close();
+}
+
+RenderSocket::RenderSocket(RenderSocket&& other) : handle(other.handle)
+{
+	other.handle = RENDER_SOCKET_CLOSED;
+}
+
+RenderSocket& RenderSocket::operator = (RenderSocket&& other)
+{
+	if (this != &other)
+	{
+		close();
+		handle = other.handle;
+		other.handle = RENDER_SOCKET_CLOSED;
+	}
+	return *this;
+}
+
+bool RenderSocket::listen(unsigned short port)
+{
+	close();
+	if (!startSockets())
+	{
+		return false;
+	}
+	intptr_t listener = (intptr_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (listener == RENDER_SOCKET_CLOSED)
+	{
+		return false;
+	}
+	// A restarted coordinator can take its port back straight away
+	int reuse = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(listener, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener, LISTEN_BACKLOG) != 0)
+	{
+		closeHandle(listener);
+		return false;
+	}
+	handle = listener;
+	return true;
+}
+
+RenderSocket RenderSocket::accept()
+{
+	RenderSocket connection;
+	if (isOpen())
+	{
+		connection.handle = (intptr_t)::accept(handle, nullptr, nullptr);
+		if (connection.isOpen())
+		{
+			configureConnection(connection.handle);
+		}
+	}
+	return connection;
+}
+
+bool RenderSocket::connect(const std::string& host, unsigned short port)
+{
+	close();
+	if (!startSockets())
+	{
+		return false;
+	}
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0)
+	{
+		return false;
+	}
+	// Take the first address that answers
+	for (addrinfo* address = addresses; address != nullptr && !isOpen(); address = address->ai_next)
+	{
+		intptr_t connection = (intptr_t)socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (connection == RENDER_SOCKET_CLOSED)
+		{
+			continue;
+		}
+		if (::connect(connection, address->ai_addr, (SocketLength)address->ai_addrlen) != 0)
+		{
+			closeHandle(connection);
+			continue;
+		}
+		configureConnection(connection);
+		handle = connection;
+	}
+	freeaddrinfo(addresses);
+	return isOpen();
+}
+
+void RenderSocket::close()
+{
+	if (isOpen())
+	{
+		closeHandle(handle);
+		handle = RENDER_SOCKET_CLOSED;
+	}
+}
+
+bool RenderSocket::setTimeout(unsigned int timeoutMs)
+{
+	if (!isOpen())
+	{
+		return false;
+	}
+#if defined(_WIN32)
+	DWORD timeout = timeoutMs;
+#else
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+#endif
+	// A send or receive that times out returns an error like any other failure, so the message is abandoned
+	return setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0 &&
+		setsockopt(handle, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+}
+
+bool RenderSocket::sendAll(const void* data, size_t size)
+{
+	const char* bytes = (const char*)data;
+	while (size > 0)
+	{
+		// Large payloads go in pieces, as Winsock takes an int length
+		int chunk = (int)std::min(size, (size_t)(1 << 24));
+		int sent = (int)::send(handle, bytes, chunk, SEND_FLAGS);
+		if (sent <= 0)
+		{
+			return false;
+		}
+		bytes += sent;
+		size -= (size_t)sent;
+	}
+	return true;
+}
+
+bool RenderSocket::receiveAll(void* data, size_t size)
+{
+	char* bytes = (char*)data;
+	while (size > 0)
+	{
+		int chunk = (int)std::min(size, (size_t)(1 << 24));
+		int received = (int)::recv(handle, bytes, chunk, 0);
+		if (received <= 0)
+		{
+			return false;
+		}
+		bytes += received;
+		size -= (size_t)received;
+	}
+	return true;
+}
+
+bool RenderSocket::send(const RenderMessage& message)
+{
+	if (!isOpen())
+	{
+		return false;
+	}
+	RenderMessage header;
+	header.writeUInt(message.type);
+	header.writeUInt((uint32_t)message.payload.size());
+	if (!sendAll(header.payload.data(), header.payload.size()) || !sendAll(message.payload.data(), message.payload.size()))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool RenderSocket::receive(RenderMessage& messageOut)
+{
+	if (!isOpen())
+	{
+		return false;
+	}
+	RenderMessage header;
+	header.payload.resize(8);
+	if (!receiveAll(header.payload.data(), header.payload.size()))
+	{
+		close();
+		return false;
+	}
+	messageOut = RenderMessage(header.readUInt());
+	uint32_t size = header.readUInt();
+	if (size > RENDER_MESSAGE_MAX_SIZE)
+	{
+		close();
+		return false;
+	}
+	messageOut.payload.resize(size);
+	if (size > 0 && !receiveAll(messageOut.payload.data(), size))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+std::string RenderSocket::getPeerName() const
+{
+	sockaddr_storage address;
+	SocketLength length = sizeof(address);
+	if (!isOpen() || getpeername(handle, (sockaddr*)&address, &length) != 0)
+	{
+		return "unknown";
+	}
+	char host[NI_MAXHOST];
+	char port[NI_MAXSERV];
+	if (getnameinfo((const sockaddr*)&address, length, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+	{
+		return "unknown";
+	}
+	return std::string(host) + ":" + port;
+}
+
+unsigned short RenderSocket::getLocalPort() const
+{
+	sockaddr_in address;
+	SocketLength length = sizeof(address);
+	if (!isOpen() || getsockname(handle, (sockaddr*)&address, &length) != 0)
+	{
+		return 0;
+	}
+	return ntohs(address.sin_port);
+}
+
+std::vector<size_t> RenderSocket::waitReadable(const std::vector<const RenderSocket*>& sockets, unsigned int timeoutMs)
+{
+	fd_set readable;
+	FD_ZERO(&readable);
+	intptr_t highest = 0;
+	for (auto socket : sockets)
+	{
+		if (socket->isOpen())
+		{
+			FD_SET(socket->handle, &readable);
+			highest = std::max(highest, socket->handle);
+		}
+	}
+	timeval timeout;
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+	std::vector<size_t> ready;
+	// Windows ignores the first argument
+	if (select((int)highest + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+	{
+		return ready;
+	}
+	for (size_t i = 0; i < sockets.size(); i++)
+	{
+		if (sockets[i]->isOpen() && FD_ISSET(sockets[i]->handle, &readable))
+		{
+			ready.push_back(i);
+		}
+	}
+	return ready;
+}
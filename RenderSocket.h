@@ -0,0 +1,87 @@
+// Blocking TCP connections carrying typed messages, for spreading a render over processes and hosts
+// Each message is a type, a payload length and the payload, every number sent as big endian 32 bit words so either end
+// may be any architecture. Winsock on Windows, BSD sockets elsewhere. A connection given a timeout fails, and closes,
+// once the other end stops taking or giving the bytes of a message for that long
+#pragma once
+
+// Standard libraries
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Constants
+// Largest payload accepted, well above any scene sent, so a corrupt length can't allocate without bound
+const uint32_t RENDER_MESSAGE_MAX_SIZE = 1u << 30;
+// Socket handle that isn't open
+const intptr_t RENDER_SOCKET_CLOSED = -1;
+
+// A message's type and payload, which is written and then read back in the same order
+class RenderMessage
+{
+private:
+	std::vector<unsigned char> payload;
+	size_t readPosition;
+	bool readFailed;
+
+	friend class RenderSocket;
+public:
+	uint32_t type;
+
+	// Constructor
+	RenderMessage(uint32_t newType = 0);
+
+	void writeUInt(uint32_t value);
+	void writeFloat(float value);
+	void writeString(const std::string& value);
+	void writeBytes(const void* data, size_t size);
+
+	// Reads past the end return zeroes and mark the message invalid
+	uint32_t readUInt();
+	float readFloat();
+	std::string readString();
+	void readBytes(void* data, size_t size);
+	// Whether every read so far found its data
+	bool isValid() const { return !readFailed; };
+};
+
+class RenderSocket
+{
+private:
+	// Platform handle, as Windows' SOCKET is unsigned and other platforms' descriptors are int
+	intptr_t handle;
+
+	bool sendAll(const void* data, size_t size);
+	bool receiveAll(void* data, size_t size);
+public:
+	// Constructor, closed
+	RenderSocket();
+	// Closes the connection
+	~RenderSocket();
+	RenderSocket(RenderSocket&& other);
+	RenderSocket& operator = (RenderSocket&& other);
+	RenderSocket(const RenderSocket&) = delete;
+	RenderSocket& operator = (const RenderSocket&) = delete;
+
+	// Listen for connections on every interface. Port 0 picks a free one, see getLocalPort()
+	bool listen(unsigned short port);
+	// Next connection to a listening socket, closed if it failed
+	RenderSocket accept();
+	// Connect to a listening socket by host name or address
+	bool connect(const std::string& host, unsigned short port);
+	void close();
+	bool isOpen() const { return handle != RENDER_SOCKET_CLOSED; };
+	// Fail any send or receive that makes no progress for this long, 0 to wait forever. Returns false if the system refused
+	bool setTimeout(unsigned int timeoutMs);
+
+	// Whole messages, returning false once the connection fails or closes
+	bool send(const RenderMessage& message);
+	bool receive(RenderMessage& messageOut);
+
+	// Address of the other end, as host:port
+	std::string getPeerName() const;
+	unsigned short getLocalPort() const;
+
+	// Indices of the open sockets with data waiting or a closed connection, after up to timeoutMs
+	static std::vector<size_t> waitReadable(const std::vector<const RenderSocket*>& sockets, unsigned int timeoutMs);
+};
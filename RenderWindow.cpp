@@ -99,6 +99,7 @@ RenderWindow::RenderWindow
     raytraceButton              = new QPushButton               ("Raytrace",            this);
     gammaCheckbox               = new QCheckBox                 ("Gamma Correction",    this);
     shadowsCheckbox             = new QCheckBox                 ("Shadows",             this);
+    interactiveCheckbox         = new QCheckBox                 ("Interactive",         this);
     
     // add all of the widgets to the grid               Row         Column      Row Span    Column Span
     
@@ -160,6 +161,7 @@ RenderWindow::RenderWindow
     windowLayout->addWidget(raytraceButton,             0,          6,          1,          1           );
     windowLayout->addWidget(gammaCheckbox,              1,          6,          1,          1           );
     windowLayout->addWidget(shadowsCheckbox,            2,          6,          1,          1           );
+    windowLayout->addWidget(interactiveCheckbox,        3,          6,          1,          1           );
 
     // now reset all of the control elements to match the render parameters passed in
     ResetInterface();
@@ -182,6 +184,7 @@ void RenderWindow::ResetInterface()
     scaleObjectBox          ->setChecked        (renderParameters   ->  scaleObject);
     gammaCheckbox           ->setChecked        (renderParameters   ->  gammaCorrection);
     shadowsCheckbox         ->setChecked        (renderParameters   ->  shadows);
+    interactiveCheckbox     ->setChecked        (renderParameters   ->  interactiveRaytrace);
     
     // set sliders
     // x & y translate are scaled to notional unit sphere in render widgets
@@ -224,6 +227,9 @@ void RenderWindow::ResetInterface()
     specularExponentSlider  ->setMinimum        ((int) (SPECULAR_EXPONENT_LOG_MIN                   * PARAMETER_SCALING));
     specularExponentSlider  ->setMaximum        ((int) (SPECULAR_EXPONENT_LOG_MAX                   * PARAMETER_SCALING));
     specularExponentSlider  ->setValue          ((int) (log10(renderParameters -> specularExponent) * PARAMETER_SCALING));
+
+    // a raytrace in progress is now out of date, so restart it
+    raytraceRenderWidget    ->ParametersChanged();
     
     // now flag them all for update 
     renderWidget            ->update();
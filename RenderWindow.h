@@ -98,6 +98,7 @@ class RenderWindow : public QWidget
     QPushButton                 *raytraceButton;
     QCheckBox                   *gammaCheckbox;
     QCheckBox                   *shadowsCheckbox;
+    QCheckBox                   *interactiveCheckbox;
 
     public:
     // constructor
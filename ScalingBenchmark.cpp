@@ -0,0 +1,98 @@
+// Thread scaling benchmark
+#include "ScalingBenchmark.h"
+
+// Standard libraries
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// RT Specific
+#include "Raytracer.h"
+#include "DirectionalLight.h"
+
+void runScalingBenchmark(RaytraceTexturedObject* object, RenderParameters* renderParameters, unsigned int maxThreads)
+{
+	if (maxThreads == THREAD_POOL_AUTO)
+	{
+		maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// Threads beyond one per core share a core's units with another, so scale differently
+	unsigned int coreCount = getPhysicalCoreCount();
+	// Powers of two, the core count, then the maximum itself
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < maxThreads; threads *= 2)
+	{
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(maxThreads);
+	if (coreCount < maxThreads && std::find(threadCounts.begin(), threadCounts.end(), coreCount) == threadCounts.end())
+	{
+		threadCounts.insert(std::upper_bound(threadCounts.begin(), threadCounts.end(), coreCount), coreCount);
+	}
+
+	// Same light as the render widget
+	Cartesian3 lightColor(renderParameters->lightColor[0], renderParameters->lightColor[1], renderParameters->lightColor[2]);
+	DirectionalLight light(renderParameters->lightMatrix, lightColor);
+	std::vector<Light*> lights(1, &light);
+	RGBAImage frameBuffer;
+	frameBuffer.Resize(SCALING_BENCHMARK_WIDTH, SCALING_BENCHMARK_HEIGHT);
+	Raytracer raytracer(&frameBuffer, object, &lights, renderParameters);
+
+	std::cout << "Scaling at " << SCALING_BENCHMARK_WIDTH << "x" << SCALING_BENCHMARK_HEIGHT << " with " << raytracer.getTileSize() << " pixel tiles, "
+		<< std::thread::hardware_concurrency() << " hardware threads on " << coreCount << " cores" << std::endl;
+	double singleThreadMs = 0.0;
+	for (auto threads : threadCounts)
+	{
+		raytracer.setThreadCount(threads);
+		double bestMs = 0.0;
+		unsigned long long rays = 0;
+		for (unsigned int repeat = 0; repeat < SCALING_BENCHMARK_REPEATS; repeat++)
+		{
+			auto startTime = std::chrono::steady_clock::now();
+			raytracer.raytrace();
+			double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			if (repeat == 0 || renderMs < bestMs)
+			{
+				bestMs = renderMs;
+			}
+			rays = raytracer.getRenderStats().rays;
+		}
+		if (threads == 1)
+		{
+			singleThreadMs = bestMs;
+		}
+		double speedup = singleThreadMs / bestMs;
+		std::cout << std::setw(4) << threads << " threads: " << std::fixed << std::setprecision(1) << bestMs << "ms, "
+			<< std::setprecision(2) << rays / bestMs / 1000.0 << " Mrays/s, speedup " << speedup << ", efficiency "
+			<< std::setprecision(0) << 100.0 * speedup / threads << "%" << std::defaultfloat << std::setprecision(6)
+			<< (threads > coreCount ? ", sharing cores" : "") << std::endl;
+	}
+
+	// On NUMA machines, compare the most threads unpinned against pinned, and pinned with per node structures
+	if (detectNumaTopology().getNodeCount() > 1)
+	{
+		for (int replicated = 0; replicated <= 1; replicated++)
+		{
+			raytracer.setNumaAware(true);
+			raytracer.setThreadCount(maxThreads);
+			raytracer.setAcceleratorReplication(replicated == 1);
+			double bestMs = 0.0;
+			for (unsigned int repeat = 0; repeat < SCALING_BENCHMARK_REPEATS; repeat++)
+			{
+				auto startTime = std::chrono::steady_clock::now();
+				raytracer.raytrace();
+				double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+				if (repeat == 0 || renderMs < bestMs)
+				{
+					bestMs = renderMs;
+				}
+			}
+			std::cout << std::setw(4) << maxThreads << " threads NUMA pinned" << (replicated == 1 ? ", replicated" : "") << ": " << std::fixed
+				<< std::setprecision(1) << bestMs << "ms, speedup " << std::setprecision(2) << singleThreadMs / bestMs << std::defaultfloat
+				<< std::setprecision(6) << std::endl;
+		}
+	}
+}
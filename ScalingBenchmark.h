@@ -0,0 +1,19 @@
+// Thread scaling benchmark
+// Renders the same frame with 1, 2, 4 ... threads up to the hardware thread count, reporting time, rays per second
+// and speedup over one thread. Each count keeps its best of a few renders, so a cold first frame doesn't count against it.
+// The physical core count is always one of the counts, and rows with more threads than cores are marked as sharing them.
+// NUMA machines also render with every thread pinned to its node, with and without per node acceleration structures
+#pragma once
+
+// RT Specific
+#include "RaytraceTexturedObject.h"
+#include "RenderParameters.h"
+#include "ThreadPool.h"
+
+// Constants
+const unsigned int SCALING_BENCHMARK_WIDTH = 512;
+const unsigned int SCALING_BENCHMARK_HEIGHT = 512;
+const unsigned int SCALING_BENCHMARK_REPEATS = 3;
+
+// Render the object under the given parameters, maxThreads of THREAD_POOL_AUTO for every hardware thread
+void runScalingBenchmark(RaytraceTexturedObject* object, RenderParameters* renderParameters, unsigned int maxThreads = THREAD_POOL_AUTO);
@@ -0,0 +1,489 @@
+// Procedural stress scenes
+#include "StressScene.h"
+
+// Standard libraries
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+
+// Constants
+const char* const STRESS_SCENE_SHAPE_NAMES[] = { "sphere", "soup", "slivers", "terrain" };
+const unsigned int STRESS_SCENE_SHAPE_COUNT = 4;
+// Soup triangles are this many times the spacing of their centres across
+const float SOUP_SIZE_FACTOR = 3.0f;
+// Sliver width as a fraction of their unit length
+const float SLIVER_WIDTH = 0.002f;
+// Terrain noise octaves, lattice cells across the lowest octave, and height range
+const unsigned int TERRAIN_OCTAVES = 8;
+const float TERRAIN_BASE_FREQUENCY = 4.0f;
+const float TERRAIN_RELIEF = 0.6f;
+// Squares of the sphere's checker around and down
+const float SPHERE_CHECKS_AROUND = 16.0f;
+const float SPHERE_CHECKS_DOWN = 8.0f;
+// The renderer rounds u and v times the texture size to a texel, so coordinates stop at the last texel's centre
+const float TEXTURE_COORD_SCALE = (float)(STRESS_SCENE_TEXTURE_SIZE - 1) / (float)STRESS_SCENE_TEXTURE_SIZE;
+
+// Random numbers that come out the same on every platform, unlike the standard distributions. SplitMix64
+class StressRandom
+{
+private:
+	uint64_t state;
+public:
+	explicit StressRandom(uint64_t seed) : state(seed) {};
+
+	uint64_t next()
+	{
+		uint64_t value = (state += 0x9E3779B97F4A7C15ull);
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	};
+	// Uniform in [0, 1)
+	float uniform() { return (float)(next() >> 40) * (1.0f / 16777216.0f); };
+	float range(float low, float high) { return low + (high - low) * uniform(); };
+	// Uniform over the unit sphere
+	Cartesian3 direction()
+	{
+		float z = range(-1.0f, 1.0f);
+		float angle = range(0.0f, 2.0f * (float)M_PI);
+		float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+		return Cartesian3(radius * std::cos(angle), radius * std::sin(angle), z);
+	};
+};
+
+// Value in [0, 1) at a lattice point of one octave
+static float latticeValue(int64_t x, int64_t z, unsigned int octave, uint64_t seed)
+{
+	StressRandom random(seed ^ ((uint64_t)x * 0x8DA6B343ull) ^ ((uint64_t)z * 0xD8163841ull) ^ ((uint64_t)octave << 56));
+	return random.uniform();
+}
+
+// Smoothly interpolated lattice values, in [0, 1)
+static float valueNoise(float x, float z, unsigned int octave, uint64_t seed)
+{
+	float cellX = std::floor(x);
+	float cellZ = std::floor(z);
+	float fractionX = x - cellX;
+	float fractionZ = z - cellZ;
+	fractionX = fractionX * fractionX * (3.0f - 2.0f * fractionX);
+	fractionZ = fractionZ * fractionZ * (3.0f - 2.0f * fractionZ);
+	int64_t latticeX = (int64_t)cellX;
+	int64_t latticeZ = (int64_t)cellZ;
+	float top = latticeValue(latticeX, latticeZ, octave, seed) * (1.0f - fractionX) + latticeValue(latticeX + 1, latticeZ, octave, seed) * fractionX;
+	float bottom = latticeValue(latticeX, latticeZ + 1, octave, seed) * (1.0f - fractionX) + latticeValue(latticeX + 1, latticeZ + 1, octave, seed) * fractionX;
+	return top * (1.0f - fractionZ) + bottom * fractionZ;
+}
+
+// Fractal noise over [0, 1] squared, in [0, 1)
+static float fractalNoise(float x, float z, unsigned int octaves, uint64_t seed)
+{
+	float value = 0.0f;
+	float amplitude = 0.5f;
+	float frequency = TERRAIN_BASE_FREQUENCY;
+	float totalAmplitude = 0.0f;
+	for (unsigned int octave = 0; octave < octaves; octave++)
+	{
+		value += amplitude * valueNoise(x * frequency, z * frequency, octave, seed);
+		totalAmplitude += amplitude;
+		amplitude *= 0.5f;
+		frequency *= 2.0f;
+	}
+	return value / totalAmplitude;
+}
+
+// Texture coordinate for a position in [0, 1] across the texture
+static float textureCoord(float position)
+{
+	return std::max(0.0f, std::min(1.0f, position)) * TEXTURE_COORD_SCALE;
+}
+
+// Fill every texel from its position in [0, 1] across and down the texture, matching textureCoord()
+template <typename ColourFunction>
+static void drawTexture(RGBAImage& texture, ColourFunction colour)
+{
+	texture.Resize(STRESS_SCENE_TEXTURE_SIZE, STRESS_SCENE_TEXTURE_SIZE);
+	for (long row = 0; row < STRESS_SCENE_TEXTURE_SIZE; row++)
+	{
+		for (long col = 0; col < STRESS_SCENE_TEXTURE_SIZE; col++)
+		{
+			texture[row][col] = colour((float)col / (STRESS_SCENE_TEXTURE_SIZE - 1), (float)row / (STRESS_SCENE_TEXTURE_SIZE - 1));
+		}
+	}
+}
+
+// Rows and columns of quads, two triangles each, stopping once the count is reached
+static void generateSphere(const StressSceneSpec& spec, RaytraceTexturedObject& object, std::vector<IndexedTriangularFace>& triangles)
+{
+	// Bands down from the pole, the first and last of one triangle per segment, with twice as many segments around
+	unsigned int bands = 2;
+	while (4ull * bands * (bands - 1) < spec.triangles)
+	{
+		bands++;
+	}
+	unsigned int segments = 2 * bands;
+	unsigned int rowLength = segments + 1;
+
+	// The seam is repeated, so its texture coordinates can be 0 on one side and 1 on the other
+	object.vertices.reserve((size_t)(bands + 1) * rowLength);
+	object.normals.reserve((size_t)(bands + 1) * rowLength);
+	object.textureCoords.reserve((size_t)(bands + 1) * rowLength);
+	for (unsigned int band = 0; band <= bands; band++)
+	{
+		float theta = (float)M_PI * band / bands;
+		for (unsigned int segment = 0; segment <= segments; segment++)
+		{
+			float phi = 2.0f * (float)M_PI * segment / segments;
+			Cartesian3 position(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+			object.vertices.push_back(position);
+			object.normals.push_back(position);
+			object.textureCoords.push_back(Cartesian3(textureCoord((float)segment / segments), textureCoord((float)band / bands), 0.0f));
+		}
+	}
+	for (unsigned int band = 0; band < bands && triangles.size() < spec.triangles; band++)
+	{
+		for (unsigned int segment = 0; segment < segments && triangles.size() < spec.triangles; segment++)
+		{
+			unsigned int topLeft = band * rowLength + segment;
+			unsigned int topRight = topLeft + 1;
+			unsigned int bottomLeft = topLeft + rowLength;
+			unsigned int bottomRight = bottomLeft + 1;
+			// Quads touching the poles have collapsed to triangles
+			if (band != 0)
+			{
+				triangles.push_back({ topLeft, bottomLeft, topRight, topLeft, bottomLeft, topRight, topLeft, bottomLeft, topRight });
+			}
+			if (band != bands - 1 && triangles.size() < spec.triangles)
+			{
+				triangles.push_back({ topRight, bottomLeft, bottomRight, topRight, bottomLeft, bottomRight, topRight, bottomLeft, bottomRight });
+			}
+		}
+	}
+
+	drawTexture(object.texture, [](float u, float v)
+	{
+		bool light = ((int)(u * SPHERE_CHECKS_AROUND) + (int)(v * SPHERE_CHECKS_DOWN)) % 2 == 0;
+		return light ? RGBAValue((unsigned char)230, 230, 220) : RGBAValue((unsigned char)190, 60, 40);
+	});
+}
+
+// Triangles with their own corners, normal and texture coordinates, placed and shaped by the function given.
+// Texture coordinates come from x and y, so the texture is laid over the scene from the front
+template <typename CornerFunction>
+static void generateLooseTriangles(const StressSceneSpec& spec, RaytraceTexturedObject& object, std::vector<IndexedTriangularFace>& triangles,
+	CornerFunction corners)
+{
+	object.vertices.reserve(spec.triangles * 3);
+	object.normals.reserve(spec.triangles);
+	object.textureCoords.reserve(spec.triangles * 3);
+	StressRandom random(spec.seed);
+	Cartesian3 corner[3];
+	for (size_t triangle = 0; triangle < spec.triangles; triangle++)
+	{
+		corners(random, corner);
+		Cartesian3 normal = (corner[1] - corner[0]).cross(corner[2] - corner[0]);
+		float length = normal.length();
+		object.normals.push_back(length > 0.0f ? normal / length : Cartesian3(0.0f, 1.0f, 0.0f));
+		unsigned int first = (unsigned int)object.vertices.size();
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			object.vertices.push_back(corner[i]);
+			object.textureCoords.push_back(Cartesian3(textureCoord((corner[i].x + 1.0f) * 0.5f), textureCoord((corner[i].y + 1.0f) * 0.5f), 0.0f));
+		}
+		unsigned int normalIndex = (unsigned int)triangle;
+		triangles.push_back({ first, first + 1, first + 2, normalIndex, normalIndex, normalIndex, first, first + 1, first + 2 });
+	}
+
+	// Colours drifting smoothly across the scene, so triangles near each other share them
+	uint64_t seed = spec.seed;
+	drawTexture(object.texture, [seed](float u, float v)
+	{
+		return RGBAValue(40.0f + 215.0f * fractalNoise(u, v, 3, seed), 40.0f + 215.0f * fractalNoise(u, v, 3, seed + 1),
+			40.0f + 215.0f * fractalNoise(u, v, 3, seed + 2), 255.0f);
+	});
+}
+
+static Cartesian3 clampToCube(const Cartesian3& point)
+{
+	return Cartesian3(std::max(-1.0f, std::min(1.0f, point.x)), std::max(-1.0f, std::min(1.0f, point.y)), std::max(-1.0f, std::min(1.0f, point.z)));
+}
+
+static void generateSoup(const StressSceneSpec& spec, RaytraceTexturedObject& object, std::vector<IndexedTriangularFace>& triangles)
+{
+	// Centres are this far apart on average, filling the cube
+	float spacing = std::cbrt(8.0f / spec.triangles);
+	float size = std::min(1.0f, SOUP_SIZE_FACTOR * spacing);
+	generateLooseTriangles(spec, object, triangles, [size](StressRandom& random, Cartesian3* corners)
+	{
+		Cartesian3 centre(random.range(-1.0f, 1.0f), random.range(-1.0f, 1.0f), random.range(-1.0f, 1.0f));
+		for (unsigned int i = 0; i < 3; i++)
+		{
+			corners[i] = clampToCube(centre + 0.5f * size * random.direction());
+		}
+	});
+}
+
+static void generateSlivers(const StressSceneSpec& spec, RaytraceTexturedObject& object, std::vector<IndexedTriangularFace>& triangles)
+{
+	generateLooseTriangles(spec, object, triangles, [](StressRandom& random, Cartesian3* corners)
+	{
+		// Centred so the full length stays inside the cube
+		Cartesian3 centre(random.range(-0.5f, 0.5f), random.range(-0.5f, 0.5f), random.range(-0.5f, 0.5f));
+		Cartesian3 along = random.direction();
+		// Any direction across the sliver
+		Cartesian3 other = std::abs(along.x) < 0.9f ? Cartesian3(1.0f, 0.0f, 0.0f) : Cartesian3(0.0f, 1.0f, 0.0f);
+		Cartesian3 across = along.cross(other).unit();
+		float angle = random.range(0.0f, 2.0f * (float)M_PI);
+		across = std::cos(angle) * across + std::sin(angle) * along.cross(across);
+		corners[0] = centre - 0.5f * along;
+		corners[1] = centre + 0.5f * along;
+		corners[2] = centre + SLIVER_WIDTH * across;
+	});
+}
+
+// Grid of quads over x and z in [-1, 1], two triangles each, stopping once the count is reached
+static void generateTerrain(const StressSceneSpec& spec, RaytraceTexturedObject& object, std::vector<IndexedTriangularFace>& triangles)
+{
+	unsigned int cells = 1;
+	while (2ull * cells * cells < spec.triangles)
+	{
+		cells++;
+	}
+	unsigned int rowLength = cells + 1;
+	size_t vertexCount = (size_t)rowLength * rowLength;
+	object.vertices.reserve(vertexCount);
+	object.normals.reserve(vertexCount);
+	object.textureCoords.reserve(vertexCount);
+
+	// Heights first, so normals can come from the neighbouring vertices
+	std::vector<float> heights(vertexCount);
+	for (unsigned int row = 0; row < rowLength; row++)
+	{
+		for (unsigned int col = 0; col < rowLength; col++)
+		{
+			heights[(size_t)row * rowLength + col] = TERRAIN_RELIEF * (fractalNoise((float)col / cells, (float)row / cells, TERRAIN_OCTAVES, spec.seed) - 0.5f);
+		}
+	}
+	float step = 2.0f / cells;
+	for (unsigned int row = 0; row < rowLength; row++)
+	{
+		for (unsigned int col = 0; col < rowLength; col++)
+		{
+			object.vertices.push_back(Cartesian3(-1.0f + step * col, heights[(size_t)row * rowLength + col], -1.0f + step * row));
+			// Central differences, one sided at the edges
+			unsigned int left = col == 0 ? col : col - 1;
+			unsigned int right = col == cells ? col : col + 1;
+			unsigned int up = row == 0 ? row : row - 1;
+			unsigned int down = row == cells ? row : row + 1;
+			float slopeX = (heights[(size_t)row * rowLength + right] - heights[(size_t)row * rowLength + left]) / (step * (right - left));
+			float slopeZ = (heights[(size_t)down * rowLength + col] - heights[(size_t)up * rowLength + col]) / (step * (down - up));
+			object.normals.push_back(Cartesian3(-slopeX, 1.0f, -slopeZ).unit());
+			object.textureCoords.push_back(Cartesian3(textureCoord((float)col / cells), textureCoord((float)row / cells), 0.0f));
+		}
+	}
+	for (unsigned int row = 0; row < cells && triangles.size() < spec.triangles; row++)
+	{
+		for (unsigned int col = 0; col < cells && triangles.size() < spec.triangles; col++)
+		{
+			unsigned int topLeft = row * rowLength + col;
+			unsigned int topRight = topLeft + 1;
+			unsigned int bottomLeft = topLeft + rowLength;
+			unsigned int bottomRight = bottomLeft + 1;
+			triangles.push_back({ topLeft, bottomLeft, topRight, topLeft, bottomLeft, topRight, topLeft, bottomLeft, topRight });
+			if (triangles.size() < spec.triangles)
+			{
+				triangles.push_back({ topRight, bottomLeft, bottomRight, topRight, bottomLeft, bottomRight, topRight, bottomLeft, bottomRight });
+			}
+		}
+	}
+
+	// Coloured by the height of the same noise under each texel: water, sand, grass, rock and snow
+	uint64_t seed = spec.seed;
+	drawTexture(object.texture, [seed](float u, float v)
+	{
+		float height = fractalNoise(u, v, TERRAIN_OCTAVES, seed);
+		if (height < 0.4f)
+			return RGBAValue((unsigned char)40, 80, 160);
+		if (height < 0.45f)
+			return RGBAValue((unsigned char)200, 190, 140);
+		if (height < 0.6f)
+			return RGBAValue((unsigned char)70, 140, 60);
+		if (height < 0.7f)
+			return RGBAValue((unsigned char)120, 110, 100);
+		return RGBAValue((unsigned char)240, 240, 245);
+	});
+}
+
+// Count with an optional k or M suffix
+static bool parseCount(const std::string& text, unsigned long long maximum, unsigned long long& countOut)
+{
+	std::istringstream stream(text);
+	unsigned long long count;
+	if (text.empty() || text[0] == '-' || !(stream >> count))
+	{
+		return false;
+	}
+	std::string suffix;
+	stream >> suffix;
+	if (suffix == "k" || suffix == "K")
+	{
+		count *= 1000;
+	}
+	else if (suffix == "M" || suffix == "m")
+	{
+		count *= 1000000;
+	}
+	else if (!suffix.empty())
+	{
+		return false;
+	}
+	countOut = count;
+	return count >= 1 && count <= maximum;
+}
+
+bool parseStressScene(const std::string& text, StressSceneSpec& specOut, std::string& errorOut)
+{
+	std::vector<std::string> fields;
+	std::istringstream stream(text);
+	std::string field;
+	while (std::getline(stream, field, ':'))
+	{
+		fields.push_back(field);
+	}
+	if (fields.size() < 2 || fields.size() > 4)
+	{
+		errorOut = "stress scenes are shape:triangles[:instances[:seed]], not " + text;
+		return false;
+	}
+	StressSceneSpec spec;
+	spec.shape = STRESS_SCENE_SHAPE_COUNT;
+	for (unsigned int shape = 0; shape < STRESS_SCENE_SHAPE_COUNT; shape++)
+	{
+		if (fields[0] == STRESS_SCENE_SHAPE_NAMES[shape])
+		{
+			spec.shape = shape;
+		}
+	}
+	if (spec.shape == STRESS_SCENE_SHAPE_COUNT)
+	{
+		errorOut = "unknown stress scene shape " + fields[0] + ", expected sphere, soup, slivers or terrain";
+		return false;
+	}
+	unsigned long long count;
+	if (!parseCount(fields[1], STRESS_SCENE_MAX_TRIANGLES, count))
+	{
+		errorOut = "stress scenes have 1 to " + std::to_string(STRESS_SCENE_MAX_TRIANGLES) + " triangles, not " + fields[1];
+		return false;
+	}
+	spec.triangles = (size_t)count;
+	if (fields.size() > 2)
+	{
+		if (!parseCount(fields[2], STRESS_SCENE_MAX_INSTANCES, count))
+		{
+			errorOut = "stress scenes have 1 to " + std::to_string(STRESS_SCENE_MAX_INSTANCES) + " instances, not " + fields[2];
+			return false;
+		}
+		spec.instances = (unsigned int)count;
+	}
+	if (fields.size() > 3)
+	{
+		std::istringstream seedStream(fields[3]);
+		std::string rest;
+		if (!(seedStream >> spec.seed) || (seedStream >> rest))
+		{
+			errorOut = "bad stress scene seed " + fields[3];
+			return false;
+		}
+	}
+	specOut = spec;
+	return true;
+}
+
+std::string getStressSceneName(const StressSceneSpec& spec)
+{
+	std::ostringstream name;
+	name << STRESS_SCENE_SHAPE_NAMES[std::min(spec.shape, STRESS_SCENE_SHAPE_COUNT - 1)] << "-" << spec.triangles;
+	if (spec.instances > 1)
+	{
+		name << "x" << spec.instances;
+	}
+	if (spec.seed != StressSceneSpec().seed)
+	{
+		name << "-seed" << spec.seed;
+	}
+	return name.str();
+}
+
+void generateStressScene(const StressSceneSpec& spec, RaytraceTexturedObject& object)
+{
+	auto startTime = std::chrono::steady_clock::now();
+	// The mesh is replaced under any structure still building from it
+	object.waitForAccelerator();
+	object.vertices.clear();
+	object.normals.clear();
+	object.textureCoords.clear();
+	std::vector<IndexedTriangularFace> triangles;
+	triangles.reserve(spec.triangles);
+	switch (spec.shape)
+	{
+	case STRESS_SCENE_SOUP:
+		generateSoup(spec, object, triangles);
+		break;
+	case STRESS_SCENE_SLIVERS:
+		generateSlivers(spec, object, triangles);
+		break;
+	case STRESS_SCENE_TERRAIN:
+		generateTerrain(spec, object, triangles);
+		break;
+	default:
+		generateSphere(spec, object, triangles);
+		break;
+	}
+	double generateTimeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "Generated " << getStressSceneName(spec) << ", " << triangles.size() << " triangles and " << object.vertices.size()
+		<< " vertices, in " << generateTimeMs << "ms" << std::endl;
+	object.setTriangles(std::move(triangles));
+}
+
+void placeStressInstances(const StressSceneSpec& spec, RaytraceScene& scene)
+{
+	if (spec.instances <= 1)
+	{
+		return;
+	}
+	// A cubic grid inside the one mesh's bounding sphere, so the view frames them all as it would the mesh
+	RaytraceTexturedObject* object = scene.getPrimaryObject();
+	unsigned int side = 1;
+	while ((unsigned long long)side * side * side < spec.instances)
+	{
+		side++;
+	}
+	float halfExtent = object->objectSize / std::sqrt(3.0f);
+	float cellSize = 2.0f * halfExtent / side;
+	float scale = 0.5f * cellSize / std::max(object->objectSize, 1e-6f);
+	Cartesian3 centre = object->centreOfGravity;
+	Matrix4 toOrigin = Matrix4::TranslationMultMat(Cartesian3(-centre.x, -centre.y, -centre.z));
+
+	StressRandom random(spec.seed ^ 0x5EED5EED5EEDull);
+	for (unsigned int instance = 0; instance < spec.instances; instance++)
+	{
+		unsigned int x = instance % side;
+		unsigned int y = instance / side % side;
+		unsigned int z = instance / (side * side);
+		Cartesian3 position = centre + Cartesian3(-halfExtent + cellSize * (x + 0.5f), -halfExtent + cellSize * (y + 0.5f), -halfExtent + cellSize * (z + 0.5f));
+		Matrix4 rotation = Matrix4::RotationMultMat(random.direction(), random.range(0.0f, 2.0f * (float)M_PI));
+		Matrix4 transform = Matrix4::TranslationMultMat(position) * rotation * Matrix4::ScaleMultMat(scale) * toOrigin;
+		// The primary object is the first instance
+		if (instance == 0)
+		{
+			scene.setInstanceTransform(0, transform);
+		}
+		else
+		{
+			scene.addInstance(object, transform);
+		}
+	}
+}
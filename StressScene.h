@@ -0,0 +1,50 @@
+// Procedural stress scenes
+// Meshes of a chosen shape and exact triangle count, from 1 to STRESS_SCENE_MAX_TRIANGLES, each with a texture drawn
+// to match it, so acceleration, threading and memory can be measured against input size without depending on whichever
+// OBJ files are to hand. The mesh is written straight into a RaytraceTexturedObject, without going through OBJ text,
+// and fits in [-1, 1] on every axis. The same description and seed always give the same scene on every platform
+//  sphere   UV sphere, tessellated evenly in latitude and longitude, textured with a checker on the same grid
+//  soup     randomly placed and oriented triangles a few times larger than their spacing, overlapping heavily
+//  slivers  random triangles a unit long and a five hundredth of that wide, whose bounds are mostly empty
+//  terrain  heightfield of fractal noise, textured by height from the same noise
+// Any shape can be instanced many times, the copies shrunk onto a grid filling the space the one mesh took up
+#pragma once
+
+// Standard libraries
+#include <string>
+#include <cstdint>
+
+// RT Specific
+#include "RaytraceTexturedObject.h"
+#include "RaytraceScene.h"
+
+// Constants
+// Shapes
+const unsigned int STRESS_SCENE_SPHERE = 0;
+const unsigned int STRESS_SCENE_SOUP = 1;
+const unsigned int STRESS_SCENE_SLIVERS = 2;
+const unsigned int STRESS_SCENE_TERRAIN = 3;
+const size_t STRESS_SCENE_MAX_TRIANGLES = 100000000;
+const unsigned int STRESS_SCENE_MAX_INSTANCES = 1000000;
+// Side of the square textures
+const long STRESS_SCENE_TEXTURE_SIZE = 512;
+
+struct StressSceneSpec
+{
+	unsigned int shape = STRESS_SCENE_SPHERE;
+	// In the mesh, before instancing
+	size_t triangles = 100000;
+	unsigned int instances = 1;
+	uint64_t seed = 1;
+};
+
+// Read "shape:triangles[:instances[:seed]]", with triangles and instances optionally ending in k or M for thousands
+// or millions, such as "terrain:10M" or "sphere:20k:500"
+bool parseStressScene(const std::string& text, StressSceneSpec& specOut, std::string& errorOut);
+// Name for reports and file names, such as "terrain-10000000" or "sphere-20000x500"
+std::string getStressSceneName(const StressSceneSpec& spec);
+
+// Replace the object's mesh and texture with the scene's, building its structure as reading a file would
+void generateStressScene(const StressSceneSpec& spec, RaytraceTexturedObject& object);
+// Place the scene's instances of its primary object, which must hold the generated mesh. Does nothing for one instance
+void placeStressInstances(const StressSceneSpec& spec, RaytraceScene& scene);
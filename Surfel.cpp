@@ -5,4 +5,5 @@ Surfel::Surfel(): position(), normal()
 {
 	u = 0.0f;
 	v = 0.0f;
+	texture = nullptr;
 }
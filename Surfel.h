@@ -3,12 +3,16 @@
 #pragma once
 #include <Cartesian3.h>
 
+class RGBAImage;
+
 class Surfel
 {
 public:
 	Cartesian3 position;
 	float alpha, beta, gamma, u, v;
 	Cartesian3 normal;
+	// Texture of the object that was hit
+	const RGBAImage* texture;
 
 	// Safe constructor
 	Surfel();
@@ -256,6 +256,7 @@ void TexturedObject::WriteObjectStream(std::ostream &geometryStream, std::ostrea
     texture.WritePPM(textureStream);
     } // WriteObjectStream()
 
+#ifndef RT_HEADLESS
 // routine to transfer assets to GPU
 void TexturedObject::TransferAssetsToGPU()
     { // TransferAssetsToGPU()
@@ -426,4 +427,4 @@ void TexturedObject::GlRender(RenderParameters *renderParameters)
     if (renderParameters->texturedRendering)
         glDisable(GL_TEXTURE_2D);
     } // GlRender()
-
+#endif
@@ -31,6 +31,8 @@
 // include the C++ standard libraries we need for the header
 #include <vector>
 #include <iostream>
+// headless builds define RT_HEADLESS, and have no OpenGL to draw with
+#ifndef RT_HEADLESS
 #ifdef __APPLE__
 #include <OpenGL/gl.h>
 #else
@@ -39,6 +41,7 @@
 #endif
 #include <GL/gl.h>
 #endif
+#endif
 
 // include the unit with Cartesian 3-vectors
 #include "Cartesian3.h"
@@ -71,8 +74,10 @@ class TexturedObject
     // RGBA Image for storing a texture
     RGBAImage texture;
 
+#ifndef RT_HEADLESS
     // a variable to store the texture's ID on the GPU
     GLuint textureID;
+#endif
 
     // centre of gravity - computed after reading
     Cartesian3 centreOfGravity;
@@ -89,11 +94,13 @@ class TexturedObject
     // write routine
     void WriteObjectStream(std::ostream &geometryStream, std::ostream &textureStream);
 
+#ifndef RT_HEADLESS
     // routine to transfer assets to GPU
     void TransferAssetsToGPU();
     
     // routine to render
     void GlRender(RenderParameters *renderParameters);
+#endif
 
     }; // class TexturedObject
 
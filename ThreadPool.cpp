@@ -0,0 +1,189 @@
+// Persistent pool of worker threads with work stealing
+#include "ThreadPool.h"
+
+// Standard libraries
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned int threadCount, bool pinToNodes) : callerWorks(!pinToNodes), job(nullptr), stealingAllowed(true), generation(0),
+	workersBusy(0), stopping(false), stolenTasks(0)
+{
+	// hardware_concurrency() may not know, in which case it returns 0
+	workerCount = threadCount != THREAD_POOL_AUTO ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+	queues.reset(new TaskQueue[workerCount]);
+	for (unsigned int worker = 0; worker < workerCount; worker++)
+	{
+		queues[worker].begin = 0;
+		queues[worker].end = 0;
+	}
+
+	// Unpinned, every worker counts as node 0
+	topology = pinToNodes ? detectNumaTopology() : NumaTopology();
+	unsigned int nodeCount = std::max(1u, (unsigned int)topology.getNodeCount());
+	for (unsigned int worker = 0; worker < workerCount; worker++)
+	{
+		workerNodes.push_back(pinToNodes ? (unsigned int)((size_t)worker * nodeCount / workerCount) : 0);
+	}
+	for (unsigned int worker = 0; worker < workerCount; worker++)
+	{
+		std::vector<unsigned int> order;
+		for (int sameNode = 1; sameNode >= 0; sameNode--)
+		{
+			for (unsigned int offset = 1; offset < workerCount; offset++)
+			{
+				unsigned int victim = (worker + offset) % workerCount;
+				if ((workerNodes[victim] == workerNodes[worker]) == (sameNode == 1))
+				{
+					order.push_back(victim);
+				}
+			}
+		}
+		stealOrders.push_back(order);
+	}
+
+	for (unsigned int worker = callerWorks ? 1 : 0; worker < workerCount; worker++)
+	{
+		threads.push_back(std::thread(&ThreadPool::workerLoop, this, worker, pinToNodes));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobLock);
+		stopping = true;
+	}
+	jobReady.notify_all();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::getInitialRange(size_t taskCount, unsigned int worker, size_t& beginOut, size_t& endOut) const
+{
+	// Contiguous ranges keep neighbouring tasks, such as neighbouring tiles, on the same worker
+	beginOut = taskCount * worker / workerCount;
+	endOut = taskCount * (worker + 1) / workerCount;
+}
+
+void ThreadPool::run(size_t taskCount, const TaskFunction& function)
+{
+	startJob(taskCount, function, true);
+}
+
+void ThreadPool::runOnEachWorker(const std::function<void(unsigned int worker)>& function)
+{
+	// One task per worker, and no stealing, so each runs its own
+	startJob(workerCount, [&function](size_t, unsigned int worker) { function(worker); }, false);
+}
+
+void ThreadPool::startJob(size_t taskCount, const TaskFunction& function, bool stealing)
+{
+	for (unsigned int worker = 0; worker < workerCount; worker++)
+	{
+		std::lock_guard<std::mutex> lock(queues[worker].lock);
+		getInitialRange(taskCount, worker, queues[worker].begin, queues[worker].end);
+	}
+	stolenTasks = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(jobLock);
+		job = &function;
+		stealingAllowed = stealing;
+		workersBusy = callerWorks ? workerCount - 1 : workerCount;
+		generation++;
+	}
+	jobReady.notify_all();
+
+	if (callerWorks)
+	{
+		runTasks(0);
+	}
+
+	std::unique_lock<std::mutex> lock(jobLock);
+	jobDone.wait(lock, [this]() { return workersBusy == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::workerLoop(unsigned int worker, bool pin)
+{
+	if (pin)
+	{
+		pinThreadToNumaNode(topology, workerNodes[worker]);
+	}
+	unsigned long long lastGeneration = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(jobLock);
+			jobReady.wait(lock, [this, lastGeneration]() { return stopping || generation != lastGeneration; });
+			if (stopping)
+			{
+				return;
+			}
+			lastGeneration = generation;
+		}
+
+		runTasks(worker);
+
+		std::lock_guard<std::mutex> lock(jobLock);
+		if (--workersBusy == 0)
+		{
+			jobDone.notify_all();
+		}
+	}
+}
+
+void ThreadPool::runTasks(unsigned int worker)
+{
+	size_t task;
+	while (takeTask(worker, task))
+	{
+		(*job)(task, worker);
+	}
+}
+
+bool ThreadPool::takeTask(unsigned int worker, size_t& taskOut)
+{
+	TaskQueue& ownQueue = queues[worker];
+	{
+		std::lock_guard<std::mutex> lock(ownQueue.lock);
+		if (ownQueue.begin < ownQueue.end)
+		{
+			taskOut = ownQueue.begin++;
+			return true;
+		}
+	}
+
+	if (!stealingAllowed)
+	{
+		return false;
+	}
+	// Steal the back half of the first non-empty queue, the far end from where its owner is working
+	for (auto victim : stealOrders[worker])
+	{
+		TaskQueue& victimQueue = queues[victim];
+		size_t stolenBegin;
+		size_t stolenEnd;
+		{
+			std::lock_guard<std::mutex> lock(victimQueue.lock);
+			size_t remaining = victimQueue.end - victimQueue.begin;
+			if (remaining == 0)
+			{
+				continue;
+			}
+			stolenEnd = victimQueue.end;
+			stolenBegin = stolenEnd - (remaining + 1) / 2;
+			victimQueue.end = stolenBegin;
+		}
+		stolenTasks += stolenEnd - stolenBegin;
+
+		// Run the first now and queue the rest, where others can steal them in turn
+		taskOut = stolenBegin;
+		std::lock_guard<std::mutex> lock(ownQueue.lock);
+		ownQueue.begin = stolenBegin + 1;
+		ownQueue.end = stolenEnd;
+		return true;
+	}
+	return false;
+}
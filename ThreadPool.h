@@ -0,0 +1,89 @@
+// Persistent pool of worker threads with work stealing
+// A job is a count of tasks, split evenly between the workers' queues up front. Each worker takes tasks from the front of
+// its own queue and, once that runs dry, steals the back half of another's, so uneven tasks balance out without every
+// task contending on one shared counter. Threads sleep between jobs and are kept for the next, so a frame costs no spawns.
+// Pinned to NUMA nodes, workers are spread over the nodes in blocks, so each node's share of a job is contiguous, and
+// steal from workers on their own node before reaching across to another
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+
+// RT Specific
+#include "NumaTopology.h"
+
+// Constants
+// Use every hardware thread
+const unsigned int THREAD_POOL_AUTO = 0;
+
+class ThreadPool
+{
+public:
+	// Runs one task, given its index and the worker running it, from 0 to getThreadCount() - 1
+	typedef std::function<void(size_t task, unsigned int worker)> TaskFunction;
+private:
+	// Tasks a worker has yet to start, as a range of task indices
+	struct TaskQueue
+	{
+		std::mutex lock;
+		size_t begin;
+		size_t end;
+	};
+
+	// The calling thread is worker 0 and the pool's threads are the rest, unless they're pinned, when the pool's
+	// threads are every worker and the caller only waits, as it may be on any node
+	unsigned int workerCount;
+	bool callerWorks;
+	std::vector<std::thread> threads;
+	std::unique_ptr<TaskQueue[]> queues;
+	// Node of each worker, and the order each tries the others' queues in, own node first
+	NumaTopology topology;
+	std::vector<unsigned int> workerNodes;
+	std::vector<std::vector<unsigned int>> stealOrders;
+
+	// Job in progress. Workers wake when the generation changes, the caller waits until none are busy
+	std::mutex jobLock;
+	std::condition_variable jobReady;
+	std::condition_variable jobDone;
+	const TaskFunction* job;
+	bool stealingAllowed;
+	unsigned long long generation;
+	unsigned int workersBusy;
+	bool stopping;
+
+	// Tasks taken from another worker's queue during the last job
+	std::atomic<size_t> stolenTasks;
+
+	void workerLoop(unsigned int worker, bool pin);
+	void startJob(size_t taskCount, const TaskFunction& function, bool stealing);
+	void runTasks(unsigned int worker);
+	// Next task for a worker, stealing if its own queue is empty. Returns false once every queue is empty
+	bool takeTask(unsigned int worker, size_t& taskOut);
+public:
+	// Starts threadCount - 1 threads, THREAD_POOL_AUTO for one per hardware thread.
+	// Pinned, it starts threadCount threads, spread evenly over the NUMA nodes
+	ThreadPool(unsigned int threadCount = THREAD_POOL_AUTO, bool pinToNodes = false);
+	// Stops and joins the threads
+	~ThreadPool();
+
+	// Run tasks 0 to taskCount - 1 on the pool and the calling thread, returning once all have finished.
+	// Only one job runs at a time, tasks must not start another
+	void run(size_t taskCount, const TaskFunction& function);
+	// Run the function once on every worker, as task index 0, with no stealing
+	void runOnEachWorker(const std::function<void(unsigned int worker)>& function);
+
+	// Tasks a worker starts a job with, before any stealing
+	void getInitialRange(size_t taskCount, unsigned int worker, size_t& beginOut, size_t& endOut) const;
+
+	unsigned int getThreadCount() const { return workerCount; };
+	bool isPinned() const { return !callerWorks; };
+	unsigned int getWorkerNode(unsigned int worker) const { return workerNodes[worker]; };
+	const NumaTopology& getTopology() const { return topology; };
+	size_t getStolenTasks() const { return stolenTasks; };
+};
@@ -0,0 +1,80 @@
+// Cache oblivious layout of tree nodes
+// The van Emde Boas order stores the top half of a tree's levels first, then each subtree hanging below them, each
+// laid out the same way recursively. A path from the root then crosses O(log n / log B) blocks of B nodes whatever
+// the cache line or page size, where a depth first layout starts a new block on most steps down the far side of a node
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Constants
+// Most children a unit of the tree can have, a pair of binary siblings has four and a BVH8 node eight
+const unsigned int TREE_LAYOUT_MAX_CHILDREN = 8;
+
+// Units at depth levels below unit, in child order. childUnits(unit, childrenOut) writes a unit's children and returns how many
+template <typename ChildUnits>
+void collectTreeUnits(unsigned int unit, unsigned int depth, ChildUnits& childUnits, std::vector<unsigned int>& unitsOut)
+{
+	if (depth == 0)
+	{
+		unitsOut.push_back(unit);
+		return;
+	}
+	unsigned int children[TREE_LAYOUT_MAX_CHILDREN];
+	unsigned int childCount = childUnits(unit, children);
+	for (unsigned int i = 0; i < childCount; i++)
+	{
+		collectTreeUnits(children[i], depth - 1, childUnits, unitsOut);
+	}
+}
+
+// Append the units of the subtree below unit down to height levels in van Emde Boas order
+template <typename ChildUnits>
+void appendVanEmdeBoasOrder(unsigned int unit, unsigned int height, ChildUnits& childUnits, std::vector<unsigned int>& orderOut)
+{
+	if (height <= 1)
+	{
+		orderOut.push_back(unit);
+		return;
+	}
+	// Top half, then the subtrees rooted just below it
+	unsigned int topHeight = height / 2;
+	appendVanEmdeBoasOrder(unit, topHeight, childUnits, orderOut);
+	std::vector<unsigned int> bottomRoots;
+	collectTreeUnits(unit, topHeight, childUnits, bottomRoots);
+	for (auto bottomRoot : bottomRoots)
+	{
+		appendVanEmdeBoasOrder(bottomRoot, height - topHeight, childUnits, orderOut);
+	}
+}
+
+// Every unit of the tree below root in van Emde Boas order. Unbalanced trees are split by the height of the deepest path,
+// so shallow subtrees end early rather than padding their blocks
+template <typename ChildUnits>
+std::vector<unsigned int> computeVanEmdeBoasOrder(unsigned int root, ChildUnits childUnits)
+{
+	// Height of the tree, depth first with an explicit stack
+	unsigned int height = 0;
+	std::vector<std::pair<unsigned int, unsigned int>> stack;
+	stack.push_back(std::make_pair(root, 1u));
+	while (!stack.empty())
+	{
+		unsigned int unit = stack.back().first;
+		unsigned int depth = stack.back().second;
+		stack.pop_back();
+		height = std::max(height, depth);
+
+		unsigned int children[TREE_LAYOUT_MAX_CHILDREN];
+		unsigned int childCount = childUnits(unit, children);
+		for (unsigned int i = 0; i < childCount; i++)
+		{
+			stack.push_back(std::make_pair(children[i], depth + 1));
+		}
+	}
+
+	std::vector<unsigned int> order;
+	appendVanEmdeBoasOrder(root, height, childUnits, order);
+	return order;
+}
@@ -0,0 +1,203 @@
+// Intersection ready copy of a mesh's triangles
+#include "TriangleStore.h"
+
+// RT Specific
+#include "CpuFeatures.h"
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+// Tests up to Width entries from first, masking lanes at or past count. Writes every lane's t, u and v and returns
+// a bit mask of the lanes hit with tMin < t < tMax
+typedef unsigned int (*TriangleChunkTest)(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+											float tMin, float tMax, float* tOut, float* uOut, float* vOut);
+
+// One entry at a time, for CPUs without a matching SIMD kernel. A chunk of one is never past the count
+static unsigned int testChunkScalar(const TriangleStore& store, unsigned int first, unsigned int, const float* origin, const float* direction,
+									float tMin, float tMax, float* tOut, float* uOut, float* vOut)
+{
+	return store.intersect(first, origin, direction, tOut[0], uOut[0], vOut[0]) && tOut[0] > tMin && tOut[0] < tMax ? 1u : 0u;
+}
+
+#ifdef RT_X86
+// The scalar test rejects fabs(determinant) < 1e-8 in double precision, and the nearest float to 1e-8 lies just below it
+static const float TRIANGLE_DETERMINANT_EPSILON = 1e-8f;
+
+// Four entries with SSE. Each lane repeats the scalar test's operations in the same order, so hits are identical
+RT_TARGET("sse2")
+static unsigned int testChunkSSE(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+									float tMin, float tMax, float* tOut, float* uOut, float* vOut)
+{
+	__m128 e1x = _mm_loadu_ps(&store.edge1x[first]), e1y = _mm_loadu_ps(&store.edge1y[first]), e1z = _mm_loadu_ps(&store.edge1z[first]);
+	__m128 e2x = _mm_loadu_ps(&store.edge2x[first]), e2y = _mm_loadu_ps(&store.edge2y[first]), e2z = _mm_loadu_ps(&store.edge2z[first]);
+	__m128 dx = _mm_set1_ps(direction[0]), dy = _mm_set1_ps(direction[1]), dz = _mm_set1_ps(direction[2]);
+
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 absDeterminant = _mm_andnot_ps(_mm_set1_ps(-0.0f), determinant);
+	__m128 valid = _mm_cmpgt_ps(absDeterminant, _mm_set1_ps(TRIANGLE_DETERMINANT_EPSILON));
+	__m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+	__m128 tx = _mm_sub_ps(_mm_set1_ps(origin[0]), _mm_loadu_ps(&store.v0x[first]));
+	__m128 ty = _mm_sub_ps(_mm_set1_ps(origin[1]), _mm_loadu_ps(&store.v0y[first]));
+	__m128 tz = _mm_sub_ps(_mm_set1_ps(origin[2]), _mm_loadu_ps(&store.v0z[first]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(v, one)));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), one));
+	valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(t, _mm_set1_ps(tMin)), _mm_cmplt_ps(t, _mm_set1_ps(tMax))));
+	// Lanes past the leaf belong to the next one
+	valid = _mm_and_ps(valid, _mm_cmplt_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), _mm_set1_ps((float)count)));
+
+	_mm_storeu_ps(tOut, t);
+	_mm_storeu_ps(uOut, u);
+	_mm_storeu_ps(vOut, v);
+	return (unsigned int)_mm_movemask_ps(valid);
+}
+
+// Eight entries with AVX, as testChunkSSE
+RT_TARGET("avx")
+static unsigned int testChunkAVX(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+									float tMin, float tMax, float* tOut, float* uOut, float* vOut)
+{
+	__m256 e1x = _mm256_loadu_ps(&store.edge1x[first]), e1y = _mm256_loadu_ps(&store.edge1y[first]), e1z = _mm256_loadu_ps(&store.edge1z[first]);
+	__m256 e2x = _mm256_loadu_ps(&store.edge2x[first]), e2y = _mm256_loadu_ps(&store.edge2y[first]), e2z = _mm256_loadu_ps(&store.edge2z[first]);
+	__m256 dx = _mm256_set1_ps(direction[0]), dy = _mm256_set1_ps(direction[1]), dz = _mm256_set1_ps(direction[2]);
+
+	__m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+	__m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+	__m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+	__m256 determinant = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+	__m256 absDeterminant = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), determinant);
+	__m256 valid = _mm256_cmp_ps(absDeterminant, _mm256_set1_ps(TRIANGLE_DETERMINANT_EPSILON), _CMP_GT_OQ);
+	__m256 invDet = _mm256_div_ps(_mm256_set1_ps(1.0f), determinant);
+
+	__m256 tx = _mm256_sub_ps(_mm256_set1_ps(origin[0]), _mm256_loadu_ps(&store.v0x[first]));
+	__m256 ty = _mm256_sub_ps(_mm256_set1_ps(origin[1]), _mm256_loadu_ps(&store.v0y[first]));
+	__m256 tz = _mm256_sub_ps(_mm256_set1_ps(origin[2]), _mm256_loadu_ps(&store.v0z[first]));
+	__m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), invDet);
+
+	__m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(tz, e1y));
+	__m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(tx, e1z));
+	__m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(ty, e1x));
+	__m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), invDet);
+	__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), invDet);
+
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+	valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(u, one, _CMP_LE_OQ)));
+	valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(v, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, one, _CMP_LE_OQ)));
+	valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_LE_OQ));
+	valid = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, _mm256_set1_ps(tMin), _CMP_GT_OQ), _mm256_cmp_ps(t, _mm256_set1_ps(tMax), _CMP_LT_OQ)));
+	valid = _mm256_and_ps(valid, _mm256_cmp_ps(_mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f), _mm256_set1_ps((float)count), _CMP_LT_OQ));
+
+	_mm256_storeu_ps(tOut, t);
+	_mm256_storeu_ps(uOut, u);
+	_mm256_storeu_ps(vOut, v);
+	return (unsigned int)_mm256_movemask_ps(valid);
+}
+#endif
+
+// Walk a leaf Width entries at a time, keeping the nearest hit
+template <unsigned int Width, TriangleChunkTest testChunk>
+static bool intersectNearestLeaf(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+									float tMin, float& tMax, float& uOut, float& vOut, unsigned int& entryOut)
+{
+	float t[Width], u[Width], v[Width];
+	bool hit = false;
+	for (unsigned int offset = 0; offset < count; offset += Width)
+	{
+		unsigned int hitMask = testChunk(store, first + offset, count - offset, origin, direction, tMin, tMax, t, u, v);
+		// Lowest lane first, so ties keep the earlier entry
+		for (unsigned int lane = 0; hitMask != 0; lane++, hitMask >>= 1)
+		{
+			if ((hitMask & 1) && t[lane] < tMax)
+			{
+				tMax = t[lane];
+				uOut = u[lane];
+				vOut = v[lane];
+				entryOut = first + offset + lane;
+				hit = true;
+			}
+		}
+	}
+	return hit;
+}
+
+// Walk a leaf Width entries at a time, stopping at the first hit
+template <unsigned int Width, TriangleChunkTest testChunk>
+static bool intersectAnyLeaf(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+								float tMin, float tMax)
+{
+	float t[Width], u[Width], v[Width];
+	for (unsigned int offset = 0; offset < count; offset += Width)
+	{
+		if (testChunk(store, first + offset, count - offset, origin, direction, tMin, tMax, t, u, v) != 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+TriangleStore::TriangleStore() : nearestKernel(intersectNearestLeaf<1, testChunkScalar>), anyKernel(intersectAnyLeaf<1, testChunkScalar>), kernelName("scalar")
+{
+}
+
+void TriangleStore::build(const std::vector<Cartesian3>& triangleVertices, const std::vector<unsigned int>& order, unsigned int kernelWidth)
+{
+	// Widest kernel the CPU runs, or the one asked for if it can
+	nearestKernel = intersectNearestLeaf<1, testChunkScalar>;
+	anyKernel = intersectAnyLeaf<1, testChunkScalar>;
+	kernelName = "scalar";
+#ifdef RT_X86
+	const CpuFeatures& features = getCpuFeatures();
+	if ((kernelWidth == TRIANGLE_KERNEL_AUTO || kernelWidth == TRIANGLE_KERNEL_8) && features.avx)
+	{
+		nearestKernel = intersectNearestLeaf<8, testChunkAVX>;
+		anyKernel = intersectAnyLeaf<8, testChunkAVX>;
+		kernelName = "AVX";
+	}
+	else if ((kernelWidth == TRIANGLE_KERNEL_AUTO || kernelWidth == TRIANGLE_KERNEL_4) && features.sse2)
+	{
+		nearestKernel = intersectNearestLeaf<4, testChunkSSE>;
+		anyKernel = intersectAnyLeaf<4, testChunkSSE>;
+		kernelName = "SSE";
+	}
+#endif
+
+	size_t count = order.size();
+	std::vector<float>* arrays[9] = { &v0x, &v0y, &v0z, &edge1x, &edge1y, &edge1z, &edge2x, &edge2y, &edge2z };
+	for (auto array : arrays)
+	{
+		// Padding is all zero, so its determinant is 0 and it never hits
+		array->assign(count + TRIANGLE_STORE_PADDING, 0.0f);
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Cartesian3* corners = &triangleVertices[3 * order[i]];
+		// Edges exactly as Triangle::intersection computes them, so hits are unchanged
+		Cartesian3 edge1 = corners[1] - corners[0];
+		Cartesian3 edge2 = corners[2] - corners[0];
+		v0x[i] = corners[0].x;
+		v0y[i] = corners[0].y;
+		v0z[i] = corners[0].z;
+		edge1x[i] = edge1.x;
+		edge1y[i] = edge1.y;
+		edge1z[i] = edge1.z;
+		edge2x[i] = edge2.x;
+		edge2y[i] = edge2.y;
+		edge2z[i] = edge2.z;
+	}
+}
@@ -0,0 +1,97 @@
+// Intersection ready copy of a mesh's triangles
+// Each entry holds one vertex and the two edges from it, as structure of arrays in the BVH's primitive order,
+// so the triangles of a leaf are contiguous and tracing never follows vertex indices.
+// Leaves are tested several triangles at a time by a SIMD kernel, which loads a leaf's entries straight from the arrays
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <cmath>
+
+// RT Specific
+#include "Geometry.h"
+
+// Constants
+// Triangles per kernel call, 0 picks the widest the CPU supports
+const unsigned int TRIANGLE_KERNEL_AUTO = 0;
+const unsigned int TRIANGLE_KERNEL_SCALAR = 1;
+const unsigned int TRIANGLE_KERNEL_4 = 4;
+const unsigned int TRIANGLE_KERNEL_8 = 8;
+// Degenerate entries after the last triangle, so the widest kernel can load past the end of the final leaf
+const unsigned int TRIANGLE_STORE_PADDING = 7;
+
+class TriangleStore;
+
+// Nearest hit among count entries from first with tMin < t < tMax. On a hit shrinks tMax, writes the barycentrics
+// and entry, and returns true. Ties go to the earlier entry, as testing them one by one would
+typedef bool (*TriangleNearestKernel)(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+										float tMin, float& tMax, float& uOut, float& vOut, unsigned int& entryOut);
+// Whether any of count entries from first is hit with tMin < t < tMax
+typedef bool (*TriangleAnyKernel)(const TriangleStore& store, unsigned int first, unsigned int count, const float* origin, const float* direction,
+									float tMin, float tMax);
+
+class TriangleStore
+{
+private:
+	// Leaf tests chosen for the CPU when building
+	TriangleNearestKernel nearestKernel;
+	TriangleAnyKernel anyKernel;
+public:
+	// First vertex, then the edges v1 - v0 and v2 - v0, one array per component
+	std::vector<float> v0x, v0y, v0z;
+	std::vector<float> edge1x, edge1y, edge1z;
+	std::vector<float> edge2x, edge2y, edge2z;
+	// Name of the leaf test in use, for reporting
+	const char* kernelName;
+
+	// Constructor
+	TriangleStore();
+
+	// Build from three vertices per triangle, with one entry for each element of order, usually BVH::primitiveIndices.
+	// kernelWidth is one of the TRIANGLE_KERNEL constants, falling back to scalar if the CPU lacks it
+	void build(const std::vector<Cartesian3>& triangleVertices, const std::vector<unsigned int>& order, unsigned int kernelWidth = TRIANGLE_KERNEL_AUTO);
+
+	// Entries, not counting the padding
+	size_t size() const { return v0x.size() < TRIANGLE_STORE_PADDING ? 0 : v0x.size() - TRIANGLE_STORE_PADDING; };
+
+	// Leaf tests, see the kernel typedefs
+	bool intersectNearest(unsigned int first, unsigned int count, const float* origin, const float* direction, float tMin, float& tMax, float& uOut, float& vOut, unsigned int& entryOut) const
+	{
+		return nearestKernel(*this, first, count, origin, direction, tMin, tMax, uOut, vOut, entryOut);
+	};
+	bool intersectAny(unsigned int first, unsigned int count, const float* origin, const float* direction, float tMin, float tMax) const
+	{
+		return anyKernel(*this, first, count, origin, direction, tMin, tMax);
+	};
+
+	// Moller-Trumbore test of one entry, with the same arithmetic as Triangle::intersection
+	bool intersect(unsigned int entry, const float* origin, const float* direction, float& tOut, float& uOut, float& vOut) const
+	{
+		float e1[3] = { edge1x[entry], edge1y[entry], edge1z[entry] };
+		float e2[3] = { edge2x[entry], edge2y[entry], edge2z[entry] };
+
+		// Determinant (scalar triple product), 0 when the ray is parallel to the triangle
+		float pvec[3] = {	direction[1] * e2[2] - direction[2] * e2[1],
+							direction[2] * e2[0] - direction[0] * e2[2],
+							direction[0] * e2[1] - direction[1] * e2[0] };
+		float determinant = e1[0] * pvec[0] + e1[1] * pvec[1] + e1[2] * pvec[2];
+		if (std::fabs(determinant) < 1e-8) return false;
+		float invDet = 1.0f / determinant;
+
+		float tVec[3] = { origin[0] - v0x[entry], origin[1] - v0y[entry], origin[2] - v0z[entry] };
+		float u = (tVec[0] * pvec[0] + tVec[1] * pvec[1] + tVec[2] * pvec[2]) * invDet;
+		if (u < 0 || u > 1) return false;
+
+		float qVec[3] = {	tVec[1] * e1[2] - tVec[2] * e1[1],
+							tVec[2] * e1[0] - tVec[0] * e1[2],
+							tVec[0] * e1[1] - tVec[1] * e1[0] };
+		float v = (direction[0] * qVec[0] + direction[1] * qVec[1] + direction[2] * qVec[2]) * invDet;
+		if (v < 0 || v > 1) return false;
+		if (u + v > 1) return false;
+
+		tOut = (e2[0] * qVec[0] + e2[1] * qVec[1] + e2[2] * qVec[2]) * invDet;
+		uOut = u;
+		vOut = v;
+		return true;
+	};
+};
@@ -0,0 +1,277 @@
+// Multi branching bounding volume hierarchy
+#include "WideBVH.h"
+
+// Standard libraries
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// RT Specific
+#include "CpuFeatures.h"
+#include "TreeLayout.h"
+
+#ifdef RT_X86
+#include <immintrin.h>
+#endif
+
+WideRay::WideRay(const Ray& ray)
+{
+	Cartesian3 rayOrigin = ray.getOrigin();
+	Cartesian3 rayDirection = ray.getDirection();
+	for (int axis = 0; axis < 3; axis++)
+	{
+		origin[axis] = rayOrigin[axis];
+		inverseDirection[axis] = 1.0f / rayDirection[axis];
+		// Use the sign bit, so -0 directions still see inverted empty boxes as misses
+		bool negative = std::signbit(rayDirection[axis]);
+		nearRow[axis] = negative ? 3 + axis : axis;
+		farRow[axis] = negative ? axis : 3 + axis;
+	}
+}
+
+// Plain loop, for CPUs without a matching SIMD kernel
+template <unsigned int Width>
+static unsigned int intersectChildrenScalar(const float* bounds, const WideRay& ray, float tMin, float tMax, float* distances)
+{
+	unsigned int hitMask = 0;
+	for (unsigned int slot = 0; slot < Width; slot++)
+	{
+		float tNear = tMin;
+		float tFar = tMax;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float nearPlane = (bounds[ray.nearRow[axis] * Width + slot] - ray.origin[axis]) * ray.inverseDirection[axis];
+			float farPlane = (bounds[ray.farRow[axis] * Width + slot] - ray.origin[axis]) * ray.inverseDirection[axis];
+			// A NaN from 0 * infinity only makes the test conservative
+			tNear = std::max(tNear, nearPlane);
+			tFar = std::min(tFar, farPlane);
+		}
+		distances[slot] = tNear;
+		if (tNear <= tFar)
+		{
+			hitMask |= 1u << slot;
+		}
+	}
+	return hitMask;
+}
+
+#ifdef RT_X86
+// Four children with SSE
+RT_TARGET("sse2")
+static unsigned int intersectChildrenSSE(const float* bounds, const WideRay& ray, float tMin, float tMax, float* distances)
+{
+	__m128 tNear = _mm_set1_ps(tMin);
+	__m128 tFar = _mm_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m128 origin = _mm_set1_ps(ray.origin[axis]);
+		__m128 inverseDirection = _mm_set1_ps(ray.inverseDirection[axis]);
+		__m128 nearPlane = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds + ray.nearRow[axis] * 4), origin), inverseDirection);
+		__m128 farPlane = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds + ray.farRow[axis] * 4), origin), inverseDirection);
+		// max and min return the second operand for NaNs, keeping the test conservative
+		tNear = _mm_max_ps(nearPlane, tNear);
+		tFar = _mm_min_ps(farPlane, tFar);
+	}
+	_mm_storeu_ps(distances, tNear);
+	return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+
+// Eight children with AVX
+RT_TARGET("avx")
+static unsigned int intersectChildrenAVX(const float* bounds, const WideRay& ray, float tMin, float tMax, float* distances)
+{
+	__m256 tNear = _mm256_set1_ps(tMin);
+	__m256 tFar = _mm256_set1_ps(tMax);
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+		__m256 inverseDirection = _mm256_set1_ps(ray.inverseDirection[axis]);
+		__m256 nearPlane = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds + ray.nearRow[axis] * 8), origin), inverseDirection);
+		__m256 farPlane = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(bounds + ray.farRow[axis] * 8), origin), inverseDirection);
+		tNear = _mm256_max_ps(nearPlane, tNear);
+		tFar = _mm256_min_ps(farPlane, tFar);
+	}
+	_mm256_storeu_ps(distances, tNear);
+	return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+}
+#endif
+
+// Pick the box test for a width on this CPU
+template <unsigned int Width>
+static WideBoxKernel selectBoxKernel(const char*& kernelName)
+{
+#ifdef RT_X86
+	const CpuFeatures& features = getCpuFeatures();
+	if (Width == 4 && features.sse2)
+	{
+		kernelName = "SSE";
+		return intersectChildrenSSE;
+	}
+	if (Width == 8 && features.avx)
+	{
+		kernelName = "AVX";
+		return intersectChildrenAVX;
+	}
+#endif
+	kernelName = "scalar";
+	return intersectChildrenScalar<Width>;
+}
+
+template <unsigned int Width>
+WideBVH<Width>::WideBVH() : boxKernel(intersectChildrenScalar<Width>), kernelName("scalar")
+{
+}
+
+template <unsigned int Width>
+void WideBVH<Width>::collapse(const BVH& binary)
+{
+	boxKernel = selectBoxKernel<Width>(kernelName);
+	nodes.clear();
+	primitiveIndices = binary.primitiveIndices;
+	if (binary.isEmpty())
+	{
+		return;
+	}
+
+	WideBVHNode<Width> emptyNode;
+	for (unsigned int slot = 0; slot < Width; slot++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			emptyNode.bounds[axis][slot] = std::numeric_limits<float>::infinity();
+			emptyNode.bounds[3 + axis][slot] = -std::numeric_limits<float>::infinity();
+		}
+		emptyNode.children[slot] = 0;
+		emptyNode.primitiveCounts[slot] = 0;
+	}
+	nodes.push_back(emptyNode);
+
+	// Pairs of wide node and the binary node whose descendants fill it
+	std::vector<std::pair<unsigned int, unsigned int>> stack;
+	if (binary.nodes[0].isLeaf())
+	{
+		// A single leaf still needs a root to hang from
+		stack.push_back(std::make_pair(0u, ~0u));
+	}
+	else
+	{
+		stack.push_back(std::make_pair(0u, 0u));
+	}
+
+	while (!stack.empty())
+	{
+		unsigned int wideIndex = stack.back().first;
+		unsigned int binaryIndex = stack.back().second;
+		stack.pop_back();
+
+		// Start from the children and open the largest interior one until the node is full
+		unsigned int candidates[Width];
+		unsigned int candidateCount = 0;
+		if (binaryIndex == ~0u)
+		{
+			candidates[candidateCount++] = 0;
+		}
+		else
+		{
+			candidates[candidateCount++] = binary.nodes[binaryIndex].leftFirst;
+			candidates[candidateCount++] = binary.nodes[binaryIndex].leftFirst + 1;
+		}
+		while (candidateCount < Width)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (unsigned int i = 0; i < candidateCount; i++)
+			{
+				const BVHNode& candidate = binary.nodes[candidates[i]];
+				if (candidate.isLeaf())
+				{
+					continue;
+				}
+				AABB box(Cartesian3(candidate.minBounds[0], candidate.minBounds[1], candidate.minBounds[2]), Cartesian3(candidate.maxBounds[0], candidate.maxBounds[1], candidate.maxBounds[2]));
+				float area = box.surfaceArea();
+				if (area > largestArea)
+				{
+					largest = (int)i;
+					largestArea = area;
+				}
+			}
+			if (largest < 0)
+			{
+				break;
+			}
+			unsigned int opened = binary.nodes[candidates[largest]].leftFirst;
+			candidates[largest] = opened;
+			candidates[candidateCount++] = opened + 1;
+		}
+
+		// Fill the slots, creating wide nodes for interior children
+		for (unsigned int slot = 0; slot < candidateCount; slot++)
+		{
+			const BVHNode& candidate = binary.nodes[candidates[slot]];
+			unsigned int child = candidate.leftFirst;
+			if (!candidate.isLeaf())
+			{
+				child = (unsigned int)nodes.size();
+				nodes.push_back(emptyNode);
+				stack.push_back(std::make_pair(child, candidates[slot]));
+			}
+			WideBVHNode<Width>& node = nodes[wideIndex];
+			for (int axis = 0; axis < 3; axis++)
+			{
+				node.bounds[axis][slot] = candidate.minBounds[axis];
+				node.bounds[3 + axis][slot] = candidate.maxBounds[axis];
+			}
+			node.children[slot] = child;
+			node.primitiveCounts[slot] = candidate.primitiveCount;
+		}
+	}
+	applyLayout(binary.layout);
+}
+
+// Reorder nodes into van Emde Boas order. Leaves keep their ranges, which already follow the binary BVH's layout
+template <unsigned int Width>
+void WideBVH<Width>::applyLayout(unsigned int layout)
+{
+	if (layout != BVH_LAYOUT_VAN_EMDE_BOAS || nodes.size() <= 1)
+	{
+		return;
+	}
+
+	// The root is never a child, so a zero child with no primitives is an empty slot
+	std::vector<unsigned int> order = computeVanEmdeBoasOrder(0, [&](unsigned int unit, unsigned int* childrenOut)
+	{
+		unsigned int childCount = 0;
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			if (nodes[unit].primitiveCounts[slot] == 0 && nodes[unit].children[slot] != 0)
+			{
+				childrenOut[childCount++] = nodes[unit].children[slot];
+			}
+		}
+		return childCount;
+	});
+
+	std::vector<unsigned int> newIndices(nodes.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		newIndices[order[i]] = (unsigned int)i;
+	}
+	std::vector<WideBVHNode<Width>> newNodes(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		WideBVHNode<Width> node = nodes[order[i]];
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			if (node.primitiveCounts[slot] == 0 && node.children[slot] != 0)
+			{
+				node.children[slot] = newIndices[node.children[slot]];
+			}
+		}
+		newNodes[i] = node;
+	}
+	nodes.swap(newNodes);
+}
+
+// Widths in use
+template class WideBVH<4>;
+template class WideBVH<8>;
\ No newline at end of file
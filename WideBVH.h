@@ -0,0 +1,200 @@
+// Multi branching bounding volume hierarchy
+// Collapsed from a binary BVH so each node holds up to Width children, with the child boxes stored
+// as structure of arrays so one ray is tested against all of them in a single SIMD kernel
+#pragma once
+
+// Standard libraries
+#include <vector>
+#include <limits>
+
+// RT Specific
+#include "Geometry.h"
+#include "BVH.h"
+
+// Constants
+// Widths, 0 picks the widest the CPU supports
+const unsigned int BVH_WIDTH_AUTO = 0;
+const unsigned int BVH_WIDTH_BINARY = 2;
+const unsigned int BVH_WIDTH_4 = 4;
+const unsigned int BVH_WIDTH_8 = 8;
+
+template <unsigned int Width>
+struct WideBVHNode
+{
+	// Child boxes: min x, y, z then max x, y, z, one float per child. Empty slots have inverted boxes
+	float bounds[6][Width];
+	// Child node, or first entry of primitiveIndices for leaf children
+	unsigned int children[Width];
+	// Primitives in leaf children, zero for interior children and empty slots
+	unsigned int primitiveCounts[Width];
+};
+
+// Ray data shared by every box test
+struct WideRay
+{
+	float origin[3];
+	float inverseDirection[3];
+	// Bounds row of the near and far plane per axis, depending on the direction's sign
+	unsigned int nearRow[3];
+	unsigned int farRow[3];
+
+	WideRay(const Ray& ray);
+};
+
+// Tests a ray against all children of a node, writing entry distances and returning a bit mask of the children hit
+typedef unsigned int (*WideBoxKernel)(const float* bounds, const WideRay& ray, float tMin, float tMax, float* distances);
+
+template <unsigned int Width>
+class WideBVH
+{
+private:
+	// Box test chosen for the CPU when collapsing
+	WideBoxKernel boxKernel;
+
+	// Reorder the collapsed nodes for one of the BVH_LAYOUT constants
+	void applyLayout(unsigned int layout);
+public:
+	// Nodes, root is at index 0
+	std::vector<WideBVHNode<Width>> nodes;
+	// Copy of the binary BVH's primitive order, which leaves reference
+	std::vector<unsigned int> primitiveIndices;
+	// Name of the box test in use, for reporting
+	const char* kernelName;
+
+	// Constructor
+	WideBVH();
+
+	// Build from a binary BVH, pulling up the largest grandchildren until each node is full, then lay the nodes out as the binary BVH's are
+	void collapse(const BVH& binary);
+
+	bool isEmpty() const { return nodes.empty(); };
+
+	// Nearest hit traversal, as BVH::intersectNearest but visiting all children of a node near to far
+	template <typename LeafIntersector>
+	bool intersectNearest(const Ray& ray, float tMin, float tMax, LeafIntersector intersectLeaf) const;
+
+	// Occlusion traversal, as BVH::intersectAny. Hit children are pushed in slot order without sorting,
+	// and leaves are tested before interior children so a cheap occluder ends the ray early
+	template <typename LeafOccluder>
+	bool intersectAny(const Ray& ray, float tMin, float tMax, LeafOccluder occludesLeaf) const;
+};
+
+template <unsigned int Width>
+template <typename LeafIntersector>
+bool WideBVH<Width>::intersectNearest(const Ray& ray, float tMin, float tMax, LeafIntersector intersectLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+	WideRay wideRay(ray);
+
+	// Stack of children still to visit, each level adds at most Width - 1 entries
+	unsigned int stackChildren[BVH_MAX_DEPTH * Width];
+	unsigned int stackCounts[BVH_MAX_DEPTH * Width];
+	float stackDistances[BVH_MAX_DEPTH * Width];
+	int stackSize = 0;
+	stackChildren[0] = 0;
+	stackCounts[0] = 0;
+	stackDistances[0] = tMin;
+	stackSize = 1;
+
+	RayStats& threadStats = rayStats;
+	bool intersection = false;
+	while (stackSize > 0)
+	{
+		stackSize--;
+		if (stackDistances[stackSize] >= tMax)
+		{
+			continue;
+		}
+		unsigned int child = stackChildren[stackSize];
+		unsigned int count = stackCounts[stackSize];
+		if (count > 0)
+		{
+			threadStats.primitiveTests += count;
+			if (intersectLeaf(child, count, tMax))
+			{
+				intersection = true;
+			}
+			continue;
+		}
+
+		const WideBVHNode<Width>& node = nodes[child];
+		threadStats.nodeVisits++;
+		float distances[Width];
+		unsigned int hitMask = boxKernel(&node.bounds[0][0], wideRay, tMin, tMax, distances);
+
+		// Push hit children farthest first so the nearest is popped next
+		int first = stackSize;
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			if (!(hitMask & (1u << slot)))
+			{
+				continue;
+			}
+			int position = stackSize++;
+			while (position > first && stackDistances[position - 1] < distances[slot])
+			{
+				stackChildren[position] = stackChildren[position - 1];
+				stackCounts[position] = stackCounts[position - 1];
+				stackDistances[position] = stackDistances[position - 1];
+				position--;
+			}
+			stackChildren[position] = node.children[slot];
+			stackCounts[position] = node.primitiveCounts[slot];
+			stackDistances[position] = distances[slot];
+		}
+	}
+	return intersection;
+}
+
+template <unsigned int Width>
+template <typename LeafOccluder>
+bool WideBVH<Width>::intersectAny(const Ray& ray, float tMin, float tMax, LeafOccluder occludesLeaf) const
+{
+	if (nodes.empty())
+	{
+		return false;
+	}
+	WideRay wideRay(ray);
+
+	// Interior children still to visit, each level adds at most Width - 1 entries
+	unsigned int stackNodes[BVH_MAX_DEPTH * Width];
+	int stackSize = 0;
+
+	RayStats& threadStats = rayStats;
+	unsigned int nodeIndex = 0;
+	while (true)
+	{
+		const WideBVHNode<Width>& node = nodes[nodeIndex];
+		threadStats.nodeVisits++;
+		float distances[Width];
+		unsigned int hitMask = boxKernel(&node.bounds[0][0], wideRay, tMin, tMax, distances);
+
+		for (unsigned int slot = 0; slot < Width; slot++)
+		{
+			if (!(hitMask & (1u << slot)))
+			{
+				continue;
+			}
+			unsigned int count = node.primitiveCounts[slot];
+			if (count == 0)
+			{
+				stackNodes[stackSize++] = node.children[slot];
+				continue;
+			}
+			threadStats.primitiveTests += count;
+			if (occludesLeaf(node.children[slot], count))
+			{
+				return true;
+			}
+		}
+
+		if (stackSize == 0)
+		{
+			return false;
+		}
+		nodeIndex = stackNodes[--stackSize];
+	}
+}
\ No newline at end of file
@@ -13,11 +13,18 @@
 //  Loads assets, then passes them to the render window. This is very far
 //  from the only way of doing it.
 //  
+//  Headless builds define RT_HEADLESS and take their main routine from
+//  HeadlessMain.cpp instead, so qmake's build of every file still links.
+//  
 ////////////////////////////////////////////////////////////////////////
 
+#ifndef RT_HEADLESS
+
 // system libraries
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
 
 // QT
 #include <QApplication>
@@ -28,18 +35,40 @@
 #include "RenderParameters.h"
 #include "RenderController.h"
 #include <RaytraceTexturedObject.h>
+#include "ScalingBenchmark.h"
+#include "DistributedRender.h"
+#include "Raytracer.h"
 
 // main routine
 int main(int argc, char **argv)
     { // main()
+    // render tiles for a coordinator elsewhere, which sends the scene, so no window or files are needed
+    if (argc >= 2 && argc <= 3 && std::string(argv[1]) == "worker")
+        { // render worker
+        std::string host;
+        unsigned short port = DISTRIBUTED_PORT_DEFAULT;
+        if (!parseWorkerAddress(argc == 3 ? argv[2] : "localhost", host, port))
+            return 1;
+        return runRenderWorker(host, port) ? 0 : 1;
+        } // render worker
+
+    // keep the BVH between runs only when asked, in the file given, as the headless build does
+    std::string bvhCachePath;
+    if (argc >= 5 && std::string(argv[argc - 2]) == "--bvh-cache")
+        { // cache given
+        bvhCachePath = argv[argc - 1];
+        argc -= 2;
+        } // cache given
+
     // initialize QT
     QApplication renderApp(argc, argv);
 
     // check the args to make sure there's an input file
-    if (argc != 3) 
+    if (argc != 3 && argc != 4) 
         { // bad arg count
         // print an error message
-        std::cout << "Usage: " << argv[0] << " geometry texture" << std::endl; 
+        std::cout << "Usage: " << argv[0] << " geometry texture [sah|sbvh|lbvh|lbvh-treelets|grid|grid2|scaling|distributed] [--bvh-cache FILE]" << std::endl; 
+        std::cout << "   or: " << argv[0] << " worker [host[:port]]" << std::endl; 
         // and leave
         return 0;
         } // bad arg count
@@ -47,6 +76,30 @@ int main(int argc, char **argv)
     //  use the argument to create a height field &c.
     RaytraceTexturedObject rtTexturedObject;
 
+    // pick the BVH builder, trading build time against trace speed, or a grid instead
+    if (argc == 4)
+        { // builder given
+        std::string builder(argv[3]);
+        if (builder == "grid")
+            rtTexturedObject.setAccelerator(ACCELERATOR_UNIFORM_GRID);
+        else if (builder == "grid2")
+            rtTexturedObject.setAccelerator(ACCELERATOR_TWO_LEVEL_GRID);
+        else if (builder == "lbvh")
+            rtTexturedObject.setBVHBuilder(BVH_BUILDER_LBVH);
+        else if (builder == "lbvh-treelets")
+            rtTexturedObject.setBVHBuilder(BVH_BUILDER_LBVH, true);
+        else if (builder == "sbvh")
+            rtTexturedObject.setBVHBuilder(BVH_BUILDER_SBVH);
+        else if (builder != "sah" && builder != "scaling" && builder != "distributed")
+            { // unknown builder
+            std::cout << "Unknown BVH builder " << builder << ", expected sah, sbvh, lbvh, lbvh-treelets, grid or grid2" << std::endl;
+            return 0;
+            } // unknown builder
+        } // builder given
+
+    // reuse the BVH from earlier runs while the geometry and settings are unchanged, if a cache was given
+    rtTexturedObject.setBVHCachePath(bvhCachePath);
+
     // open the input files for the geometry & texture
     std::ifstream geometryFile(argv[1]);
     std::ifstream textureFile(argv[2]);
@@ -64,6 +117,28 @@ int main(int argc, char **argv)
     // create some default render parameters
     RenderParameters renderParameters;
 
+    // time renders at increasing thread counts instead of opening the window
+    if (argc == 4 && std::string(argv[3]) == "scaling")
+        { // scaling benchmark
+        rtTexturedObject.waitForAccelerator();
+        runScalingBenchmark(&rtTexturedObject, &renderParameters);
+        return 0;
+        } // scaling benchmark
+
+    // render one frame across worker processes instead of opening the window
+    if (argc == 4 && std::string(argv[3]) == "distributed")
+        { // distributed render
+        RGBAImage image;
+        image.Resize(DISTRIBUTED_FRAME_WIDTH, DISTRIBUTED_FRAME_HEIGHT);
+        // start once one worker is ready, later ones join during the frame
+        if (renderDistributed(argv[1], argv[2], rtTexturedObject.getAcceleratorType(), DISTRIBUTED_PORT_DEFAULT, 1, image, renderParameters, RT_ORTHO))
+            { // frame finished
+            std::ofstream imageFile(std::string(argv[1]) + ".distributed.ppm");
+            image.WritePPM(imageFile);
+            } // frame finished
+        return 0;
+        } // distributed render
+
     // use the object & parameters to create a window
     RenderWindow renderWindow(&rtTexturedObject, &renderParameters, argv[1]);
 
@@ -79,3 +154,5 @@ int main(int argc, char **argv)
     // set QT running
     return renderApp.exec();
     } // main()
+
+#endif // RT_HEADLESS
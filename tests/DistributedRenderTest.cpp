@@ -0,0 +1,286 @@
+//////////////////////////////////////////////////////////////////////
+//
+//  -----------------------------
+//  DistributedRenderTest.cpp
+//  -----------------------------
+//
+//  Runs a render coordinator and workers in one process over loopback,
+//  checking the frame matches one rendered locally, including when a
+//  worker stalls partway through a message. Built with RT_HEADLESS and
+//  RT_TESTS defined; without RT_TESTS this file is empty, so builds of
+//  every source file are unaffected. Exits with 1 if any test failed.
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifdef RT_TESTS
+
+// system libraries
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+// platform sockets, for a worker that stops partway through a message
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET RawSocket;
+#define closeRawSocket closesocket
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int RawSocket;
+#define closeRawSocket close
+#endif
+
+// local includes
+#include "DistributedRender.h"
+#include "RaytraceTexturedObject.h"
+#include "Raytracer.h"
+#include "DirectionalLight.h"
+
+// Constants
+const long TEST_FRAME_WIDTH = 160;
+const long TEST_FRAME_HEIGHT = 120;
+// Long enough for a worker to connect and load the scene on a loaded machine
+const unsigned int TEST_ACCEPT_TIMEOUT_MS = 30000;
+// Short, so the stalled worker is dropped quickly
+const unsigned int TEST_STALL_TIMEOUT_MS = 500;
+
+// a sphere with a vertex, texture coordinate and normal per point, as OBJ text
+static std::string makeSphereGeometry(unsigned int slices, unsigned int stacks)
+    { // makeSphereGeometry()
+    const double pi = 3.14159265358979323846;
+    std::ostringstream geometry;
+    for (unsigned int stack = 0; stack <= stacks; stack++)
+        for (unsigned int slice = 0; slice <= slices; slice++)
+            { // point
+            double theta = pi * stack / stacks;
+            double phi = 2.0 * pi * slice / slices;
+            geometry << "v " << std::sin(theta) * std::cos(phi) << " " << std::cos(theta) << " " << std::sin(theta) * std::sin(phi) << "\n";
+            geometry << "vt " << (double)slice / slices << " " << (double)stack / stacks << " 0\n";
+            geometry << "vn " << std::sin(theta) * std::cos(phi) << " " << std::cos(theta) << " " << std::sin(theta) * std::sin(phi) << "\n";
+            } // point
+    for (unsigned int stack = 0; stack < stacks; stack++)
+        for (unsigned int slice = 0; slice < slices; slice++)
+            { // quad
+            unsigned int a = stack * (slices + 1) + slice + 1;
+            unsigned int b = a + 1;
+            unsigned int c = a + slices + 2;
+            unsigned int d = a + slices + 1;
+            geometry << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " " << c << "/" << c << "/" << c << "\n";
+            geometry << "f " << a << "/" << a << "/" << a << " " << c << "/" << c << "/" << c << " " << d << "/" << d << "/" << d << "\n";
+            } // quad
+    return geometry.str();
+    } // makeSphereGeometry()
+
+// a checkerboard, as P3 PPM text
+static std::string makeCheckerTexture(unsigned int size)
+    { // makeCheckerTexture()
+    std::ostringstream texture;
+    texture << "P3\n" << size << " " << size << "\n255\n";
+    for (unsigned int row = 0; row < size; row++)
+        for (unsigned int col = 0; col < size; col++)
+            texture << (((row / 8 + col / 8) % 2) ? "255 40 40\n" : "40 200 90\n");
+    return texture.str();
+    } // makeCheckerTexture()
+
+// the frame as a worker would render it, all in this process
+static bool renderLocally(const std::string& geometry, const std::string& texture, const RenderParameters& renderParameters, RGBAImage& imageOut)
+    { // renderLocally()
+    RaytraceTexturedObject object;
+    object.setBackgroundBuild(false);
+    std::istringstream geometryStream(geometry);
+    std::istringstream textureStream(texture);
+    if (!object.ReadObjectStream(geometryStream, textureStream))
+        return false;
+    Cartesian3 lightColor(renderParameters.lightColor[0], renderParameters.lightColor[1], renderParameters.lightColor[2]);
+    DirectionalLight light(renderParameters.lightMatrix, lightColor);
+    std::vector<Light*> lights(1, &light);
+    RenderParameters parameters = renderParameters;
+    imageOut.Resize(TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT);
+    Raytracer raytracer(&imageOut, &object, &lights, &parameters);
+    raytracer.setQuiet(true);
+    return raytracer.raytrace();
+    } // renderLocally()
+
+static bool imagesMatch(const RGBAImage& first, const RGBAImage& second)
+    { // imagesMatch()
+    if (first.width != second.width || first.height != second.height)
+        return false;
+    for (int row = 0; row < first.height; row++)
+        for (int col = 0; col < first.width; col++)
+            { // pixel
+            const RGBAValue& a = first.block[row * first.width + col];
+            const RGBAValue& b = second.block[row * second.width + col];
+            if (a.red != b.red || a.green != b.green || a.blue != b.blue || a.alpha != b.alpha)
+                return false;
+            } // pixel
+    return true;
+    } // imagesMatch()
+
+// a message as the coordinator sends it: type and payload length as big endian words, then the payload
+static std::vector<unsigned char> frameMessage(uint32_t type, const std::vector<unsigned char>& payload)
+    { // frameMessage()
+    std::vector<unsigned char> bytes;
+    uint32_t words[2] = { type, (uint32_t)payload.size() };
+    for (auto word : words)
+        for (int shift = 24; shift >= 0; shift -= 8)
+            bytes.push_back((unsigned char)(word >> shift));
+    bytes.insert(bytes.end(), payload.begin(), payload.end());
+    return bytes;
+    } // frameMessage()
+
+static bool receiveRaw(RawSocket socket, unsigned char* bytes, size_t size)
+    { // receiveRaw()
+    while (size > 0)
+        { // more to come
+        int received = (int)recv(socket, (char*)bytes, (int)size, 0);
+        if (received <= 0)
+            return false;
+        bytes += received;
+        size -= (size_t)received;
+        } // more to come
+    return true;
+    } // receiveRaw()
+
+// the next whole message's type, skipping its payload
+static bool receiveRawType(RawSocket socket, uint32_t& typeOut)
+    { // receiveRawType()
+    unsigned char header[8];
+    if (!receiveRaw(socket, header, sizeof(header)))
+        return false;
+    typeOut = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+    uint32_t size = ((uint32_t)header[4] << 24) | ((uint32_t)header[5] << 16) | ((uint32_t)header[6] << 8) | header[7];
+    std::vector<unsigned char> payload(size);
+    return size == 0 || receiveRaw(socket, payload.data(), size);
+    } // receiveRawType()
+
+// a worker that loads nothing, says it's ready, then sends half a result header for its first tile and goes quiet
+// until released, holding the connection open so only the stall timeout can drop it
+static void runStallingWorker(unsigned short port, const std::atomic<bool>& release, std::atomic<bool>& stalledOut)
+    { // runStallingWorker()
+    RawSocket socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (::connect(socket, (const sockaddr*)&address, sizeof(address)) == 0)
+        { // connected
+        uint32_t type = 0;
+        if (receiveRawType(socket, type) && type == DISTRIBUTED_MESSAGE_SCENE)
+            { // scene sent
+            std::vector<unsigned char> ready = frameMessage(DISTRIBUTED_MESSAGE_READY, std::vector<unsigned char>(4, 0));
+            ready.back() = 1;
+            send(socket, (const char*)ready.data(), (int)ready.size(), 0);
+            while (receiveRawType(socket, type) && type != DISTRIBUTED_MESSAGE_TILE)
+                continue;
+            if (type == DISTRIBUTED_MESSAGE_TILE)
+                { // first tile
+                std::vector<unsigned char> result = frameMessage(DISTRIBUTED_MESSAGE_RESULT, std::vector<unsigned char>(64, 0));
+                send(socket, (const char*)result.data(), 4, 0);
+                stalledOut = true;
+                } // first tile
+            } // scene sent
+        } // connected
+    while (!release)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    closeRawSocket(socket);
+    } // runStallingWorker()
+
+// report a test's outcome, counting failures
+static void check(bool passed, const char *name, int &failures)
+    { // check()
+    std::cout << (passed ? "PASS " : "FAIL ") << name << std::endl;
+    if (!passed)
+        failures++;
+    } // check()
+
+// main routine
+int main()
+    { // main()
+    int failures = 0;
+    std::string geometry = makeSphereGeometry(24, 16);
+    std::string texture = makeCheckerTexture(64);
+    RenderParameters renderParameters;
+    renderParameters.useLighting = true;
+    renderParameters.texturedRendering = true;
+
+    RGBAImage expected;
+    check(renderLocally(geometry, texture, renderParameters, expected), "local render", failures);
+
+        { // two workers share the frame
+        std::unique_ptr<RenderCoordinator> coordinator(new RenderCoordinator(geometry, texture, ACCELERATOR_BVH));
+        bool listening = coordinator->listen(0);
+        unsigned short port = coordinator->getPort();
+        std::vector<std::thread> workerThreads;
+        for (int worker = 0; worker < 2; worker++)
+            workerThreads.push_back(std::thread([port]() { runRenderWorker("127.0.0.1", port); }));
+        bool rendered = listening && coordinator->acceptWorkers(2, TEST_ACCEPT_TIMEOUT_MS) == 2;
+        RGBAImage image;
+        image.Resize(TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT);
+        rendered = rendered && coordinator->render(image, renderParameters, RT_ORTHO);
+        check(rendered && imagesMatch(image, expected), "two loopback workers match a local render", failures);
+        unsigned long long pixels = 0;
+        for (auto& stats : coordinator->getWorkerStats())
+            pixels += stats.pixels;
+        check(pixels == (unsigned long long)(TEST_FRAME_WIDTH * TEST_FRAME_HEIGHT), "workers' pixels cover the frame once", failures);
+        // a second frame reuses the loaded workers
+        RGBAImage second;
+        second.Resize(TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT);
+        check(coordinator->render(second, renderParameters, RT_ORTHO) && imagesMatch(second, expected), "second frame on the same workers", failures);
+        // the coordinator tells the workers to stop as it goes
+        coordinator.reset();
+        for (auto& thread : workerThreads)
+            thread.join();
+        } // two workers share the frame
+
+        { // a worker stalls partway through a result
+        std::atomic<bool> release(false);
+        std::atomic<bool> stalled(false);
+        std::unique_ptr<RenderCoordinator> coordinator(new RenderCoordinator(geometry, texture, ACCELERATOR_BVH));
+        coordinator->setStallTimeout(TEST_STALL_TIMEOUT_MS);
+        bool listening = coordinator->listen(0);
+        unsigned short port = coordinator->getPort();
+        // the stalling worker is ready first, so it's given tiles first
+        std::thread stallingThread([port, &release, &stalled]() { runStallingWorker(port, release, stalled); });
+        bool accepted = listening && coordinator->acceptWorkers(1, TEST_ACCEPT_TIMEOUT_MS) == 1;
+        std::thread workerThread([port]() { runRenderWorker("127.0.0.1", port); });
+        accepted = accepted && coordinator->acceptWorkers(2, TEST_ACCEPT_TIMEOUT_MS) == 2;
+        RGBAImage image;
+        image.Resize(TEST_FRAME_WIDTH, TEST_FRAME_HEIGHT);
+        auto startTime = std::chrono::steady_clock::now();
+        bool rendered = accepted && coordinator->render(image, renderParameters, RT_ORTHO);
+        double renderMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        check(rendered && imagesMatch(image, expected), "frame finishes despite a stalled worker", failures);
+        bool dropped = false;
+        for (auto& stats : coordinator->getWorkerStats())
+            if (!stats.alive && stats.tilesLost > 0)
+                dropped = true;
+        check(stalled && dropped, "stalled worker dropped and its tiles reassigned", failures);
+        // well before the silent worker timeout, which would also have dropped it
+        check(renderMs < DISTRIBUTED_WORKER_TIMEOUT_MS / 2, "stall detected by its own timeout", failures);
+        release = true;
+        stallingThread.join();
+        // the coordinator tells the remaining worker to stop as it goes
+        coordinator.reset();
+        workerThread.join();
+        } // a worker stalls partway through a result
+
+    std::cout << (failures == 0 ? "All distributed render tests passed" : "Distributed render tests failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+    } // main()
+
+#endif // RT_TESTS